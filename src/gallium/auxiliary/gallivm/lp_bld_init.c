@@ -79,7 +79,8 @@ create_pass_manager(struct gallivm_state *gallivm)
       free(td_str);
    }
 
-   return lp_passmgr_create(gallivm->module, &gallivm->passmgr);
+   return lp_passmgr_create(gallivm->module, gallivm->no_opt,
+                            &gallivm->passmgr);
 }
 
 /**
@@ -147,7 +148,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if (gallivm->no_opt) {
          optlevel = None;
       }
       else {
@@ -202,7 +203,8 @@ fail:
  */
 static bool
 init_gallivm_state(struct gallivm_state *gallivm, const char *name,
-                   lp_context_ref *context, struct lp_cached_code *cache)
+                   lp_context_ref *context, struct lp_cached_code *cache,
+                   bool no_opt)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -212,6 +214,7 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
 
    gallivm->context = context->ref;
    gallivm->cache = cache;
+   gallivm->no_opt = no_opt || (gallivm_perf & GALLIVM_PERF_NO_OPT);
    if (!gallivm->context)
       goto fail;
 
@@ -331,7 +334,31 @@ gallivm_create(const char *name, lp_context_ref *context,
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm, name, context, cache)) {
+      if (!init_gallivm_state(gallivm, name, context, cache, false)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   assert(gallivm != NULL);
+   return gallivm;
+}
+
+
+/**
+ * Create a new gallivm_state object whose module is compiled without
+ * optimization, as if GALLIVM_PERF=nopt was set for this module only.
+ * Useful for code that is needed right away and replaced later.
+ */
+struct gallivm_state *
+gallivm_create_noopt(const char *name, lp_context_ref *context,
+                     struct lp_cached_code *cache)
+{
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      if (!init_gallivm_state(gallivm, name, context, cache, true)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -392,10 +419,10 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       LLVMWriteBitcodeToFile(gallivm->module, filename);
       debug_printf("%s written\n", filename);
       debug_printf("Invoke as \"opt %s %s | llc -O%d %s%s\"\n",
-                   gallivm_perf & GALLIVM_PERF_NO_OPT ? "-mem2reg" :
+                   gallivm->no_opt ? "-mem2reg" :
                    "-sroa -early-cse -simplifycfg -reassociate "
                    "-mem2reg -constprop -instcombine -gvn",
-                   filename, gallivm_perf & GALLIVM_PERF_NO_OPT ? 0 : 2,
+                   filename, gallivm->no_opt ? 0 : 2,
                    "[-mcpu=<-mcpu option>] ",
                    "[-mattr=<-mattr option(s)>]");
    }
@@ -403,7 +430,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    lp_passmgr_run(gallivm->passmgr,
                   gallivm->module,
                   LLVMGetExecutionEngineTargetMachine(gallivm->engine),
-                  gallivm->module_name);
+                  gallivm->module_name, gallivm->no_opt);
 
    /* Setting the module's DataLayout to an empty string will cause the
     * ExecutionEngine to copy to the DataLayout string from its target machine
@@ -62,6 +62,8 @@ struct gallivm_state
    struct lp_passmgr *passmgr;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   /* skip the IR optimization passes and use the fastest codegen level */
+   bool no_opt;
 #endif
    LLVMContextRef context;
    LLVMBuilderRef builder;
@@ -91,6 +93,12 @@ struct gallivm_state *
 gallivm_create(const char *name, lp_context_ref *context,
                struct lp_cached_code *cache);
 
+#if !GALLIVM_USE_ORCJIT
+struct gallivm_state *
+gallivm_create_noopt(const char *name, lp_context_ref *context,
+                     struct lp_cached_code *cache);
+#endif
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
@@ -307,11 +307,13 @@ void lpjit_exit()
 LLVMErrorRef module_transform(void *Ctx, LLVMModuleRef mod) {
    struct lp_passmgr *mgr;
 
-   lp_passmgr_create(mod, &mgr);
+   const bool no_opt = gallivm_perf & GALLIVM_PERF_NO_OPT;
+
+   lp_passmgr_create(mod, no_opt, &mgr);
 
    lp_passmgr_run(mgr, mod,
                   LPJit::get_instance()->tm,
-                  get_module_name(mod));
+                  get_module_name(mod), no_opt);
 
    lp_passmgr_dispose(mgr);
    return LLVMErrorSuccess;
@@ -68,7 +68,8 @@ struct lp_passmgr;
 #endif
 
 bool
-lp_passmgr_create(LLVMModuleRef module, struct lp_passmgr **mgr_p)
+lp_passmgr_create(LLVMModuleRef module, bool no_opt,
+                  struct lp_passmgr **mgr_p)
 {
    struct lp_passmgr *mgr = NULL;
 #if USE_NEW_PASS == 0
@@ -101,7 +102,7 @@ lp_passmgr_create(LLVMModuleRef module, struct lp_passmgr **mgr_p)
    LLVMAddCoroElidePass(mgr->cgpassmgr);
 #endif
 
-   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0) {
+   if (!no_opt) {
       /*
        * TODO: Evaluate passes some more - keeping in mind
        * both quality of generated code and compile times.
@@ -150,7 +151,8 @@ void
 lp_passmgr_run(struct lp_passmgr *mgr,
                LLVMModuleRef module,
                LLVMTargetMachineRef tm,
-               const char *module_name)
+               const char *module_name,
+               bool no_opt)
 {
    int64_t time_begin;
 
@@ -170,7 +172,7 @@ lp_passmgr_run(struct lp_passmgr *mgr,
    LLVMPassBuilderOptionsRef opts = LLVMCreatePassBuilderOptions();
    LLVMRunPasses(module, passes, tm, opts);
 
-   if (!(gallivm_perf & GALLIVM_PERF_NO_OPT))
+   if (!no_opt)
 #if LLVM_VERSION_MAJOR >= 18
       strcpy(passes, "sroa,early-cse,simplifycfg,reassociate,mem2reg,instsimplify,instcombine<no-verify-fixpoint>");
 #else
@@ -41,11 +41,17 @@ struct lp_passmgr;
  * mgr can be returned as NULL for modern pass mgr handling
  * so use a bool to denote success/fail.
  */
-bool lp_passmgr_create(LLVMModuleRef module, struct lp_passmgr **mgr);
+/*
+ * no_opt restricts the pipeline to the passes the backends need, which
+ * trades code quality for compile time.
+ */
+bool lp_passmgr_create(LLVMModuleRef module, bool no_opt,
+                       struct lp_passmgr **mgr);
 void lp_passmgr_run(struct lp_passmgr *mgr,
                     LLVMModuleRef module,
                     LLVMTargetMachineRef tm,
-                    const char *module_name);
+                    const char *module_name,
+                    bool no_opt);
 void lp_passmgr_dispose(struct lp_passmgr *mgr);
 
 #ifdef __cplusplus
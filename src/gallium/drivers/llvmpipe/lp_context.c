@@ -61,6 +61,8 @@ llvmpipe_destroy(struct pipe_context *pipe)
    mtx_unlock(&lp_screen->ctx_mutex);
    lp_print_counters();
 
+   llvmpipe_destroy_fs_compile_queue(llvmpipe);
+
    if (llvmpipe->csctx) {
       lp_csctx_destroy(llvmpipe->csctx);
    }
@@ -104,6 +106,7 @@ llvmpipe_destroy(struct pipe_context *pipe)
    }
 
    lp_delete_setup_variants(llvmpipe);
+   lp_variant_cache_fini(&llvmpipe->setup_variant_cache);
 
    llvmpipe_sampler_matrix_destroy(llvmpipe);
 
@@ -221,6 +224,11 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe->pipe.screen = screen;
    llvmpipe->pipe.priv = priv;
 
+   if (!lp_variant_cache_init(&llvmpipe->setup_variant_cache)) {
+      align_free(llvmpipe);
+      return NULL;
+   }
+
    /* Init the pipe context methods */
    llvmpipe->pipe.destroy = llvmpipe_destroy;
    llvmpipe->pipe.set_framebuffer_state = llvmpipe_set_framebuffer_state;
@@ -272,6 +280,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context.ref)
       goto fail;
 
+   llvmpipe_init_fs_compile_queue(llvmpipe);
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -35,6 +35,7 @@
 
 #include "draw/draw_vertex.h"
 #include "util/u_blitter.h"
+#include "util/u_queue.h"
 
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
@@ -164,17 +165,21 @@ struct llvmpipe_context {
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
+   struct lp_variant_cache_stats fs_variant_stats;
 
    bool permit_linear_rasterizer;
    bool single_vp;
 
    struct lp_setup_variant_list_item setup_variants_list;
+   struct hash_table setup_variant_cache;
    unsigned nr_setup_variants;
+   struct lp_variant_cache_stats setup_variant_stats;
 
    /** List of all compute shader variants */
    struct lp_cs_variant_list_item cs_variants_list;
    unsigned nr_cs_variants;
    unsigned nr_cs_instrs;
+   struct lp_variant_cache_stats cs_variant_stats;
    struct lp_cs_context *csctx;
 
    struct lp_cs_context *task_ctx;
@@ -192,6 +197,15 @@ struct llvmpipe_context {
    /** The LLVMContext to use for LLVM related work */
    lp_context_ref context;
 
+   /** Background compilation of optimized fragment shader variants.
+    * The queue has a single thread, which is the only user of
+    * fs_compile_context.
+    */
+   bool fs_async_compile;
+   struct util_queue fs_compile_queue;
+   lp_context_ref fs_compile_context;
+   struct list_head fs_compile_jobs;
+
    int max_global_buffers;
    struct pipe_resource **global_buffers;
 
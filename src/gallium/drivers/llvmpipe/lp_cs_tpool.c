@@ -31,6 +31,7 @@
 #include "util/u_thread.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
+#include "lp_screen.h"
 
 static int
 lp_cs_tpool_worker(void *data)
@@ -84,7 +85,7 @@ lp_cs_tpool_worker(void *data)
 }
 
 struct lp_cs_tpool *
-lp_cs_tpool_create(unsigned num_threads)
+lp_cs_tpool_create(unsigned num_threads, unsigned num_domains)
 {
    struct lp_cs_tpool *pool = CALLOC_STRUCT(lp_cs_tpool);
 
@@ -103,6 +104,10 @@ lp_cs_tpool_create(unsigned num_threads)
       }
    }
    pool->num_threads = num_threads;
+
+   num_domains = MIN2(num_domains, num_threads);
+   for (unsigned i = 0; i < num_threads; i++)
+      lp_thread_bind_domain(pool->threads[i], i, num_threads, num_domains);
    return pool;
 }
 
@@ -70,7 +70,8 @@ struct lp_cs_tpool_task {
    unsigned iter_remainder;
 };
 
-struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
+struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads,
+                                       unsigned num_domains);
 void lp_cs_tpool_destroy(struct lp_cs_tpool *);
 
 struct lp_cs_tpool_task *lp_cs_tpool_queue_task(struct lp_cs_tpool *,
@@ -73,6 +73,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
       return;
    }
 
+   llvmpipe_poll_fs_compiles(lp);
+
    if (lp->dirty)
       llvmpipe_update_derived(lp);
 
@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "util/compiler.h"
+#include "util/u_atomic.h"
 
 /**
  * Various counters
@@ -74,10 +75,12 @@ struct lp_counters
 extern struct lp_counters lp_count;
 
 
-/** Increment the named counter (only for debug builds) */
+/** Increment the named counter (only for debug builds).  Rasterizer and
+ * binning threads update the counters concurrently.
+ */
 #if MESA_DEBUG && !THREAD_SANITIZER
-#define LP_COUNT(counter) lp_count.counter++
-#define LP_COUNT_ADD(counter, incr)  lp_count.counter += (incr)
+#define LP_COUNT(counter) p_atomic_inc(&lp_count.counter)
+#define LP_COUNT_ADD(counter, incr)  p_atomic_add(&lp_count.counter, (incr))
 #define LP_COUNT_GET(counter) (lp_count.counter)
 #else
 #define LP_COUNT(counter) do {} while (0)
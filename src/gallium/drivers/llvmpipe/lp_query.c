@@ -43,6 +43,50 @@
 #include "lp_rast.h"
 
 
+enum lp_query_group {
+   LP_QUERY_GROUP_VARIANTS,
+   LP_QUERY_GROUP_RAST,
+   LP_QUERY_GROUP_COUNT,
+};
+
+static const char *const lp_driver_query_groups[] = {
+   [LP_QUERY_GROUP_VARIANTS] = "Shader variant cache",
+   [LP_QUERY_GROUP_RAST] = "Rasterizer",
+};
+
+#define LP_DRIVER_QUERY(_name, _query_type, _type, _group)  \
+   { .name = _name, .query_type = _query_type, .type = _type, .group_id = _group }
+
+static const struct pipe_driver_query_info lp_driver_queries[] = {
+   LP_DRIVER_QUERY("fs-variant-hits", LP_QUERY_FS_VARIANT_HITS,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("fs-variant-misses", LP_QUERY_FS_VARIANT_MISSES,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("fs-variant-evictions", LP_QUERY_FS_VARIANT_EVICTIONS,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("cs-variant-hits", LP_QUERY_CS_VARIANT_HITS,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("cs-variant-misses", LP_QUERY_CS_VARIANT_MISSES,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("cs-variant-evictions", LP_QUERY_CS_VARIANT_EVICTIONS,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("setup-variant-hits", LP_QUERY_SETUP_VARIANT_HITS,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("setup-variant-misses", LP_QUERY_SETUP_VARIANT_MISSES,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("setup-variant-evictions", LP_QUERY_SETUP_VARIANT_EVICTIONS,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_VARIANTS),
+   LP_DRIVER_QUERY("rast-busy-time", LP_QUERY_RAST_BUSY_TIME,
+                   PIPE_DRIVER_QUERY_TYPE_MICROSECONDS, LP_QUERY_GROUP_RAST),
+   LP_DRIVER_QUERY("rast-idle-time", LP_QUERY_RAST_IDLE_TIME,
+                   PIPE_DRIVER_QUERY_TYPE_MICROSECONDS, LP_QUERY_GROUP_RAST),
+   LP_DRIVER_QUERY("rast-stolen-bins", LP_QUERY_RAST_STOLEN_BINS,
+                   PIPE_DRIVER_QUERY_TYPE_UINT64, LP_QUERY_GROUP_RAST),
+};
+
+#undef LP_DRIVER_QUERY
+
+
 static struct llvmpipe_query *
 llvmpipe_query(struct pipe_query *p)
 {
@@ -50,12 +94,57 @@ llvmpipe_query(struct pipe_query *p)
 }
 
 
+/**
+ * Current value of the counter behind a driver specific query.
+ */
+static uint64_t
+llvmpipe_driver_query_value(const struct llvmpipe_context *lp, unsigned type)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_rast_stats rast_stats;
+
+   switch (type) {
+   case LP_QUERY_FS_VARIANT_HITS:
+      return lp->fs_variant_stats.hits;
+   case LP_QUERY_FS_VARIANT_MISSES:
+      return lp->fs_variant_stats.misses;
+   case LP_QUERY_FS_VARIANT_EVICTIONS:
+      return lp->fs_variant_stats.evictions;
+   case LP_QUERY_CS_VARIANT_HITS:
+      return lp->cs_variant_stats.hits;
+   case LP_QUERY_CS_VARIANT_MISSES:
+      return lp->cs_variant_stats.misses;
+   case LP_QUERY_CS_VARIANT_EVICTIONS:
+      return lp->cs_variant_stats.evictions;
+   case LP_QUERY_SETUP_VARIANT_HITS:
+      return lp->setup_variant_stats.hits;
+   case LP_QUERY_SETUP_VARIANT_MISSES:
+      return lp->setup_variant_stats.misses;
+   case LP_QUERY_SETUP_VARIANT_EVICTIONS:
+      return lp->setup_variant_stats.evictions;
+   case LP_QUERY_RAST_BUSY_TIME:
+      lp_rast_get_stats(screen->rast, &rast_stats);
+      return rast_stats.busy_ns / 1000;
+   case LP_QUERY_RAST_IDLE_TIME:
+      lp_rast_get_stats(screen->rast, &rast_stats);
+      return rast_stats.idle_ns / 1000;
+   case LP_QUERY_RAST_STOLEN_BINS:
+      lp_rast_get_stats(screen->rast, &rast_stats);
+      return rast_stats.stolen_bins;
+   default:
+      unreachable("unknown driver query");
+   }
+}
+
+
 static struct pipe_query *
 llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          (type >= PIPE_QUERY_DRIVER_SPECIFIC &&
+           type < PIPE_QUERY_DRIVER_SPECIFIC + ARRAY_SIZE(lp_driver_queries)));
 
    struct llvmpipe_query *pq = CALLOC_STRUCT(llvmpipe_query);
    if (pq) {
@@ -99,6 +188,11 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    const unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      result->u64 = pq->end[0] - pq->start[0];
+      return true;
+   }
+
    if (pq->fence) {
       /* only have a fence if there was a scene */
       if (!lp_fence_signalled(pq->fence)) {
@@ -395,6 +489,13 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   /* Driver queries sample CPU-side counters, no need to bin them. */
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      pq->start[0] = llvmpipe_driver_query_value(llvmpipe, pq->type);
+      pq->end[0] = pq->start[0];
+      return true;
+   }
+
    /* Check if the query is already in the scene.  If so, we need to
     * flush the scene now.  Real apps shouldn't re-use a query in a
     * frame of rendering.
@@ -457,6 +558,11 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      pq->end[0] = llvmpipe_driver_query_value(llvmpipe, pq->type);
+      return true;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -535,6 +641,49 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
 }
 
 
+int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   if (!info)
+      return ARRAY_SIZE(lp_driver_queries);
+
+   if (index >= ARRAY_SIZE(lp_driver_queries))
+      return 0;
+
+   *info = lp_driver_queries[index];
+   return 1;
+}
+
+
+/**
+ * The driver queries are software counters, so all the queries of a group
+ * can be active at once.  The groups are what exposes them through
+ * AMD_performance_monitor.
+ */
+int
+llvmpipe_get_driver_query_group_info(struct pipe_screen *screen,
+                                     unsigned index,
+                                     struct pipe_driver_query_group_info *info)
+{
+   if (!info)
+      return LP_QUERY_GROUP_COUNT;
+
+   if (index >= LP_QUERY_GROUP_COUNT)
+      return 0;
+
+   info->name = lp_driver_query_groups[index];
+   info->num_queries = 0;
+   for (unsigned i = 0; i < ARRAY_SIZE(lp_driver_queries); i++) {
+      if (lp_driver_queries[i].group_id == index)
+         info->num_queries++;
+   }
+   info->max_active_queries = info->num_queries;
+   return 1;
+}
+
+
 bool
 llvmpipe_check_render_cond(struct llvmpipe_context *lp)
 {
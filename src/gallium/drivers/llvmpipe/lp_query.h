@@ -39,6 +39,25 @@
 
 
 struct llvmpipe_context;
+struct pipe_driver_query_group_info;
+struct pipe_driver_query_info;
+struct pipe_screen;
+
+/* Shader variant cache statistics, see lp_variant_cache.h */
+#define LP_QUERY_FS_VARIANT_HITS         (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_FS_VARIANT_MISSES       (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+#define LP_QUERY_FS_VARIANT_EVICTIONS    (PIPE_QUERY_DRIVER_SPECIFIC + 2)
+#define LP_QUERY_CS_VARIANT_HITS         (PIPE_QUERY_DRIVER_SPECIFIC + 3)
+#define LP_QUERY_CS_VARIANT_MISSES       (PIPE_QUERY_DRIVER_SPECIFIC + 4)
+#define LP_QUERY_CS_VARIANT_EVICTIONS    (PIPE_QUERY_DRIVER_SPECIFIC + 5)
+#define LP_QUERY_SETUP_VARIANT_HITS      (PIPE_QUERY_DRIVER_SPECIFIC + 6)
+#define LP_QUERY_SETUP_VARIANT_MISSES    (PIPE_QUERY_DRIVER_SPECIFIC + 7)
+#define LP_QUERY_SETUP_VARIANT_EVICTIONS (PIPE_QUERY_DRIVER_SPECIFIC + 8)
+
+/* Rasterizer thread statistics summed over all threads, see lp_rast.h */
+#define LP_QUERY_RAST_BUSY_TIME          (PIPE_QUERY_DRIVER_SPECIFIC + 9)
+#define LP_QUERY_RAST_IDLE_TIME          (PIPE_QUERY_DRIVER_SPECIFIC + 10)
+#define LP_QUERY_RAST_STOLEN_BINS        (PIPE_QUERY_DRIVER_SPECIFIC + 11)
 
 
 struct llvmpipe_query {
@@ -58,4 +77,12 @@ extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
 extern bool llvmpipe_check_render_cond(struct llvmpipe_context *);
 
+extern int llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                                          unsigned index,
+                                          struct pipe_driver_query_info *info);
+
+extern int llvmpipe_get_driver_query_group_info(struct pipe_screen *screen,
+                                                unsigned index,
+                                                struct pipe_driver_query_group_info *info);
+
 #endif /* LP_QUERY_H */
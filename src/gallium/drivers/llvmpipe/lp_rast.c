@@ -25,7 +25,9 @@
  *
  **************************************************************************/
 
+#include <inttypes.h>
 #include <limits.h>
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -78,7 +80,8 @@ lp_rast_begin(struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, MAX2(1, rast->num_threads),
+                           MAX2(1, rast->num_domains));
 }
 
 
@@ -1059,13 +1062,21 @@ rasterize_scene(struct lp_rasterizer_task *task,
    if (!task->rast->no_rast) {
       /* loop over scene bins, rasterize each */
       struct cmd_bin *bin;
+      unsigned bins = 0, stolen_bins = 0;
+      bool stolen;
       int i, j;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+      while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                           &i, &j, &stolen))) {
          if (!is_empty_bin(bin))
             rasterize_bin(task, bin, i, j);
+         bins++;
+         stolen_bins += stolen;
       }
+
+      p_atomic_add(&task->stats.bins, bins);
+      p_atomic_add(&task->stats.stolen_bins, stolen_bins);
    }
 
 #if LP_BUILD_FORMAT_CACHE_DEBUG
@@ -1114,7 +1125,10 @@ lp_rast_queue_scene(struct lp_rasterizer *rast,
 
       lp_rast_begin(rast, scene);
 
+      int64_t start = os_time_get_nano();
       rasterize_scene(&rast->tasks[0], scene);
+      p_atomic_add(&rast->tasks[0].stats.busy_ns,
+                   os_time_get_nano() - start);
 
       lp_rast_end(rast);
 
@@ -1199,11 +1213,16 @@ thread_function(void *init_data)
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
+      int64_t start = os_time_get_nano();
       rasterize_scene(task, rast->curr_scene);
+      int64_t end = os_time_get_nano();
 
       /* wait for all threads to finish with this scene */
       util_barrier_wait(&rast->barrier);
 
+      p_atomic_add(&task->stats.busy_ns, end - start);
+      p_atomic_add(&task->stats.idle_ns, os_time_get_nano() - end);
+
       /* XXX: shouldn't be necessary:
        */
       if (task->thread_index == 0) {
@@ -1244,6 +1263,12 @@ create_rast_threads(struct lp_rasterizer *rast)
          break;
       }
    }
+
+   rast->num_domains = MIN2(rast->num_domains, rast->num_threads);
+   for (unsigned i = 0; i < rast->num_threads; i++) {
+      lp_thread_bind_domain(rast->threads[i], i, rast->num_threads,
+                            rast->num_domains);
+   }
 }
 
 
@@ -1251,9 +1276,11 @@ create_rast_threads(struct lp_rasterizer *rast)
  * Create new lp_rasterizer.  If num_threads is zero, don't create any
  * new threads, do rendering synchronously.
  * \param num_threads  number of rasterizer threads to create
+ * \param num_domains  number of cache domains to pin the threads to,
+ *                     one or zero to leave them unpinned
  */
 struct lp_rasterizer *
-lp_rast_create(unsigned num_threads)
+lp_rast_create(unsigned num_threads, unsigned num_domains)
 {
    struct lp_rasterizer *rast = CALLOC_STRUCT(lp_rasterizer);
    if (!rast) {
@@ -1277,6 +1304,7 @@ lp_rast_create(unsigned num_threads)
    }
 
    rast->num_threads = num_threads;
+   rast->num_domains = num_domains;
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", false);
 
@@ -1350,6 +1378,16 @@ lp_rast_destroy(struct lp_rasterizer *rast)
       align_free(rast->tasks[i].thread_data.cache);
    }
 
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+         const struct lp_rast_stats *stats = &rast->tasks[i].stats;
+         debug_printf("llvmpipe: rast thread %2u: busy %10.3f ms, "
+                      "idle %10.3f ms, bins %9" PRIu64 ", stolen %9" PRIu64 "\n",
+                      i, stats->busy_ns / 1e6, stats->idle_ns / 1e6,
+                      stats->bins, stats->stolen_bins);
+      }
+   }
+
    lp_fence_reference(&rast->last_fence, NULL);
 
    /* for synchronizing rasterization threads */
@@ -1363,6 +1401,26 @@ lp_rast_destroy(struct lp_rasterizer *rast)
 }
 
 
+/**
+ * Get the statistics of the rasterizer threads, summed over all threads.
+ */
+void
+lp_rast_get_stats(struct lp_rasterizer *rast,
+                  struct lp_rast_stats *stats)
+{
+   memset(stats, 0, sizeof *stats);
+
+   for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+      const struct lp_rast_stats *task_stats = &rast->tasks[i].stats;
+
+      stats->busy_ns += p_atomic_read(&task_stats->busy_ns);
+      stats->idle_ns += p_atomic_read(&task_stats->idle_ns);
+      stats->bins += p_atomic_read(&task_stats->bins);
+      stats->stolen_bins += p_atomic_read(&task_stats->stolen_bins);
+   }
+}
+
+
 void
 lp_rast_fence(struct lp_rasterizer *rast,
               struct lp_fence **fence)
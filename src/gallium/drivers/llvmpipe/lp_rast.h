@@ -40,6 +40,7 @@
 #include "util/compiler.h"
 #include "util/u_pack_color.h"
 #include "util/u_rect.h"
+#include "util/u_thread.h"
 #include "lp_jit.h"
 
 
@@ -231,7 +232,7 @@ GET_PLANES(const struct lp_rast_triangle *tri)
 
 
 struct lp_rasterizer *
-lp_rast_create(unsigned num_threads);
+lp_rast_create(unsigned num_threads, unsigned num_domains);
 
 void
 lp_rast_destroy(struct lp_rasterizer *);
@@ -244,6 +245,19 @@ void
 lp_rast_finish(struct lp_rasterizer *rast);
 
 
+/** Rasterizer thread statistics, see lp_rast_get_stats() */
+struct lp_rast_stats {
+   uint64_t busy_ns;      /**< time spent rasterizing scenes */
+   uint64_t idle_ns;      /**< time spent waiting for the other threads */
+   uint64_t bins;         /**< bins rasterized */
+   uint64_t stolen_bins;  /**< bins taken from another thread's queue */
+};
+
+void
+lp_rast_get_stats(struct lp_rasterizer *rast,
+                  struct lp_rast_stats *stats);
+
+
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
    struct {
@@ -100,6 +100,8 @@ struct lp_rasterizer_task
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   struct lp_rast_stats stats;
+
    util_semaphore work_ready;
    util_semaphore work_done;
 #ifdef _WIN32
@@ -130,6 +132,9 @@ struct lp_rasterizer
    unsigned num_threads;
    thrd_t threads[LP_MAX_THREADS];
 
+   /** Cache domains the threads are pinned to, see lp_thread_bind_domain() */
+   unsigned num_domains;
+
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
 
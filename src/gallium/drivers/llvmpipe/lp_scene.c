@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include "util/u_atomic.h"
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -103,6 +104,8 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->bin_order);
+   free(scene->reset_bins);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -152,6 +155,9 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
       bin->tail->next = NULL;
       bin->tail->count = 0;
    }
+
+   if (scene->reset_bins)
+      BITSET_SET(scene->reset_bins, scene->tiles_x * y + x);
 }
 
 
@@ -547,60 +553,188 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static bool
-next_bin(struct lp_scene *scene)
+/**
+ * Estimated cost of rasterizing a bin: the number of commands in it.
+ */
+static unsigned
+bin_cost(const struct cmd_bin *bin)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return false;
-   }
-   return true;
+   unsigned count = 0;
+   for (const struct cmd_block *block = bin->head; block; block = block->next)
+      count += block->count;
+   return count;
 }
 
 
+/**
+ * Queues are split evenly over the domains, queue q belongs to domain
+ * q * num_domains / num_queues.  Must match lp_thread_bind_domain().
+ */
+static inline unsigned
+bin_domain_first_queue(unsigned domain, unsigned num_queues,
+                       unsigned num_domains)
+{
+   return DIV_ROUND_UP(domain * num_queues, num_domains);
+}
+
+
+/**
+ * Split the non-empty bins of the scene into one queue per rasterizer
+ * thread.
+ *
+ * The framebuffer is cut into one band of tile rows per domain, and the
+ * bins of a band only go to the queues of that domain's threads, so a
+ * region of the framebuffer is rendered on the same cache domain from
+ * frame to frame.  Within a band the bins are bucketed by the log2 of
+ * their cost and dealt out round robin, most expensive first, so the
+ * expensive bins start early and the queues end with cheap bins that are
+ * easy to steal.
+ */
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_queues,
+                        unsigned num_domains)
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned pos = 0;
+
+   assert(num_queues >= 1 && num_queues <= LP_MAX_THREADS);
+   assert(num_domains >= 1 && num_domains <= num_queues);
+
+   scene->num_bin_queues = num_queues;
+   scene->num_bin_domains = num_domains;
+
+   for (unsigned d = 0; d < num_domains; d++) {
+      const unsigned first_bin =
+         d * scene->tiles_y / num_domains * scene->tiles_x;
+      const unsigned end_bin =
+         (d + 1) * scene->tiles_y / num_domains * scene->tiles_x;
+      const unsigned first_queue =
+         bin_domain_first_queue(d, num_queues, num_domains);
+      const unsigned num_domain_queues =
+         bin_domain_first_queue(d + 1, num_queues, num_domains) - first_queue;
+      unsigned bucket_start[33] = { 0 };
+      unsigned num_active = 0;
+
+      for (unsigned i = first_bin; i < end_bin; i++) {
+         const struct cmd_bin *bin = &scene->tiles[i];
+         if (bin->head) {
+            bucket_start[32 - util_logbase2(bin_cost(bin) | 1)]++;
+            num_active++;
+         }
+      }
+
+      for (unsigned b = 0, sum = pos; b < ARRAY_SIZE(bucket_start); b++) {
+         unsigned count = bucket_start[b];
+         bucket_start[b] = sum;
+         sum += count;
+      }
+
+      for (unsigned i = first_bin; i < end_bin; i++) {
+         const struct cmd_bin *bin = &scene->tiles[i];
+         if (bin->head) {
+            unsigned b = 32 - util_logbase2(bin_cost(bin) | 1);
+            scene->bin_order[bucket_start[b]++] = i;
+         }
+      }
+
+      for (unsigned t = 0; t < num_domain_queues; t++) {
+         struct lp_bin_queue *queue = &scene->bin_queues[first_queue + t];
+         uint64_t len = num_active / num_domain_queues +
+                        (t < num_active % num_domain_queues);
+         queue->range = len << 32;
+         queue->first = pos + t;
+         queue->stride = num_domain_queues;
+      }
+
+      pos += num_active;
+   }
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Take a bin from the front (owner) or the back (thief) of a queue.
  */
-struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+static bool
+bin_queue_pop(struct lp_scene *scene, unsigned queue, bool front,
+              unsigned *idx)
 {
-   struct cmd_bin *bin = NULL;
+   struct lp_bin_queue *q = &scene->bin_queues[queue];
+   uint64_t old = p_atomic_read(&q->range), prev;
 
-   mtx_lock(&scene->mutex);
+   do {
+      const uint32_t head = old, tail = old >> 32;
+      uint64_t new_range;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+      if (head == tail)
+         return false;
+
+      if (front) {
+         new_range = old + 1;
+         *idx = head;
+      } else {
+         new_range = ((uint64_t)(tail - 1) << 32) | head;
+         *idx = tail - 1;
+      }
+
+      prev = old;
+      old = p_atomic_cmpxchg(&q->range, prev, new_range);
+   } while (old != prev);
+
+   *idx = scene->bin_order[q->first + *idx * q->stride];
+   return true;
+}
+
+
+/**
+ * Steal a bin from one of the queues in [first, end), starting after
+ * the given thread so that thieves spread over the victims.
+ */
+static bool
+bin_queue_steal(struct lp_scene *scene, unsigned thread,
+                unsigned first, unsigned end, unsigned *idx)
+{
+   const unsigned n = end - first;
+
+   for (unsigned i = 1; i <= n; i++) {
+      unsigned queue = first + (thread - first + i) % n;
+      if (queue != thread && bin_queue_pop(scene, queue, false, idx))
+         return true;
    }
+   return false;
+}
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+/**
+ * Return pointer to next bin to be rendered by the given thread.
+ * Threads first work through their own queue, then steal the cheapest
+ * remaining bins from the other threads of their domain, and only then
+ * from the other domains.
+ */
+struct cmd_bin *
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread,
+                       int *x, int *y, bool *stolen)
+{
+   const unsigned num_queues = scene->num_bin_queues;
+   const unsigned num_domains = scene->num_bin_domains;
+   unsigned idx;
+
+   *stolen = false;
+   if (!bin_queue_pop(scene, thread, true, &idx)) {
+      const unsigned domain = thread * num_domains / num_queues;
+      const unsigned first =
+         bin_domain_first_queue(domain, num_queues, num_domains);
+      const unsigned end =
+         bin_domain_first_queue(domain + 1, num_queues, num_domains);
+
+      if (!bin_queue_steal(scene, thread, first, end, &idx) &&
+          (num_domains == 1 ||
+           !bin_queue_steal(scene, thread, 0, num_queues, &idx)))
+         return NULL;
+      *stolen = true;
+   }
+
+   *x = idx % scene->tiles_x;
+   *y = idx / scene->tiles_x;
+   return &scene->tiles[idx];
 }
 
 
@@ -623,6 +757,16 @@ lp_scene_begin_binning(struct lp_scene *scene,
                                   sizeof(struct cmd_bin));
       if (!scene->tiles)
          return;
+      /* callers only check tiles, so fail through it */
+      unsigned *bin_order = reallocarray(scene->bin_order, num_required_tiles,
+                                         sizeof(unsigned));
+      if (!bin_order) {
+         free(scene->tiles);
+         scene->tiles = NULL;
+         scene->num_alloced_tiles = 0;
+         return;
+      }
+      scene->bin_order = bin_order;
       memset(scene->tiles, 0, sizeof(struct cmd_bin) * num_required_tiles);
       scene->num_alloced_tiles = num_required_tiles;
    }
@@ -676,3 +820,92 @@ lp_scene_end_binning(struct lp_scene *scene)
          lp_debug_bins(scene);
    }
 }
+
+
+/**
+ * Prepare a scene for binning a range of primitives on another thread.
+ * The job starts out with the bin state of \p scene, and only allocates
+ * heap data blocks so they can be handed over by lp_scene_append_job().
+ * Those blocks all end up in \p scene, so each of the \p num_jobs jobs
+ * only gets its share of what is left of the scene's size budget.
+ * On success the job is reset with lp_scene_end_rasterization() once it
+ * has been appended or discarded.
+ */
+bool
+lp_scene_begin_job(struct lp_scene *job, struct lp_scene *scene,
+                   unsigned num_jobs)
+{
+   const unsigned budget =
+      (LP_SCENE_MAX_SIZE - MIN2(scene->scene_size, LP_SCENE_MAX_SIZE)) /
+      num_jobs;
+
+   if (!job->reset_bins) {
+      job->reset_bins = calloc(BITSET_WORDS(TILES_X * TILES_Y),
+                               sizeof(BITSET_WORD));
+      if (!job->reset_bins)
+         return false;
+   }
+
+   lp_scene_begin_binning(job, &scene->fb);
+   if (!job->tiles) {
+      job->num_alloced_tiles = 0;
+      util_unreference_framebuffer_state(&job->fb);
+      return false;
+   }
+
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+   memset(job->reset_bins, 0, BITSET_WORDS(num_bins) * sizeof(BITSET_WORD));
+   for (unsigned i = 0; i < num_bins; i++)
+      job->tiles[i].last_state = scene->tiles[i].last_state;
+
+   job->had_queries = scene->had_queries;
+   job->permit_linear_rasterizer = scene->permit_linear_rasterizer;
+   job->scene_size = LP_SCENE_MAX_SIZE - budget;
+   job->data.first.used = DATA_BLOCK_SIZE;
+
+   return true;
+}
+
+
+/**
+ * Append the commands binned by a job to the end of each of the scene's
+ * bins.  Jobs must be appended in primitive order.
+ */
+void
+lp_scene_append_job(struct lp_scene *scene, struct lp_scene *job)
+{
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+
+   assert(lp_scene_get_num_bins(job) == num_bins);
+
+   for (unsigned i = 0; i < num_bins; i++) {
+      struct cmd_bin *bin = &scene->tiles[i];
+      const struct cmd_bin *job_bin = &job->tiles[i];
+
+      if (BITSET_TEST(job->reset_bins, i)) {
+         /* An opaque tile covered everything binned before it */
+         *bin = *job_bin;
+      } else if (job_bin->head) {
+         if (bin->tail)
+            bin->tail->next = job_bin->head;
+         else
+            bin->head = job_bin->head;
+         bin->tail = job_bin->tail;
+         bin->last_state = job_bin->last_state;
+      }
+   }
+
+   /* The commands point into the job's data blocks, which now live as long
+    * as the scene.
+    */
+   struct data_block *block, *next;
+   for (block = job->data.head; block != &job->data.first; block = next) {
+      next = block->next;
+      block->next = scene->data.head->next;
+      scene->data.head->next = block;
+      scene->scene_size += sizeof *block;
+   }
+
+   job->data.head = &job->data.first;
+   job->data.first.next = NULL;
+}
@@ -35,6 +35,7 @@
 #ifndef LP_SCENE_H
 #define LP_SCENE_H
 
+#include "util/bitset.h"
 #include "util/u_thread.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
@@ -195,12 +196,25 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
    mtx_t mutex;
 
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
    struct data_block_list data;
+
+   /** Non-empty bins in rasterization order and the per-thread queues
+    * over them, see lp_scene_bin_iter_begin()
+    */
+   unsigned *bin_order;
+   unsigned num_bin_queues;
+   unsigned num_bin_domains;
+   struct lp_bin_queue {
+      uint64_t range;            /**< head | tail << 32 */
+      unsigned first, stride;    /**< bin i is bin_order[first + i * stride] */
+   } bin_queues[LP_MAX_THREADS];
+
+   /** Bins reset while binning a job, see lp_scene_append_job() */
+   BITSET_WORD *reset_bins;
 };
 
 
@@ -396,10 +410,12 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_queues,
+                        unsigned num_domains);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread,
+                       int *x, int *y, bool *stolen);
 
 
 
@@ -413,6 +429,17 @@ void
 lp_scene_end_binning(struct lp_scene *scene);
 
 
+/* Bin a range of primitives into a separate scene on another thread, then
+ * append its bins to the scene being built.
+ */
+bool
+lp_scene_begin_job(struct lp_scene *job, struct lp_scene *scene,
+                   unsigned num_jobs);
+
+void
+lp_scene_append_job(struct lp_scene *scene, struct lp_scene *job);
+
+
 /* Begin/end rasterization of a scene
  */
 void
@@ -29,6 +29,7 @@
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_cpu_detect.h"
+#include "util/thread_sched.h"
 #include "util/format/u_format.h"
 #include "util/u_screen.h"
 #include "util/u_string.h"
@@ -55,6 +56,7 @@
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
 #include "lp_flush.h"
+#include "lp_query.h"
 
 #include "frontend/sw_winsys.h"
 
@@ -1100,13 +1102,14 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
    if (screen->late_init_done)
       goto out;
 
-   screen->rast = lp_rast_create(screen->num_threads);
+   screen->rast = lp_rast_create(screen->num_threads, screen->num_domains);
    if (!screen->rast) {
       ret = false;
       goto out;
    }
 
-   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
+   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads,
+                                          screen->num_domains);
    if (!screen->cs_tpool) {
       lp_rast_destroy(screen->rast);
       ret = false;
@@ -1128,6 +1131,27 @@ out:
 }
 
 
+/**
+ * Pin one of num_threads threads to its cache domain.  The threads are
+ * split evenly and contiguously over the domains, and the domains over
+ * the L3 caches of the machine.
+ */
+void
+lp_thread_bind_domain(thrd_t thread, unsigned index, unsigned num_threads,
+                      unsigned num_domains)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   if (num_domains <= 1 || !caps->L3_affinity_mask)
+      return;
+
+   unsigned domain = index * num_domains / num_threads;
+   unsigned L3 = domain * caps->num_L3_caches / num_domains;
+   util_set_thread_affinity(thread, caps->L3_affinity_mask[L3], NULL,
+                            caps->num_cpu_mask_bits);
+}
+
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -1168,6 +1192,9 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = u_default_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
+   screen->base.get_driver_query_group_info =
+      llvmpipe_get_driver_query_group_info;
 
    screen->base.query_memory_info = util_sw_query_memory_info;
 
@@ -1186,6 +1213,19 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
                                               screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
+   /* On machines with several L3 caches (chiplets, sockets), optionally
+    * pin the rasterizer and compute threads to them and keep framebuffer
+    * regions on the same cache from frame to frame.  This is opt-in as
+    * hard affinity hurts when the threads share the machine with other
+    * work.
+    */
+   screen->num_domains = 1;
+   if (util_thread_scheduler_enabled() &&
+       debug_get_bool_option("LP_PIN_THREADS", false)) {
+      screen->num_domains = MIN2(util_get_cpu_caps()->num_L3_caches,
+                                 MAX2(screen->num_threads, 1));
+   }
+
 #if defined(HAVE_LIBDRM) && defined(HAVE_LINUX_UDMABUF_H)
    screen->udmabuf_fd = open("/dev/udmabuf", O_RDWR);
    llvmpipe_init_screen_fence_funcs(&screen->base);
@@ -52,6 +52,7 @@ struct llvmpipe_screen
    struct sw_winsys *winsys;
 
    unsigned num_threads;
+   unsigned num_domains;  /**< L3 cache domains the threads are spread over */
 
    /* Increments whenever textures are modified.  Contexts can track this.
     */
@@ -105,6 +106,10 @@ lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
 bool
 llvmpipe_screen_late_init(struct llvmpipe_screen *screen);
 
+void
+lp_thread_bind_domain(thrd_t thread, unsigned index, unsigned num_threads,
+                      unsigned num_domains);
+
 
 static inline struct llvmpipe_screen *
 llvmpipe_screen(struct pipe_screen *pipe)
@@ -1314,6 +1314,13 @@ lp_setup_destroy(struct lp_setup_context *setup)
    }
 
    LP_DBG(DEBUG_SETUP, "number of scenes used: %d\n", setup->num_active_scenes);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(setup->bin.scenes); i++) {
+      if (setup->bin.scenes[i])
+         lp_scene_destroy(setup->bin.scenes[i]);
+   }
+   FREE(setup->bin.tris);
+
    slab_destroy(&setup->scene_slab);
 
    FREE(setup);
@@ -1347,6 +1354,8 @@ lp_setup_create(struct pipe_context *pipe,
    setup->pipe = pipe;
 
    setup->num_threads = screen->num_threads;
+   setup->bin.num_threads = MIN2(debug_get_num_option("LP_BIN_THREADS", 0),
+                                 screen->num_threads);
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
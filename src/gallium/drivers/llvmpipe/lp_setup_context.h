@@ -55,6 +55,12 @@
 struct lp_setup_variant;
 
 
+/** A triangle waiting to be binned by lp_setup_bin_deferred_triangles() */
+struct lp_setup_bin_tri {
+   const float (*v[3])[4];
+};
+
+
 /** Max number of scenes */
 #define INITIAL_SCENES 4
 #define MAX_SCENES 64
@@ -194,6 +200,18 @@ struct lp_setup_context
            const float (*v3)[4],
            const float (*v4)[4],
            const float (*v5)[4]);
+
+   /** Parallel triangle setup/binning (LP_BIN_THREADS) */
+   struct {
+      unsigned num_threads;
+      struct lp_scene *scenes[LP_MAX_THREADS];  /**< one per binning job */
+      struct lp_setup_bin_tri *tris;
+      unsigned num_tris, max_tris;
+      void (*triangle)(struct lp_setup_context *,
+                       const float (*v0)[4],
+                       const float (*v1)[4],
+                       const float (*v2)[4]);
+   } bin;
 };
 
 
@@ -244,6 +262,7 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup);
 
 bool
 lp_setup_whole_tile(struct lp_setup_context *setup,
+                    struct lp_scene *scene,
                     const struct lp_rast_shader_inputs *inputs,
                     int tx, int ty, bool opaque);
 
@@ -293,6 +312,7 @@ lp_setup_analyse_triangles(struct lp_setup_context *setup,
 
 bool
 lp_setup_bin_triangle(struct lp_setup_context *setup,
+                      struct lp_scene *scene,
                       struct lp_rast_triangle *tri,
                       bool use_32bits,
                       bool opaque,
@@ -300,6 +320,13 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       int nr_planes,
                       unsigned scissor_index);
 
+bool
+lp_setup_defer_triangles(struct lp_setup_context *setup,
+                         unsigned max_tris);
+
+void
+lp_setup_bin_deferred_triangles(struct lp_setup_context *setup);
+
 bool
 lp_setup_bin_rectangle(struct lp_setup_context *setup,
                        struct lp_rast_rectangle *rect,
@@ -82,11 +82,10 @@ lp_setup_alloc_rectangle(struct lp_scene *scene, unsigned nr_inputs)
  */
 bool
 lp_setup_whole_tile(struct lp_setup_context *setup,
+                    struct lp_scene *scene,
                     const struct lp_rast_shader_inputs *inputs,
                     int tx, int ty, bool opaque)
 {
-   struct lp_scene *scene = setup->scene;
-
    LP_COUNT(nr_fully_covered_64);
 
    /* if variant is opaque and scissor doesn't effect the tile */
@@ -205,7 +204,7 @@ partial(struct lp_setup_context *setup,
       assert(rect->box.x1 >= (ix+1) * TILE_SIZE - 1);
       assert(rect->box.y1 >= (iy+1) * TILE_SIZE - 1);
 
-      lp_setup_whole_tile(setup, &rect->inputs, ix, iy, opaque);
+      lp_setup_whole_tile(setup, setup->scene, &rect->inputs, ix, iy, opaque);
    } else {
       LP_COUNT(nr_partially_covered_64);
       lp_scene_bin_cmd_with_state(setup->scene,
@@ -433,7 +432,7 @@ lp_setup_bin_rectangle(struct lp_setup_context *setup,
        */
       for (unsigned j = iy0 + 1; j < iy1; j++) {
          for (unsigned i = ix0 + 1; i < ix1; i++) {
-            lp_setup_whole_tile(setup, &rect->inputs, i, j, opaque);
+            lp_setup_whole_tile(setup, scene, &rect->inputs, i, j, opaque);
          }
       }
    }
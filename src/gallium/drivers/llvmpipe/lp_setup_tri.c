@@ -54,6 +54,8 @@ altivec.h inclusion in -std=c++98..11 causes bool to be redefined
 #include "lp_state_fs.h"
 #include "lp_state_setup.h"
 #include "lp_context.h"
+#include "lp_cs_tpool.h"
+#include "lp_screen.h"
 
 #include <inttypes.h>
 
@@ -273,14 +275,13 @@ check_opaque(const struct lp_setup_context *setup,
  */
 static bool
 do_triangle_ccw(struct lp_setup_context *setup,
+                struct lp_scene *scene,
                 struct fixed_position *position,
                 const float (*v0)[4],
                 const float (*v1)[4],
                 const float (*v2)[4],
                 bool frontfacing)
 {
-   struct lp_scene *scene = setup->scene;
-
    const float (*pv)[4];
    if (setup->flatshade_first) {
       pv = v0;
@@ -744,7 +745,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
                                   s_planes, setup->multisample);
    }
 
-   return lp_setup_bin_triangle(setup, tri, use_32bits,
+   return lp_setup_bin_triangle(setup, scene, tri, use_32bits,
                                 check_opaque(setup, v0, v1, v2),
                                 &bbox, nr_planes, viewport_index);
 }
@@ -779,6 +780,7 @@ floor_pot(uint32_t n)
 
 bool
 lp_setup_bin_triangle(struct lp_setup_context *setup,
+                      struct lp_scene *scene,
                       struct lp_rast_triangle *tri,
                       bool use_32bits,
                       bool opaque,
@@ -786,7 +788,6 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       int nr_planes,
                       unsigned viewport_index)
 {
-   struct lp_scene *scene = setup->scene;
    unsigned cmd;
 
    /* What is the largest power-of-two boundary this triangle crosses:
@@ -970,7 +971,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                /* triangle covers the whole tile- shade whole tile */
                LP_COUNT(nr_fully_covered_64);
                in = true;
-               if (!lp_setup_whole_tile(setup, &tri->inputs, x, y, opaque))
+               if (!lp_setup_whole_tile(setup, scene, &tri->inputs, x, y,
+                                        opaque))
                   goto fail;
             }
 
@@ -1017,11 +1019,11 @@ retry_triangle_ccw(struct lp_setup_context *setup,
       return;
    }
 
-   if (!do_triangle_ccw(setup, position, v0, v1, v2, front)) {
+   if (!do_triangle_ccw(setup, setup->scene, position, v0, v1, v2, front)) {
       if (!lp_setup_flush_and_restart(setup))
          return;
 
-      if (!do_triangle_ccw(setup, position, v0, v1, v2, front))
+      if (!do_triangle_ccw(setup, setup->scene, position, v0, v1, v2, front))
          return;
    }
 }
@@ -1274,3 +1276,193 @@ lp_setup_choose_triangle(struct lp_setup_context *setup)
       break;
    }
 }
+
+
+/* Smallest number of triangles worth handing to a binning job.
+ */
+#define LP_BIN_JOB_MIN_TRIS 64
+
+
+struct lp_setup_bin_job {
+   struct lp_setup_context *setup;
+   struct lp_scene *scene;
+   unsigned start, end;
+   bool done;
+};
+
+
+/**
+ * Set up and bin a triangle into a binning job's scene.  Same as
+ * triangle_cw/ccw/both() with the culling done here, and without flushing
+ * the scene on failure: the caller bins the rest of the triangles directly
+ * instead.
+ */
+static bool
+triangle_job(struct lp_setup_context *setup,
+             struct lp_scene *scene,
+             const float (*v0)[4],
+             const float (*v1)[4],
+             const float (*v2)[4])
+{
+   alignas(16) struct fixed_position position;
+
+   int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
+   if (area_sign == 0)
+      return true;
+
+   const bool front = (area_sign > 0) == setup->ccw_is_frontface;
+   if (setup->cullmode & (front ? PIPE_FACE_FRONT : PIPE_FACE_BACK))
+      return true;
+
+   if (area_sign > 0)
+      return do_triangle_ccw(setup, scene, &position, v0, v1, v2, front);
+
+   if (setup->flatshade_first) {
+      rotate_fixed_position_12(&position);
+      return do_triangle_ccw(setup, scene, &position, v0, v2, v1, front);
+   } else {
+      rotate_fixed_position_01(&position);
+      return do_triangle_ccw(setup, scene, &position, v1, v0, v2, front);
+   }
+}
+
+
+static void
+bin_triangles_task(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct lp_setup_bin_job *job = (struct lp_setup_bin_job *)data + iter_idx;
+   struct lp_setup_context *setup = job->setup;
+
+   for (unsigned i = job->start; i < job->end; i++) {
+      const struct lp_setup_bin_tri *tri = &setup->bin.tris[i];
+      if (!triangle_job(setup, job->scene, tri->v[0], tri->v[1], tri->v[2]))
+         return;
+   }
+
+   job->done = true;
+}
+
+
+static void
+triangle_deferred(struct lp_setup_context *setup,
+                  const float (*v0)[4],
+                  const float (*v1)[4],
+                  const float (*v2)[4])
+{
+   struct lp_setup_bin_tri *tri = &setup->bin.tris[setup->bin.num_tris++];
+
+   assert(setup->bin.num_tris <= setup->bin.max_tris);
+
+   tri->v[0] = v0;
+   tri->v[1] = v1;
+   tri->v[2] = v2;
+}
+
+
+/**
+ * Start collecting the triangles of a draw, so they can be set up and
+ * binned on the thread pool by lp_setup_bin_deferred_triangles().
+ * \param max_tris  upper bound on the number of triangles in the draw
+ * \return false if the triangles should be binned directly instead
+ */
+bool
+lp_setup_defer_triangles(struct lp_setup_context *setup, unsigned max_tris)
+{
+   /* The rectangle paths bin directly and would break primitive order.
+    */
+   if (setup->bin.num_threads < 2 ||
+       max_tris < 2 * LP_BIN_JOB_MIN_TRIS ||
+       u_reduced_prim(setup->prim) != MESA_PRIM_TRIANGLES ||
+       setup->permit_linear_rasterizer ||
+       setup->rasterizer_discard ||
+       setup->cullmode == PIPE_FACE_FRONT_AND_BACK ||
+       lp_setup_zero_sample_mask(setup))
+      return false;
+
+   if (setup->bin.max_tris < max_tris) {
+      FREE(setup->bin.tris);
+      setup->bin.tris = MALLOC(max_tris * sizeof *setup->bin.tris);
+      if (!setup->bin.tris) {
+         setup->bin.max_tris = 0;
+         return false;
+      }
+      setup->bin.max_tris = max_tris;
+   }
+
+   setup->bin.num_tris = 0;
+   setup->bin.triangle = setup->triangle;
+   setup->triangle = triangle_deferred;
+   return true;
+}
+
+
+/**
+ * Set up and bin the triangles collected since lp_setup_defer_triangles().
+ *
+ * Each job bins a contiguous range of triangles into its own scene, and
+ * the jobs' bins are appended to the current scene in primitive order, so
+ * the result is the same as binning the triangles one after the other.
+ * Whatever the jobs couldn't bin (out of scene memory) is binned directly,
+ * flushing the scene as needed.
+ */
+void
+lp_setup_bin_deferred_triangles(struct lp_setup_context *setup)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+   struct llvmpipe_context *lp_context = llvmpipe_context(setup->pipe);
+   struct lp_setup_bin_job jobs[LP_MAX_THREADS];
+   const unsigned num_tris = setup->bin.num_tris;
+   unsigned num_jobs = MIN2(setup->bin.num_threads,
+                            num_tris / LP_BIN_JOB_MIN_TRIS);
+   unsigned binned = 0;
+
+   setup->triangle = setup->bin.triangle;
+
+   if (num_jobs < 2)
+      num_jobs = 0;
+
+   for (unsigned i = 0; i < num_jobs; i++) {
+      if (!setup->bin.scenes[i])
+         setup->bin.scenes[i] = lp_scene_create(setup);
+
+      if (!setup->bin.scenes[i] ||
+          !lp_scene_begin_job(setup->bin.scenes[i], setup->scene,
+                              num_jobs)) {
+         num_jobs = i;
+         break;
+      }
+
+      jobs[i].setup = setup;
+      jobs[i].scene = setup->bin.scenes[i];
+      jobs[i].start = num_tris * i / num_jobs;
+      jobs[i].end = num_tris * (i + 1) / num_jobs;
+      jobs[i].done = false;
+   }
+
+   if (num_jobs > 1) {
+      struct lp_cs_tpool_task *task;
+      mtx_lock(&screen->cs_mutex);
+      task = lp_cs_tpool_queue_task(screen->cs_tpool, bin_triangles_task,
+                                    jobs, num_jobs);
+      mtx_unlock(&screen->cs_mutex);
+
+      lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+   }
+
+   for (unsigned i = 0; i < num_jobs; i++) {
+      if (jobs[i].done && jobs[i].start == binned) {
+         lp_scene_append_job(setup->scene, jobs[i].scene);
+         binned = jobs[i].end;
+      }
+      lp_scene_end_rasterization(jobs[i].scene);
+   }
+
+   if (lp_context->active_statistics_queries) {
+      lp_context->pipeline_statistics.c_primitives += binned;
+   }
+
+   for (unsigned i = binned; i < num_tris; i++) {
+      const struct lp_setup_bin_tri *tri = &setup->bin.tris[i];
+      setup->triangle(setup, tri->v[0], tri->v[1], tri->v[2]);
+   }
+}
@@ -184,6 +184,7 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
 
    const bool uses_constant_interp =
       setup->setup.variant->key.uses_constant_interp;
+   const bool deferred = lp_setup_defer_triangles(setup, nr);
 
    switch (setup->prim) {
    case MESA_PRIM_POINTS:
@@ -370,6 +371,9 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
    default:
       assert(0);
    }
+
+   if (deferred)
+      lp_setup_bin_deferred_triangles(setup);
 }
 
 
@@ -392,6 +396,7 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
    const bool uses_constant_interp =
       setup->setup.variant->key.uses_constant_interp;
+   const bool deferred = lp_setup_defer_triangles(setup, nr);
 
    switch (setup->prim) {
    case MESA_PRIM_POINTS:
@@ -632,6 +637,9 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    default:
       assert(0);
    }
+
+   if (deferred)
+      lp_setup_bin_deferred_triangles(setup);
 }
 
 
@@ -125,6 +125,15 @@ llvmpipe_set_framebuffer_state(struct pipe_context *,
 void
 llvmpipe_update_fs(struct llvmpipe_context *lp);
 
+void
+llvmpipe_poll_fs_compiles(struct llvmpipe_context *lp);
+
+void
+llvmpipe_init_fs_compile_queue(struct llvmpipe_context *lp);
+
+void
+llvmpipe_destroy_fs_compile_queue(struct llvmpipe_context *lp);
+
 void 
 llvmpipe_update_setup(struct llvmpipe_context *lp);
 
@@ -928,6 +928,11 @@ llvmpipe_create_compute_state(struct pipe_context *pipe,
    if (!shader)
       return NULL;
 
+   if (!lp_variant_cache_init(&shader->variant_cache)) {
+      FREE(shader);
+      return NULL;
+   }
+
    shader->no = cs_no++;
 
    shader->base.type = PIPE_SHADER_IR_NIR;
@@ -1012,6 +1017,8 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
 
    /* remove from shader's list */
    list_del(&variant->list_item_local.list);
+   lp_variant_cache_remove(&variant->shader->variant_cache,
+                           &variant->cache_key);
    variant->shader->variants_cached--;
 
    /* remove from context's list */
@@ -1043,6 +1050,7 @@ llvmpipe_delete_compute_state(struct pipe_context *pipe,
    LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
       llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
    }
+   lp_variant_cache_fini(&shader->variant_cache);
    ralloc_free(shader->base.ir.nir);
    FREE(shader);
 }
@@ -1315,18 +1323,15 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
    char store[LP_CS_MAX_VARIANT_KEY_SIZE];
    struct lp_compute_shader_variant_key *key =
       make_variant_key(lp, shader, sh_type, store);
-   struct lp_compute_shader_variant *variant = NULL;
-   struct lp_cs_variant_list_item *li;
 
    /* Search the variants for one which matches the key */
-   LIST_FOR_EACH_ENTRY(li, &shader->variants.list, list) {
-      if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
-      }
-   }
+   struct lp_compute_shader_variant *variant =
+      lp_variant_cache_search(&shader->variant_cache, key,
+                              shader->variant_key_size);
 
    if (variant) {
+      lp->cs_variant_stats.hits++;
+
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
        */
@@ -1334,6 +1339,7 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
                    &lp->cs_variants_list.list);
    } else {
       /* variant not found, create it now */
+      lp->cs_variant_stats.misses++;
 
       if (LP_DEBUG & DEBUG_CS) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
@@ -1376,6 +1382,7 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
             assert(item);
             assert(item->base);
             llvmpipe_remove_cs_shader_variant(lp, item->base);
+            lp->cs_variant_stats.evictions++;
          }
       }
 
@@ -1393,6 +1400,9 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
       /* Put the new variant into the list */
       if (variant) {
          list_add(&variant->list_item_local.list, &shader->variants.list);
+         lp_variant_cache_insert(&shader->variant_cache, &variant->cache_key,
+                                 &variant->key, shader->variant_key_size,
+                                 variant);
          list_add(&variant->list_item_global.list, &lp->cs_variants_list.list);
          lp->nr_cs_variants++;
          lp->nr_cs_instrs += variant->nr_instrs;
@@ -1877,6 +1887,11 @@ llvmpipe_create_ts_state(struct pipe_context *pipe,
    if (!shader)
       return NULL;
 
+   if (!lp_variant_cache_init(&shader->variant_cache)) {
+      FREE(shader);
+      return NULL;
+   }
+
    llvmpipe_register_shader(pipe, templ);
 
    shader->no = task_no++;
@@ -1918,6 +1933,7 @@ llvmpipe_delete_ts_state(struct pipe_context *pipe, void *_task)
    LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
       llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
    }
+   lp_variant_cache_fini(&shader->variant_cache);
    ralloc_free(shader->base.ir.nir);
    FREE(shader);
 }
@@ -1948,6 +1964,11 @@ llvmpipe_create_ms_state(struct pipe_context *pipe,
    if (!shader)
       return NULL;
 
+   if (!lp_variant_cache_init(&shader->variant_cache)) {
+      FREE(shader);
+      return NULL;
+   }
+
    llvmpipe_register_shader(pipe, templ);
 
    shader->no = mesh_no++;
@@ -1959,6 +1980,7 @@ llvmpipe_create_ms_state(struct pipe_context *pipe,
 
    shader->draw_mesh_data = draw_create_mesh_shader(llvmpipe->draw, templ);
    if (shader->draw_mesh_data == NULL) {
+      lp_variant_cache_fini(&shader->variant_cache);
       FREE(shader);
       return NULL;
    }
@@ -2000,6 +2022,7 @@ llvmpipe_delete_ms_state(struct pipe_context *pipe, void *_mesh)
    }
 
    draw_delete_mesh_shader(llvmpipe->draw, shader->draw_mesh_data);
+   lp_variant_cache_fini(&shader->variant_cache);
    ralloc_free(shader->base.ir.nir);
 
    FREE(shader);
@@ -2085,6 +2108,7 @@ llvmpipe_draw_mesh_tasks(struct pipe_context *pipe,
       return;
 
    memset(&job_info, 0, sizeof(job_info));
+   llvmpipe_poll_fs_compiles(lp);
    if (lp->dirty)
       llvmpipe_update_derived(lp);
 
@@ -98,6 +98,7 @@ struct lp_compute_shader_variant
    unsigned nr_instrs;
 
    struct lp_cs_variant_list_item list_item_global, list_item_local;
+   struct lp_variant_cache_key cache_key;
 
    struct lp_compute_shader *shader;
 
@@ -112,6 +113,8 @@ struct lp_compute_shader {
    struct pipe_shader_state base;
 
    struct lp_cs_variant_list_item variants;
+   /* the same variants, indexed by key */
+   struct hash_table variant_cache;
 
    struct draw_mesh_shader *draw_mesh_data;
    uint32_t req_local_mem;
@@ -113,6 +113,8 @@
 /** Fragment shader number (for debugging) */
 static unsigned fs_no = 0;
 
+DEBUG_GET_ONCE_BOOL_OPTION(lp_async_fs_compile, "LP_ASYNC_FS_COMPILE", false)
+
 
 static void
 load_unswizzled_block(struct gallivm_state *gallivm,
@@ -3755,6 +3757,275 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 }
 
 
+/**
+ * Background compilation of an optimized fragment shader variant.
+ *
+ * When a draw misses both the variant list and the disk cache, the variant
+ * is first compiled without optimization so the draw does not have to wait
+ * for the full LLVM pipeline.  The same functions are then regenerated and
+ * optimized on the compile queue, and swapped into the variant by
+ * llvmpipe_poll_fs_compiles().
+ */
+struct lp_fs_compile_job {
+   struct util_queue_fence fence;
+   struct list_head list;
+
+   struct llvmpipe_context *lp;
+
+   /* the live variant; holds a reference */
+   struct lp_fragment_shader_variant *variant;
+
+   /* Private copies for the compile thread, as codegen modifies the NIR
+    * and the variant's LLVM state belongs to the main LLVMContext.  The
+    * shader copy only has the fields codegen reads, see
+    * queue_fs_compile_job().
+    */
+   struct lp_fragment_shader shader;
+   struct lp_fragment_shader_variant *scratch;
+
+   bool edge_test, whole, linear;
+   unsigned char ir_sha1_cache_key[20];
+
+   /* results */
+   struct gallivm_state *gallivm;
+   lp_jit_frag_func jit_function[2];
+   lp_jit_linear_llvm_func jit_linear_llvm;
+};
+
+
+static void
+fs_compile_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct lp_fragment_shader_variant *variant = job->scratch;
+   struct llvmpipe_screen *screen = llvmpipe_screen(job->lp->pipe.screen);
+   struct lp_cached_code cached = { 0 };
+
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u_opt",
+            job->shader.no, variant->no);
+   variant->gallivm = gallivm_create(module_name,
+                                     &job->lp->fs_compile_context, &cached);
+   if (!variant->gallivm)
+      return;
+
+   lp_jit_init_types(variant);
+
+   if (job->edge_test)
+      generate_fragment(job->lp, &job->shader, variant, RAST_EDGE_TEST);
+   if (job->whole)
+      generate_fragment(job->lp, &job->shader, variant, RAST_WHOLE);
+   if (job->linear)
+      llvmpipe_fs_variant_linear_llvm(job->lp, &job->shader, variant);
+
+   gallivm_compile_module(variant->gallivm);
+
+   if (job->edge_test) {
+      job->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+         gallivm_jit_function(variant->gallivm,
+                              variant->function[RAST_EDGE_TEST],
+                              variant->function_name[RAST_EDGE_TEST]);
+      job->jit_function[RAST_WHOLE] = job->jit_function[RAST_EDGE_TEST];
+   }
+
+   if (job->whole) {
+      job->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+         gallivm_jit_function(variant->gallivm,
+                              variant->function[RAST_WHOLE],
+                              variant->function_name[RAST_WHOLE]);
+   }
+
+   if (job->linear) {
+      job->jit_linear_llvm = (lp_jit_linear_llvm_func)
+         gallivm_jit_function(variant->gallivm, variant->linear_function,
+                              variant->linear_function_name);
+   }
+
+   lp_disk_cache_insert_shader(screen, &cached, job->ir_sha1_cache_key);
+
+   gallivm_free_ir(variant->gallivm);
+   job->gallivm = variant->gallivm;
+}
+
+
+static void
+queue_fs_compile_job(struct llvmpipe_context *lp,
+                     struct lp_fragment_shader *shader,
+                     struct lp_fragment_shader_variant *variant,
+                     const unsigned char ir_sha1_cache_key[20])
+{
+   const size_t variant_size =
+      sizeof *variant + shader->variant_key_size - sizeof variant->key;
+
+   struct lp_fs_compile_job *job = CALLOC_STRUCT(lp_fs_compile_job);
+   if (!job)
+      return;
+
+   job->scratch = MALLOC(variant_size);
+   if (!job->scratch) {
+      FREE(job);
+      return;
+   }
+
+   util_queue_fence_init(&job->fence);
+   job->lp = lp;
+   job->edge_test = variant->function[RAST_EDGE_TEST] != NULL;
+   job->whole = variant->function[RAST_WHOLE] != NULL;
+   job->linear = variant->linear_function != NULL;
+   memcpy(job->ir_sha1_cache_key, ir_sha1_cache_key,
+          sizeof(job->ir_sha1_cache_key));
+
+   /* The variant lists, the variant index and the reference count stay
+    * with the live shader.
+    */
+   job->shader.base.type = shader->base.type;
+   job->shader.base.ir.nir = nir_shader_clone(NULL, shader->base.ir.nir);
+   job->shader.info = shader->info;
+   job->shader.kind = shader->kind;
+   job->shader.variant_key_size = shader->variant_key_size;
+   job->shader.no = shader->no;
+   memcpy(job->shader.inputs, shader->inputs, sizeof(job->shader.inputs));
+
+   /* Keep the analysis results and the key, drop everything that refers
+    * to the main LLVMContext or to the live variant lists.
+    */
+   struct lp_fragment_shader_variant *scratch = job->scratch;
+   memcpy(scratch, variant, variant_size);
+   scratch->gallivm = NULL;
+   scratch->optimized_gallivm = NULL;
+   scratch->jit_context_type = NULL;
+   scratch->jit_context_ptr_type = NULL;
+   scratch->jit_thread_data_type = NULL;
+   scratch->jit_resources_type = NULL;
+   scratch->jit_resources_ptr_type = NULL;
+   scratch->jit_thread_data_ptr_type = NULL;
+   scratch->jit_linear_context_type = NULL;
+   scratch->jit_linear_context_ptr_type = NULL;
+   scratch->jit_linear_func_type = NULL;
+   scratch->jit_linear_inputs_type = NULL;
+   scratch->jit_linear_textures_type = NULL;
+   memset(scratch->function, 0, sizeof(scratch->function));
+   memset(scratch->function_name, 0, sizeof(scratch->function_name));
+   scratch->linear_function = NULL;
+   scratch->linear_function_name = NULL;
+   list_inithead(&scratch->list_item_global.list);
+   list_inithead(&scratch->list_item_local.list);
+   scratch->shader = &job->shader;
+
+   lp_fs_variant_reference(lp, &job->variant, variant);
+
+   list_addtail(&job->list, &lp->fs_compile_jobs);
+   util_queue_add_job(&lp->fs_compile_queue, job, &job->fence,
+                      fs_compile_job_execute, NULL, 0);
+}
+
+
+static void
+finish_fs_compile_job(struct llvmpipe_context *lp,
+                      struct lp_fs_compile_job *job,
+                      bool install)
+{
+   struct lp_fragment_shader_variant *variant = job->variant;
+
+   if (job->gallivm && install) {
+      /* The rasterizer threads read these pointers for every tile while
+       * scenes are in flight, so each one is swapped atomically.  The
+       * unoptimized code they may still be running remains valid.
+       */
+      if (job->edge_test) {
+         p_atomic_set(&variant->jit_function[RAST_EDGE_TEST],
+                      job->jit_function[RAST_EDGE_TEST]);
+      }
+      if (job->edge_test || job->whole) {
+         p_atomic_set(&variant->jit_function[RAST_WHOLE],
+                      job->jit_function[RAST_WHOLE]);
+      }
+      if (job->linear)
+         p_atomic_set(&variant->jit_linear_llvm, job->jit_linear_llvm);
+
+      variant->optimized_gallivm = job->gallivm;
+   } else if (job->gallivm) {
+      gallivm_destroy(job->gallivm);
+   }
+
+   if (job->scratch->function_name[RAST_EDGE_TEST])
+      FREE(job->scratch->function_name[RAST_EDGE_TEST]);
+   if (job->scratch->function_name[RAST_WHOLE])
+      FREE(job->scratch->function_name[RAST_WHOLE]);
+   if (job->scratch->linear_function_name)
+      FREE(job->scratch->linear_function_name);
+   FREE(job->scratch);
+   ralloc_free(job->shader.base.ir.nir);
+
+   lp_fs_variant_reference(lp, &job->variant, NULL);
+
+   list_del(&job->list);
+   util_queue_fence_destroy(&job->fence);
+   FREE(job);
+}
+
+
+/**
+ * Install the optimized code of all background compiles that finished.
+ */
+void
+llvmpipe_poll_fs_compiles(struct llvmpipe_context *lp)
+{
+   if (list_is_empty(&lp->fs_compile_jobs))
+      return;
+
+   struct lp_fs_compile_job *job, *next;
+   LIST_FOR_EACH_ENTRY_SAFE(job, next, &lp->fs_compile_jobs, list) {
+      if (util_queue_fence_is_signalled(&job->fence))
+         finish_fs_compile_job(lp, job, true);
+   }
+}
+
+
+void
+llvmpipe_init_fs_compile_queue(struct llvmpipe_context *lp)
+{
+   list_inithead(&lp->fs_compile_jobs);
+
+#if !GALLIVM_USE_ORCJIT
+   if (!debug_get_option_lp_async_fs_compile())
+      return;
+
+   lp_context_create(&lp->fs_compile_context);
+   if (!lp->fs_compile_context.ref)
+      return;
+
+   if (!util_queue_init(&lp->fs_compile_queue, "lpfs", 32, 1,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY, NULL)) {
+      lp_context_destroy(&lp->fs_compile_context);
+      return;
+   }
+
+   lp->fs_async_compile = true;
+#endif
+}
+
+
+void
+llvmpipe_destroy_fs_compile_queue(struct llvmpipe_context *lp)
+{
+   if (!lp->fs_async_compile)
+      return;
+
+   /* Don't wait for compiles nobody is going to use. */
+   struct lp_fs_compile_job *job, *next;
+   LIST_FOR_EACH_ENTRY_SAFE(job, next, &lp->fs_compile_jobs, list) {
+      util_queue_drop_job(&lp->fs_compile_queue, &job->fence);
+      finish_fs_compile_job(lp, job, false);
+   }
+
+   util_queue_destroy(&lp->fs_compile_queue);
+   lp_context_destroy(&lp->fs_compile_context);
+   lp->fs_async_compile = false;
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -3789,10 +4060,23 @@ generate_variant(struct llvmpipe_context *lp,
          needs_caching = true;
    }
 
+   /* On a cache miss, get something to draw with quickly and leave the
+    * optimized compile, and the disk cache insertion, to the compile queue.
+    */
+   const bool compile_async = needs_caching && lp->fs_async_compile;
+
    char module_name[64];
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
             shader->no, shader->variants_created);
+#if GALLIVM_USE_ORCJIT
    variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
+#else
+   if (compile_async)
+      variant->gallivm = gallivm_create_noopt(module_name, &lp->context,
+                                              &cached);
+   else
+      variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
+#endif
    if (!variant->gallivm) {
       FREE(variant);
       return NULL;
@@ -3996,12 +4280,17 @@ generate_variant(struct llvmpipe_context *lp,
       lp_linear_check_variant(variant);
    }
 
-   if (needs_caching) {
+   if (needs_caching && !compile_async) {
       lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
    }
 
    gallivm_free_ir(variant->gallivm);
 
+   if (compile_async &&
+       (variant->function[RAST_EDGE_TEST] || variant->linear_function)) {
+      queue_fs_compile_job(lp, shader, variant, ir_sha1_cache_key);
+   }
+
    return variant;
 }
 
@@ -4019,6 +4308,10 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    pipe_reference_init(&shader->reference, 1);
    shader->no = fs_no++;
    list_inithead(&shader->variants.list);
+   if (!lp_variant_cache_init(&shader->variant_cache)) {
+      FREE(shader);
+      return NULL;
+   }
 
    shader->base.type = PIPE_SHADER_IR_NIR;
 
@@ -4040,6 +4333,7 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
 
    shader->draw_data = draw_create_fragment_shader(llvmpipe->draw, templ);
    if (shader->draw_data == NULL) {
+      lp_variant_cache_fini(&shader->variant_cache);
       FREE(shader);
       return NULL;
    }
@@ -4147,6 +4441,8 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
 
    /* remove from shader's list */
    list_del(&variant->list_item_local.list);
+   lp_variant_cache_remove(&variant->shader->variant_cache,
+                           &variant->cache_key);
    variant->shader->variants_cached--;
 
    /* remove from context's list */
@@ -4161,6 +4457,8 @@ llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
    gallivm_destroy(variant->gallivm);
+   if (variant->optimized_gallivm)
+      gallivm_destroy(variant->optimized_gallivm);
    lp_fs_reference(lp, &variant->shader, NULL);
    if (variant->function_name[RAST_EDGE_TEST])
       FREE(variant->function_name[RAST_EDGE_TEST]);
@@ -4181,6 +4479,7 @@ llvmpipe_destroy_fs(struct llvmpipe_context *llvmpipe,
 
    ralloc_free(shader->base.ir.nir);
    assert(shader->variants_cached == 0);
+   lp_variant_cache_fini(&shader->variant_cache);
    FREE(shader);
 }
 
@@ -4685,23 +4984,21 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    const struct lp_fragment_shader_variant_key *key =
       make_variant_key(lp, shader, store);
 
-   struct lp_fragment_shader_variant *variant = NULL;
-   struct lp_fs_variant_list_item *li;
    /* Search the variants for one which matches the key */
-   LIST_FOR_EACH_ENTRY(li, &shader->variants.list, list) {
-      if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
-      }
-   }
+   struct lp_fragment_shader_variant *variant =
+      lp_variant_cache_search(&shader->variant_cache, key,
+                              shader->variant_key_size);
 
    if (variant) {
+      lp->fs_variant_stats.hits++;
+
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
        */
       list_move_to(&variant->list_item_global.list, &lp->fs_variants_list.list);
    } else {
       /* variant not found, create it now */
+      lp->fs_variant_stats.misses++;
 
       if (LP_DEBUG & DEBUG_FS) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
@@ -4748,6 +5045,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
             llvmpipe_remove_shader_variant(lp, item->base);
             struct lp_fragment_shader_variant *variant = item->base;
             lp_fs_variant_reference(lp, &variant, NULL);
+            lp->fs_variant_stats.evictions++;
          }
       }
 
@@ -4764,6 +5062,9 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       /* Put the new variant into the list */
       if (variant) {
          list_add(&variant->list_item_local.list, &shader->variants.list);
+         lp_variant_cache_insert(&shader->variant_cache, &variant->cache_key,
+                                 &variant->key, shader->variant_key_size,
+                                 variant);
          list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
          lp->nr_fs_variants++;
          lp->nr_fs_instrs += variant->nr_instrs;
@@ -39,6 +39,7 @@
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
 #include "lp_jit.h"
+#include "lp_variant_cache.h"
 
 struct lp_fragment_shader;
 
@@ -181,6 +182,12 @@ struct lp_fragment_shader_variant
    char *linear_function_name;
    lp_jit_linear_llvm_func jit_linear_llvm;
 
+   /* Optimized code compiled in the background, which replaced the
+    * unoptimized functions above.  The code in gallivm stays alive until
+    * the variant is destroyed, as scenes in flight may still be using it.
+    */
+   struct gallivm_state *optimized_gallivm;
+
    /* Bitmask to say what cbufs are unswizzled */
    unsigned unswizzled_cbufs;
 
@@ -188,6 +195,7 @@ struct lp_fragment_shader_variant
    unsigned nr_instrs;
 
    struct lp_fs_variant_list_item list_item_global, list_item_local;
+   struct lp_variant_cache_key cache_key;
    struct lp_fragment_shader *shader;
 
    /* For debugging/profiling purposes */
@@ -210,6 +218,8 @@ struct lp_fragment_shader
    enum lp_fs_kind kind;
 
    struct lp_fs_variant_list_item variants;
+   /* the same variants, indexed by key */
+   struct hash_table variant_cache;
 
    struct draw_fragment_shader *draw_data;
 
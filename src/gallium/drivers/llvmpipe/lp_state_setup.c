@@ -833,6 +833,7 @@ remove_setup_variant(struct llvmpipe_context *lp,
    }
 
    list_del(&variant->list_item_global.list);
+   lp_variant_cache_remove(&lp->setup_variant_cache, &variant->cache_key);
    lp->nr_setup_variants--;
    FREE(variant->function_name);
    FREE(variant);
@@ -864,6 +865,7 @@ cull_setup_variants(struct llvmpipe_context *lp)
       assert(item);
       assert(item->base);
       remove_setup_variant(lp, item->base);
+      lp->setup_variant_stats.evictions++;
    }
 }
 
@@ -877,22 +879,18 @@ void
 llvmpipe_update_setup(struct llvmpipe_context *lp)
 {
    struct lp_setup_variant_key *key = &lp->setup_variant.key;
-   struct lp_setup_variant *variant = NULL;
-   struct lp_setup_variant_list_item *li;
 
    lp_make_setup_variant_key(lp, key);
 
-   LIST_FOR_EACH_ENTRY(li, &lp->setup_variants_list.list, list) {
-      if (li->base->key.size == key->size &&
-         memcmp(&li->base->key, key, key->size) == 0) {
-         variant = li->base;
-         break;
-      }
-   }
+   struct lp_setup_variant *variant =
+      lp_variant_cache_search(&lp->setup_variant_cache, key, key->size);
 
    if (variant) {
+      lp->setup_variant_stats.hits++;
       list_move_to(&variant->list_item_global.list, &lp->setup_variants_list.list);
    } else {
+      lp->setup_variant_stats.misses++;
+
       if (lp->nr_setup_variants >= LP_MAX_SETUP_VARIANTS) {
          cull_setup_variants(lp);
       }
@@ -900,6 +898,8 @@ llvmpipe_update_setup(struct llvmpipe_context *lp)
       variant = generate_setup_variant(key, lp);
       if (variant) {
          list_add(&variant->list_item_global.list, &lp->setup_variants_list.list);
+         lp_variant_cache_insert(&lp->setup_variant_cache, &variant->cache_key,
+                                 &variant->key, variant->key.size, variant);
          lp->nr_setup_variants++;
       }
    }
@@ -2,6 +2,7 @@
 #define LP_STATE_SETUP_H
 
 #include "lp_bld_interp.h"
+#include "lp_variant_cache.h"
 
 
 struct llvmpipe_context;
@@ -57,6 +58,7 @@ struct lp_setup_variant {
    struct lp_setup_variant_key key;
 
    struct lp_setup_variant_list_item list_item_global;
+   struct lp_variant_cache_key cache_key;
 
    struct gallivm_state *gallivm;
 
@@ -0,0 +1,90 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include "lp_variant_cache.h"
+
+
+static uint32_t
+variant_key_hash(const void *key)
+{
+   return ((const struct lp_variant_cache_key *)key)->hash;
+}
+
+
+static bool
+variant_key_equal(const void *a, const void *b)
+{
+   const struct lp_variant_cache_key *ka = a;
+   const struct lp_variant_cache_key *kb = b;
+
+   return ka->hash == kb->hash &&
+          ka->size == kb->size &&
+          memcmp(ka->data, kb->data, ka->size) == 0;
+}
+
+
+bool
+lp_variant_cache_init(struct hash_table *cache)
+{
+   return _mesa_hash_table_init(cache, NULL,
+                                variant_key_hash, variant_key_equal);
+}
+
+
+void
+lp_variant_cache_fini(struct hash_table *cache)
+{
+   _mesa_hash_table_fini(cache, NULL);
+}
+
+
+/**
+ * Return the variant stored under the given key, or NULL.
+ */
+void *
+lp_variant_cache_search(struct hash_table *cache,
+                        const void *data, size_t size)
+{
+   const struct lp_variant_cache_key key = {
+      .data = data,
+      .size = size,
+      .hash = _mesa_hash_data(data, size),
+   };
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(cache, key.hash, &key);
+   return entry ? entry->data : NULL;
+}
+
+
+/**
+ * Store a variant.  The key, and the key bytes it points to, must live as
+ * long as the variant is in the cache, so they are normally part of the
+ * variant itself.
+ */
+void
+lp_variant_cache_insert(struct hash_table *cache,
+                        struct lp_variant_cache_key *key,
+                        const void *data, size_t size,
+                        void *variant)
+{
+   key->data = data;
+   key->size = size;
+   key->hash = _mesa_hash_data(data, size);
+
+   _mesa_hash_table_insert_pre_hashed(cache, key->hash, key, variant);
+}
+
+
+void
+lp_variant_cache_remove(struct hash_table *cache,
+                        struct lp_variant_cache_key *key)
+{
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(cache, key->hash, key);
+   if (entry)
+      _mesa_hash_table_remove(cache, entry);
+}
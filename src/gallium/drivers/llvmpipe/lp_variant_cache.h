@@ -0,0 +1,57 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LP_VARIANT_CACHE_H
+#define LP_VARIANT_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/hash_table.h"
+
+/*
+ * Hash index over the variants of a shader (or of the context for setup
+ * variants), keyed on the raw bytes of the variable-sized variant key.
+ *
+ * This only replaces the linear key search.  The LRU lists used for
+ * eviction and for deleting all the variants of a shader stay with the
+ * callers, so that inserting, touching and evicting a variant remain O(1).
+ */
+
+/** Embedded in each variant, it is the key the variant is stored under. */
+struct lp_variant_cache_key {
+   const void *data;
+   uint32_t size;
+   uint32_t hash;
+};
+
+/** Lookup statistics, exported as driver queries. */
+struct lp_variant_cache_stats {
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+};
+
+bool
+lp_variant_cache_init(struct hash_table *cache);
+
+void
+lp_variant_cache_fini(struct hash_table *cache);
+
+void *
+lp_variant_cache_search(struct hash_table *cache,
+                        const void *data, size_t size);
+
+void
+lp_variant_cache_insert(struct hash_table *cache,
+                        struct lp_variant_cache_key *key,
+                        const void *data, size_t size,
+                        void *variant);
+
+void
+lp_variant_cache_remove(struct hash_table *cache,
+                        struct lp_variant_cache_key *key);
+
+#endif /* LP_VARIANT_CACHE_H */
@@ -0,0 +1,250 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Replays command buffers captured with VIRGL_CMDBUF_CAPTURE and reports how
+ * many bytes command compression would put on the wire, and what it costs,
+ * for a range of size thresholds.
+ *
+ *    virgl_compress_bench [-t min_size]... capture...
+ *
+ * Commands that were compressed at capture time are inflated first, so the
+ * numbers are always relative to the uncompressed stream.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/compress.h"
+#include "util/os_time.h"
+#include "util/u_dynarray.h"
+#include "util/u_math.h"
+#include "virgl_encode.h"
+
+#define MAX_THRESHOLDS 16
+
+struct bench_result {
+   unsigned min_size;
+   uint64_t wire_bytes;
+   uint64_t compressed_cmds;
+   int64_t compress_ns;
+   int64_t inflate_ns;
+};
+
+struct bench {
+   unsigned num_results;
+   struct bench_result results[MAX_THRESHOLDS];
+
+   uint64_t num_cmd_bufs;
+   uint64_t num_cmds;
+   uint64_t raw_bytes;
+
+   uint8_t *scratch;
+   size_t scratch_size;
+   uint8_t *inflated;
+   size_t inflated_size;
+};
+
+static uint8_t *
+bench_scratch(uint8_t **buf, size_t *buf_size, size_t size)
+{
+   if (*buf_size < size) {
+      *buf = realloc(*buf, size);
+      if (!*buf) {
+         fprintf(stderr, "out of memory\n");
+         exit(1);
+      }
+      *buf_size = size;
+   }
+   return *buf;
+}
+
+static void
+bench_cmd(struct bench *bench, const uint8_t *cmd, size_t size)
+{
+   const size_t max_size = util_compress_max_compressed_len(size);
+   uint8_t *out = bench_scratch(&bench->scratch, &bench->scratch_size,
+                                max_size);
+   uint8_t *check = bench_scratch(&bench->inflated, &bench->inflated_size,
+                                  size);
+   size_t compressed = 0;
+   int64_t compress_ns = 0, inflate_ns = 0;
+   bool measured = false;
+
+   bench->num_cmds++;
+   bench->raw_bytes += size;
+
+   /* the driver only ever compresses these, whatever their size */
+   if (!virgl_encoder_cmd_is_compressible(*(const uint32_t *)cmd)) {
+      for (unsigned i = 0; i < bench->num_results; i++)
+         bench->results[i].wire_bytes += size;
+      return;
+   }
+
+   for (unsigned i = 0; i < bench->num_results; i++) {
+      struct bench_result *result = &bench->results[i];
+      size_t wire = size;
+
+      if (size >= result->min_size) {
+         if (!measured) {
+            int64_t start = os_time_get_nano();
+            compressed = util_compress_deflate_fast(cmd, size, out, max_size);
+            compress_ns = os_time_get_nano() - start;
+
+            if (compressed) {
+               start = os_time_get_nano();
+               if (!util_compress_inflate(out, compressed, check, size) ||
+                   memcmp(check, cmd, size)) {
+                  fprintf(stderr, "round trip mismatch\n");
+                  exit(1);
+               }
+               inflate_ns = os_time_get_nano() - start;
+            }
+            measured = true;
+         }
+
+         if (virgl_encoder_compression_pays(size / 4, compressed)) {
+            wire = (VIRGL_COMPRESSED_SIZE(compressed) + 1) * 4;
+            result->compressed_cmds++;
+            result->inflate_ns += inflate_ns;
+         }
+         result->compress_ns += compress_ns;
+      }
+
+      result->wire_bytes += wire;
+   }
+}
+
+static bool
+bench_cmd_buf(struct bench *bench, const uint32_t *buf, uint32_t dwords)
+{
+   uint32_t i = 0;
+
+   bench->num_cmd_bufs++;
+
+   while (i < dwords) {
+      const uint32_t header = buf[i];
+      const uint32_t len = header >> 16;
+
+      if (i + len + 1 > dwords) {
+         fprintf(stderr, "truncated command at dword %u\n", i);
+         return false;
+      }
+
+      if ((header & 0xff) == VIRGL_CCMD_COMPRESSED) {
+         const uint32_t inflated_dwords = buf[i + VIRGL_COMPRESSED_DWORDS];
+         const uint32_t bytes = buf[i + VIRGL_COMPRESSED_BYTES];
+         uint8_t *cmd = bench_scratch(&bench->inflated, &bench->inflated_size,
+                                      inflated_dwords * 4);
+
+         if (!util_compress_inflate((const uint8_t *)&buf[i + VIRGL_COMPRESSED_DATA],
+                                    bytes, cmd, inflated_dwords * 4)) {
+            fprintf(stderr, "failed to inflate command at dword %u\n", i);
+            return false;
+         }
+
+         /* bench_cmd() reuses the inflate buffer */
+         uint8_t *copy = malloc(inflated_dwords * 4);
+         if (!copy)
+            return false;
+         memcpy(copy, cmd, inflated_dwords * 4);
+         bench_cmd(bench, copy, inflated_dwords * 4);
+         free(copy);
+      } else {
+         bench_cmd(bench, (const uint8_t *)&buf[i], (len + 1) * 4);
+      }
+
+      i += len + 1;
+   }
+
+   return true;
+}
+
+static bool
+bench_file(struct bench *bench, const char *path)
+{
+   struct util_dynarray buf;
+   uint32_t dwords;
+   bool ok = true;
+   FILE *fp;
+
+   fp = fopen(path, "rb");
+   if (!fp) {
+      fprintf(stderr, "failed to open %s\n", path);
+      return false;
+   }
+
+   util_dynarray_init(&buf, NULL);
+   while (ok && fread(&dwords, sizeof(dwords), 1, fp) == 1) {
+      util_dynarray_clear(&buf);
+      uint32_t *data = util_dynarray_grow(&buf, uint32_t, dwords);
+      if (!data || fread(data, sizeof(uint32_t), dwords, fp) != dwords) {
+         fprintf(stderr, "%s: truncated command buffer\n", path);
+         ok = false;
+         break;
+      }
+      ok = bench_cmd_buf(bench, data, dwords);
+   }
+   util_dynarray_fini(&buf);
+   fclose(fp);
+
+   return ok;
+}
+
+static void
+bench_report(const struct bench *bench)
+{
+   printf("%" PRIu64 " command buffers, %" PRIu64 " commands, %" PRIu64 " bytes\n\n",
+          bench->num_cmd_bufs, bench->num_cmds, bench->raw_bytes);
+   printf("%10s %14s %8s %10s %14s %14s\n", "min size", "wire bytes", "ratio",
+          "commands", "deflate ms", "inflate ms");
+
+   for (unsigned i = 0; i < bench->num_results; i++) {
+      const struct bench_result *result = &bench->results[i];
+      printf("%10u %14" PRIu64 " %8.3f %10" PRIu64 " %14.3f %14.3f\n",
+             result->min_size, result->wire_bytes,
+             bench->raw_bytes ? (double)result->wire_bytes / bench->raw_bytes : 1.0,
+             result->compressed_cmds,
+             result->compress_ns / 1e6, result->inflate_ns / 1e6);
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   static const unsigned default_thresholds[] = { 256, 1024, 4096, 16384, 65536 };
+   struct bench bench;
+   int i;
+
+   memset(&bench, 0, sizeof(bench));
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-t") || i + 1 >= argc)
+         break;
+      if (bench.num_results < MAX_THRESHOLDS)
+         bench.results[bench.num_results++].min_size = atoi(argv[++i]);
+   }
+
+   if (i >= argc) {
+      fprintf(stderr, "usage: %s [-t min_size]... capture...\n", argv[0]);
+      return 1;
+   }
+
+   if (!bench.num_results) {
+      for (unsigned j = 0; j < ARRAY_SIZE(default_thresholds); j++)
+         bench.results[bench.num_results++].min_size = default_thresholds[j];
+   }
+
+   for (; i < argc; i++) {
+      if (!bench_file(&bench, argv[i]))
+         return 1;
+   }
+
+   bench_report(&bench);
+
+   free(bench.scratch);
+   free(bench.inflated);
+   return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "pipe/p_state.h"
+#include "util/u_memory.h"
+
+extern "C" {
+#include "virgl_encode.h"
+
+#include "util/compress.h"
+}
+
+class VirglCompress : public ::testing::Test
+{
+protected:
+   VirglCompress() : scratch(NULL), scratch_size(0)
+   {
+      /* room for the worst case a compressed command can take */
+      storage.resize(util_compress_max_compressed_len(max_dwords * 4) / 4 +
+                     max_dwords + 16);
+      cbuf.cdw = 0;
+      cbuf.buf = storage.data();
+   }
+
+   ~VirglCompress()
+   {
+      FREE(scratch);
+   }
+
+   /* a constant buffer upload with the given payload */
+   uint32_t encode_constants(const std::vector<uint32_t> &payload)
+   {
+      const uint32_t start = cbuf.cdw;
+
+      virgl_encoder_write_dword(&cbuf, VIRGL_CMD0(VIRGL_CCMD_SET_CONSTANT_BUFFER,
+                                                  0, payload.size() + 2));
+      virgl_encoder_write_dword(&cbuf, PIPE_SHADER_FRAGMENT);
+      virgl_encoder_write_dword(&cbuf, 0);
+      for (uint32_t dw : payload)
+         virgl_encoder_write_dword(&cbuf, dw);
+
+      return start;
+   }
+
+   static const uint32_t max_dwords = 4096;
+
+   std::vector<uint32_t> storage;
+   struct virgl_cmd_buf cbuf;
+   uint8_t *scratch;
+   size_t scratch_size;
+};
+
+TEST_F(VirglCompress, round_trip)
+{
+   std::vector<uint32_t> payload(max_dwords - 3);
+   for (size_t i = 0; i < payload.size(); i++)
+      payload[i] = i % 16;
+
+   /* a preceding command must be left alone */
+   virgl_encoder_write_dword(&cbuf, VIRGL_CMD0(VIRGL_CCMD_NOP, 0, 1));
+   virgl_encoder_write_dword(&cbuf, 0xdeadbeef);
+
+   const uint32_t start = encode_constants(payload);
+   const uint32_t dwords = cbuf.cdw - start;
+   const std::vector<uint32_t> original(cbuf.buf + start, cbuf.buf + cbuf.cdw);
+
+   ASSERT_TRUE(virgl_encoder_compress_last_cmd(&cbuf, start,
+                                               VIRGL_COMPRESSION_ZLIB,
+                                               &scratch, &scratch_size));
+
+   EXPECT_EQ(cbuf.buf[0], VIRGL_CMD0(VIRGL_CCMD_NOP, 0, 1));
+   EXPECT_EQ(cbuf.buf[1], 0xdeadbeef);
+
+   const uint32_t *cmd = cbuf.buf + start;
+   const uint32_t len = cmd[0] >> 16;
+   EXPECT_EQ(cmd[0] & 0xff, VIRGL_CCMD_COMPRESSED);
+   EXPECT_EQ((cmd[0] >> 8) & 0xff, VIRGL_COMPRESSION_ZLIB);
+   EXPECT_EQ(start + len + 1, cbuf.cdw);
+   EXPECT_LT(cbuf.cdw - start, dwords);
+   EXPECT_EQ(cmd[VIRGL_COMPRESSED_DWORDS], dwords);
+   EXPECT_EQ(len, VIRGL_COMPRESSED_SIZE(cmd[VIRGL_COMPRESSED_BYTES]));
+
+   std::vector<uint32_t> inflated(dwords);
+   ASSERT_TRUE(util_compress_inflate((const uint8_t *)&cmd[VIRGL_COMPRESSED_DATA],
+                                     cmd[VIRGL_COMPRESSED_BYTES],
+                                     (uint8_t *)inflated.data(),
+                                     dwords * 4));
+   EXPECT_EQ(inflated, original);
+}
+
+TEST_F(VirglCompress, incompressible)
+{
+   std::vector<uint32_t> payload(max_dwords - 3);
+   uint32_t x = 0x12345678;
+   for (size_t i = 0; i < payload.size(); i++) {
+      /* xorshift32 */
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      payload[i] = x;
+   }
+
+   const uint32_t start = encode_constants(payload);
+   const uint32_t cdw = cbuf.cdw;
+   const std::vector<uint32_t> original(cbuf.buf, cbuf.buf + cbuf.cdw);
+
+   EXPECT_FALSE(virgl_encoder_compress_last_cmd(&cbuf, start,
+                                                VIRGL_COMPRESSION_ZLIB,
+                                                &scratch, &scratch_size));
+   EXPECT_EQ(cbuf.cdw, cdw);
+   EXPECT_EQ(std::vector<uint32_t>(cbuf.buf, cbuf.buf + cbuf.cdw), original);
+}
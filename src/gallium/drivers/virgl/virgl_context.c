@@ -29,6 +29,7 @@
 #include "pipe/p_shader_tokens.h"
 
 #include "compiler/nir/nir.h"
+#include "compiler/nir/nir_serialize.h"
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
@@ -44,8 +45,11 @@
 #include "util/u_transfer.h"
 #include "util/u_helpers.h"
 #include "util/slab.h"
+#include "util/blob.h"
 #include "util/u_upload_mgr.h"
 #include "util/u_blitter.h"
+#include "util/u_threaded_context.h"
+#include "tgsi/tgsi_parse.h"
 
 #include "virgl_encode.h"
 #include "virgl_context.h"
@@ -61,29 +65,298 @@ uint32_t virgl_object_assign_handle(void)
    return p_atomic_inc_return(&next_handle);
 }
 
+static void
+virgl_deferred_job_execute(void *data)
+{
+   struct virgl_deferred_job *job = data;
+
+   job->func(job->vctx, job);
+   FREE(job);
+}
+
+/* With u_threaded_context, the create_* entry points (and link_shader) are
+ * called directly from the frontend thread while the driver thread may be
+ * writing to the command buffer.  The encoding is thus queued as a callback
+ * so that it happens on the driver thread, in order with the calls that
+ * bind or delete the object.
+ *
+ * Without the threaded context the job is executed right away, and its
+ * result is returned so that creation failures can still be reported.
+ */
+bool
+virgl_context_defer(struct virgl_context *vctx, virgl_deferred_func func,
+                    struct virgl_deferred_job *job)
+{
+   bool ret = true;
+
+   job->vctx = vctx;
+   job->func = func;
+
+   if (vctx->tc) {
+      vctx->tc->base.callback(&vctx->tc->base, virgl_deferred_job_execute,
+                              job, false);
+   } else {
+      ret = func(vctx, job);
+      FREE(job);
+   }
+
+   return ret;
+}
+
+struct virgl_pending_delete {
+   uint32_t handle;
+   uint32_t type;
+};
+
+void
+virgl_context_delete_object(struct virgl_context *vctx, uint32_t handle,
+                            uint32_t type)
+{
+   if (!vctx->tc) {
+      virgl_encode_delete_object(vctx, handle, type);
+      return;
+   }
+
+   const struct virgl_pending_delete del = { handle, type };
+
+   simple_mtx_lock(&vctx->pending_deletes_mutex);
+   util_dynarray_append(&vctx->pending_deletes, struct virgl_pending_delete,
+                        del);
+   simple_mtx_unlock(&vctx->pending_deletes_mutex);
+}
+
+static void
+virgl_emit_pending_deletes(struct virgl_context *vctx)
+{
+   if (!vctx->tc)
+      return;
+
+   /* Pop one at a time: encoding may flush, and the flush drains the list
+    * again.
+    */
+   for (;;) {
+      struct virgl_pending_delete del;
+
+      simple_mtx_lock(&vctx->pending_deletes_mutex);
+      if (!util_dynarray_num_elements(&vctx->pending_deletes,
+                                      struct virgl_pending_delete)) {
+         simple_mtx_unlock(&vctx->pending_deletes_mutex);
+         break;
+      }
+      del = util_dynarray_pop(&vctx->pending_deletes,
+                              struct virgl_pending_delete);
+      simple_mtx_unlock(&vctx->pending_deletes_mutex);
+
+      virgl_encode_delete_object(vctx, del.handle, del.type);
+   }
+}
+
+/* Host sampler views reference the storage of their resource.  When the
+ * storage of a buffer is replaced, re-create the host object against the new
+ * one.
+ */
+static void
+virgl_sampler_view_revalidate(struct virgl_context *vctx,
+                              struct virgl_sampler_view *view)
+{
+   struct virgl_resource *res = virgl_resource(view->base.texture);
+
+   if (likely(view->storage_generation == res->storage_generation))
+      return;
+
+   virgl_encode_delete_object(vctx, view->handle, VIRGL_OBJECT_SAMPLER_VIEW);
+   view->handle = virgl_object_assign_handle();
+   virgl_encode_sampler_view(vctx, view->handle, res, &view->base);
+   view->storage_generation = res->storage_generation;
+}
+
+static void
+virgl_shadow_init(struct virgl_shadow_state *shadow)
+{
+   memset(shadow->objects, 0xff, sizeof(shadow->objects));
+   memset(shadow->shaders, 0xff, sizeof(shadow->shaders));
+   memset(shadow->views, 0xff, sizeof(shadow->views));
+   memset(shadow->samplers, 0xff, sizeof(shadow->samplers));
+   shadow->num_vertex_buffers = ~0u;
+}
+
+static void
+virgl_shadow_fini(struct virgl_shadow_state *shadow)
+{
+   for (unsigned i = 0; i < PIPE_SHADER_TYPES; i++) {
+      for (unsigned j = 0; j < PIPE_MAX_CONSTANT_BUFFERS; j++)
+         pipe_resource_reference(&shadow->ubos[i][j].res, NULL);
+   }
+   for (unsigned i = 0; i < PIPE_MAX_ATTRIBS; i++)
+      pipe_resource_reference(&shadow->vertex_buffers[i].res, NULL);
+}
+
+/* Account for one state command and return whether it has to be encoded. */
+static inline bool
+virgl_shadow_account(struct virgl_context *vctx, bool changed)
+{
+   vctx->stats[changed ? VIRGL_STAT_STATE_EMITTED :
+                         VIRGL_STAT_STATE_SKIPPED]++;
+   return changed;
+}
+
+static inline bool
+virgl_shadow_update(struct virgl_context *vctx, uint32_t *shadow,
+                    uint32_t handle)
+{
+   bool changed = *shadow != handle;
+
+   *shadow = handle;
+   return virgl_shadow_account(vctx, changed);
+}
+
+/* Update the handles shadowing slots [start, start + count) and narrow the
+ * range down to the slots that changed.  Returns false when none did.
+ */
+static bool
+virgl_shadow_update_range(struct virgl_context *vctx, uint32_t *shadow,
+                          const uint32_t *handles, unsigned *start,
+                          unsigned *count)
+{
+   unsigned first = *count, last = 0;
+
+   for (unsigned i = 0; i < *count; i++) {
+      if (shadow[*start + i] != handles[i]) {
+         shadow[*start + i] = handles[i];
+         first = MIN2(first, i);
+         last = i;
+      }
+   }
+
+   if (!virgl_shadow_account(vctx, first < *count))
+      return false;
+
+   *start += first;
+   *count = last - first + 1;
+   return true;
+}
+
+/* The host unbinds every sampler view at or past the end of a
+ * SET_SAMPLER_VIEWS range, so the range sent always extends to the last
+ * bound view.
+ */
+static void
+virgl_emit_sampler_views(struct virgl_context *vctx,
+                         enum pipe_shader_type shader_type,
+                         unsigned start, unsigned end)
+{
+   struct virgl_shader_binding_state *binding =
+      &vctx->shader_bindings[shader_type];
+   unsigned last = PIPE_MAX_SHADER_SAMPLER_VIEWS;
+
+   while (last > end && !binding->views[last - 1])
+      last--;
+
+   virgl_encode_set_sampler_views(vctx, shader_type, start, last - start,
+         (struct virgl_sampler_view **)&binding->views[start]);
+}
+
+/* The host takes the number of bound samplers from the count of a
+ * BIND_SAMPLER_STATES command, so always send the samplers from slot 0 up
+ * to the last bound one.
+ */
+static void
+virgl_emit_sampler_states(struct virgl_context *vctx,
+                          enum pipe_shader_type shader, unsigned end)
+{
+   const uint32_t *shadow = vctx->shadow.samplers[shader];
+   uint32_t handles[PIPE_MAX_SAMPLERS];
+   unsigned last = PIPE_MAX_SAMPLERS;
+
+   while (last > end && (shadow[last - 1] == 0 || shadow[last - 1] == ~0u))
+      last--;
+
+   for (unsigned i = 0; i < last; i++)
+      handles[i] = shadow[i] == ~0u ? 0 : shadow[i];
+
+   virgl_encode_bind_sampler_states(vctx, shader, 0, last, handles);
+}
+
+static bool
+virgl_shadow_buffer_update(struct virgl_shadow_buffer *shadow,
+                           struct pipe_resource *res,
+                           uint32_t offset, uint32_t size)
+{
+   const uint32_t generation =
+      res ? virgl_resource(res)->storage_generation : 0;
+
+   if (shadow->res == res &&
+       shadow->storage_generation == generation &&
+       shadow->offset == offset &&
+       shadow->size == size)
+      return false;
+
+   pipe_resource_reference(&shadow->res, res);
+   shadow->storage_generation = generation;
+   shadow->offset = offset;
+   shadow->size = size;
+   return true;
+}
+
+static void
+virgl_shadow_buffer_clear(struct virgl_shadow_buffer *shadow)
+{
+   pipe_resource_reference(&shadow->res, NULL);
+   memset(shadow, 0, sizeof(*shadow));
+}
+
 bool
 virgl_can_rebind_resource(struct virgl_context *vctx,
                           struct pipe_resource *res)
 {
-   /* We cannot rebind resources that are referenced by host objects, which
-    * are
-    *
-    *  - VIRGL_OBJECT_SURFACE
-    *  - VIRGL_OBJECT_SAMPLER_VIEW
-    *  - VIRGL_OBJECT_STREAMOUT_TARGET
-    *
-    * Because surfaces cannot be created from buffers, we require the resource
-    * to be a buffer instead (and avoid tracking VIRGL_OBJECT_SURFACE binds).
+   /* Host objects referencing a resource (VIRGL_OBJECT_SAMPLER_VIEW,
+    * VIRGL_OBJECT_STREAMOUT_TARGET) are re-created against the new storage
+    * when they are rebound.  VIRGL_OBJECT_SURFACE cannot, but surfaces cannot
+    * be created from buffers, so we only require the resource to be a buffer.
     */
-   const unsigned unsupported_bind = (PIPE_BIND_SAMPLER_VIEW |
-                                      PIPE_BIND_STREAM_OUTPUT);
-   const unsigned bind_history = virgl_resource(res)->bind_history;
-   return res->target == PIPE_BUFFER && !(bind_history & unsupported_bind);
+   return res->target == PIPE_BUFFER;
+}
+
+/* Map a bind history to the u_threaded_context binding points, a mask of
+ * BITFIELD_BIT(enum tc_binding_type), where per-stage bindings are indexed
+ * by pipe_shader_type.
+ */
+static uint32_t
+virgl_rebind_mask_from_bind_history(unsigned bind_history)
+{
+   uint32_t rebind_mask = 0;
+
+   if (bind_history & PIPE_BIND_VERTEX_BUFFER)
+      rebind_mask |= BITFIELD_BIT(TC_BINDING_VERTEX_BUFFER);
+   if (bind_history & PIPE_BIND_STREAM_OUTPUT)
+      rebind_mask |= BITFIELD_BIT(TC_BINDING_STREAMOUT_BUFFER);
+   if (bind_history & PIPE_BIND_CONSTANT_BUFFER)
+      rebind_mask |= BITFIELD_RANGE(TC_BINDING_UBO_VS, PIPE_SHADER_TYPES);
+   if (bind_history & PIPE_BIND_SAMPLER_VIEW)
+      rebind_mask |= BITFIELD_RANGE(TC_BINDING_SAMPLERVIEW_VS,
+                                    PIPE_SHADER_TYPES);
+   if (bind_history & PIPE_BIND_SHADER_BUFFER)
+      rebind_mask |= BITFIELD_RANGE(TC_BINDING_SSBO_VS, PIPE_SHADER_TYPES);
+   if (bind_history & PIPE_BIND_SHADER_IMAGE)
+      rebind_mask |= BITFIELD_RANGE(TC_BINDING_IMAGE_VS, PIPE_SHADER_TYPES);
+
+   return rebind_mask;
 }
 
 void
 virgl_rebind_resource(struct virgl_context *vctx,
                       struct pipe_resource *res)
+{
+   const unsigned bind_history = virgl_resource(res)->bind_history;
+
+   virgl_rebind_resource_bindings(
+      vctx, res, virgl_rebind_mask_from_bind_history(bind_history));
+}
+
+void
+virgl_rebind_resource_bindings(struct virgl_context *vctx,
+                               struct pipe_resource *res,
+                               uint32_t rebind_mask)
 {
    /* Queries use internally created buffers and do not go through transfers.
     * Index buffers are not bindable.  They are not tracked.
@@ -91,14 +364,36 @@ virgl_rebind_resource(struct virgl_context *vctx,
    ASSERTED const unsigned tracked_bind = (PIPE_BIND_VERTEX_BUFFER |
                                                PIPE_BIND_CONSTANT_BUFFER |
                                                PIPE_BIND_SHADER_BUFFER |
-                                               PIPE_BIND_SHADER_IMAGE);
+                                               PIPE_BIND_SHADER_IMAGE |
+                                               PIPE_BIND_SAMPLER_VIEW |
+                                               PIPE_BIND_STREAM_OUTPUT);
    const unsigned bind_history = virgl_resource(res)->bind_history;
+   const uint32_t ssbo_mask =
+      BITFIELD_RANGE(TC_BINDING_SSBO_VS, PIPE_SHADER_TYPES);
    unsigned i;
 
    assert(virgl_can_rebind_resource(vctx, res) &&
           (bind_history & tracked_bind) == bind_history);
 
-   if (bind_history & PIPE_BIND_VERTEX_BUFFER) {
+   rebind_mask &= virgl_rebind_mask_from_bind_history(bind_history);
+
+   if (rebind_mask & BITFIELD_BIT(TC_BINDING_STREAMOUT_BUFFER)) {
+      bool rebind = false;
+
+      for (i = 0; i < vctx->num_so_targets; i++) {
+         if (vctx->so_targets[i] && vctx->so_targets[i]->buffer == res) {
+            virgl_so_target_revalidate(vctx,
+                                       virgl_so_target(vctx->so_targets[i]));
+            rebind = true;
+         }
+      }
+
+      if (rebind)
+         virgl_encoder_set_so_targets(vctx, vctx->num_so_targets,
+                                      vctx->so_targets, 0);
+   }
+
+   if (rebind_mask & BITFIELD_BIT(TC_BINDING_VERTEX_BUFFER)) {
       for (i = 0; i < vctx->num_vertex_buffers; i++) {
          if (vctx->vertex_buffer[i].buffer.resource == res) {
             vctx->vertex_array_dirty = true;
@@ -107,7 +402,10 @@ virgl_rebind_resource(struct virgl_context *vctx,
       }
    }
 
-   if (bind_history & PIPE_BIND_SHADER_BUFFER) {
+   /* hw atomic buffers are not tracked by u_threaded_context, which does
+    * not support them, so any shader buffer rebind covers them
+    */
+   if (rebind_mask & ssbo_mask) {
       uint32_t remaining_mask = vctx->atomic_buffer_enabled_mask;
       while (remaining_mask) {
          int i = u_bit_scan(&remaining_mask);
@@ -119,49 +417,68 @@ virgl_rebind_resource(struct virgl_context *vctx,
    }
 
    /* check per-stage shader bindings */
-   if (bind_history & (PIPE_BIND_CONSTANT_BUFFER |
-                       PIPE_BIND_SHADER_BUFFER |
-                       PIPE_BIND_SHADER_IMAGE)) {
-      enum pipe_shader_type shader_type;
-      for (shader_type = 0; shader_type < PIPE_SHADER_TYPES; shader_type++) {
-         const struct virgl_shader_binding_state *binding =
-            &vctx->shader_bindings[shader_type];
-
-         if (bind_history & PIPE_BIND_CONSTANT_BUFFER) {
-            uint32_t remaining_mask = binding->ubo_enabled_mask;
-            while (remaining_mask) {
-               int i = u_bit_scan(&remaining_mask);
-               if (binding->ubos[i].buffer == res) {
-                  const struct pipe_constant_buffer *ubo = &binding->ubos[i];
-                  virgl_encoder_set_uniform_buffer(vctx, shader_type, i,
-                                                   ubo->buffer_offset,
-                                                   ubo->buffer_size,
-                                                   virgl_resource(res));
-               }
+   enum pipe_shader_type shader_type;
+   for (shader_type = 0; shader_type < PIPE_SHADER_TYPES; shader_type++) {
+      const struct virgl_shader_binding_state *binding =
+         &vctx->shader_bindings[shader_type];
+
+      if (rebind_mask &
+          BITFIELD_BIT(TC_BINDING_SAMPLERVIEW_VS + shader_type)) {
+         bool views_changed = false;
+         for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+            struct virgl_sampler_view *view =
+               virgl_sampler_view(binding->views[i]);
+            if (view && view->base.texture == res) {
+               virgl_sampler_view_revalidate(vctx, view);
+               views_changed |=
+                  virgl_shadow_update(vctx,
+                                      &vctx->shadow.views[shader_type][i],
+                                      view->handle);
             }
          }
+         if (views_changed)
+            virgl_emit_sampler_views(vctx, shader_type, 0, 0);
+      }
 
-         if (bind_history & PIPE_BIND_SHADER_BUFFER) {
-            uint32_t remaining_mask = binding->ssbo_enabled_mask;
-            while (remaining_mask) {
-               int i = u_bit_scan(&remaining_mask);
-               if (binding->ssbos[i].buffer == res) {
-                  const struct pipe_shader_buffer *ssbo = &binding->ssbos[i];
-                  virgl_encode_set_shader_buffers(vctx, shader_type, i, 1,
-                                                  ssbo);
-               }
+      if (rebind_mask & BITFIELD_BIT(TC_BINDING_UBO_VS + shader_type)) {
+         uint32_t remaining_mask = binding->ubo_enabled_mask;
+         while (remaining_mask) {
+            int i = u_bit_scan(&remaining_mask);
+            if (binding->ubos[i].buffer == res) {
+               const struct pipe_constant_buffer *ubo = &binding->ubos[i];
+               if (!virgl_shadow_account(vctx,
+                      virgl_shadow_buffer_update(&vctx->shadow.ubos[shader_type][i],
+                                                 res, ubo->buffer_offset,
+                                                 ubo->buffer_size)))
+                  continue;
+               virgl_encoder_set_uniform_buffer(vctx, shader_type, i,
+                                                ubo->buffer_offset,
+                                                ubo->buffer_size,
+                                                virgl_resource(res));
             }
          }
+      }
 
-         if (bind_history & PIPE_BIND_SHADER_IMAGE) {
-            uint32_t remaining_mask = binding->image_enabled_mask;
-            while (remaining_mask) {
-               int i = u_bit_scan(&remaining_mask);
-               if (binding->images[i].resource == res) {
-                  const struct pipe_image_view *image = &binding->images[i];
-                  virgl_encode_set_shader_images(vctx, shader_type, i, 1,
-                                                 image);
-               }
+      if (rebind_mask & BITFIELD_BIT(TC_BINDING_SSBO_VS + shader_type)) {
+         uint32_t remaining_mask = binding->ssbo_enabled_mask;
+         while (remaining_mask) {
+            int i = u_bit_scan(&remaining_mask);
+            if (binding->ssbos[i].buffer == res) {
+               const struct pipe_shader_buffer *ssbo = &binding->ssbos[i];
+               virgl_encode_set_shader_buffers(vctx, shader_type, i, 1,
+                                               ssbo);
+            }
+         }
+      }
+
+      if (rebind_mask & BITFIELD_BIT(TC_BINDING_IMAGE_VS + shader_type)) {
+         uint32_t remaining_mask = binding->image_enabled_mask;
+         while (remaining_mask) {
+            int i = u_bit_scan(&remaining_mask);
+            if (binding->images[i].resource == res) {
+               const struct pipe_image_view *image = &binding->images[i];
+               virgl_encode_set_shader_images(vctx, shader_type, i, 1,
+                                              image);
             }
          }
       }
@@ -241,7 +558,9 @@ static void virgl_attach_res_so_targets(struct virgl_context *vctx)
    unsigned i;
 
    for (i = 0; i < vctx->num_so_targets; i++) {
-      res = virgl_resource(vctx->so_targets[i].base.buffer);
+      if (!vctx->so_targets[i])
+         continue;
+      res = virgl_resource(vctx->so_targets[i]->buffer);
       if (res)
          vws->emit_res(vws, vctx->cbuf, res->hw_res, false);
    }
@@ -345,13 +664,34 @@ static void virgl_reemit_compute_resources(struct virgl_context *vctx)
    virgl_attach_res_atomic_buffers(vctx);
 }
 
+struct virgl_create_surface_job {
+   struct virgl_deferred_job base;
+   struct pipe_surface *surf;
+};
+
+static bool
+virgl_create_surface_execute(struct virgl_context *vctx,
+                             struct virgl_deferred_job *_job)
+{
+   struct virgl_create_surface_job *job =
+      (struct virgl_create_surface_job *)_job;
+   struct virgl_surface *surf = virgl_surface(job->surf);
+   struct virgl_resource *res = virgl_resource(surf->base.texture);
+
+   virgl_resource_dirty(res, 0);
+   virgl_encoder_create_surface(vctx, surf->handle, res, &surf->base);
+
+   pipe_surface_reference(&job->surf, NULL);
+   return true;
+}
+
 static struct pipe_surface *virgl_create_surface(struct pipe_context *ctx,
                                                 struct pipe_resource *resource,
                                                 const struct pipe_surface *templ)
 {
    struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_surface_job *job;
    struct virgl_surface *surf;
-   struct virgl_resource *res = virgl_resource(resource);
    uint32_t handle;
 
    /* no support for buffer surfaces */
@@ -362,12 +702,17 @@ static struct pipe_surface *virgl_create_surface(struct pipe_context *ctx,
    if (!surf)
       return NULL;
 
+   job = CALLOC_STRUCT(virgl_create_surface_job);
+   if (!job) {
+      FREE(surf);
+      return NULL;
+   }
+
    assert(ctx->screen->get_param(ctx->screen,
                                  PIPE_CAP_DEST_SURFACE_SRGB_CONTROL) ||
           (util_format_is_srgb(templ->format) ==
            util_format_is_srgb(resource->format)));
 
-   virgl_resource_dirty(res, 0);
    handle = virgl_object_assign_handle();
    pipe_reference_init(&surf->base.reference, 1);
    pipe_resource_reference(&surf->base.texture, resource);
@@ -380,9 +725,12 @@ static struct pipe_surface *virgl_create_surface(struct pipe_context *ctx,
    surf->base.u.tex.first_layer = templ->u.tex.first_layer;
    surf->base.u.tex.last_layer = templ->u.tex.last_layer;
    surf->base.nr_samples = templ->nr_samples;
-
-   virgl_encoder_create_surface(vctx, handle, res, &surf->base);
    surf->handle = handle;
+
+   /* the surface must outlive the deferred encoding */
+   pipe_surface_reference(&job->surf, &surf->base);
+   virgl_context_defer(vctx, virgl_create_surface_execute, &job->base);
+
    return &surf->base;
 }
 
@@ -393,18 +741,42 @@ static void virgl_surface_destroy(struct pipe_context *ctx,
    struct virgl_surface *surf = virgl_surface(psurf);
 
    pipe_resource_reference(&surf->base.texture, NULL);
-   virgl_encode_delete_object(vctx, surf->handle, VIRGL_OBJECT_SURFACE);
+   virgl_context_delete_object(vctx, surf->handle, VIRGL_OBJECT_SURFACE);
    FREE(surf);
 }
 
+struct virgl_create_blend_job {
+   struct virgl_deferred_job base;
+   uint32_t handle;
+   struct pipe_blend_state state;
+};
+
+static bool
+virgl_create_blend_execute(struct virgl_context *vctx,
+                           struct virgl_deferred_job *_job)
+{
+   struct virgl_create_blend_job *job = (struct virgl_create_blend_job *)_job;
+
+   virgl_encode_blend_state(vctx, job->handle, &job->state);
+   return true;
+}
+
 static void *virgl_create_blend_state(struct pipe_context *ctx,
                                               const struct pipe_blend_state *blend_state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_blend_job *job;
    uint32_t handle;
+
+   job = MALLOC_STRUCT(virgl_create_blend_job);
+   if (!job)
+      return NULL;
+
    handle = virgl_object_assign_handle();
+   job->handle = handle;
+   job->state = *blend_state;
+   virgl_context_defer(vctx, virgl_create_blend_execute, &job->base);
 
-   virgl_encode_blend_state(vctx, handle, blend_state);
    return (void *)(unsigned long)handle;
 
 }
@@ -414,7 +786,9 @@ static void virgl_bind_blend_state(struct pipe_context *ctx,
 {
    struct virgl_context *vctx = virgl_context(ctx);
    uint32_t handle = (unsigned long)blend_state;
-   virgl_encode_bind_object(vctx, handle, VIRGL_OBJECT_BLEND);
+   if (virgl_shadow_update(vctx, &vctx->shadow.objects[VIRGL_OBJECT_BLEND],
+                           handle))
+      virgl_encode_bind_object(vctx, handle, VIRGL_OBJECT_BLEND);
 }
 
 static void virgl_delete_blend_state(struct pipe_context *ctx,
@@ -425,14 +799,38 @@ static void virgl_delete_blend_state(struct pipe_context *ctx,
    virgl_encode_delete_object(vctx, handle, VIRGL_OBJECT_BLEND);
 }
 
+struct virgl_create_dsa_job {
+   struct virgl_deferred_job base;
+   uint32_t handle;
+   struct pipe_depth_stencil_alpha_state state;
+};
+
+static bool
+virgl_create_dsa_execute(struct virgl_context *vctx,
+                         struct virgl_deferred_job *_job)
+{
+   struct virgl_create_dsa_job *job = (struct virgl_create_dsa_job *)_job;
+
+   virgl_encode_dsa_state(vctx, job->handle, &job->state);
+   return true;
+}
+
 static void *virgl_create_depth_stencil_alpha_state(struct pipe_context *ctx,
                                                    const struct pipe_depth_stencil_alpha_state *blend_state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_dsa_job *job;
    uint32_t handle;
+
+   job = MALLOC_STRUCT(virgl_create_dsa_job);
+   if (!job)
+      return NULL;
+
    handle = virgl_object_assign_handle();
+   job->handle = handle;
+   job->state = *blend_state;
+   virgl_context_defer(vctx, virgl_create_dsa_execute, &job->base);
 
-   virgl_encode_dsa_state(vctx, handle, blend_state);
    return (void *)(unsigned long)handle;
 }
 
@@ -441,7 +839,9 @@ static void virgl_bind_depth_stencil_alpha_state(struct pipe_context *ctx,
 {
    struct virgl_context *vctx = virgl_context(ctx);
    uint32_t handle = (unsigned long)blend_state;
-   virgl_encode_bind_object(vctx, handle, VIRGL_OBJECT_DSA);
+   if (virgl_shadow_update(vctx, &vctx->shadow.objects[VIRGL_OBJECT_DSA],
+                           handle))
+      virgl_encode_bind_object(vctx, handle, VIRGL_OBJECT_DSA);
 }
 
 static void virgl_delete_depth_stencil_alpha_state(struct pipe_context *ctx,
@@ -452,21 +852,47 @@ static void virgl_delete_depth_stencil_alpha_state(struct pipe_context *ctx,
    virgl_encode_delete_object(vctx, handle, VIRGL_OBJECT_DSA);
 }
 
+struct virgl_create_rasterizer_job {
+   struct virgl_deferred_job base;
+   /* Owned by the frontend, but only deleted after this job has run. */
+   const struct virgl_rasterizer_state *vrs;
+};
+
+static bool
+virgl_create_rasterizer_execute(struct virgl_context *vctx,
+                                struct virgl_deferred_job *_job)
+{
+   struct virgl_create_rasterizer_job *job =
+      (struct virgl_create_rasterizer_job *)_job;
+
+   virgl_encode_rasterizer_state(vctx, job->vrs->handle, &job->vrs->rs);
+   return true;
+}
+
 static void *virgl_create_rasterizer_state(struct pipe_context *ctx,
                                                    const struct pipe_rasterizer_state *rs_state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_rasterizer_state *vrs = CALLOC_STRUCT(virgl_rasterizer_state);
+   struct virgl_create_rasterizer_job *job;
 
    if (!vrs)
       return NULL;
+
+   job = MALLOC_STRUCT(virgl_create_rasterizer_job);
+   if (!job) {
+      FREE(vrs);
+      return NULL;
+   }
+
    vrs->rs = *rs_state;
    vrs->handle = virgl_object_assign_handle();
 
    assert(rs_state->depth_clip_near ||
           virgl_screen(ctx->screen)->caps.caps.v1.bset.depth_clip_disable);
 
-   virgl_encode_rasterizer_state(vctx, vrs->handle, rs_state);
+   job->vrs = vrs;
+   virgl_context_defer(vctx, virgl_create_rasterizer_execute, &job->base);
    return (void *)vrs;
 }
 
@@ -480,7 +906,9 @@ static void virgl_bind_rasterizer_state(struct pipe_context *ctx,
       vctx->rs_state = *vrs;
       handle = vrs->handle;
    }
-   virgl_encode_bind_object(vctx, handle, VIRGL_OBJECT_RASTERIZER);
+   if (virgl_shadow_update(vctx, &vctx->shadow.objects[VIRGL_OBJECT_RASTERIZER],
+                           handle))
+      virgl_encode_bind_object(vctx, handle, VIRGL_OBJECT_RASTERIZER);
 }
 
 static void virgl_delete_rasterizer_state(struct pipe_context *ctx,
@@ -511,15 +939,44 @@ static void virgl_set_viewport_states(struct pipe_context *ctx,
    virgl_encoder_set_viewport_states(vctx, start_slot, num_viewports, state);
 }
 
+struct virgl_create_vertex_elements_job {
+   struct virgl_deferred_job base;
+   uint32_t handle;
+   unsigned num_elements;
+   struct pipe_vertex_element elements[PIPE_MAX_ATTRIBS];
+};
+
+static bool
+virgl_create_vertex_elements_execute(struct virgl_context *vctx,
+                                     struct virgl_deferred_job *_job)
+{
+   struct virgl_create_vertex_elements_job *job =
+      (struct virgl_create_vertex_elements_job *)_job;
+
+   virgl_encoder_create_vertex_elements(vctx, job->handle,
+                                        job->num_elements, job->elements);
+   return true;
+}
+
 static void *virgl_create_vertex_elements_state(struct pipe_context *ctx,
                                                         unsigned num_elements,
                                                         const struct pipe_vertex_element *elements)
 {
    struct pipe_vertex_element new_elements[PIPE_MAX_ATTRIBS];
    struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_vertex_elements_job *job;
    struct virgl_vertex_elements_state *state =
       CALLOC_STRUCT(virgl_vertex_elements_state);
 
+   if (!state)
+      return NULL;
+
+   job = MALLOC_STRUCT(virgl_create_vertex_elements_job);
+   if (!job) {
+      FREE(state);
+      return NULL;
+   }
+
    for (int i = 0; i < num_elements; ++i) {
       if (elements[i].instance_divisor) {
          /* Virglrenderer doesn't deal with instance_divisor correctly if
@@ -540,8 +997,12 @@ static void *virgl_create_vertex_elements_state(struct pipe_context *ctx,
       state->strides[elements[i].vertex_buffer_index] = elements[i].src_stride;
 
    state->handle = virgl_object_assign_handle();
-   virgl_encoder_create_vertex_elements(vctx, state->handle,
-                                       num_elements, elements);
+
+   job->handle = state->handle;
+   job->num_elements = num_elements;
+   memcpy(job->elements, elements, num_elements * sizeof(*elements));
+   virgl_context_defer(vctx, virgl_create_vertex_elements_execute,
+                       &job->base);
    return state;
 }
 
@@ -561,9 +1022,13 @@ static void virgl_bind_vertex_elements_state(struct pipe_context *ctx,
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_vertex_elements_state *state =
       (struct virgl_vertex_elements_state *)ve;
+   uint32_t handle = state ? state->handle : 0;
+
    vctx->vertex_elements = state;
-   virgl_encode_bind_object(vctx, state ? state->handle : 0,
-                            VIRGL_OBJECT_VERTEX_ELEMENTS);
+   if (virgl_shadow_update(vctx,
+                           &vctx->shadow.objects[VIRGL_OBJECT_VERTEX_ELEMENTS],
+                           handle))
+      virgl_encode_bind_object(vctx, handle, VIRGL_OBJECT_VERTEX_ELEMENTS);
    vctx->vertex_array_dirty = true;
 }
 
@@ -590,19 +1055,49 @@ static void virgl_set_vertex_buffers(struct pipe_context *ctx,
    vctx->vertex_array_dirty = true;
 }
 
+/* The encoded vertex buffer state also depends on the strides of the bound
+ * vertex elements, so it is diffed as a whole.
+ */
+static bool
+virgl_shadow_update_vertex_buffers(struct virgl_context *vctx,
+                                   unsigned num_buffers,
+                                   const struct pipe_vertex_buffer *buffers)
+{
+   struct virgl_shadow_state *shadow = &vctx->shadow;
+   const struct virgl_vertex_elements_state *ve = vctx->vertex_elements;
+   bool changed = shadow->num_vertex_buffers != num_buffers;
+   unsigned i;
+
+   for (i = 0; i < num_buffers; i++) {
+      changed |= virgl_shadow_buffer_update(&shadow->vertex_buffers[i],
+                                            buffers[i].buffer.resource,
+                                            buffers[i].buffer_offset,
+                                            ve ? ve->strides[i] : 0);
+   }
+   for (; i < PIPE_MAX_ATTRIBS; i++)
+      virgl_shadow_buffer_clear(&shadow->vertex_buffers[i]);
+
+   shadow->num_vertex_buffers = num_buffers;
+   return virgl_shadow_account(vctx, changed);
+}
+
 static void virgl_hw_set_vertex_buffers(struct virgl_context *vctx)
 {
    if (vctx->vertex_array_dirty) {
       const struct virgl_vertex_elements_state *ve = vctx->vertex_elements;
+      struct pipe_vertex_buffer vertex_buffers[PIPE_MAX_ATTRIBS];
+      const struct pipe_vertex_buffer *buffers = vctx->vertex_buffer;
+      unsigned num_buffers = vctx->num_vertex_buffers;
 
       if (ve && ve->num_bindings) {
-         struct pipe_vertex_buffer vertex_buffers[PIPE_MAX_ATTRIBS];
          for (int i = 0; i < ve->num_bindings; ++i)
             vertex_buffers[i] = vctx->vertex_buffer[ve->binding_map[i]];
+         buffers = vertex_buffers;
+         num_buffers = ve->num_bindings;
+      }
 
-         virgl_encoder_set_vertex_buffers(vctx, ve->num_bindings, vertex_buffers);
-      } else
-         virgl_encoder_set_vertex_buffers(vctx, vctx->num_vertex_buffers, vctx->vertex_buffer);
+      if (virgl_shadow_update_vertex_buffers(vctx, num_buffers, buffers))
+         virgl_encoder_set_vertex_buffers(vctx, num_buffers, buffers);
 
       virgl_attach_res_vertex_buffers(vctx);
 
@@ -644,9 +1139,14 @@ static void virgl_set_constant_buffer(struct pipe_context *ctx,
       struct virgl_resource *res = virgl_resource(buf->buffer);
       res->bind_history |= PIPE_BIND_CONSTANT_BUFFER;
 
-      virgl_encoder_set_uniform_buffer(vctx, shader, index,
-                                       buf->buffer_offset,
-                                       buf->buffer_size, res);
+      if (virgl_shadow_account(vctx,
+             virgl_shadow_buffer_update(&vctx->shadow.ubos[shader][index],
+                                        buf->buffer, buf->buffer_offset,
+                                        buf->buffer_size))) {
+         virgl_encoder_set_uniform_buffer(vctx, shader, index,
+                                          buf->buffer_offset,
+                                          buf->buffer_size, res);
+      }
 
       if (take_ownership) {
          pipe_resource_reference(&binding->ubos[index].buffer, NULL);
@@ -660,9 +1160,11 @@ static void virgl_set_constant_buffer(struct pipe_context *ctx,
       static const struct pipe_constant_buffer dummy_ubo;
       if (!buf)
          buf = &dummy_ubo;
+      /* User constants are inline data and always sent. */
       virgl_encoder_write_constant_buffer(vctx, shader, index,
                                           buf->buffer_size / 4,
                                           buf->user_buffer);
+      virgl_shadow_buffer_clear(&vctx->shadow.ubos[shader][index]);
 
       pipe_resource_reference(&binding->ubos[index].buffer, NULL);
       binding->ubo_enabled_mask &= ~(1 << index);
@@ -694,82 +1196,284 @@ lower_gles_arrayshadow_offset_filter(const nir_instr *instr,
    return false;
 }
 
-static void *virgl_shader_encoder(struct pipe_context *ctx,
-                                  const struct pipe_shader_state *shader,
-                                  unsigned type)
-{
-   struct virgl_context *vctx = virgl_context(ctx);
-   struct virgl_screen *rs = virgl_screen(ctx->screen);
+struct virgl_create_shader_job {
+   struct virgl_deferred_job base;
    uint32_t handle;
+   enum pipe_shader_type type;
+   struct pipe_stream_output_info stream_output;
+   unsigned static_shared_mem;
+   /* The translated shader, owned by the job: the serialized NIR when
+    * is_nir is set, the TGSI text otherwise.
+    */
+   bool is_nir;
+   struct blob nir;
+   char *text;
+   uint32_t num_tokens;
+};
+
+/* The parts of virgl_tgsi_transform() that work around host limits rather
+ * than TGSI quirks, for shaders sent as NIR.  Doubles on GLES hosts are
+ * dropped by the TGSI path, and there is nothing to tell a host without
+ * cull distance support about them, so these shaders still go through TGSI.
+ */
+static bool
+virgl_nir_can_send(const struct virgl_screen *rs, const nir_shader *s)
+{
+   if (!rs->caps.caps.v1.bset.has_cull && s->info.cull_distance_array_size)
+      return false;
+
+   if (!(rs->caps.caps.v2.capability_bits & VIRGL_CAP_HOST_IS_GLES))
+      return true;
+
+   nir_foreach_function_impl(impl, s) {
+      nir_foreach_block(block, impl) {
+         nir_foreach_instr(instr, block) {
+            if (instr->type != nir_instr_type_alu)
+               continue;
+
+            nir_alu_instr *alu = nir_instr_as_alu(instr);
+            const nir_op_info *info = &nir_op_infos[alu->op];
+
+            if (nir_alu_type_get_base_type(info->output_type) == nir_type_float &&
+                alu->def.bit_size == 64)
+               return false;
+            for (unsigned i = 0; i < info->num_inputs; i++) {
+               if (nir_alu_type_get_base_type(info->input_types[i]) == nir_type_float &&
+                   nir_src_bit_size(alu->src[i].src) == 64)
+                  return false;
+            }
+         }
+      }
+   }
+   return true;
+}
+
+static void
+virgl_nir_lower_for_host(const struct virgl_screen *rs, nir_shader *s,
+                         bool is_separable)
+{
+   s->info.separate_shader = is_separable &&
+      (rs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_SSO);
+
+   if (rs->caps.caps.v2.capability_bits & VIRGL_CAP_TGSI_PRECISE)
+      return;
+
+   nir_foreach_function_impl(impl, s) {
+      nir_foreach_block(block, impl) {
+         nir_foreach_instr(instr, block) {
+            if (instr->type == nir_instr_type_alu)
+               nir_instr_as_alu(instr)->exact = false;
+         }
+      }
+   }
+}
+
+/* Serialize a shader for a host that consumes NIR.  Takes ownership of s. */
+static bool
+virgl_translate_shader_nir(struct virgl_create_shader_job *job,
+                           nir_shader *s)
+{
+   blob_init(&job->nir);
+   nir_serialize(&job->nir, s, true);
+
+   if (virgl_debug & VIRGL_DEBUG_TGSI)
+      nir_print_shader(s, stderr);
+
+   ralloc_free(s);
+
+   if (job->nir.out_of_memory) {
+      blob_finish(&job->nir);
+      return false;
+   }
+
+   job->is_nir = true;
+   return true;
+}
+
+/* Translate the shader to what the host consumes, serialized NIR or TGSI
+ * text, and store it in the job.  This is done before any handle is handed
+ * out so that translation failures are reported to the caller, only the
+ * encoding of the result is deferred.
+ */
+static bool
+virgl_translate_shader(struct virgl_context *vctx,
+                       struct virgl_create_shader_job *job,
+                       enum pipe_shader_ir ir_type,
+                       const void *ir)
+{
+   struct virgl_screen *rs = virgl_screen(vctx->base.screen);
    const struct tgsi_token *tokens;
    const struct tgsi_token *ntt_tokens = NULL;
    struct tgsi_token *new_tokens;
-   int ret;
+   cache_key key;
    bool is_separable = false;
 
-   if (shader->type == PIPE_SHADER_IR_NIR) {
-      struct nir_to_tgsi_options options = {
-         .unoptimized_ra = true,
-         .lower_fabs = true,
-         .lower_ssbo_bindings =
-               rs->caps.caps.v2.host_feature_check_version >= 16,
-         .non_compute_membar_needs_all_modes = true
-      };
+   if (ir_type != PIPE_SHADER_IR_NIR) {
+      tokens = ir;
+   } else {
+      const nir_shader *nir = ir;
+      const bool send_nir = rs->nir_shaders && virgl_nir_can_send(rs, nir);
+
+      if (!send_nir) {
+         virgl_shader_cache_compute_key(rs, nir, key);
+         job->text = virgl_shader_cache_find(rs, key, &job->num_tokens);
+         if (job->text)
+            return true;
+      }
 
-      if (!(rs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_TEXTURE_SHADOW_LOD) &&
-          rs->caps.caps.v2.capability_bits & VIRGL_CAP_HOST_IS_GLES) {
-         nir_lower_tex_options lower_tex_options = {
-            .lower_offset_filter = lower_gles_arrayshadow_offset_filter,
+      nir_shader *s = nir_shader_clone(NULL, nir);
+      if (!s)
+         return false;
+
+      if (job->type == PIPE_SHADER_COMPUTE) {
+         if (send_nir) {
+            virgl_nir_lower_for_host(rs, s, false);
+            return virgl_translate_shader_nir(job, s);
+         }
+
+         struct nir_to_tgsi_options options = {
+            .unoptimized_ra = true,
+            .lower_fabs = true
          };
+         ntt_tokens = tokens = nir_to_tgsi_options(s, vctx->base.screen, &options); /* takes ownership */
+      } else {
+         struct nir_to_tgsi_options options = {
+            .unoptimized_ra = true,
+            .lower_fabs = true,
+            .lower_ssbo_bindings =
+                  rs->caps.caps.v2.host_feature_check_version >= 16,
+            .non_compute_membar_needs_all_modes = true
+         };
+
+         if (!(rs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_TEXTURE_SHADOW_LOD) &&
+             rs->caps.caps.v2.capability_bits & VIRGL_CAP_HOST_IS_GLES) {
+            nir_lower_tex_options lower_tex_options = {
+               .lower_offset_filter = lower_gles_arrayshadow_offset_filter,
+            };
 
-         NIR_PASS_V(shader->ir.nir, nir_lower_tex, &lower_tex_options);
+            NIR_PASS_V(s, nir_lower_tex, &lower_tex_options);
+         }
+
+         /* The host can't handle certain IO slots as separable, because we can't assign
+          * more than 32 IO locations explicitly, and with varyings and patches we already
+          * exhaust the possible ways of handling this for the varyings with generic names,
+          * so drop the flag in these cases */
+         const uint64_t drop_slots_for_separable_io = 0xffull << VARYING_SLOT_TEX0 |
+                                                           1 <<  VARYING_SLOT_FOGC |
+                                                           1 <<  VARYING_SLOT_BFC0 |
+                                                           1 <<  VARYING_SLOT_BFC1 |
+                                                           1 <<  VARYING_SLOT_COL0 |
+                                                           1 <<  VARYING_SLOT_COL1;
+         bool keep_separable_flags = true;
+         if (s->info.stage != MESA_SHADER_VERTEX)
+            keep_separable_flags &= !(s->info.inputs_read & drop_slots_for_separable_io);
+         if (s->info.stage != MESA_SHADER_FRAGMENT)
+            keep_separable_flags &= !(s->info.outputs_written & drop_slots_for_separable_io);
+
+         /* Propagare the separable shader property to the host, unless
+          * it is an internal shader - these are marked separable even though they are not. */
+         is_separable = s->info.separate_shader && !s->info.internal && keep_separable_flags;
+
+         /* The host consumes the serialized NIR directly, so skip the TGSI
+          * translation and the text dump entirely. */
+         if (send_nir) {
+            virgl_nir_lower_for_host(rs, s, is_separable);
+            return virgl_translate_shader_nir(job, s);
+         }
+
+         ntt_tokens = tokens = nir_to_tgsi_options(s, vctx->base.screen, &options); /* takes ownership */
       }
+   }
+
+   new_tokens = virgl_tgsi_transform(rs, tokens, is_separable);
+   if (!new_tokens) {
+      FREE((void *)ntt_tokens);
+      return false;
+   }
+
+   job->text = virgl_shader_tokens_to_text(new_tokens, &job->num_tokens);
+
+   /* Only shaders that came in as NIR have a cache key. */
+   if (job->text && ntt_tokens)
+      virgl_shader_cache_insert(rs, key, job->text, job->num_tokens);
+
+   FREE((void *)ntt_tokens);
+   FREE(new_tokens);
+
+   return job->text != NULL;
+}
 
-      nir_shader *s = nir_shader_clone(NULL, shader->ir.nir);
-
-      /* The host can't handle certain IO slots as separable, because we can't assign
-       * more than 32 IO locations explicitly, and with varyings and patches we already
-       * exhaust the possible ways of handling this for the varyings with generic names,
-       * so drop the flag in these cases */
-      const uint64_t drop_slots_for_separable_io = 0xffull << VARYING_SLOT_TEX0 |
-                                                        1 <<  VARYING_SLOT_FOGC |
-                                                        1 <<  VARYING_SLOT_BFC0 |
-                                                        1 <<  VARYING_SLOT_BFC1 |
-                                                        1 <<  VARYING_SLOT_COL0 |
-                                                        1 <<  VARYING_SLOT_COL1;
-      bool keep_separable_flags = true;
-      if (s->info.stage != MESA_SHADER_VERTEX)
-         keep_separable_flags &= !(s->info.inputs_read & drop_slots_for_separable_io);
-      if (s->info.stage != MESA_SHADER_FRAGMENT)
-         keep_separable_flags &= !(s->info.outputs_written & drop_slots_for_separable_io);
-
-      /* Propagare the separable shader property to the host, unless
-       * it is an internal shader - these are marked separable even though they are not. */
-      is_separable = s->info.separate_shader && !s->info.internal && keep_separable_flags;
-      ntt_tokens = tokens = nir_to_tgsi_options(s, vctx->base.screen, &options); /* takes ownership */
+static bool
+virgl_create_shader_execute(struct virgl_context *vctx,
+                            struct virgl_deferred_job *_job)
+{
+   struct virgl_create_shader_job *job =
+      (struct virgl_create_shader_job *)_job;
+
+   if (job->is_nir) {
+      virgl_encode_shader_nir(vctx, job->handle, job->type,
+                              &job->stream_output, job->static_shared_mem,
+                              job->nir.data, job->nir.size);
+      blob_finish(&job->nir);
    } else {
-      tokens = shader->tokens;
+      virgl_encode_shader_text(vctx, job->handle, job->type,
+                               &job->stream_output, job->static_shared_mem,
+                               job->num_tokens, job->text);
+      FREE(job->text);
    }
 
-   new_tokens = virgl_tgsi_transform(rs, tokens, is_separable);
-   if (!new_tokens)
+   return true;
+}
+
+/* The translation happens right away, on the frontend thread with the
+ * threaded context, so that failures can be returned.  Only the encoding,
+ * which cannot fail, is deferred to the driver thread.
+ */
+static void *virgl_create_shader(struct pipe_context *ctx,
+                                 enum pipe_shader_type type,
+                                 enum pipe_shader_ir ir_type,
+                                 const void *ir,
+                                 const struct pipe_stream_output_info *so_info,
+                                 unsigned static_shared_mem)
+{
+   struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_shader_job *job;
+   uint32_t handle;
+
+   job = CALLOC_STRUCT(virgl_create_shader_job);
+   if (!job)
       return NULL;
 
-   handle = virgl_object_assign_handle();
-   /* encode VS state */
-   ret = virgl_encode_shader_state(vctx, handle, type,
-                                   &shader->stream_output, 0,
-                                   new_tokens);
-   if (ret) {
-      FREE((void *)ntt_tokens);
+   job->type = type;
+   if (so_info)
+      job->stream_output = *so_info;
+   job->static_shared_mem = static_shared_mem;
+
+   if (!virgl_translate_shader(vctx, job, ir_type, ir)) {
+      FREE(job);
       return NULL;
    }
 
-   FREE((void *)ntt_tokens);
-   FREE(new_tokens);
+   handle = virgl_object_assign_handle();
+   job->handle = handle;
+
+   virgl_context_defer(vctx, virgl_create_shader_execute, &job->base);
+
    return (void *)(unsigned long)handle;
+}
+
+static void *virgl_shader_encoder(struct pipe_context *ctx,
+                                  const struct pipe_shader_state *shader,
+                                  unsigned type)
+{
+   if (shader->type == PIPE_SHADER_IR_NIR)
+      return virgl_create_shader(ctx, type, PIPE_SHADER_IR_NIR,
+                                 shader->ir.nir, &shader->stream_output, 0);
 
+   return virgl_create_shader(ctx, type, PIPE_SHADER_IR_TGSI,
+                              shader->tokens, &shader->stream_output, 0);
 }
+
 static void *virgl_create_vs_state(struct pipe_context *ctx,
                                    const struct pipe_shader_state *shader)
 {
@@ -856,7 +1560,9 @@ static void virgl_bind_vs_state(struct pipe_context *ctx,
    uint32_t handle = (unsigned long)vss;
    struct virgl_context *vctx = virgl_context(ctx);
 
-   virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_VERTEX);
+   if (virgl_shadow_update(vctx, &vctx->shadow.shaders[PIPE_SHADER_VERTEX],
+                           handle))
+      virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_VERTEX);
 }
 
 static void virgl_bind_tcs_state(struct pipe_context *ctx,
@@ -865,7 +1571,9 @@ static void virgl_bind_tcs_state(struct pipe_context *ctx,
    uint32_t handle = (unsigned long)vss;
    struct virgl_context *vctx = virgl_context(ctx);
 
-   virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_TESS_CTRL);
+   if (virgl_shadow_update(vctx, &vctx->shadow.shaders[PIPE_SHADER_TESS_CTRL],
+                           handle))
+      virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_TESS_CTRL);
 }
 
 static void virgl_bind_tes_state(struct pipe_context *ctx,
@@ -874,7 +1582,9 @@ static void virgl_bind_tes_state(struct pipe_context *ctx,
    uint32_t handle = (unsigned long)vss;
    struct virgl_context *vctx = virgl_context(ctx);
 
-   virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_TESS_EVAL);
+   if (virgl_shadow_update(vctx, &vctx->shadow.shaders[PIPE_SHADER_TESS_EVAL],
+                           handle))
+      virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_TESS_EVAL);
 }
 
 static void virgl_bind_gs_state(struct pipe_context *ctx,
@@ -883,7 +1593,9 @@ static void virgl_bind_gs_state(struct pipe_context *ctx,
    uint32_t handle = (unsigned long)vss;
    struct virgl_context *vctx = virgl_context(ctx);
 
-   virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_GEOMETRY);
+   if (virgl_shadow_update(vctx, &vctx->shadow.shaders[PIPE_SHADER_GEOMETRY],
+                           handle))
+      virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_GEOMETRY);
 }
 
 
@@ -893,7 +1605,9 @@ static void virgl_bind_fs_state(struct pipe_context *ctx,
    uint32_t handle = (unsigned long)vss;
    struct virgl_context *vctx = virgl_context(ctx);
 
-   virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_FRAGMENT);
+   if (virgl_shadow_update(vctx, &vctx->shadow.shaders[PIPE_SHADER_FRAGMENT],
+                           handle))
+      virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_FRAGMENT);
 }
 
 static void virgl_clear(struct pipe_context *ctx,
@@ -989,6 +1703,104 @@ static void virgl_clear_texture(struct pipe_context *ctx,
    virgl_resource_dirty(vres, level);
 }
 
+static bool
+virgl_can_draw_multi(struct virgl_context *vctx,
+                     const struct pipe_draw_info *dinfo,
+                     const struct pipe_draw_indirect_info *indirect)
+{
+   struct virgl_screen *rs = virgl_screen(vctx->base.screen);
+
+   return !indirect &&
+          (rs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_MULTI_DRAW) &&
+          (rs->caps.caps.v1.prim_mask & (1 << dinfo->mode));
+}
+
+/* Encode a multi-draw as VIRGL_CCMD_DRAW_MULTI commands of up to
+ * VIRGL_DRAW_MULTI_MAX_DRAWS records, instead of one VIRGL_CCMD_DRAW_VBO
+ * per draw.
+ */
+static void
+virgl_draw_vbo_multi(struct virgl_context *vctx,
+                     const struct pipe_draw_info *dinfo,
+                     unsigned drawid_offset,
+                     const struct pipe_draw_start_count_bias *draws,
+                     unsigned num_draws)
+{
+   struct pipe_draw_start_count_bias records[VIRGL_DRAW_MULTI_MAX_DRAWS];
+   struct virgl_indexbuf ib = { 0 };
+   unsigned min_start = ~0u, max_end = 0;
+   unsigned first = 0, drawid = drawid_offset;
+
+   if (!dinfo->instance_count)
+      return;
+
+   for (unsigned i = 0; i < num_draws; i++) {
+      if (!draws[i].count)
+         continue;
+      min_start = MIN2(min_start, draws[i].start);
+      max_end = MAX2(max_end, draws[i].start + draws[i].count);
+   }
+   if (min_start >= max_end)
+      return;
+
+   if (dinfo->index_size) {
+      ib.index_size = dinfo->index_size;
+      if (dinfo->has_user_indices) {
+         /* upload the indices of all draws at once; starts are rebased */
+         u_upload_data(vctx->uploader, 0,
+                       (max_end - min_start) * ib.index_size, 4,
+                       (const char *)dinfo->index.user + min_start * ib.index_size,
+                       &ib.offset, &ib.buffer);
+      } else {
+         pipe_resource_reference(&ib.buffer, dinfo->index.resource);
+         min_start = 0;
+      }
+      virgl_hw_set_index_buffer(vctx, &ib);
+   } else {
+      min_start = 0;
+   }
+
+   while (first < num_draws) {
+      unsigned count = 0;
+
+      /* Empty draws are dropped unless they occupy a draw id. */
+      for (; first < num_draws && count < VIRGL_DRAW_MULTI_MAX_DRAWS; first++) {
+         struct pipe_draw_start_count_bias *draw = &records[count];
+
+         *draw = draws[first];
+         if (!dinfo->primitive_restart)
+            u_trim_pipe_prim(dinfo->mode, &draw->count);
+         if (!draw->count && !dinfo->increment_draw_id)
+            continue;
+
+         draw->start = draw->count ? draw->start - min_start : 0;
+         count++;
+      }
+      if (!count)
+         break;
+
+      /* Keep the command and the resources it uses in the same cbuf. */
+      if (vctx->cbuf->cdw + VIRGL_DRAW_MULTI_SIZE(count) + 1 >
+          VIRGL_MAX_CMDBUF_DWORDS)
+         vctx->base.flush(&vctx->base, NULL, 0);
+
+      if (!vctx->num_draws) {
+         virgl_reemit_draw_resources(vctx);
+         if (ib.buffer)
+            virgl_attach_res_index_buffer(vctx, &ib);
+      }
+      vctx->num_draws++;
+
+      virgl_hw_set_vertex_buffers(vctx);
+
+      virgl_encoder_draw_multi(vctx, dinfo, drawid, records, count);
+      if (dinfo->increment_draw_id)
+         drawid += count;
+   }
+
+   pipe_resource_reference(&ib.buffer, NULL);
+}
+
 static void virgl_draw_vbo(struct pipe_context *ctx,
                            const struct pipe_draw_info *dinfo,
                            unsigned drawid_offset,
@@ -997,7 +1809,12 @@ static void virgl_draw_vbo(struct pipe_context *ctx,
                            unsigned num_draws)
 {
    if (num_draws > 1) {
-      util_draw_multi(ctx, dinfo, drawid_offset, indirect, draws, num_draws);
+      struct virgl_context *vctx = virgl_context(ctx);
+
+      if (virgl_can_draw_multi(vctx, dinfo, indirect))
+         virgl_draw_vbo_multi(vctx, dinfo, drawid_offset, draws, num_draws);
+      else
+         util_draw_multi(ctx, dinfo, drawid_offset, indirect, draws, num_draws);
       return;
    }
 
@@ -1064,11 +1881,27 @@ static void virgl_submit_cmd(struct virgl_winsys *vws,
    }
 }
 
+/* Append a command buffer to the VIRGL_CMDBUF_CAPTURE file as its size in
+ * dwords followed by the dwords, for replaying with virgl_compress_bench.
+ */
+static void virgl_capture_cmd_buf(struct virgl_screen *rs,
+                                  const struct virgl_cmd_buf *cbuf)
+{
+   const uint32_t dwords = cbuf->cdw;
+
+   simple_mtx_lock(&rs->cmdbuf_capture_mutex);
+   fwrite(&dwords, sizeof(dwords), 1, rs->cmdbuf_capture);
+   fwrite(cbuf->buf, sizeof(uint32_t), dwords, rs->cmdbuf_capture);
+   simple_mtx_unlock(&rs->cmdbuf_capture_mutex);
+}
+
 void virgl_flush_eq(struct virgl_context *ctx, void *closure,
                     struct pipe_fence_handle **fence)
 {
    struct virgl_screen *rs = virgl_screen(ctx->base.screen);
 
+   virgl_emit_pending_deletes(ctx);
+
    /* skip empty cbuf */
    if (ctx->cbuf->cdw == ctx->cbuf_initial_cdw &&
        ctx->queue.num_dwords == 0 &&
@@ -1083,7 +1916,13 @@ void virgl_flush_eq(struct virgl_context *ctx, void *closure,
 
    virgl_transfer_queue_clear(&ctx->queue, ctx->cbuf);
 
+   if (unlikely(rs->cmdbuf_capture))
+      virgl_capture_cmd_buf(rs, ctx->cbuf);
+
    virgl_submit_cmd(rs->vws, ctx->cbuf, fence);
+   tc_driver_internal_flush_notify(ctx->tc);
+
+   virgl_resource_issue_readbacks(ctx);
 
    /* Reserve some space for transfers. */
    if (ctx->encoded_transfers)
@@ -1108,14 +1947,35 @@ static void virgl_flush_from_st(struct pipe_context *ctx,
    virgl_flush_eq(vctx, vctx, fence);
 }
 
+struct virgl_create_sampler_view_job {
+   struct virgl_deferred_job base;
+   struct pipe_sampler_view *view;
+};
+
+static bool
+virgl_create_sampler_view_execute(struct virgl_context *vctx,
+                                  struct virgl_deferred_job *_job)
+{
+   struct virgl_create_sampler_view_job *job =
+      (struct virgl_create_sampler_view_job *)_job;
+   struct virgl_sampler_view *grview = virgl_sampler_view(job->view);
+   struct virgl_resource *res = virgl_resource(grview->base.texture);
+
+   virgl_encode_sampler_view(vctx, grview->handle, res, &grview->base);
+   grview->storage_generation = res->storage_generation;
+
+   pipe_sampler_view_reference(&job->view, NULL);
+   return true;
+}
+
 static struct pipe_sampler_view *virgl_create_sampler_view(struct pipe_context *ctx,
                                       struct pipe_resource *texture,
                                       const struct pipe_sampler_view *state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_sampler_view_job *job;
    struct virgl_sampler_view *grview;
    uint32_t handle;
-   struct virgl_resource *res;
 
    if (!state)
       return NULL;
@@ -1124,9 +1984,13 @@ static struct pipe_sampler_view *virgl_create_sampler_view(struct pipe_context *
    if (!grview)
       return NULL;
 
-   res = virgl_resource(texture);
+   job = CALLOC_STRUCT(virgl_create_sampler_view_job);
+   if (!job) {
+      FREE(grview);
+      return NULL;
+   }
+
    handle = virgl_object_assign_handle();
-   virgl_encode_sampler_view(vctx, handle, res, state);
 
    grview->base = *state;
    grview->base.reference.count = 1;
@@ -1135,6 +1999,11 @@ static struct pipe_sampler_view *virgl_create_sampler_view(struct pipe_context *
    grview->base.context = ctx;
    pipe_resource_reference(&grview->base.texture, texture);
    grview->handle = handle;
+
+   /* the view must outlive the deferred encoding */
+   pipe_sampler_view_reference(&job->view, &grview->base);
+   virgl_context_defer(vctx, virgl_create_sampler_view_execute, &job->base);
+
    return &grview->base;
 }
 
@@ -1155,6 +2024,7 @@ static void virgl_set_sampler_views(struct pipe_context *ctx,
       if (views && views[i]) {
          struct virgl_resource *res = virgl_resource(views[i]->texture);
          res->bind_history |= PIPE_BIND_SAMPLER_VIEW;
+         virgl_sampler_view_revalidate(vctx, virgl_sampler_view(views[i]));
 
          if (take_ownership) {
             pipe_sampler_view_reference(&binding->views[idx], NULL);
@@ -1167,8 +2037,16 @@ static void virgl_set_sampler_views(struct pipe_context *ctx,
       }
    }
 
-   virgl_encode_set_sampler_views(vctx, shader_type,
-         start_slot, num_views, (struct virgl_sampler_view **)binding->views);
+   uint32_t handles[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   unsigned start = start_slot, count = num_views;
+   for (unsigned i = 0; i < num_views; i++) {
+      struct pipe_sampler_view *view = binding->views[start_slot + i];
+      handles[i] = view ? virgl_sampler_view(view)->handle : 0;
+   }
+
+   if (virgl_shadow_update_range(vctx, vctx->shadow.views[shader_type],
+                                 handles, &start, &count))
+      virgl_emit_sampler_views(vctx, shader_type, start, start + count);
    virgl_attach_res_sampler_views(vctx, shader_type);
 
    if (unbind_num_trailing_slots) {
@@ -1195,20 +2073,45 @@ static void virgl_destroy_sampler_view(struct pipe_context *ctx,
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_sampler_view *grview = virgl_sampler_view(view);
 
-   virgl_encode_delete_object(vctx, grview->handle, VIRGL_OBJECT_SAMPLER_VIEW);
+   virgl_context_delete_object(vctx, grview->handle,
+                               VIRGL_OBJECT_SAMPLER_VIEW);
    pipe_resource_reference(&view->texture, NULL);
    FREE(view);
 }
 
+struct virgl_create_sampler_job {
+   struct virgl_deferred_job base;
+   uint32_t handle;
+   struct pipe_sampler_state state;
+};
+
+static bool
+virgl_create_sampler_execute(struct virgl_context *vctx,
+                             struct virgl_deferred_job *_job)
+{
+   struct virgl_create_sampler_job *job =
+      (struct virgl_create_sampler_job *)_job;
+
+   virgl_encode_sampler_state(vctx, job->handle, &job->state);
+   return true;
+}
+
 static void *virgl_create_sampler_state(struct pipe_context *ctx,
                                         const struct pipe_sampler_state *state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_sampler_job *job;
    uint32_t handle;
 
+   job = MALLOC_STRUCT(virgl_create_sampler_job);
+   if (!job)
+      return NULL;
+
    handle = virgl_object_assign_handle();
+   job->handle = handle;
+   job->state = *state;
+   virgl_context_defer(vctx, virgl_create_sampler_execute, &job->base);
 
-   virgl_encode_sampler_state(vctx, handle, state);
    return (void *)(unsigned long)handle;
 }
 
@@ -1229,11 +2132,14 @@ static void virgl_bind_sampler_states(struct pipe_context *ctx,
 {
    struct virgl_context *vctx = virgl_context(ctx);
    uint32_t handles[PIPE_MAX_SAMPLERS];
+   unsigned start = start_slot, count = num_samplers;
    int i;
    for (i = 0; i < num_samplers; i++) {
       handles[i] = (unsigned long)(samplers[i]);
    }
-   virgl_encode_bind_sampler_states(vctx, shader, start_slot, num_samplers, handles);
+   if (virgl_shadow_update_range(vctx, vctx->shadow.samplers[shader],
+                                 handles, &start, &count))
+      virgl_emit_sampler_states(vctx, shader, start + count);
 }
 
 static void virgl_set_polygon_stipple(struct pipe_context *ctx,
@@ -1308,14 +2214,15 @@ static void virgl_resource_copy_region(struct pipe_context *ctx,
    struct virgl_resource *dres = virgl_resource(dst);
    struct virgl_resource *sres = virgl_resource(src);
 
-   if (dres->b.target == PIPE_BUFFER)
-      util_range_add(&dres->b, &dres->valid_buffer_range, dstx, dstx + src_box->width);
+   if (dres->b.b.target == PIPE_BUFFER)
+      util_range_add(&dres->b.b, &dres->valid_buffer_range, dstx, dstx + src_box->width);
    virgl_resource_dirty(dres, dst_level);
 
    virgl_encode_resource_copy_region(vctx, dres,
                                     dst_level, dstx, dsty, dstz,
                                     sres, src_level,
                                     src_box);
+   virgl_resource_queue_readback(vctx, dres);
 }
 
 static void
@@ -1339,6 +2246,7 @@ static void virgl_blit(struct pipe_context *ctx,
    virgl_resource_dirty(dres, blit->dst.level);
    virgl_encode_blit(vctx, dres, sres,
                     blit);
+   virgl_resource_queue_readback(vctx, dres);
 }
 
 static void virgl_set_hw_atomic_buffers(struct pipe_context *ctx,
@@ -1477,42 +2385,8 @@ static void virgl_memory_barrier(struct pipe_context *ctx,
 static void *virgl_create_compute_state(struct pipe_context *ctx,
                                         const struct pipe_compute_state *state)
 {
-   struct virgl_context *vctx = virgl_context(ctx);
-   uint32_t handle;
-   const struct tgsi_token *ntt_tokens = NULL;
-   const struct tgsi_token *tokens;
-   struct pipe_stream_output_info so_info = { 0 };
-   int ret;
-
-   if (state->ir_type == PIPE_SHADER_IR_NIR) {
-      struct nir_to_tgsi_options options = {
-         .unoptimized_ra = true,
-         .lower_fabs = true
-      };
-      nir_shader *s = nir_shader_clone(NULL, state->prog);
-      ntt_tokens = tokens = nir_to_tgsi_options(s, vctx->base.screen, &options); /* takes ownership */
-   } else {
-      tokens = state->prog;
-   }
-
-   void *new_tokens = virgl_tgsi_transform((struct virgl_screen *)vctx->base.screen, tokens, false);
-   if (!new_tokens)
-      return NULL;
-
-   handle = virgl_object_assign_handle();
-   ret = virgl_encode_shader_state(vctx, handle, PIPE_SHADER_COMPUTE,
-                                   &so_info,
-                                   state->static_shared_mem,
-                                   new_tokens);
-   if (ret) {
-      FREE((void *)ntt_tokens);
-      return NULL;
-   }
-
-   FREE((void *)ntt_tokens);
-   FREE(new_tokens);
-
-   return (void *)(unsigned long)handle;
+   return virgl_create_shader(ctx, PIPE_SHADER_COMPUTE, state->ir_type,
+                              state->prog, NULL, state->static_shared_mem);
 }
 
 static void virgl_bind_compute_state(struct pipe_context *ctx, void *state)
@@ -1520,7 +2394,9 @@ static void virgl_bind_compute_state(struct pipe_context *ctx, void *state)
    uint32_t handle = (unsigned long)state;
    struct virgl_context *vctx = virgl_context(ctx);
 
-   virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_COMPUTE);
+   if (virgl_shadow_update(vctx, &vctx->shadow.shaders[PIPE_SHADER_COMPUTE],
+                           handle))
+      virgl_encode_bind_shader(vctx, handle, PIPE_SHADER_COMPUTE);
 }
 
 static void virgl_delete_compute_state(struct pipe_context *ctx, void *state)
@@ -1600,6 +2476,13 @@ virgl_context_destroy( struct pipe_context *ctx )
       pipe_resource_reference(&vctx->atomic_buffers[i].buffer, NULL);
    }
 
+   for (unsigned i = 0; i < vctx->num_so_targets; i++)
+      pipe_so_target_reference(&vctx->so_targets[i], NULL);
+
+   virgl_resource_drop_readbacks(vctx);
+   virgl_shadow_fini(&vctx->shadow);
+   FREE(vctx->compress_buf);
+
    rs->vws->cmd_buf_destroy(vctx->cbuf);
    if (vctx->uploader)
       u_upload_destroy(vctx->uploader);
@@ -1609,6 +2492,9 @@ virgl_context_destroy( struct pipe_context *ctx )
    virgl_transfer_queue_fini(&vctx->queue);
 
    slab_destroy_child(&vctx->transfer_pool);
+   slab_destroy_child(&vctx->transfer_pool_unsync);
+   util_dynarray_fini(&vctx->pending_deletes);
+   simple_mtx_destroy(&vctx->pending_deletes_mutex);
    FREE(vctx);
 }
 
@@ -1663,15 +2549,19 @@ static void virgl_send_tweaks(struct virgl_context *vctx, struct virgl_screen *r
                          rs->tweak_gles_tf3_value);
 }
 
-static void virgl_link_shader(struct pipe_context *ctx, void **handles)
+struct virgl_link_shader_job {
+   struct virgl_deferred_job base;
+   uint32_t shader_handles[PIPE_SHADER_TYPES];
+};
+
+static bool
+virgl_link_shader_execute(struct virgl_context *vctx,
+                          struct virgl_deferred_job *_job)
 {
-   struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_link_shader_job *job = (struct virgl_link_shader_job *)_job;
    struct virgl_screen *rs = virgl_screen(vctx->base.screen);
 
-   uint32_t shader_handles[PIPE_SHADER_TYPES];
-   for (uint32_t i = 0; i < PIPE_SHADER_TYPES; ++i)
-      shader_handles[i] = (uintptr_t)handles[i];
-   virgl_encode_link_shader(vctx, shader_handles);
+   virgl_encode_link_shader(vctx, job->shader_handles);
 
    /* block until shader linking is finished on host */
    if (rs->shader_sync && !unlikely(virgl_debug & VIRGL_DEBUG_SYNC)) {
@@ -1681,6 +2571,67 @@ static void virgl_link_shader(struct pipe_context *ctx, void **handles)
       vws->fence_wait(vws, sync_fence, OS_TIMEOUT_INFINITE);
       vws->fence_reference(vws, &sync_fence, NULL);
    }
+
+   return true;
+}
+
+static void virgl_link_shader(struct pipe_context *ctx, void **handles)
+{
+   struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_link_shader_job *job;
+
+   job = MALLOC_STRUCT(virgl_link_shader_job);
+   if (!job)
+      return;
+
+   for (uint32_t i = 0; i < PIPE_SHADER_TYPES; ++i)
+      job->shader_handles[i] = (uintptr_t)handles[i];
+   virgl_context_defer(vctx, virgl_link_shader_execute, &job->base);
+}
+
+static void
+virgl_replace_buffer_storage(struct pipe_context *ctx,
+                             struct pipe_resource *dst,
+                             struct pipe_resource *src,
+                             unsigned minimum_num_rebinds,
+                             uint32_t rebind_mask,
+                             uint32_t delete_buffer_id)
+{
+   struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_screen *rs = virgl_screen(ctx->screen);
+   struct virgl_resource *vdst = virgl_resource(dst);
+   struct virgl_resource *vsrc = virgl_resource(src);
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+
+   rs->vws->resource_reference(rs->vws, &vdst->hw_res, vsrc->hw_res);
+   vdst->clean_mask = vsrc->clean_mask;
+   vdst->readback_pending = vsrc->readback_pending;
+
+   util_range_set_empty(&vdst->valid_buffer_range);
+   if (vsrc->valid_buffer_range.end > vsrc->valid_buffer_range.start)
+      util_range_add(dst, &vdst->valid_buffer_range,
+                     vsrc->valid_buffer_range.start,
+                     vsrc->valid_buffer_range.end);
+
+   vdst->storage_generation++;
+
+   /* only the binding points where the threaded context found the buffer */
+   if (minimum_num_rebinds)
+      virgl_rebind_resource_bindings(vctx, dst, rebind_mask);
+
+   if (delete_buffer_id)
+      util_idalloc_mt_free(&rs->buffer_ids, delete_buffer_id);
+}
+
+static bool
+virgl_is_resource_busy(struct pipe_screen *screen,
+                       struct pipe_resource *resource,
+                       unsigned usage)
+{
+   struct virgl_winsys *vws = virgl_screen(screen)->vws;
+
+   return vws->resource_is_busy(vws, virgl_resource(resource)->hw_res);
 }
 
 struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
@@ -1698,6 +2649,8 @@ struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
       return NULL;
    }
 
+   virgl_shadow_init(&vctx->shadow);
+
    vctx->base.destroy = virgl_context_destroy;
    vctx->base.create_surface = virgl_create_surface;
    vctx->base.surface_destroy = virgl_surface_destroy;
@@ -1799,6 +2752,9 @@ struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
    virgl_init_so_functions(vctx);
 
    slab_create_child(&vctx->transfer_pool, &rs->transfer_pool);
+   slab_create_child(&vctx->transfer_pool_unsync, &rs->transfer_pool);
+   simple_mtx_init(&vctx->pending_deletes_mutex, mtx_plain);
+   util_dynarray_init(&vctx->pending_deletes, NULL);
    virgl_transfer_queue_init(&vctx->queue, vctx);
    vctx->encoded_transfers = (rs->vws->supports_encoded_transfers &&
                        (rs->caps.caps.v2.capability_bits & VIRGL_CAP_TRANSFER));
@@ -1850,6 +2806,20 @@ struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
    }
 #endif
 
+   if ((flags & PIPE_CONTEXT_PREFER_THREADED) &&
+       !(flags & (PIPE_CONTEXT_COMPUTE_ONLY | PIPE_CONTEXT_MEDIA_ONLY)) &&
+       !(virgl_debug & VIRGL_DEBUG_NO_TC)) {
+      struct threaded_context_options options = {
+         .is_resource_busy = virgl_is_resource_busy,
+         .driver_calls_flush_notify = true,
+         .unsynchronized_create_fence_fd = true,
+      };
+
+      return threaded_context_create(&vctx->base, &rs->transfer_pool,
+                                     virgl_replace_buffer_storage,
+                                     &options, &vctx->tc);
+   }
+
    return &vctx->base;
 fail:
    virgl_context_destroy(&vctx->base);
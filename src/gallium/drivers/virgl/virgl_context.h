@@ -27,11 +27,15 @@
 #include "pipe/p_context.h"
 #include "util/slab.h"
 #include "util/list.h"
+#include "util/simple_mtx.h"
+#include "util/u_dynarray.h"
+#include "virtio-gpu/virgl_protocol.h"
 
 #include "virgl_staging_mgr.h"
 #include "virgl_transfer_queue.h"
 
 struct pipe_screen;
+struct threaded_context;
 struct tgsi_token;
 struct u_upload_mgr;
 struct virgl_cmd_buf;
@@ -40,11 +44,14 @@ struct virgl_vertex_elements_state;
 struct virgl_sampler_view {
    struct pipe_sampler_view base;
    uint32_t handle;
+   /* virgl_resource::storage_generation the host object was created with */
+   uint32_t storage_generation;
 };
 
 struct virgl_so_target {
    struct pipe_stream_output_target base;
    uint32_t handle;
+   uint32_t storage_generation;
 };
 
 struct virgl_rasterizer_state {
@@ -65,6 +72,42 @@ struct virgl_shader_binding_state {
    uint32_t image_enabled_mask;
 };
 
+/* Driver counters, exposed as driver-specific queries. */
+enum virgl_context_stat {
+   VIRGL_STAT_TRANSFERS_QUEUED,
+   VIRGL_STAT_TRANSFERS_MERGED,
+   VIRGL_STAT_STATE_EMITTED,
+   VIRGL_STAT_STATE_SKIPPED,
+   VIRGL_STAT_COMPRESS_BYTES_IN,
+   VIRGL_STAT_COMPRESS_BYTES_OUT,
+   VIRGL_STAT_COUNT,
+};
+
+/* A buffer binding as last encoded.  The resource is referenced so that
+ * neither the pointer nor the host handle can be recycled behind our back.
+ * For vertex buffers, size holds the stride.
+ */
+struct virgl_shadow_buffer {
+   struct pipe_resource *res;
+   uint32_t storage_generation;
+   uint32_t offset;
+   uint32_t size;
+};
+
+/* The binding state the host last saw from this context.  set_* hooks diff
+ * against it and drop commands that would not change anything.  Object
+ * handles are never reused, so comparing them is enough; ~0 means unknown.
+ */
+struct virgl_shadow_state {
+   uint32_t objects[VIRGL_MAX_OBJECTS];
+   uint32_t shaders[PIPE_SHADER_TYPES];
+   uint32_t views[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   uint32_t samplers[PIPE_SHADER_TYPES][PIPE_MAX_SAMPLERS];
+   struct virgl_shadow_buffer ubos[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
+   struct virgl_shadow_buffer vertex_buffers[PIPE_MAX_ATTRIBS];
+   unsigned num_vertex_buffers;
+};
+
 struct virgl_context {
    struct pipe_context base;
    struct virgl_cmd_buf *cbuf;
@@ -79,6 +122,10 @@ struct virgl_context {
    struct pipe_framebuffer_state framebuffer;
 
    struct slab_child_pool transfer_pool;
+   /* For TC_TRANSFER_MAP_THREADED_UNSYNC maps, which run on the frontend
+    * thread while the driver thread may be allocating from transfer_pool.
+    */
+   struct slab_child_pool transfer_pool_unsync;
    struct virgl_transfer_queue queue;
    struct u_upload_mgr *uploader;
    struct virgl_staging_mgr staging;
@@ -91,7 +138,7 @@ struct virgl_context {
    bool vertex_array_dirty;
 
    struct virgl_rasterizer_state rs_state;
-   struct virgl_so_target so_targets[PIPE_MAX_SO_BUFFERS];
+   struct pipe_stream_output_target *so_targets[PIPE_MAX_SO_BUFFERS];
    unsigned num_so_targets;
 
    uint32_t num_draws, num_compute;
@@ -101,6 +148,28 @@ struct virgl_context {
 
    /* The total size of staging resources used in queued copy transfers. */
    uint64_t queued_staging_res_size;
+
+   uint64_t stats[VIRGL_STAT_COUNT];
+
+   struct virgl_shadow_state shadow;
+
+   /* scratch space for virgl_encoder_compress_cmd() */
+   uint8_t *compress_buf;
+   size_t compress_buf_size;
+
+   /* see virgl_resource_queue_readback() */
+   struct pipe_resource *readbacks[16];
+   unsigned num_readbacks;
+
+   /* Non-NULL when the context is wrapped by u_threaded_context. */
+   struct threaded_context *tc;
+
+   /* Host object deletions requested from threads other than the driver
+    * thread (sampler views, surfaces and stream output targets can be
+    * released from any thread).  They are encoded on the next flush.
+    */
+   simple_mtx_t pending_deletes_mutex;
+   struct util_dynarray pending_deletes;
 };
 
 struct virgl_vertex_elements_state {
@@ -132,6 +201,9 @@ struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
 
 void virgl_init_blit_functions(struct virgl_context *vctx);
 void virgl_init_query_functions(struct virgl_context *vctx);
+
+int virgl_get_driver_query_info(struct pipe_screen *pscreen, unsigned index,
+                                struct pipe_driver_query_info *info);
 void virgl_init_so_functions(struct virgl_context *vctx);
 
 struct tgsi_token *virgl_tgsi_transform(struct virgl_screen *vscreen, const struct tgsi_token *tokens_in,
@@ -145,6 +217,36 @@ void
 virgl_rebind_resource(struct virgl_context *vctx,
                       struct pipe_resource *res);
 
+void
+virgl_rebind_resource_bindings(struct virgl_context *vctx,
+                               struct pipe_resource *res,
+                               uint32_t rebind_mask);
+
 void virgl_flush_eq(struct virgl_context *ctx, void *closure, struct pipe_fence_handle **fence);
 
+void
+virgl_context_delete_object(struct virgl_context *vctx, uint32_t handle,
+                            uint32_t type);
+
+/* Work that has to be encoded in order with the driver thread.  Jobs are
+ * heap allocated with the header as their first member and freed once
+ * executed.
+ */
+struct virgl_deferred_job;
+typedef bool (*virgl_deferred_func)(struct virgl_context *vctx,
+                                    struct virgl_deferred_job *job);
+
+struct virgl_deferred_job {
+   struct virgl_context *vctx;
+   virgl_deferred_func func;
+};
+
+bool
+virgl_context_defer(struct virgl_context *vctx, virgl_deferred_func func,
+                    struct virgl_deferred_job *job);
+
+void
+virgl_so_target_revalidate(struct virgl_context *vctx,
+                           struct virgl_so_target *target);
+
 #endif
@@ -30,6 +30,7 @@
 #include "pipe/p_state.h"
 #include "tgsi/tgsi_dump.h"
 #include "tgsi/tgsi_parse.h"
+#include "util/compress.h"
 
 #include "virgl_context.h"
 #include "virgl_encode.h"
@@ -508,6 +509,74 @@ static int virgl_encoder_write_cmd_dword(struct virgl_context *ctx,
    return 0;
 }
 
+/* Replace the command starting at cbuf->buf[start], which must be the last
+ * one in the buffer, with a VIRGL_CCMD_COMPRESSED copy when that shrinks it
+ * noticeably.  *scratch is grown as needed to hold the compressed data.
+ */
+bool virgl_encoder_compress_last_cmd(struct virgl_cmd_buf *cbuf,
+                                     uint32_t start,
+                                     enum virgl_compression compression,
+                                     uint8_t **scratch, size_t *scratch_size)
+{
+#ifdef HAVE_COMPRESSION
+   const uint32_t dwords = cbuf->cdw - start;
+   const size_t size = dwords * 4;
+   size_t max_size, compressed;
+
+   max_size = util_compress_max_compressed_len(size);
+   if (*scratch_size < max_size) {
+      uint8_t *buf = REALLOC(*scratch, *scratch_size, max_size);
+      if (!buf)
+         return false;
+      *scratch = buf;
+      *scratch_size = max_size;
+   }
+
+   compressed = util_compress_deflate_fast((const uint8_t *)&cbuf->buf[start],
+                                           size, *scratch, max_size);
+
+   if (!virgl_encoder_compression_pays(dwords, compressed))
+      return false;
+
+   cbuf->cdw = start;
+   virgl_encoder_write_dword(cbuf, VIRGL_CMD0(VIRGL_CCMD_COMPRESSED, compression,
+                                              VIRGL_COMPRESSED_SIZE(compressed)));
+   virgl_encoder_write_dword(cbuf, dwords);
+   virgl_encoder_write_dword(cbuf, compressed);
+   virgl_encoder_write_block(cbuf, *scratch, compressed);
+   return true;
+#else
+   (void)cbuf;
+   (void)start;
+   (void)compression;
+   (void)scratch;
+   (void)scratch_size;
+   return false;
+#endif
+}
+
+static void virgl_encoder_compress_cmd(struct virgl_context *ctx,
+                                       uint32_t start)
+{
+   struct virgl_screen *vs = virgl_screen(ctx->base.screen);
+   struct virgl_cmd_buf *cbuf = ctx->cbuf;
+   const size_t size = (cbuf->cdw - start) * 4;
+
+   assert(virgl_encoder_cmd_is_compressible(cbuf->buf[start]));
+
+   if (vs->compression == VIRGL_COMPRESSION_NONE ||
+       size < vs->compress_min_size)
+      return;
+
+   if (!virgl_encoder_compress_last_cmd(cbuf, start, vs->compression,
+                                        &ctx->compress_buf,
+                                        &ctx->compress_buf_size))
+      return;
+
+   ctx->stats[VIRGL_STAT_COMPRESS_BYTES_IN] += size;
+   ctx->stats[VIRGL_STAT_COMPRESS_BYTES_OUT] += (cbuf->cdw - start) * 4;
+}
+
 static void virgl_encoder_emit_resource(struct virgl_screen *vs,
                                         struct virgl_cmd_buf *buf,
                                         struct virgl_resource *res)
@@ -670,11 +739,12 @@ int virgl_encode_rasterizer_state(struct virgl_context *ctx,
 }
 
 static void virgl_emit_shader_header(struct virgl_context *ctx,
+                                     uint32_t obj_type,
                                      uint32_t handle, uint32_t len,
                                      uint32_t type, uint32_t offlen,
                                      uint32_t num_tokens)
 {
-   virgl_encoder_write_cmd_dword(ctx, VIRGL_CMD0(VIRGL_CCMD_CREATE_OBJECT, VIRGL_OBJECT_SHADER, len));
+   virgl_encoder_write_cmd_dword(ctx, VIRGL_CMD0(VIRGL_CCMD_CREATE_OBJECT, obj_type, len));
    virgl_encoder_write_dword(ctx->cbuf, handle);
    virgl_encoder_write_dword(ctx->cbuf, type);
    virgl_encoder_write_dword(ctx->cbuf, offlen);
@@ -709,24 +779,76 @@ static void virgl_emit_shader_streamout(struct virgl_context *ctx,
    }
 }
 
-int virgl_encode_shader_state(struct virgl_context *ctx,
-                              uint32_t handle,
-                              enum pipe_shader_type type,
-                              const struct pipe_stream_output_info *so_info,
-                              uint32_t cs_req_local_mem,
-                              const struct tgsi_token *tokens)
+/* Split a shader payload across as many CREATE_OBJECT commands as needed.
+ * The first one carries the total size, the following ones their offset.
+ */
+static void virgl_emit_shader_payload(struct virgl_context *ctx,
+                                      uint32_t obj_type,
+                                      uint32_t handle,
+                                      enum pipe_shader_type type,
+                                      const struct pipe_stream_output_info *so_info,
+                                      uint32_t cs_req_local_mem,
+                                      uint32_t num_tokens,
+                                      const uint8_t *data,
+                                      uint32_t size)
+{
+   const uint8_t *sptr = data;
+   uint32_t left_bytes = size;
+   uint32_t base_hdr_size, strm_hdr_size, thispass, len, start;
+   bool first_pass;
+
+   base_hdr_size = 5;
+   strm_hdr_size = so_info->num_outputs ? so_info->num_outputs * 2 + 4 : 0;
+   first_pass = true;
+   while (left_bytes) {
+      uint32_t length, offlen;
+      int hdr_len = base_hdr_size + (first_pass ? strm_hdr_size : 0);
+      if (ctx->cbuf->cdw + hdr_len + 1 >= VIRGL_ENCODE_MAX_DWORDS)
+         ctx->base.flush(&ctx->base, NULL, 0);
+
+      thispass = (VIRGL_ENCODE_MAX_DWORDS - ctx->cbuf->cdw - hdr_len - 1) * 4;
+
+      length = MIN2(thispass, left_bytes);
+      len = ((length + 3) / 4) + hdr_len;
+
+      if (first_pass)
+         offlen = VIRGL_OBJ_SHADER_OFFSET_VAL(size);
+      else
+         offlen = VIRGL_OBJ_SHADER_OFFSET_VAL(sptr - data) | VIRGL_OBJ_SHADER_OFFSET_CONT;
+
+      start = ctx->cbuf->cdw;
+      virgl_emit_shader_header(ctx, obj_type, handle, len,
+                               virgl_shader_stage_convert(type), offlen,
+                               num_tokens);
+
+      if (type == PIPE_SHADER_COMPUTE)
+         virgl_encoder_write_dword(ctx->cbuf, cs_req_local_mem);
+      else
+         virgl_emit_shader_streamout(ctx, first_pass ? so_info : NULL);
+
+      virgl_encoder_write_block(ctx->cbuf, sptr, length);
+      virgl_encoder_compress_cmd(ctx, start);
+
+      sptr += length;
+      first_pass = false;
+      left_bytes -= length;
+   }
+}
+
+/* Dump the tokens into the text form the host parses.  The returned string
+ * must be freed with FREE().
+ */
+char *virgl_shader_tokens_to_text(const struct tgsi_token *tokens,
+                                  uint32_t *num_tokens_out)
 {
-   char *str, *sptr;
-   uint32_t shader_len, len;
+   char *str;
    bool bret;
    int num_tokens = tgsi_num_tokens(tokens);
    int str_total_size = 65536;
    int retry_size = 1;
-   uint32_t left_bytes, base_hdr_size, strm_hdr_size, thispass;
-   bool first_pass;
    str = CALLOC(1, str_total_size);
    if (!str)
-      return -1;
+      return NULL;
 
    do {
       int old_size;
@@ -740,12 +862,14 @@ int virgl_encode_shader_state(struct virgl_context *ctx,
          retry_size *= 2;
          str = REALLOC(str, old_size, str_total_size);
          if (!str)
-            return -1;
+            return NULL;
       }
    } while (bret == false && retry_size < 1024);
 
-   if (bret == false)
-      return -1;
+   if (bret == false) {
+      FREE(str);
+      return NULL;
+   }
 
    if (virgl_debug & VIRGL_DEBUG_TGSI)
       debug_printf("TGSI:\n---8<---\n%s\n---8<---\n", str);
@@ -757,48 +881,54 @@ int virgl_encode_shader_state(struct virgl_context *ctx,
    while ((barrier = strstr(barrier + 1, "BARRIER")))
       num_tokens++;
 
-   shader_len = strlen(str) + 1;
-
-   left_bytes = shader_len;
-
-   base_hdr_size = 5;
-   strm_hdr_size = so_info->num_outputs ? so_info->num_outputs * 2 + 4 : 0;
-   first_pass = true;
-   sptr = str;
-   while (left_bytes) {
-      uint32_t length, offlen;
-      int hdr_len = base_hdr_size + (first_pass ? strm_hdr_size : 0);
-      if (ctx->cbuf->cdw + hdr_len + 1 >= VIRGL_ENCODE_MAX_DWORDS)
-         ctx->base.flush(&ctx->base, NULL, 0);
-
-      thispass = (VIRGL_ENCODE_MAX_DWORDS - ctx->cbuf->cdw - hdr_len - 1) * 4;
-
-      length = MIN2(thispass, left_bytes);
-      len = ((length + 3) / 4) + hdr_len;
-
-      if (first_pass)
-         offlen = VIRGL_OBJ_SHADER_OFFSET_VAL(shader_len);
-      else
-         offlen = VIRGL_OBJ_SHADER_OFFSET_VAL((uintptr_t)sptr - (uintptr_t)str) | VIRGL_OBJ_SHADER_OFFSET_CONT;
-
-      virgl_emit_shader_header(ctx, handle, len, virgl_shader_stage_convert(type), offlen, num_tokens);
+   *num_tokens_out = num_tokens;
+   return str;
+}
 
-      if (type == PIPE_SHADER_COMPUTE)
-         virgl_encoder_write_dword(ctx->cbuf, cs_req_local_mem);
-      else
-         virgl_emit_shader_streamout(ctx, first_pass ? so_info : NULL);
+void virgl_encode_shader_text(struct virgl_context *ctx,
+                              uint32_t handle,
+                              enum pipe_shader_type type,
+                              const struct pipe_stream_output_info *so_info,
+                              uint32_t cs_req_local_mem,
+                              uint32_t num_tokens,
+                              const char *text)
+{
+   virgl_emit_shader_payload(ctx, VIRGL_OBJECT_SHADER, handle, type, so_info,
+                             cs_req_local_mem, num_tokens,
+                             (const uint8_t *)text, strlen(text) + 1);
+}
 
-      virgl_encoder_write_block(ctx->cbuf, (uint8_t *)sptr, length);
+int virgl_encode_shader_state(struct virgl_context *ctx,
+                              uint32_t handle,
+                              enum pipe_shader_type type,
+                              const struct pipe_stream_output_info *so_info,
+                              uint32_t cs_req_local_mem,
+                              const struct tgsi_token *tokens)
+{
+   uint32_t num_tokens;
+   char *str = virgl_shader_tokens_to_text(tokens, &num_tokens);
+   if (!str)
+      return -1;
 
-      sptr += length;
-      first_pass = false;
-      left_bytes -= length;
-   }
+   virgl_encode_shader_text(ctx, handle, type, so_info, cs_req_local_mem,
+                            num_tokens, str);
 
    FREE(str);
    return 0;
 }
 
+void virgl_encode_shader_nir(struct virgl_context *ctx,
+                             uint32_t handle,
+                             enum pipe_shader_type type,
+                             const struct pipe_stream_output_info *so_info,
+                             uint32_t cs_req_local_mem,
+                             const void *data,
+                             uint32_t size)
+{
+   virgl_emit_shader_payload(ctx, VIRGL_OBJECT_SHADER_NIR, handle, type,
+                             so_info, cs_req_local_mem, 0, data, size);
+}
+
 
 int virgl_encode_clear(struct virgl_context *ctx,
                       unsigned buffers,
@@ -826,7 +956,7 @@ int virgl_encode_clear_texture(struct virgl_context *ctx,
                                const struct pipe_box *box,
                                const void *data)
 {
-   const struct util_format_description *desc = util_format_description(res->b.format);
+   const struct util_format_description *desc = util_format_description(res->b.b.format);
    unsigned block_bits = desc->block.bits;
    uint32_t arr[4] = {0};
    /* The spec describe <data> as a pointer to an array of between one
@@ -986,6 +1116,35 @@ int virgl_encoder_draw_vbo(struct virgl_context *ctx,
    return 0;
 }
 
+int virgl_encoder_draw_multi(struct virgl_context *ctx,
+                             const struct pipe_draw_info *info,
+                             unsigned drawid,
+                             const struct pipe_draw_start_count_bias *draws,
+                             unsigned num_draws)
+{
+   assert(num_draws <= VIRGL_DRAW_MULTI_MAX_DRAWS);
+
+   virgl_encoder_write_cmd_dword(ctx, VIRGL_CMD0(VIRGL_CCMD_DRAW_MULTI, 0, VIRGL_DRAW_MULTI_SIZE(num_draws)));
+   virgl_encoder_write_dword(ctx->cbuf, info->mode);
+   virgl_encoder_write_dword(ctx->cbuf, !!info->index_size);
+   virgl_encoder_write_dword(ctx->cbuf, info->instance_count);
+   virgl_encoder_write_dword(ctx->cbuf, info->start_instance);
+   virgl_encoder_write_dword(ctx->cbuf, info->primitive_restart);
+   virgl_encoder_write_dword(ctx->cbuf, info->primitive_restart ? info->restart_index : 0);
+   virgl_encoder_write_dword(ctx->cbuf, info->index_bounds_valid ? info->min_index : 0);
+   virgl_encoder_write_dword(ctx->cbuf, info->index_bounds_valid ? info->max_index : ~0);
+   virgl_encoder_write_dword(ctx->cbuf, ctx->patch_vertices);
+   virgl_encoder_write_dword(ctx->cbuf, drawid);
+   virgl_encoder_write_dword(ctx->cbuf, info->increment_draw_id ?
+                             VIRGL_DRAW_MULTI_FLAG_INCREMENT_DRAWID : 0);
+   for (unsigned i = 0; i < num_draws; i++) {
+      virgl_encoder_write_dword(ctx->cbuf, draws[i].start);
+      virgl_encoder_write_dword(ctx->cbuf, draws[i].count);
+      virgl_encoder_write_dword(ctx->cbuf, info->index_size ? draws[i].index_bias : 0);
+   }
+   return 0;
+}
+
 static int virgl_encoder_create_surface_common(struct virgl_context *ctx,
                                                uint32_t handle,
                                                struct virgl_resource *res,
@@ -1051,7 +1210,7 @@ static void virgl_encoder_transfer3d_common(struct virgl_screen *vs,
                                             enum virgl_transfer3d_encode_stride encode_stride)
 
 {
-   struct pipe_transfer *transfer = &xfer->base;
+   struct pipe_transfer *transfer = &xfer->base.b;
    unsigned stride;
    uintptr_t layer_stride;
 
@@ -1135,7 +1294,7 @@ int virgl_encode_sampler_view(struct virgl_context *ctx,
    if (rs->caps.caps.v2.capability_bits & VIRGL_CAP_TEXTURE_VIEW)
      dword_fmt_target |= (state->target << 24);
    virgl_encoder_write_dword(ctx->cbuf, dword_fmt_target);
-   if (res->b.target == PIPE_BUFFER) {
+   if (res->b.b.target == PIPE_BUFFER) {
       virgl_encoder_write_dword(ctx->cbuf, state->u.buf.offset / elem_size);
       virgl_encoder_write_dword(ctx->cbuf, (state->u.buf.offset + state->u.buf.size) / elem_size - 1);
    } else {
@@ -1193,11 +1352,16 @@ int virgl_encoder_write_constant_buffer(struct virgl_context *ctx,
                                        uint32_t size,
                                        const void *data)
 {
+   uint32_t start;
+
    virgl_encoder_write_cmd_dword(ctx, VIRGL_CMD0(VIRGL_CCMD_SET_CONSTANT_BUFFER, 0, size + 2));
+   start = ctx->cbuf->cdw - 1;
    virgl_encoder_write_dword(ctx->cbuf, virgl_shader_stage_convert(shader));
    virgl_encoder_write_dword(ctx->cbuf, index);
-   if (data)
+   if (data) {
       virgl_encoder_write_block(ctx->cbuf, data, size * 4);
+      virgl_encoder_compress_cmd(ctx, start);
+   }
    return 0;
 }
 
@@ -1491,7 +1655,7 @@ int virgl_encode_set_shader_buffers(struct virgl_context *ctx,
          virgl_encoder_write_dword(ctx->cbuf, buffers[i].buffer_size);
          virgl_encoder_write_res(ctx, res);
 
-         util_range_add(&res->b, &res->valid_buffer_range, buffers[i].buffer_offset,
+         util_range_add(&res->b.b, &res->valid_buffer_range, buffers[i].buffer_offset,
                buffers[i].buffer_offset + buffers[i].buffer_size);
          virgl_resource_dirty(res, 0);
       } else {
@@ -1518,7 +1682,7 @@ int virgl_encode_set_hw_atomic_buffers(struct virgl_context *ctx,
          virgl_encoder_write_dword(ctx->cbuf, buffers[i].buffer_size);
          virgl_encoder_write_res(ctx, res);
 
-         util_range_add(&res->b, &res->valid_buffer_range, buffers[i].buffer_offset,
+         util_range_add(&res->b.b, &res->valid_buffer_range, buffers[i].buffer_offset,
                buffers[i].buffer_offset + buffers[i].buffer_size);
          virgl_resource_dirty(res, 0);
       } else {
@@ -1549,8 +1713,8 @@ int virgl_encode_set_shader_images(struct virgl_context *ctx,
          virgl_encoder_write_dword(ctx->cbuf, images[i].u.buf.size);
          virgl_encoder_write_res(ctx, res);
 
-         if (res->b.target == PIPE_BUFFER) {
-            util_range_add(&res->b, &res->valid_buffer_range, images[i].u.buf.offset,
+         if (res->b.b.target == PIPE_BUFFER) {
+            util_range_add(&res->b.b, &res->valid_buffer_range, images[i].u.buf.offset,
                   images[i].u.buf.offset + images[i].u.buf.size);
          }
          virgl_resource_dirty(res, images[i].u.tex.level);
@@ -1653,12 +1817,12 @@ void virgl_encode_transfer(struct virgl_screen *vs, struct virgl_cmd_buf *buf,
                            struct virgl_transfer *trans, uint32_t direction)
 {
    uint32_t command;
-   struct virgl_resource *vres = virgl_resource(trans->base.resource);
+   struct virgl_resource *vres = virgl_resource(trans->base.b.resource);
    enum virgl_transfer3d_encode_stride stride_type =
         virgl_transfer3d_host_inferred_stride;
 
-   if (trans->base.box.depth == 1 && trans->base.level == 0 &&
-       trans->base.resource->target == PIPE_TEXTURE_2D &&
+   if (trans->base.b.box.depth == 1 && trans->base.b.level == 0 &&
+       trans->base.b.resource->target == PIPE_TEXTURE_2D &&
        vres->blob_mem == VIRGL_BLOB_MEM_HOST3D_GUEST)
       stride_type = virgl_transfer3d_explicit_stride;
 
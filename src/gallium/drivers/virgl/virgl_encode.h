@@ -84,6 +84,33 @@ static inline void virgl_encoder_write_block(struct virgl_cmd_buf *state,
    state->cdw += (len + 3) / 4;
 }
 
+/* Whether the command with this header is one virgl_encoder_compress_cmd()
+ * is applied to: constant uploads and shader text.
+ */
+static inline bool virgl_encoder_cmd_is_compressible(uint32_t header)
+{
+   const uint32_t cmd = header & 0xff;
+   const uint32_t obj = (header >> 8) & 0xff;
+
+   return cmd == VIRGL_CCMD_SET_CONSTANT_BUFFER ||
+          (cmd == VIRGL_CCMD_CREATE_OBJECT && obj == VIRGL_OBJECT_SHADER);
+}
+
+/* The host has to inflate a compressed command, so it must save at least an
+ * eighth of the original dwords.
+ */
+static inline bool virgl_encoder_compression_pays(uint32_t dwords,
+                                                  size_t compressed)
+{
+   return compressed &&
+          VIRGL_COMPRESSED_SIZE(compressed) + 1 <= dwords - dwords / 8;
+}
+
+bool virgl_encoder_compress_last_cmd(struct virgl_cmd_buf *cbuf,
+                                     uint32_t start,
+                                     enum virgl_compression compression,
+                                     uint8_t **scratch, size_t *scratch_size);
+
 extern int virgl_encode_blend_state(struct virgl_context *ctx,
                                    uint32_t handle,
                                    const struct pipe_blend_state *blend_state);
@@ -98,6 +125,26 @@ extern int virgl_encode_shader_state(struct virgl_context *ctx,
                                      uint32_t cs_req_local_mem,
                                      const struct tgsi_token *tokens);
 
+char *virgl_shader_tokens_to_text(const struct tgsi_token *tokens,
+                                  uint32_t *num_tokens);
+
+void virgl_encode_shader_text(struct virgl_context *ctx,
+                              uint32_t handle,
+                              enum pipe_shader_type type,
+                              const struct pipe_stream_output_info *so_info,
+                              uint32_t cs_req_local_mem,
+                              uint32_t num_tokens,
+                              const char *text);
+
+/* data is a shader serialized with nir_serialize() */
+void virgl_encode_shader_nir(struct virgl_context *ctx,
+                             uint32_t handle,
+                             enum pipe_shader_type type,
+                             const struct pipe_stream_output_info *so_info,
+                             uint32_t cs_req_local_mem,
+                             const void *data,
+                             uint32_t size);
+
 int virgl_encode_stream_output_info(struct virgl_context *ctx,
                                    uint32_t handle,
                                    uint32_t type,
@@ -143,6 +190,12 @@ int virgl_encoder_draw_vbo(struct virgl_context *ctx,
                            const struct pipe_draw_indirect_info *indirect,
                            const struct pipe_draw_start_count_bias *draw);
 
+int virgl_encoder_draw_multi(struct virgl_context *ctx,
+                             const struct pipe_draw_info *info,
+                             unsigned drawid,
+                             const struct pipe_draw_start_count_bias *draws,
+                             unsigned num_draws);
+
 
 int virgl_encoder_create_surface(struct virgl_context *ctx,
                                 uint32_t handle,
@@ -23,6 +23,7 @@
 
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
+#include "util/u_threaded_context.h"
 #include "virgl_context.h"
 #include "virgl_encode.h"
 #include "virtio-gpu/virgl_protocol.h"
@@ -30,6 +31,7 @@
 #include "virgl_screen.h"
 
 struct virgl_query {
+   struct threaded_query b;
    enum pipe_query_type type;
 
    union {
@@ -45,6 +47,41 @@ struct virgl_query {
    uint64_t result;
 };
 
+/* Driver-specific queries are counters kept by the guest driver, they never
+ * reach the host.
+ */
+static const struct pipe_driver_query_info virgl_driver_query_list[] = {
+   { "virgl-transfers-queued", PIPE_QUERY_DRIVER_SPECIFIC + VIRGL_STAT_TRANSFERS_QUEUED, { 0 } },
+   { "virgl-transfers-merged", PIPE_QUERY_DRIVER_SPECIFIC + VIRGL_STAT_TRANSFERS_MERGED, { 0 } },
+   { "virgl-state-emitted", PIPE_QUERY_DRIVER_SPECIFIC + VIRGL_STAT_STATE_EMITTED, { 0 } },
+   { "virgl-state-skipped", PIPE_QUERY_DRIVER_SPECIFIC + VIRGL_STAT_STATE_SKIPPED, { 0 } },
+   { "virgl-compress-bytes-in", PIPE_QUERY_DRIVER_SPECIFIC + VIRGL_STAT_COMPRESS_BYTES_IN, { 0 }, PIPE_DRIVER_QUERY_TYPE_BYTES },
+   { "virgl-compress-bytes-out", PIPE_QUERY_DRIVER_SPECIFIC + VIRGL_STAT_COMPRESS_BYTES_OUT, { 0 }, PIPE_DRIVER_QUERY_TYPE_BYTES },
+};
+
+static_assert(ARRAY_SIZE(virgl_driver_query_list) == VIRGL_STAT_COUNT,
+              "missing driver query");
+
+int
+virgl_get_driver_query_info(struct pipe_screen *pscreen, unsigned index,
+                            struct pipe_driver_query_info *info)
+{
+   if (!info)
+      return ARRAY_SIZE(virgl_driver_query_list);
+
+   if (index >= ARRAY_SIZE(virgl_driver_query_list))
+      return 0;
+
+   *info = virgl_driver_query_list[index];
+   return 1;
+}
+
+static inline bool
+virgl_query_is_driver_specific(enum pipe_query_type type)
+{
+   return type >= PIPE_QUERY_DRIVER_SPECIFIC;
+}
+
 #define VIRGL_QUERY_OCCLUSION_COUNTER     0
 #define VIRGL_QUERY_OCCLUSION_PREDICATE   1
 #define VIRGL_QUERY_TIMESTAMP             2
@@ -119,10 +156,34 @@ static void virgl_render_condition(struct pipe_context *ctx,
    virgl_encoder_render_condition(vctx, handle, condition, mode);
 }
 
+struct virgl_create_query_job {
+   struct virgl_deferred_job base;
+   /* destroy_query is always queued after this job */
+   struct virgl_query *query;
+   uint32_t index;
+};
+
+static bool
+virgl_create_query_execute(struct virgl_context *vctx,
+                           struct virgl_deferred_job *_job)
+{
+   struct virgl_create_query_job *job = (struct virgl_create_query_job *)_job;
+   struct virgl_query *query = job->query;
+
+   util_range_add(&query->buf->b.b, &query->buf->valid_buffer_range, 0,
+                  sizeof(struct virgl_host_query_state));
+   virgl_resource_dirty(query->buf, 0);
+
+   virgl_encoder_create_query(vctx, query->handle,
+         pipe_to_virgl_query(query->type), job->index, query->buf, 0);
+   return true;
+}
+
 static struct pipe_query *virgl_create_query(struct pipe_context *ctx,
                                             unsigned query_type, unsigned index)
 {
    struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_create_query_job *job;
    struct virgl_query *query;
 
    query = CALLOC_STRUCT(virgl_query);
@@ -131,13 +192,21 @@ static struct pipe_query *virgl_create_query(struct pipe_context *ctx,
 
    query->type = query_type;
 
-   if (query->type == PIPE_QUERY_GPU_FINISHED)
+   if (query->type == PIPE_QUERY_GPU_FINISHED ||
+       virgl_query_is_driver_specific(query->type))
       return (struct pipe_query *)query;
 
+   job = MALLOC_STRUCT(virgl_create_query_job);
+   if (!job) {
+      FREE(query);
+      return NULL;
+   }
+
    query->buf = (struct virgl_resource *)
       pipe_buffer_create(ctx->screen, PIPE_BIND_CUSTOM, PIPE_USAGE_STAGING,
                          sizeof(struct virgl_host_query_state));
    if (!query->buf) {
+      FREE(job);
       FREE(query);
       return NULL;
    }
@@ -154,12 +223,9 @@ static struct pipe_query *virgl_create_query(struct pipe_context *ctx,
       query->pipeline_stats = ~0;
    }
 
-   util_range_add(&query->buf->b, &query->buf->valid_buffer_range, 0,
-                  sizeof(struct virgl_host_query_state));
-   virgl_resource_dirty(query->buf, 0);
-
-   virgl_encoder_create_query(vctx, query->handle,
-         pipe_to_virgl_query(query_type), index, query->buf, 0);
+   job->query = query;
+   job->index = index;
+   virgl_context_defer(vctx, virgl_create_query_execute, &job->base);
 
    return (struct pipe_query *)query;
 }
@@ -172,6 +238,8 @@ static void virgl_destroy_query(struct pipe_context *ctx,
 
    if (query->type == PIPE_QUERY_GPU_FINISHED) {
       ctx->screen->fence_reference(ctx->screen, &query->fence, NULL);
+   } else if (virgl_query_is_driver_specific(query->type)) {
+      /* nothing on the host */
    } else {
       virgl_encode_delete_object(vctx, query->handle, VIRGL_OBJECT_QUERY);
       pipe_resource_reference((struct pipe_resource **)&query->buf, NULL);
@@ -186,6 +254,11 @@ static bool virgl_begin_query(struct pipe_context *ctx,
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_query *query = virgl_query(q);
 
+   if (virgl_query_is_driver_specific(query->type)) {
+      query->result = vctx->stats[query->type - PIPE_QUERY_DRIVER_SPECIFIC];
+      return true;
+   }
+
    virgl_encoder_begin_query(vctx, query->handle);
 
    return true;
@@ -204,6 +277,12 @@ static bool virgl_end_query(struct pipe_context *ctx,
       return true;
    }
 
+   if (virgl_query_is_driver_specific(query->type)) {
+      query->result = vctx->stats[query->type - PIPE_QUERY_DRIVER_SPECIFIC] -
+                      query->result;
+      return true;
+   }
+
    host_state = vs->vws->resource_map(vs->vws, query->buf->hw_res);
    if (!host_state)
       return false;
@@ -226,21 +305,36 @@ static bool virgl_get_query_result(struct pipe_context *ctx,
                                    union pipe_query_result *result)
 {
    struct virgl_query *query = virgl_query(q);
+   struct virgl_context *vctx = virgl_context(ctx);
+
+   /* With the threaded context, a flushed query is read from the frontend
+    * thread and the context must not be used.  Everything below only goes
+    * through the winsys for flushed queries.
+    */
+   if (query->b.flushed)
+      assert(vctx->tc);
 
    if (query->type == PIPE_QUERY_GPU_FINISHED) {
       struct pipe_screen *screen = ctx->screen;
 
-      result->b = screen->fence_finish(screen, ctx, query->fence, wait ? OS_TIMEOUT_INFINITE : 0);
+      result->b = screen->fence_finish(screen, query->b.flushed ? NULL : ctx,
+                                       query->fence,
+                                       wait ? OS_TIMEOUT_INFINITE : 0);
       return result->b;
    }
 
+   if (virgl_query_is_driver_specific(query->type)) {
+      result->u64 = query->result;
+      return true;
+   }
+
    if (!query->ready) {
       struct virgl_screen *vs = virgl_screen(ctx->screen);
-      struct virgl_context *vctx = virgl_context(ctx);
       volatile struct virgl_host_query_state *host_state;
-      struct pipe_transfer *transfer = NULL;
+      bool fetched = false;
 
-      if (vs->vws->res_is_referenced(vs->vws, vctx->cbuf, query->buf->hw_res))
+      if (!query->b.flushed &&
+          vs->vws->res_is_referenced(vs->vws, vctx->cbuf, query->buf->hw_res))
          ctx->flush(ctx, NULL, 0);
 
       if (wait)
@@ -254,19 +348,21 @@ static bool virgl_get_query_result(struct pipe_context *ctx,
        * unless we are dealing with an older host.  In that case,
        * VIRGL_CCMD_GET_QUERY_RESULT is not fenced, the buffer is not
        * coherent, and transfers are unsynchronized.  We have to repeatedly
-       * transfer until we get the result back.
+       * transfer until we get the result back.  The transfer goes straight
+       * through the winsys, so that no context is needed.
        */
       while (host_state->query_state != VIRGL_QUERY_STATE_DONE) {
+         struct pipe_box box;
+
          debug_printf("VIRGL: get_query_result is forced blocking\n");
 
-         if (transfer) {
-            pipe_buffer_unmap(ctx, transfer);
-            if (!wait)
-               return false;
-         }
+         if (fetched && !wait)
+            return false;
 
-         host_state = pipe_buffer_map(ctx, &query->buf->b,
-               PIPE_MAP_READ, &transfer);
+         u_box_1d(0, sizeof(struct virgl_host_query_state), &box);
+         vs->vws->transfer_get(vs->vws, query->buf->hw_res, &box, 0, 0, 0, 0);
+         vs->vws->resource_wait(vs->vws, query->buf->hw_res);
+         fetched = true;
       }
 
       if (query->result_size == 8)
@@ -274,9 +370,6 @@ static bool virgl_get_query_result(struct pipe_context *ctx,
       else
          query->result = (uint32_t) host_state->result;
 
-      if (transfer)
-         pipe_buffer_unmap(ctx, transfer);
-
       query->ready = true;
    }
 
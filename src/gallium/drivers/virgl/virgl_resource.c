@@ -56,6 +56,11 @@ enum virgl_transfer_map_type {
    VIRGL_TRANSFER_MAP_WRITE_TO_STAGING_WITH_READBACK,
 };
 
+static void
+virgl_resource_free_transfer(struct virgl_context *vctx,
+                             struct virgl_transfer *trans,
+                             struct slab_child_pool *pool);
+
 /* Check if copy transfer from host can be used:
  *  1. if resource is a texture,
  *  2. if renderer supports copy transfer from host,
@@ -66,9 +71,9 @@ enum virgl_transfer_map_type {
 static bool virgl_can_readback_from_rendertarget(struct virgl_screen *vs,
                                                  struct virgl_resource *res)
 {
-   return res->b.nr_samples < 2 &&
-         vs->base.is_format_supported(&vs->base, res->b.format, res->b.target,
-                                      res->b.nr_samples, res->b.nr_samples,
+   return res->b.b.nr_samples < 2 &&
+         vs->base.is_format_supported(&vs->base, res->b.b.format, res->b.b.target,
+                                      res->b.b.nr_samples, res->b.b.nr_samples,
                                       PIPE_BIND_RENDER_TARGET);
 }
 
@@ -78,20 +83,20 @@ static bool virgl_can_readback_from_scanout(struct virgl_screen *vs,
 {
    return (vs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_SCANOUT_USES_GBM) &&
          (bind & VIRGL_BIND_SCANOUT) &&
-         virgl_has_scanout_format(vs, res->b.format, true);
+         virgl_has_scanout_format(vs, res->b.b.format, true);
 }
 
 static bool virgl_can_use_staging(struct virgl_screen *vs,
                                   struct virgl_resource *res)
 {
    return (vs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_COPY_TRANSFER_BOTH_DIRECTIONS) &&
-         (res->b.target != PIPE_BUFFER);
+         (res->b.b.target != PIPE_BUFFER);
 }
 
 static bool is_stencil_array(struct virgl_resource *res)
 {
-   const struct util_format_description *descr = util_format_description(res->b.format);
-   return (res->b.array_size > 1 || res->b.depth0 > 1) && util_format_has_stencil(descr);
+   const struct util_format_description *descr = util_format_description(res->b.b.format);
+   return (res->b.b.array_size > 1 || res->b.b.depth0 > 1) && util_format_has_stencil(descr);
 }
 
 static bool virgl_can_copy_transfer_from_host(struct virgl_screen *vs,
@@ -101,7 +106,7 @@ static bool virgl_can_copy_transfer_from_host(struct virgl_screen *vs,
    return virgl_can_use_staging(vs, res) &&
          !is_stencil_array(res) &&
          !(bind & VIRGL_BIND_SHARED) &&
-         virgl_has_readback_format(&vs->base, pipe_to_virgl_format(res->b.format), false) &&
+         virgl_has_readback_format(&vs->base, pipe_to_virgl_format(res->b.b.format), false) &&
          ((!(vs->caps.caps.v2.capability_bits & VIRGL_CAP_HOST_IS_GLES)) ||
           virgl_can_readback_from_rendertarget(vs, res) ||
           virgl_can_readback_from_scanout(vs, res, bind));
@@ -117,9 +122,9 @@ static bool virgl_res_needs_flush(struct virgl_context *vctx,
                                   struct virgl_transfer *trans)
 {
    struct virgl_winsys *vws = virgl_screen(vctx->base.screen)->vws;
-   struct virgl_resource *res = virgl_resource(trans->base.resource);
+   struct virgl_resource *res = virgl_resource(trans->base.b.resource);
 
-   if (trans->base.usage & PIPE_MAP_UNSYNCHRONIZED)
+   if (trans->base.b.usage & PIPE_MAP_UNSYNCHRONIZED)
       return false;
 
    if (!vws->res_is_referenced(vws, vctx->cbuf, res->hw_res))
@@ -159,14 +164,14 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
 {
    struct virgl_screen *vs = virgl_screen(vctx->base.screen);
    struct virgl_winsys *vws = vs->vws;
-   struct virgl_resource *res = virgl_resource(xfer->base.resource);
+   struct virgl_resource *res = virgl_resource(xfer->base.b.resource);
    enum virgl_transfer_map_type map_type = VIRGL_TRANSFER_MAP_HW_RES;
    bool flush;
    bool readback;
    bool wait;
 
    /* there is no way to map the host storage currently */
-   if (xfer->base.usage & PIPE_MAP_DIRECTLY)
+   if (xfer->base.b.usage & PIPE_MAP_DIRECTLY)
       return VIRGL_TRANSFER_MAP_ERROR;
 
    /* We break the logic down into four steps
@@ -178,21 +183,22 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
     */
 
    flush = virgl_res_needs_flush(vctx, xfer);
-   readback = virgl_res_needs_readback(vctx, res, xfer->base.usage,
-                                       xfer->base.level);
+   readback = virgl_res_needs_readback(vctx, res, xfer->base.b.usage,
+                                       xfer->base.b.level);
    /* We need to wait for all cmdbufs, current or previous, that access the
     * resource to finish unless synchronization is disabled.
     */
-   wait = !(xfer->base.usage & PIPE_MAP_UNSYNCHRONIZED);
+   wait = !(xfer->base.b.usage & PIPE_MAP_UNSYNCHRONIZED);
 
    /* When the transfer range consists of only uninitialized data, we can
     * assume the GPU is not accessing the range and readback is unnecessary.
     * We can proceed as if PIPE_MAP_UNSYNCHRONIZED and
     * PIPE_MAP_DISCARD_RANGE are set.
     */
-   if (res->b.target == PIPE_BUFFER &&
-       !util_ranges_intersect(&res->valid_buffer_range, xfer->base.box.x,
-                              xfer->base.box.x + xfer->base.box.width) &&
+   if (res->b.b.target == PIPE_BUFFER &&
+       !(xfer->base.b.usage & TC_TRANSFER_MAP_NO_INFER_UNSYNCHRONIZED) &&
+       !util_ranges_intersect(&res->valid_buffer_range, xfer->base.b.box.x,
+                              xfer->base.b.box.x + xfer->base.b.box.width) &&
        likely(!(virgl_debug & VIRGL_DEBUG_XFER))) {
       flush = false;
       readback = false;
@@ -201,9 +207,13 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
 
    /* When the resource is busy but its content can be discarded, we can
     * replace its HW resource or use a staging buffer to avoid waiting.
+    * Both need the context, and rebinding re-creates the host objects of
+    * views, so threaded unsynchronized maps never get here: they never
+    * wait.
     */
+   assert(!wait || !(xfer->base.b.usage & TC_TRANSFER_MAP_THREADED_UNSYNC));
    if (wait && !is_blob &&
-       (xfer->base.usage & (PIPE_MAP_DISCARD_RANGE |
+       (xfer->base.b.usage & (PIPE_MAP_DISCARD_RANGE |
                             PIPE_MAP_DISCARD_WHOLE_RESOURCE)) &&
        likely(!(virgl_debug & VIRGL_DEBUG_XFER))) {
       bool can_realloc = false;
@@ -214,8 +224,9 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
        * otherwise those following unsynchronized transfers may overwrite
        * valid data.
        */
-      if (xfer->base.usage & PIPE_MAP_DISCARD_WHOLE_RESOURCE) {
-         can_realloc = virgl_can_rebind_resource(vctx, &res->b);
+      if ((xfer->base.b.usage & PIPE_MAP_DISCARD_WHOLE_RESOURCE) &&
+          !(xfer->base.b.usage & TC_TRANSFER_MAP_NO_INVALIDATE)) {
+         can_realloc = virgl_can_rebind_resource(vctx, &res->b.b);
       }
 
       /* discard implies no readback */
@@ -244,13 +255,42 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
       }
    }
 
+   /* A readback issued right after a flush (virgl_resource_issue_readbacks)
+    * makes the guest storage up to date, but only once the transfer has
+    * completed.  Wait for it instead of issuing another one, even when
+    * synchronization is disabled.
+    */
+   if (readback && res->readback_pending) {
+      if (xfer->base.b.usage & TC_TRANSFER_MAP_THREADED_UNSYNC)
+         threaded_context_unwrap_sync(&vctx->tc->base);
+
+      if ((xfer->base.b.usage & PIPE_MAP_DONTBLOCK) &&
+          vws->resource_is_busy(vws, res->hw_res))
+         return VIRGL_TRANSFER_MAP_ERROR;
+
+      vws->resource_wait(vws, res->hw_res);
+      res->clean_mask |= 1;
+      res->readback_pending = false;
+      readback = false;
+   }
+
    /* readback has some implications */
    if (readback) {
+      /* A threaded unsynchronized map runs on the frontend thread, while
+       * the driver thread may be using the context.  Readback has to check
+       * the transfer queue and may flush, so this is the one case where such
+       * a map waits for the driver thread to go idle.  TC only produces
+       * these for unsynchronized reads, and they only need a readback when
+       * the host wrote the resource since the last one.
+       */
+      if (xfer->base.b.usage & TC_TRANSFER_MAP_THREADED_UNSYNC)
+         threaded_context_unwrap_sync(&vctx->tc->base);
+
       /* If we are performing readback for textures and renderer supports
        * copy_transfer_from_host, then we can return here with proper map.
        */
       if (res->use_staging) {
-         if (xfer->base.usage & PIPE_MAP_READ)
+         if (xfer->base.b.usage & PIPE_MAP_READ)
             return VIRGL_TRANSFER_MAP_READ_FROM_STAGING;
          else
             return VIRGL_TRANSFER_MAP_WRITE_TO_STAGING_WITH_READBACK;
@@ -273,7 +313,7 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
     * during which another unsynchronized map could write to the resource
     * contents, leaving the contents in an undefined state.
     */
-   if ((xfer->base.usage & PIPE_MAP_DONTBLOCK) &&
+   if ((xfer->base.b.usage & PIPE_MAP_DONTBLOCK) &&
        (readback || (wait && vws->resource_is_busy(vws, res->hw_res))))
       return VIRGL_TRANSFER_MAP_ERROR;
 
@@ -284,8 +324,8 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
        */
       if (!is_blob) {
          vws->resource_wait(vws, res->hw_res);
-         vws->transfer_get(vws, res->hw_res, &xfer->base.box, xfer->base.stride,
-                           xfer->l_stride, xfer->offset, xfer->base.level);
+         vws->transfer_get(vws, res->hw_res, &xfer->base.b.box, xfer->base.b.stride,
+                           xfer->l_stride, xfer->offset, xfer->base.b.level);
       }
       /* transfer_get puts the resource into a maybe_busy state, so we will have
        * to wait another time if we want to use that resource. */
@@ -311,8 +351,8 @@ virgl_transfer_map_size(struct virgl_transfer *vtransfer,
                         unsigned *out_stride,
                         uintptr_t *out_layer_stride)
 {
-   struct pipe_resource *pres = vtransfer->base.resource;
-   struct pipe_box *box = &vtransfer->base.box;
+   struct pipe_resource *pres = vtransfer->base.b.resource;
+   struct pipe_box *box = &vtransfer->base.b.box;
    unsigned stride;
    uintptr_t layer_stride;
    unsigned size;
@@ -345,7 +385,7 @@ static void *
 virgl_staging_map(struct virgl_context *vctx,
                   struct virgl_transfer *vtransfer)
 {
-   struct virgl_resource *vres = virgl_resource(vtransfer->base.resource);
+   struct virgl_resource *vres = virgl_resource(vtransfer->base.b.resource);
    unsigned size;
    unsigned align_offset;
    unsigned stride;
@@ -370,8 +410,8 @@ virgl_staging_map(struct virgl_context *vctx,
     *         |---|             ==> align_offset
     *         |------------|    ==> allocation of size + align_offset
     */
-   align_offset = vres->b.target == PIPE_BUFFER ?
-                  vtransfer->base.box.x % VIRGL_MAP_BUFFER_ALIGNMENT :
+   align_offset = vres->b.b.target == PIPE_BUFFER ?
+                  vtransfer->base.b.box.x % VIRGL_MAP_BUFFER_ALIGNMENT :
                   0;
 
    alloc_succeeded =
@@ -390,14 +430,14 @@ virgl_staging_map(struct virgl_context *vctx,
        * without going through the corresponding guest side resource, and
        * hence the two will diverge.
        */
-      virgl_resource_dirty(vres, vtransfer->base.level);
+      virgl_resource_dirty(vres, vtransfer->base.b.level);
 
       /* We are using the minimum required size to hold the contents,
        * possibly using a layout different from the layout of the resource,
        * so update the transfer strides accordingly.
        */
-      vtransfer->base.stride = stride;
-      vtransfer->base.layer_stride = layer_stride;
+      vtransfer->base.b.stride = stride;
+      vtransfer->base.b.layer_stride = layer_stride;
 
       /* Track the total size of active staging resources. */
       vctx->queued_staging_res_size += size + align_offset;
@@ -415,7 +455,7 @@ virgl_staging_read_map(struct virgl_context *vctx,
 {
    struct virgl_screen *vscreen = virgl_screen(vctx->base.screen);
    struct virgl_winsys *vws = vscreen->vws;
-   assert(vtransfer->base.resource->target != PIPE_BUFFER);
+   assert(vtransfer->base.b.resource->target != PIPE_BUFFER);
    void *map_addr;
 
    /* There are two possibilities to perform readback via:
@@ -440,7 +480,7 @@ static bool
 virgl_resource_realloc(struct virgl_context *vctx, struct virgl_resource *res)
 {
    struct virgl_screen *vs = virgl_screen(vctx->base.screen);
-   const struct pipe_resource *templ = &res->b;
+   const struct pipe_resource *templ = &res->b.b;
    unsigned vbind, vflags;
    struct virgl_hw_res *hw_res;
 
@@ -467,6 +507,8 @@ virgl_resource_realloc(struct virgl_context *vctx, struct virgl_resource *res)
 
    vs->vws->resource_reference(vs->vws, &res->hw_res, NULL);
    res->hw_res = hw_res;
+   res->storage_generation++;
+   res->readback_pending = false;
 
    /* We can safely clear the range here, since it will be repopulated in the
     * following rebind operation, according to the active buffer binds.
@@ -476,7 +518,7 @@ virgl_resource_realloc(struct virgl_context *vctx, struct virgl_resource *res)
    /* count toward the staging resource size limit */
    vctx->queued_staging_res_size += res->metadata.total_size;
 
-   virgl_rebind_resource(vctx, &res->b);
+   virgl_rebind_resource(vctx, &res->b.b);
 
    return true;
 }
@@ -514,6 +556,10 @@ virgl_resource_transfer_map(struct pipe_context *ctx,
 
    bool is_blob = usage & (PIPE_MAP_COHERENT | PIPE_MAP_PERSISTENT);
 
+   /* only buffers the CPU reads are worth reading back ahead of time */
+   if (resource->target == PIPE_BUFFER && (usage & PIPE_MAP_READ))
+      vres->mapped_for_read = true;
+
    trans = virgl_resource_create_transfer(vctx, resource,
                                           &vres->metadata, level, usage, box);
 
@@ -558,15 +604,18 @@ virgl_resource_transfer_map(struct pipe_context *ctx,
    }
 
    if (!map_addr) {
-      virgl_resource_destroy_transfer(vctx, trans);
+      virgl_resource_free_transfer(vctx, trans,
+                                   (usage & TC_TRANSFER_MAP_THREADED_UNSYNC) ?
+                                   &vctx->transfer_pool_unsync :
+                                   &vctx->transfer_pool);
       return NULL;
    }
 
-   if (vres->b.target == PIPE_BUFFER) {
+   if (vres->b.b.target == PIPE_BUFFER) {
       /* For the checks below to be able to use 'usage', we assume that
        * transfer preparation doesn't affect the usage.
        */
-      assert(usage == trans->base.usage);
+      assert(usage == trans->base.b.usage);
 
       /* If we are doing a whole resource discard with a hw_res map, the buffer
        * storage can now be considered unused and we don't care about previous
@@ -585,10 +634,10 @@ virgl_resource_transfer_map(struct pipe_context *ctx,
       }
 
       if (usage & PIPE_MAP_WRITE)
-          util_range_add(&vres->b, &vres->valid_buffer_range, box->x, box->x + box->width);
+          util_range_add(&vres->b.b, &vres->valid_buffer_range, box->x, box->x + box->width);
    }
 
-   *transfer = &trans->base;
+   *transfer = &trans->base.b;
    return map_addr;
 }
 
@@ -646,12 +695,12 @@ static struct pipe_resource *virgl_resource_create_front(struct pipe_screen *scr
    struct virgl_resource *res = CALLOC_STRUCT(virgl_resource);
    uint32_t alloc_size;
 
-   res->b = *templ;
-   res->b.screen = &vs->base;
-   pipe_reference_init(&res->b.reference, 1);
+   res->b.b = *templ;
+   res->b.b.screen = &vs->base;
+   pipe_reference_init(&res->b.b.reference, 1);
    vbind = pipe_to_virgl_bind(vs, templ->bind);
    vflags = pipe_to_virgl_flags(vs, templ->flags);
-   virgl_resource_layout(&res->b, &res->metadata, 0, 0, 0, 0);
+   virgl_resource_layout(&res->b.b, &res->metadata, 0, 0, 0, 0);
 
    if ((vs->caps.caps.v2.capability_bits & VIRGL_CAP_APP_TWEAK_SUPPORT) &&
        vs->tweak_gles_emulate_bgra &&
@@ -691,13 +740,15 @@ static struct pipe_resource *virgl_resource_create_front(struct pipe_screen *scr
    res->clean_mask = (1 << VR_MAX_TEXTURE_2D_LEVELS) - 1;
 
    if (templ->target == PIPE_BUFFER) {
+      threaded_resource_init(&res->b.b, false);
+      res->b.buffer_id_unique = util_idalloc_mt_alloc(&vs->buffer_ids);
       util_range_init(&res->valid_buffer_range);
       virgl_buffer_init(res);
    } else {
       virgl_texture_init(res);
    }
 
-   return &res->b;
+   return &res->b.b;
 
 }
 
@@ -722,13 +773,13 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
 
    struct virgl_resource *res = CALLOC_STRUCT(virgl_resource);
    if (templ)
-      res->b = *templ;
-   res->b.screen = &vs->base;
-   pipe_reference_init(&res->b.reference, 1);
+      res->b.b = *templ;
+   res->b.b.screen = &vs->base;
+   pipe_reference_init(&res->b.b.reference, 1);
 
    plane = winsys_stride = plane_offset = modifier = 0;
    res->hw_res = vs->vws->resource_create_from_handle(vs->vws, whandle,
-                                                      &res->b,
+                                                      &res->b.b,
                                                       &plane,
                                                       &winsys_stride,
                                                       &plane_offset,
@@ -747,7 +798,7 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
       modifier = 0;
    }
 
-   virgl_resource_layout(&res->b, &res->metadata, plane, winsys_stride,
+   virgl_resource_layout(&res->b.b, &res->metadata, plane, winsys_stride,
                          plane_offset, modifier);
 
    /*
@@ -770,17 +821,17 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
       uint32_t plane_strides[VIRGL_MAX_PLANE_COUNT];
       uint32_t plane_offsets[VIRGL_MAX_PLANE_COUNT];
       uint32_t plane_count = 0;
-      struct pipe_resource *iter = &res->b;
+      struct pipe_resource *iter = &res->b.b;
 
       do {
          struct virgl_resource *plane = virgl_resource(iter);
 
          /* must be a plain 2D texture sharing the same hw_res */
-         if (plane->b.target != PIPE_TEXTURE_2D ||
-             plane->b.depth0 != 1 ||
-             plane->b.array_size != 1 ||
-             plane->b.last_level != 0 ||
-             plane->b.nr_samples > 1 ||
+         if (plane->b.b.target != PIPE_TEXTURE_2D ||
+             plane->b.b.depth0 != 1 ||
+             plane->b.b.array_size != 1 ||
+             plane->b.b.last_level != 0 ||
+             plane->b.b.nr_samples > 1 ||
              plane->hw_res != res->hw_res ||
              plane_count >= VIRGL_MAX_PLANE_COUNT) {
             vs->vws->resource_reference(vs->vws, &res->hw_res, NULL);
@@ -796,10 +847,10 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
 
       vs->vws->resource_set_type(vs->vws,
                                  res->hw_res,
-                                 pipe_to_virgl_format(res->b.format),
-                                 pipe_to_virgl_bind(vs, res->b.bind),
-                                 res->b.width0,
-                                 res->b.height0,
+                                 pipe_to_virgl_format(res->b.b.format),
+                                 pipe_to_virgl_bind(vs, res->b.b.bind),
+                                 res->b.b.width0,
+                                 res->b.b.height0,
                                  usage,
                                  res->metadata.modifier,
                                  plane_count,
@@ -809,7 +860,7 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
 
    virgl_texture_init(res);
 
-   return &res->b;
+   return &res->b.b;
 }
 
 static bool
@@ -857,12 +908,14 @@ static void virgl_buffer_subdata(struct pipe_context *pipe,
     * the simplest way to make sure that is the case is to check the valid
     * buffer range.
     */
-   if (!util_ranges_intersect(&vbuf->valid_buffer_range,
+   if (!(usage & (TC_TRANSFER_MAP_NO_INFER_UNSYNCHRONIZED |
+                  TC_TRANSFER_MAP_NO_INVALIDATE)) &&
+       !util_ranges_intersect(&vbuf->valid_buffer_range,
                               offset, offset + size) &&
        likely(!(virgl_debug & VIRGL_DEBUG_XFER)) &&
        virgl_transfer_queue_extend_buffer(&vctx->queue,
                                           vbuf->hw_res, offset, size, data)) {
-      util_range_add(&vbuf->b, &vbuf->valid_buffer_range, offset, offset + size);
+      util_range_add(&vbuf->b.b, &vbuf->valid_buffer_range, offset, offset + size);
       return;
    }
 
@@ -913,35 +966,40 @@ virgl_resource_create_transfer(struct virgl_context *vctx,
    offset += blocksy * metadata->stride[level];
    offset += blocksx * util_format_get_blocksize(format);
 
-   trans = slab_zalloc(&vctx->transfer_pool);
+   if (usage & TC_TRANSFER_MAP_THREADED_UNSYNC)
+      trans = slab_zalloc(&vctx->transfer_pool_unsync);
+   else
+      trans = slab_zalloc(&vctx->transfer_pool);
    if (!trans)
       return NULL;
 
-   pipe_resource_reference(&trans->base.resource, pres);
+   pipe_resource_reference(&trans->base.b.resource, pres);
    vws->resource_reference(vws, &trans->hw_res, virgl_resource(pres)->hw_res);
 
-   trans->base.level = level;
-   trans->base.usage = usage;
-   trans->base.box = *box;
-   trans->base.stride = metadata->stride[level];
-   trans->base.layer_stride = metadata->layer_stride[level];
+   trans->base.b.level = level;
+   trans->base.b.usage = usage;
+   trans->base.b.box = *box;
+   trans->base.b.stride = metadata->stride[level];
+   trans->base.b.layer_stride = metadata->layer_stride[level];
    trans->offset = offset;
    util_range_init(&trans->range);
 
-   if (trans->base.resource->target != PIPE_TEXTURE_3D &&
-       trans->base.resource->target != PIPE_TEXTURE_CUBE &&
-       trans->base.resource->target != PIPE_TEXTURE_1D_ARRAY &&
-       trans->base.resource->target != PIPE_TEXTURE_2D_ARRAY &&
-       trans->base.resource->target != PIPE_TEXTURE_CUBE_ARRAY)
+   if (trans->base.b.resource->target != PIPE_TEXTURE_3D &&
+       trans->base.b.resource->target != PIPE_TEXTURE_CUBE &&
+       trans->base.b.resource->target != PIPE_TEXTURE_1D_ARRAY &&
+       trans->base.b.resource->target != PIPE_TEXTURE_2D_ARRAY &&
+       trans->base.b.resource->target != PIPE_TEXTURE_CUBE_ARRAY)
       trans->l_stride = 0;
    else
-      trans->l_stride = trans->base.layer_stride;
+      trans->l_stride = trans->base.b.layer_stride;
 
    return trans;
 }
 
-void virgl_resource_destroy_transfer(struct virgl_context *vctx,
-                                     struct virgl_transfer *trans)
+static void
+virgl_resource_free_transfer(struct virgl_context *vctx,
+                             struct virgl_transfer *trans,
+                             struct slab_child_pool *pool)
 {
    struct virgl_winsys *vws = virgl_screen(vctx->base.screen)->vws;
 
@@ -949,8 +1007,17 @@ void virgl_resource_destroy_transfer(struct virgl_context *vctx,
 
    util_range_destroy(&trans->range);
    vws->resource_reference(vws, &trans->hw_res, NULL);
-   pipe_resource_reference(&trans->base.resource, NULL);
-   slab_free(&vctx->transfer_pool, trans);
+   pipe_resource_reference(&trans->base.b.resource, NULL);
+   slab_free(pool, trans);
+}
+
+void virgl_resource_destroy_transfer(struct virgl_context *vctx,
+                                     struct virgl_transfer *trans)
+{
+   /* Transfers are released on the driver thread, including those that
+    * were allocated from transfer_pool_unsync.
+    */
+   virgl_resource_free_transfer(vctx, trans, &vctx->transfer_pool);
 }
 
 void virgl_resource_destroy(struct pipe_screen *screen,
@@ -959,8 +1026,12 @@ void virgl_resource_destroy(struct pipe_screen *screen,
    struct virgl_screen *vs = virgl_screen(screen);
    struct virgl_resource *res = virgl_resource(resource);
 
-   if (res->b.target == PIPE_BUFFER)
+   if (res->b.b.target == PIPE_BUFFER) {
       util_range_destroy(&res->valid_buffer_range);
+      if (res->b.buffer_id_unique)
+         util_idalloc_mt_free(&vs->buffer_ids, res->b.buffer_id_unique);
+      threaded_resource_deinit(resource);
+   }
 
    vs->vws->resource_reference(vs->vws, &res->hw_res, NULL);
    FREE(res);
@@ -975,7 +1046,7 @@ bool virgl_resource_get_handle(struct pipe_screen *screen,
    struct virgl_screen *vs = virgl_screen(screen);
    struct virgl_resource *res = virgl_resource(resource);
 
-   if (res->b.target == PIPE_BUFFER)
+   if (res->b.b.target == PIPE_BUFFER)
       return false;
 
    return vs->vws->resource_get_handle(vs->vws, res->hw_res,
@@ -986,9 +1057,91 @@ bool virgl_resource_get_handle(struct pipe_screen *screen,
 void virgl_resource_dirty(struct virgl_resource *res, uint32_t level)
 {
    if (res) {
-      if (res->b.target == PIPE_BUFFER)
+      if (res->b.b.target == PIPE_BUFFER) {
          res->clean_mask &= ~1;
-      else
+         res->readback_pending = false;
+      } else
          res->clean_mask &= ~(1 << level);
    }
 }
+
+/* Only the GPU writes to the buffer through these, and not at a point in
+ * time we can track.
+ */
+#define VIRGL_READBACK_UNSAFE_BINDS (PIPE_BIND_SHADER_BUFFER | \
+                                     PIPE_BIND_SHADER_IMAGE | \
+                                     PIPE_BIND_STREAM_OUTPUT)
+
+/* Staging buffers written by copies and blits, and that were mapped for
+ * reading before, are most likely going to be read by the CPU next (pixel
+ * pack buffers, glGetBufferSubData after a copy).  Instead of issuing the
+ * readback at map time and waiting for it there, queue it to be issued right
+ * after the next flush.  It then runs on the host behind the rendering that
+ * produced the data, and the map only has to wait for it to complete.
+ */
+void virgl_resource_queue_readback(struct virgl_context *vctx,
+                                   struct virgl_resource *res)
+{
+   unsigned i;
+
+   if (res->b.b.target != PIPE_BUFFER ||
+       res->b.b.usage != PIPE_USAGE_STAGING ||
+       !res->mapped_for_read ||
+       res->use_staging || res->blob_mem ||
+       (res->bind_history & VIRGL_READBACK_UNSAFE_BINDS) ||
+       unlikely(virgl_debug & VIRGL_DEBUG_XFER))
+      return;
+
+   for (i = 0; i < vctx->num_readbacks; i++) {
+      if (vctx->readbacks[i] == &res->b.b)
+         return;
+   }
+
+   /* Too many in flight, the map will do the readback itself. */
+   if (vctx->num_readbacks == ARRAY_SIZE(vctx->readbacks))
+      return;
+
+   pipe_resource_reference(&vctx->readbacks[vctx->num_readbacks++], &res->b.b);
+}
+
+/* Called right after the command buffer was submitted. */
+void virgl_resource_issue_readbacks(struct virgl_context *vctx)
+{
+   struct virgl_winsys *vws = virgl_screen(vctx->base.screen)->vws;
+   unsigned i;
+
+   for (i = 0; i < vctx->num_readbacks; i++) {
+      struct virgl_resource *res = virgl_resource(vctx->readbacks[i]);
+      struct pipe_box box;
+
+      /* The buffer might have been bound for writing since it was queued, and
+       * a readback issued at map time has already made it clean.
+       */
+      if (!(res->bind_history & VIRGL_READBACK_UNSAFE_BINDS) &&
+          !(res->clean_mask & 1) && !res->readback_pending &&
+          res->valid_buffer_range.start < res->valid_buffer_range.end) {
+         u_box_1d(res->valid_buffer_range.start,
+                  res->valid_buffer_range.end - res->valid_buffer_range.start,
+                  &box);
+         vws->transfer_get(vws, res->hw_res, &box, 0, 0, box.x, 0);
+
+         /* The transfer makes hw_res busy until it completes.  Maps wait
+          * for that before treating the buffer as clean, and any later GPU
+          * write cancels it.
+          */
+         res->readback_pending = true;
+      }
+
+      pipe_resource_reference(&vctx->readbacks[i], NULL);
+   }
+   vctx->num_readbacks = 0;
+}
+
+void virgl_resource_drop_readbacks(struct virgl_context *vctx)
+{
+   unsigned i;
+
+   for (i = 0; i < vctx->num_readbacks; i++)
+      pipe_resource_reference(&vctx->readbacks[i], NULL);
+   vctx->num_readbacks = 0;
+}
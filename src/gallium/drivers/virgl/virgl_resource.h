@@ -28,6 +28,7 @@
 #include "util/u_range.h"
 #include "util/list.h"
 #include "util/u_transfer.h"
+#include "util/u_threaded_context.h"
 
 #include "virtio-gpu/virgl_hw.h"
 #include "virgl_screen.h"
@@ -51,7 +52,7 @@ struct virgl_resource_metadata
 };
 
 struct virgl_resource {
-   struct pipe_resource b;
+   struct threaded_resource b;
    struct virgl_hw_res *hw_res;
    struct virgl_resource_metadata metadata;
 
@@ -71,10 +72,25 @@ struct virgl_resource {
    uint16_t clean_mask;
    uint16_t use_staging : 1;
    uint16_t reserved : 15;
+
+   /* For PIPE_BUFFER only, see virgl_resource_queue_readback().  A readback
+    * was issued after the last GPU write, and the buffer becomes clean once
+    * it has completed.  These are not bitfields because buffer maps may set
+    * mapped_for_read from the frontend thread.
+    */
+   bool readback_pending;
+   bool mapped_for_read;
+
+   /* Bumped whenever hw_res is swapped for a buffer (reallocation or
+    * threaded_context buffer replacement).  Host objects created against
+    * an older storage (sampler views, stream output targets) compare
+    * against this to know when they have to be re-created.
+    */
+   uint32_t storage_generation;
 };
 
 struct virgl_transfer {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
    uint32_t offset, l_stride;
    struct util_range range;
    struct list_head queue_link;
@@ -207,6 +223,13 @@ bool virgl_resource_get_handle(struct pipe_screen *screen,
 
 void virgl_resource_dirty(struct virgl_resource *res, uint32_t level);
 
+void virgl_resource_queue_readback(struct virgl_context *vctx,
+                                   struct virgl_resource *res);
+
+void virgl_resource_issue_readbacks(struct virgl_context *vctx);
+
+void virgl_resource_drop_readbacks(struct virgl_context *vctx);
+
 void *virgl_texture_transfer_map(struct pipe_context *ctx,
                                  struct pipe_resource *resource,
                                  unsigned level,
@@ -29,11 +29,16 @@
 #include "util/u_inlines.h"
 #include "util/os_time.h"
 #include "util/xmlconfig.h"
+#include "util/u_threaded_context.h"
+#include "util/hash_table.h"
+#include "util/blob.h"
+#include "compiler/nir/nir_serialize.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "nir/nir_to_tgsi.h"
 #include "vl/vl_decoder.h"
 #include "vl/vl_video_buffer.h"
+#include "git_sha1.h"
 
 #include "virgl_screen.h"
 #include "virgl_resource.h"
@@ -53,9 +58,14 @@ const struct debug_named_value virgl_debug_options[] = {
    { "nocoherent",      VIRGL_DEBUG_NO_COHERENT,             "Disable coherent memory" },
    { "video",           VIRGL_DEBUG_VIDEO,                   "Video codec" },
    { "shader_sync",     VIRGL_DEBUG_SHADER_SYNC,             "Sync after every shader link" },
+   { "notc",            VIRGL_DEBUG_NO_TC,                   "Disable the threaded context" },
+   { "nonir",           VIRGL_DEBUG_NO_NIR_SHADER,           "Send shaders as TGSI even if the host accepts NIR" },
+   { "compress",        VIRGL_DEBUG_COMPRESS,                "Compress large inline payloads if the host can inflate them" },
    DEBUG_NAMED_VALUE_END
 };
 DEBUG_GET_ONCE_FLAGS_OPTION(virgl_debug, "VIRGL_DEBUG", virgl_debug_options, 0)
+DEBUG_GET_ONCE_NUM_OPTION(virgl_compress_min_size, "VIRGL_COMPRESS_MIN_SIZE", 4096)
+DEBUG_GET_ONCE_OPTION(virgl_cmdbuf_capture, "VIRGL_CMDBUF_CAPTURE", NULL)
 
 static const char *
 virgl_get_vendor(struct pipe_screen *screen)
@@ -957,7 +967,10 @@ static bool virgl_fence_finish(struct pipe_screen *screen,
 {
    struct virgl_screen *vscreen = virgl_screen(screen);
    struct virgl_winsys *vws = vscreen->vws;
-   struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_context *vctx;
+
+   ctx = threaded_context_unwrap_sync(ctx);
+   vctx = virgl_context(ctx);
 
    if (vctx && timeout)
       virgl_flush_eq(vctx, NULL, NULL);
@@ -974,6 +987,194 @@ static int virgl_fence_get_fd(struct pipe_screen *screen,
    return vws->fence_get_fd(vws, fence);
 }
 
+/* Shaders created from NIR are cached as the final TGSI text that gets sent to
+ * the host, so that neither nir_to_tgsi nor the text dump has to run again for
+ * a shader that was seen before, in this process or, through the disk cache,
+ * in an earlier one.  The in-memory cache keeps the most recently used
+ * entries up to VIRGL_SHADER_CACHE_MAX_SIZE bytes of text.
+ */
+#define VIRGL_SHADER_CACHE_MAX_SIZE (4 * 1024 * 1024)
+
+struct virgl_shader_cache_entry {
+   cache_key key;
+   struct list_head link;  /* in virgl_screen::shader_cache_lru */
+   size_t text_size;
+   uint32_t num_tokens;
+   char text[];
+};
+
+static uint32_t
+virgl_shader_cache_key_hash(const void *key)
+{
+   /* The key is a sha1, any part of it is as good a hash as any other. */
+   return *(const uint32_t *)key;
+}
+
+static bool
+virgl_shader_cache_key_equals(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(cache_key)) == 0;
+}
+
+static void
+virgl_shader_cache_free_entry(struct hash_entry *entry)
+{
+   FREE(entry->data);
+}
+
+void
+virgl_shader_cache_compute_key(struct virgl_screen *vs, const nir_shader *nir,
+                               cache_key key)
+{
+   struct mesa_sha1 ctx;
+   struct blob blob;
+   unsigned char sha1[20];
+
+   blob_init(&blob);
+   nir_serialize(&blob, nir, true);
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, blob.data, blob.size);
+   /* Lowering depends on these; the disk cache id covers all of the caps
+    * already, but the in-memory cache does not go through it. */
+   _mesa_sha1_update(&ctx, &vs->caps.caps.v2.host_feature_check_version,
+                     sizeof(vs->caps.caps.v2.host_feature_check_version));
+   _mesa_sha1_update(&ctx, &vs->caps.caps.v2.capability_bits,
+                     sizeof(vs->caps.caps.v2.capability_bits));
+   _mesa_sha1_update(&ctx, &vs->caps.caps.v2.capability_bits_v2,
+                     sizeof(vs->caps.caps.v2.capability_bits_v2));
+   _mesa_sha1_final(&ctx, sha1);
+   blob_finish(&blob);
+
+   if (vs->disk_cache)
+      disk_cache_compute_key(vs->disk_cache, sha1, sizeof(sha1), key);
+   else
+      memcpy(key, sha1, sizeof(cache_key));
+}
+
+static struct virgl_shader_cache_entry *
+virgl_shader_cache_add_locked(struct virgl_screen *vs, const cache_key key,
+                              const char *text, size_t text_size,
+                              uint32_t num_tokens)
+{
+   struct virgl_shader_cache_entry *entry;
+
+   entry = MALLOC(sizeof(*entry) + text_size);
+   if (!entry)
+      return NULL;
+
+   memcpy(entry->key, key, sizeof(cache_key));
+   entry->text_size = text_size;
+   entry->num_tokens = num_tokens;
+   memcpy(entry->text, text, text_size);
+   _mesa_hash_table_insert(vs->shader_cache, entry->key, entry);
+   list_add(&entry->link, &vs->shader_cache_lru);
+   vs->shader_cache_size += text_size;
+
+   /* Evict the least recently used entries, but always keep the new one. */
+   while (vs->shader_cache_size > VIRGL_SHADER_CACHE_MAX_SIZE &&
+          vs->shader_cache_lru.prev != &entry->link) {
+      struct virgl_shader_cache_entry *old =
+         list_last_entry(&vs->shader_cache_lru,
+                         struct virgl_shader_cache_entry, link);
+
+      _mesa_hash_table_remove_key(vs->shader_cache, old->key);
+      list_del(&old->link);
+      vs->shader_cache_size -= old->text_size;
+      FREE(old);
+   }
+
+   return entry;
+}
+
+/* Returns the entry's text, copied while the cache was locked */
+static char *
+virgl_shader_cache_copy_locked(struct virgl_screen *vs,
+                               struct virgl_shader_cache_entry *entry,
+                               uint32_t *num_tokens)
+{
+   char *text;
+
+   list_move_to(&entry->link, &vs->shader_cache_lru);
+
+   text = MALLOC(entry->text_size);
+   if (!text)
+      return NULL;
+
+   memcpy(text, entry->text, entry->text_size);
+   *num_tokens = entry->num_tokens;
+   return text;
+}
+
+/* Returns a copy of the cached text, to be freed with FREE(), or NULL on a
+ * miss.
+ */
+char *
+virgl_shader_cache_find(struct virgl_screen *vs, const cache_key key,
+                        uint32_t *num_tokens)
+{
+   struct virgl_shader_cache_entry *entry;
+   struct hash_entry *he;
+   char *text = NULL;
+
+   simple_mtx_lock(&vs->shader_cache_mutex);
+   he = _mesa_hash_table_search(vs->shader_cache, key);
+   if (he)
+      text = virgl_shader_cache_copy_locked(vs, he->data, num_tokens);
+   simple_mtx_unlock(&vs->shader_cache_mutex);
+
+   if (!he && vs->disk_cache) {
+      size_t size;
+      uint8_t *data = disk_cache_get(vs->disk_cache, key, &size);
+
+      /* uint32_t num_tokens followed by the NUL terminated text */
+      if (data && size > sizeof(uint32_t) && data[size - 1] == '\0') {
+         uint32_t disk_num_tokens;
+
+         memcpy(&disk_num_tokens, data, sizeof(disk_num_tokens));
+         simple_mtx_lock(&vs->shader_cache_mutex);
+         he = _mesa_hash_table_search(vs->shader_cache, key);
+         if (he)
+            entry = he->data;
+         else
+            entry = virgl_shader_cache_add_locked(vs, key,
+                                                  (const char *)data + sizeof(uint32_t),
+                                                  size - sizeof(uint32_t),
+                                                  disk_num_tokens);
+         if (entry)
+            text = virgl_shader_cache_copy_locked(vs, entry, num_tokens);
+         simple_mtx_unlock(&vs->shader_cache_mutex);
+      }
+      free(data);
+   }
+
+   return text;
+}
+
+void
+virgl_shader_cache_insert(struct virgl_screen *vs, const cache_key key,
+                          const char *text, uint32_t num_tokens)
+{
+   size_t text_size = strlen(text) + 1;
+   bool added = false;
+
+   simple_mtx_lock(&vs->shader_cache_mutex);
+   if (!_mesa_hash_table_search(vs->shader_cache, key))
+      added = virgl_shader_cache_add_locked(vs, key, text, text_size, num_tokens);
+   simple_mtx_unlock(&vs->shader_cache_mutex);
+
+   if (added && vs->disk_cache) {
+      struct blob blob;
+
+      blob_init(&blob);
+      blob_write_uint32(&blob, num_tokens);
+      blob_write_bytes(&blob, text, text_size);
+      if (!blob.out_of_memory)
+         disk_cache_put(vs->disk_cache, key, blob.data, blob.size, NULL);
+      blob_finish(&blob);
+   }
+}
+
 static void
 virgl_destroy_screen(struct pipe_screen *screen)
 {
@@ -981,15 +1182,43 @@ virgl_destroy_screen(struct pipe_screen *screen)
    struct virgl_winsys *vws = vscreen->vws;
 
    slab_destroy_parent(&vscreen->transfer_pool);
+   util_idalloc_mt_fini(&vscreen->buffer_ids);
 
    if (vws)
       vws->destroy(vws);
 
    disk_cache_destroy(vscreen->disk_cache);
 
+   _mesa_hash_table_destroy(vscreen->shader_cache, virgl_shader_cache_free_entry);
+   simple_mtx_destroy(&vscreen->shader_cache_mutex);
+
+   if (vscreen->cmdbuf_capture)
+      fclose(vscreen->cmdbuf_capture);
+   simple_mtx_destroy(&vscreen->cmdbuf_capture_mutex);
+
    FREE(vscreen);
 }
 
+/* nir_serialize() blobs can only be read by the same Mesa version that
+ * wrote them, so shaders are only sent as NIR when the host reads NIR with
+ * exactly our version.  Anything else falls back to TGSI.
+ */
+static bool
+virgl_host_reads_nir(const struct virgl_screen *vscreen)
+{
+   static const char version[] = PACKAGE_VERSION MESA_GIT_SHA1;
+   const union virgl_caps *caps = &vscreen->caps.caps;
+
+   STATIC_ASSERT(sizeof(version) <= sizeof(caps->v2.nir_version));
+
+   if (!(caps->v2.capability_bits_v2 & VIRGL_CAP_V2_NIR_SHADER) ||
+       (virgl_debug & VIRGL_DEBUG_NO_NIR_SHADER))
+      return false;
+
+   return strncmp(caps->v2.nir_version, version,
+                  sizeof(caps->v2.nir_version)) == 0;
+}
+
 static void
 fixup_formats(union virgl_caps *caps, struct virgl_supported_format_mask *mask)
 {
@@ -1031,7 +1260,7 @@ static void virgl_query_memory_info(struct pipe_screen *screen, struct pipe_memo
    virgl_encode_get_memory_info(vctx, res);
    ctx->flush(ctx, NULL, 0);
    vscreen->vws->resource_wait(vscreen->vws, res->hw_res);
-   pipe_buffer_read(ctx, &res->b, 0, sizeof(struct virgl_memory_info), &virgl_info);
+   pipe_buffer_read(ctx, &res->b.b, 0, sizeof(struct virgl_memory_info), &virgl_info);
 
    info->avail_device_memory = virgl_info.avail_device_memory;
    info->avail_staging_memory = virgl_info.avail_staging_memory;
@@ -1040,7 +1269,7 @@ static void virgl_query_memory_info(struct pipe_screen *screen, struct pipe_memo
    info->total_device_memory = virgl_info.total_device_memory;
    info->total_staging_memory = virgl_info.total_staging_memory;
 
-   screen->resource_destroy(screen, &res->b);
+   screen->resource_destroy(screen, &res->b.b);
    ctx->destroy(ctx);
 }
 
@@ -1143,6 +1372,29 @@ virgl_screen_get_fd(struct pipe_screen *pscreen)
       return -1;
 }
 
+/* Pick the codec for large inline payloads.  It has to be the one
+ * util_compress was built with, and the host has to be able to inflate it.
+ */
+static void
+virgl_compression_init(struct virgl_screen *vs)
+{
+#ifdef HAVE_COMPRESSION
+   const uint32_t caps = vs->caps.caps.v2.capability_bits_v2;
+
+   if (!(virgl_debug & VIRGL_DEBUG_COMPRESS))
+      return;
+
+#ifdef HAVE_ZSTD
+   if (caps & VIRGL_CAP_V2_COMPRESS_ZSTD)
+      vs->compression = VIRGL_COMPRESSION_ZSTD;
+#else
+   if (caps & VIRGL_CAP_V2_COMPRESS_ZLIB)
+      vs->compression = VIRGL_COMPRESSION_ZLIB;
+#endif
+   vs->compress_min_size = debug_get_option_virgl_compress_min_size();
+#endif
+}
+
 struct pipe_screen *
 virgl_create_screen(struct virgl_winsys *vws, const struct pipe_screen_config *config)
 {
@@ -1184,6 +1436,7 @@ virgl_create_screen(struct virgl_winsys *vws, const struct pipe_screen_config *c
    screen->base.get_vendor = virgl_get_vendor;
    screen->base.get_screen_fd = virgl_screen_get_fd;
    screen->base.get_param = virgl_get_param;
+   screen->base.get_driver_query_info = virgl_get_driver_query_info;
    screen->base.get_shader_param = virgl_get_shader_param;
    screen->base.get_video_param = virgl_get_video_param;
    screen->base.get_compute_param = virgl_get_compute_param;
@@ -1214,6 +1467,7 @@ virgl_create_screen(struct virgl_winsys *vws, const struct pipe_screen_config *c
 
    union virgl_caps *caps = &screen->caps.caps;
    screen->tweak_gles_emulate_bgra &= !virgl_format_check_bitmask(PIPE_FORMAT_B8G8R8A8_SRGB, caps->v1.render.bitmask, false);
+   screen->nir_shaders = virgl_host_reads_nir(screen);
    screen->refcnt = 1;
 
    /* Set up the NIR shader compiler options now that we've figured out the caps. */
@@ -1234,7 +1488,21 @@ virgl_create_screen(struct virgl_winsys *vws, const struct pipe_screen_config *c
    screen->compiler_options.lower_atomic_offset_to_range_base = true;
 
    slab_create_parent(&screen->transfer_pool, sizeof(struct virgl_transfer), 16);
+   util_idalloc_mt_init_tc(&screen->buffer_ids);
 
    virgl_disk_cache_create(screen);
+   simple_mtx_init(&screen->shader_cache_mutex, mtx_plain);
+   screen->shader_cache = _mesa_hash_table_create(NULL, virgl_shader_cache_key_hash,
+                                                  virgl_shader_cache_key_equals);
+   list_inithead(&screen->shader_cache_lru);
+
+   virgl_compression_init(screen);
+   simple_mtx_init(&screen->cmdbuf_capture_mutex, mtx_plain);
+   if (debug_get_option_virgl_cmdbuf_capture()) {
+      screen->cmdbuf_capture = fopen(debug_get_option_virgl_cmdbuf_capture(), "wb");
+      if (!screen->cmdbuf_capture)
+         debug_printf("virgl: failed to open %s for command buffer capture\n",
+                      debug_get_option_virgl_cmdbuf_capture());
+   }
    return &screen->base;
 }
@@ -23,9 +23,14 @@
 #ifndef VIRGL_H
 #define VIRGL_H
 
+#include <stdio.h>
+
 #include "pipe/p_screen.h"
 #include "util/slab.h"
 #include "util/disk_cache.h"
+#include "util/u_idalloc.h"
+#include "util/simple_mtx.h"
+#include "util/list.h"
 #include "virgl_winsys.h"
 #include "compiler/nir/nir.h"
 #include "virtio-gpu/virgl_protocol.h"
@@ -41,6 +46,9 @@ enum virgl_debug_flags {
    VIRGL_DEBUG_L8_SRGB_ENABLE_READBACK = 1 << 8,
    VIRGL_DEBUG_VIDEO                = 1 << 9,
    VIRGL_DEBUG_SHADER_SYNC          = 1 << 10,
+   VIRGL_DEBUG_NO_TC                = 1 << 11,
+   VIRGL_DEBUG_NO_NIR_SHADER        = 1 << 12,
+   VIRGL_DEBUG_COMPRESS             = 1 << 13,
 };
 
 extern const struct debug_named_value virgl_debug_options[];
@@ -60,17 +68,40 @@ struct virgl_screen {
 
    struct slab_parent_pool transfer_pool;
 
+   /* threaded_resource::buffer_id_unique */
+   struct util_idalloc_mt buffer_ids;
+
    uint32_t sub_ctx_id;
    bool tweak_gles_emulate_bgra;
    bool tweak_gles_apply_bgra_dest_swizzle;
    bool tweak_l8_srgb_readback;
    bool no_coherent;
    bool shader_sync;
+   /* Send NIR shaders as VIRGL_OBJECT_SHADER_NIR, see virgl_host_reads_nir() */
+   bool nir_shaders;
    int32_t tweak_gles_tf3_value;
 
+   /* Codec for large inline payloads and the smallest command worth
+    * compressing, see virgl_encoder_compress_cmd().
+    */
+   enum virgl_compression compression;
+   unsigned compress_min_size;
+
+   /* VIRGL_CMDBUF_CAPTURE: every submitted command buffer is appended to
+    * this file, see virgl_capture_cmd_buf().
+    */
+   FILE *cmdbuf_capture;
+   simple_mtx_t cmdbuf_capture_mutex;
+
    nir_shader_compiler_options compiler_options;
 
    struct disk_cache *disk_cache;
+
+   /* NIR -> final TGSI text, see virgl_shader_cache_find() */
+   simple_mtx_t shader_cache_mutex;
+   struct hash_table *shader_cache;
+   struct list_head shader_cache_lru;  /* most recently used first */
+   size_t shader_cache_size;           /* bytes of cached text */
 };
 
 
@@ -84,6 +115,18 @@ bool
 virgl_has_readback_format(struct pipe_screen *screen, enum virgl_formats fmt,
                           bool allow_tweak);
 
+void
+virgl_shader_cache_compute_key(struct virgl_screen *vs, const nir_shader *nir,
+                               cache_key key);
+
+char *
+virgl_shader_cache_find(struct virgl_screen *vs, const cache_key key,
+                        uint32_t *num_tokens);
+
+void
+virgl_shader_cache_insert(struct virgl_screen *vs, const cache_key key,
+                          const char *text, uint32_t num_tokens);
+
 bool
 virgl_has_scanout_format(struct virgl_screen *vscreen,
                          enum pipe_format format,
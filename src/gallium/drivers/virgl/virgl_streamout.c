@@ -27,6 +27,33 @@
 #include "virtio-gpu/virgl_protocol.h"
 #include "virgl_resource.h"
 
+struct virgl_create_so_target_job {
+   struct virgl_deferred_job base;
+   struct pipe_stream_output_target *target;
+};
+
+static bool
+virgl_create_so_target_execute(struct virgl_context *vctx,
+                               struct virgl_deferred_job *_job)
+{
+   struct virgl_create_so_target_job *job =
+      (struct virgl_create_so_target_job *)_job;
+   struct virgl_so_target *t = virgl_so_target(job->target);
+   struct virgl_resource *res = virgl_resource(t->base.buffer);
+
+   res->bind_history |= PIPE_BIND_STREAM_OUTPUT;
+   util_range_add(&res->b.b, &res->valid_buffer_range, t->base.buffer_offset,
+                  t->base.buffer_offset + t->base.buffer_size);
+   virgl_resource_dirty(res, 0);
+
+   virgl_encoder_create_so_target(vctx, t->handle, res, t->base.buffer_offset,
+                                  t->base.buffer_size);
+   t->storage_generation = res->storage_generation;
+
+   pipe_so_target_reference(&job->target, NULL);
+   return true;
+}
+
 static struct pipe_stream_output_target *virgl_create_so_target(
    struct pipe_context *ctx,
    struct pipe_resource *buffer,
@@ -34,12 +61,19 @@ static struct pipe_stream_output_target *virgl_create_so_target(
    unsigned buffer_size)
 {
    struct virgl_context *vctx = virgl_context(ctx);
-   struct virgl_resource *res = virgl_resource(buffer);
+   struct virgl_create_so_target_job *job;
    struct virgl_so_target *t = CALLOC_STRUCT(virgl_so_target);
    uint32_t handle;
 
    if (!t)
       return NULL;
+
+   job = CALLOC_STRUCT(virgl_create_so_target_job);
+   if (!job) {
+      FREE(t);
+      return NULL;
+   }
+
    handle = virgl_object_assign_handle();
 
    t->base.reference.count = 1;
@@ -49,12 +83,10 @@ static struct pipe_stream_output_target *virgl_create_so_target(
    t->base.buffer_size = buffer_size;
    t->handle = handle;
 
-   res->bind_history |= PIPE_BIND_STREAM_OUTPUT;
-   util_range_add(&res->b, &res->valid_buffer_range, buffer_offset,
-                  buffer_offset + buffer_size);
-   virgl_resource_dirty(res, 0);
+   /* the target must outlive the deferred encoding */
+   pipe_so_target_reference(&job->target, &t->base);
+   virgl_context_defer(vctx, virgl_create_so_target_execute, &job->base);
 
-   virgl_encoder_create_so_target(vctx, handle, res, buffer_offset, buffer_size);
    return &t->base;
 }
 
@@ -65,10 +97,31 @@ static void virgl_destroy_so_target(struct pipe_context *ctx,
    struct virgl_so_target *t = virgl_so_target(target);
 
    pipe_resource_reference(&t->base.buffer, NULL);
-   virgl_encode_delete_object(vctx, t->handle, VIRGL_OBJECT_STREAMOUT_TARGET);
+   virgl_context_delete_object(vctx, t->handle, VIRGL_OBJECT_STREAMOUT_TARGET);
    FREE(t);
 }
 
+/* Re-create the host object when the storage of the buffer was replaced
+ * since it was created.
+ */
+void
+virgl_so_target_revalidate(struct virgl_context *vctx,
+                           struct virgl_so_target *target)
+{
+   struct virgl_resource *res = virgl_resource(target->base.buffer);
+
+   if (likely(target->storage_generation == res->storage_generation))
+      return;
+
+   virgl_encode_delete_object(vctx, target->handle,
+                              VIRGL_OBJECT_STREAMOUT_TARGET);
+   target->handle = virgl_object_assign_handle();
+   virgl_encoder_create_so_target(vctx, target->handle, res,
+                                  target->base.buffer_offset,
+                                  target->base.buffer_size);
+   target->storage_generation = res->storage_generation;
+}
+
 static void virgl_set_so_targets(struct pipe_context *ctx,
                                 unsigned num_targets,
                                 struct pipe_stream_output_target **targets,
@@ -81,15 +134,16 @@ static void virgl_set_so_targets(struct pipe_context *ctx,
          struct virgl_winsys *vws = virgl_screen(vctx->base.screen)->vws;
          struct virgl_resource *res = virgl_resource(targets[i]->buffer);
 
-         pipe_resource_reference(&vctx->so_targets[i].base.buffer, targets[i]->buffer);
+         virgl_so_target_revalidate(vctx, virgl_so_target(targets[i]));
+         pipe_so_target_reference(&vctx->so_targets[i], targets[i]);
 
          vws->emit_res(vws, vctx->cbuf, res->hw_res, false);
       } else {
-         pipe_resource_reference(&vctx->so_targets[i].base.buffer, NULL);
+         pipe_so_target_reference(&vctx->so_targets[i], NULL);
       }
    }
    for (i = num_targets; i < vctx->num_so_targets; i++)
-      pipe_resource_reference(&vctx->so_targets[i].base.buffer, NULL);
+      pipe_so_target_reference(&vctx->so_targets[i], NULL);
    vctx->num_so_targets = num_targets;
    virgl_encoder_set_so_targets(vctx, num_targets, targets, 0);//append_bitmask);
 }
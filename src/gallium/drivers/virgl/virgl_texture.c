@@ -176,10 +176,10 @@ static void *texture_transfer_map_resolve(struct pipe_context *ctx,
    /* trans->resolve_transfer owns resolve_tmp now */
    pipe_resource_reference(&resolve_tmp, NULL);
 
-   *transfer = &trans->base;
+   *transfer = &trans->base.b;
    if (fmt == resource->format) {
-      trans->base.stride = trans->resolve_transfer->stride;
-      trans->base.layer_stride = trans->resolve_transfer->layer_stride;
+      trans->base.b.stride = trans->resolve_transfer->stride;
+      trans->base.b.layer_stride = trans->resolve_transfer->layer_stride;
       return ptr;
    } else {
       if (usage & PIPE_MAP_READ) {
@@ -191,8 +191,8 @@ static void *texture_transfer_map_resolve(struct pipe_context *ctx,
 
          if (!util_format_translate_3d(resource->format,
                                        (uint8_t *)ptr + vtex->metadata.level_offset[level],
-                                       trans->base.stride,
-                                       trans->base.layer_stride,
+                                       trans->base.b.stride,
+                                       trans->base.b.layer_stride,
                                        box->x, box->y, box->z,
                                        fmt,
                                        src,
@@ -254,8 +254,8 @@ static void flush_data(struct pipe_context *ctx,
 {
    struct virgl_winsys *vws = virgl_screen(ctx->screen)->vws;
    vws->transfer_put(vws, trans->hw_res, box,
-                     trans->base.stride, trans->l_stride, trans->offset,
-                     trans->base.level);
+                     trans->base.b.stride, trans->l_stride, trans->offset,
+                     trans->base.b.level);
 }
 
 void virgl_texture_transfer_unmap(struct pipe_context *ctx,
@@ -268,7 +268,7 @@ void virgl_texture_transfer_unmap(struct pipe_context *ctx,
    if (transfer->usage & PIPE_MAP_WRITE &&
        (transfer->usage & PIPE_MAP_FLUSH_EXPLICIT) == 0) {
 
-      if (trans->resolve_transfer && (trans->base.resource->format ==
+      if (trans->resolve_transfer && (trans->base.b.resource->format ==
           trans->resolve_transfer->resource->format)) {
          flush_data(ctx, virgl_transfer(trans->resolve_transfer),
                     &trans->resolve_transfer->box);
@@ -280,7 +280,7 @@ void virgl_texture_transfer_unmap(struct pipe_context *ctx,
           */
 
          virgl_copy_region_with_blit(ctx,
-                                     trans->base.resource, trans->base.level,
+                                     trans->base.b.resource, trans->base.b.level,
                                      &transfer->box,
                                      trans->resolve_transfer->resource, 0,
                                      &trans->resolve_transfer->box);
@@ -1153,7 +1153,7 @@ static void virgl_video_get_feedback(struct pipe_video_codec *codec,
         return;
 
     vs->vws->resource_wait(vs->vws, vres->hw_res);
-    fb = pipe_buffer_map(&vctx->base, &vres->b, PIPE_MAP_READ, &xfer);
+    fb = pipe_buffer_map(&vctx->base, &vres->b.b, PIPE_MAP_READ, &xfer);
     if (!fb)
         return;
     if (fb->stat == VIRGL_VIDEO_ENCODE_STAT_SUCCESS) {
@@ -1298,6 +1298,10 @@ lvp_physical_device_init(struct lvp_physical_device *device,
    for (unsigned i = 0; i < ARRAY_SIZE(device->drv_options); i++)
       device->drv_options[i] = device->pscreen->get_compiler_options(device->pscreen, PIPE_SHADER_IR_NIR, i);
 
+   /* lowered NIR shares llvmpipe's disk cache, which is owned by the screen */
+   if (device->pscreen->get_disk_shader_cache)
+      device->vk.disk_cache = device->pscreen->get_disk_shader_cache(device->pscreen);
+
    device->sync_timeline_type = vk_sync_timeline_get_type(&lvp_pipe_sync_type);
    device->sync_types[0] = &lvp_pipe_sync_type;
    device->sync_types[1] = &device->sync_timeline_type.sync;
@@ -1510,17 +1514,8 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
 {
    VK_OUTARRAY_MAKE_TYPED(VkQueueFamilyProperties2, out, pQueueFamilyProperties, pCount);
 
-   VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(pQueueFamilyProperties, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
-   if (prio) {
-      prio->priorityCount = 4;
-      prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
-      prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
-      prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
-      prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
-   }
-
-   vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
-      p->queueFamilyProperties = (VkQueueFamilyProperties) {
+   static const VkQueueFamilyProperties families[LVP_QUEUE_FAMILY_COUNT] = {
+      [LVP_QUEUE_FAMILY_GENERAL] = {
          .queueFlags = VK_QUEUE_GRAPHICS_BIT |
          VK_QUEUE_COMPUTE_BIT |
          VK_QUEUE_TRANSFER_BIT |
@@ -1528,7 +1523,28 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
          .queueCount = 1,
          .timestampValidBits = 64,
          .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
-      };
+      },
+      [LVP_QUEUE_FAMILY_TRANSFER] = {
+         .queueFlags = VK_QUEUE_TRANSFER_BIT,
+         .queueCount = LVP_MAX_TRANSFER_QUEUES,
+         .timestampValidBits = 64,
+         .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
+      },
+   };
+
+   for (uint32_t i = 0; i < ARRAY_SIZE(families); i++) {
+      vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
+         p->queueFamilyProperties = families[i];
+
+         VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(p, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
+         if (prio) {
+            prio->priorityCount = 4;
+            prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
+            prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
+            prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
+            prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
+         }
+      }
    }
 }
 
@@ -1702,6 +1718,13 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
 
    queue->device = device;
 
+   queue->state = vk_zalloc(&device->vk.alloc, lvp_get_rendering_state_size(), 8,
+                            VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+   if (!queue->state) {
+      vk_queue_finish(&queue->vk);
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
    queue->ctx = device->pscreen->context_create(device->pscreen, NULL, PIPE_CONTEXT_ROBUST_BUFFER_ACCESS);
    queue->cso = cso_create_context(queue->ctx, CSO_NO_VBUF);
    queue->uploader = u_upload_create(queue->ctx, 1024 * 1024, PIPE_BIND_CONSTANT_BUFFER, PIPE_USAGE_STREAM, 0);
@@ -1723,9 +1746,13 @@ lvp_queue_finish(struct lvp_queue *queue)
    simple_mtx_destroy(&queue->lock);
    util_dynarray_fini(&queue->pipeline_destroys);
 
+   if (queue->last_fence)
+      queue->device->pscreen->fence_reference(queue->device->pscreen, &queue->last_fence, NULL);
+
    u_upload_destroy(queue->uploader);
    cso_destroy_context(queue->cso);
    queue->ctx->destroy(queue->ctx);
+   vk_free(&queue->device->vk.alloc, queue->state);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
@@ -1740,14 +1767,12 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO);
 
-   size_t state_size = lvp_get_rendering_state_size();
    device = vk_zalloc2(&physical_device->vk.instance->alloc, pAllocator,
-                       sizeof(*device) + state_size, 8,
+                       sizeof(*device), 8,
                        VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
    if (!device)
       return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
 
-   device->queue.state = device + 1;
    device->poison_mem = debug_get_bool_option("LVP_POISON_MEMORY", false);
    device->print_cmds = debug_get_bool_option("LVP_CMD_DEBUG", false);
 
@@ -1774,15 +1799,58 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount == 1);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
+   /* The general queue is always created: its context is the one resources,
+    * handles and shader CSOs are created on.
+    */
+   const VkDeviceQueueCreateInfo *general_info = NULL;
+   const VkDeviceQueueCreateInfo *transfer_info = NULL;
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *info = &pCreateInfo->pQueueCreateInfos[i];
+      if (info->queueFamilyIndex == LVP_QUEUE_FAMILY_GENERAL)
+         general_info = info;
+      else if (info->queueFamilyIndex == LVP_QUEUE_FAMILY_TRANSFER)
+         transfer_info = info;
+   }
+   assert(!general_info || general_info->queueCount == 1);
+   assert(!transfer_info || transfer_info->queueCount <= LVP_MAX_TRANSFER_QUEUES);
+
+   const VkDeviceQueueCreateInfo implicit_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = LVP_QUEUE_FAMILY_GENERAL,
+      .queueCount = 1,
+   };
+   result = lvp_queue_init(device, &device->queue,
+                           general_info ? general_info : &implicit_info, 0);
    if (result != VK_SUCCESS) {
+      vk_device_finish(&device->vk);
       vk_free(&device->vk.alloc, device);
       return result;
    }
 
+   if (transfer_info) {
+      device->transfer_queues = vk_zalloc(&device->vk.alloc,
+                                          transfer_info->queueCount * sizeof(*device->transfer_queues), 8,
+                                          VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+      if (!device->transfer_queues)
+         result = vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+      for (uint32_t i = 0; result == VK_SUCCESS && i < transfer_info->queueCount; i++) {
+         result = lvp_queue_init(device, &device->transfer_queues[i], transfer_info, i);
+         if (result == VK_SUCCESS)
+            device->transfer_queue_count++;
+      }
+
+      if (result != VK_SUCCESS) {
+         for (uint32_t i = 0; i < device->transfer_queue_count; i++)
+            lvp_queue_finish(&device->transfer_queues[i]);
+         vk_free(&device->vk.alloc, device->transfer_queues);
+         lvp_queue_finish(&device->queue);
+         vk_device_finish(&device->vk);
+         vk_free(&device->vk.alloc, device);
+         return result;
+      }
+   }
+
    nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
    struct pipe_shader_state shstate = {0};
    shstate.type = PIPE_SHADER_IR_NIR;
@@ -1804,6 +1872,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->group_handle_alloc = 1;
 
+   struct vk_pipeline_cache_create_info cache_info = { 0 };
+   device->vk.mem_cache = vk_pipeline_cache_create(&device->vk, &cache_info, NULL);
+
    *pDevice = lvp_device_to_handle(device);
 
    return VK_SUCCESS;
@@ -1831,12 +1902,16 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 
    device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
 
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
+   if (device->vk.mem_cache)
+      vk_pipeline_cache_destroy(device->vk.mem_cache, NULL);
+
    ralloc_free(device->bda.table);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
 
+   for (uint32_t i = 0; i < device->transfer_queue_count; i++)
+      lvp_queue_finish(&device->transfer_queues[i]);
+   vk_free(&device->vk.alloc, device->transfer_queues);
    lvp_queue_finish(&device->queue);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
@@ -472,15 +472,88 @@ lvp_shader_lower(struct lvp_device *pdevice, struct lvp_pipeline *pipeline, nir_
                                nir->info.stage);
 }
 
+static void
+hash_pipeline_layout(struct mesa_sha1 *ctx, const struct lvp_pipeline_layout *layout)
+{
+   if (!layout)
+      return;
+
+   _mesa_sha1_update(ctx, &layout->vk.set_count, sizeof(layout->vk.set_count));
+   for (uint32_t set = 0; set < layout->vk.set_count; set++) {
+      if (!layout->vk.set_layouts[set]) {
+         static const uint32_t no_set = UINT32_MAX;
+         _mesa_sha1_update(ctx, &no_set, sizeof(no_set));
+         continue;
+      }
+
+      const struct lvp_descriptor_set_layout *set_layout = get_set_layout(layout, set);
+      _mesa_sha1_update(ctx, &set_layout->binding_count, sizeof(set_layout->binding_count));
+      for (uint32_t b = 0; b < set_layout->binding_count; b++) {
+         const struct lvp_descriptor_set_binding_layout *binding = &set_layout->binding[b];
+         /* same prefix layouts_equal() compares */
+         _mesa_sha1_update(ctx, binding, offsetof(struct lvp_descriptor_set_binding_layout, immutable_samplers));
+
+         if (!binding->immutable_samplers)
+            continue;
+
+         /* immutable YCbCr conversions are baked into the shader */
+         for (uint32_t i = 0; i < binding->array_size; i++) {
+            const struct vk_ycbcr_conversion *conversion = binding->immutable_samplers[i]->vk.ycbcr_conversion;
+            if (conversion)
+               _mesa_sha1_update(ctx, &conversion->state, sizeof(conversion->state));
+         }
+      }
+   }
+}
+
+static void
+lvp_shader_cache_key(struct lvp_pipeline *pipeline, const VkPipelineShaderStageCreateInfo *sinfo,
+                     unsigned char *key)
+{
+   unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
+   vk_pipeline_hash_shader_stage(pipeline->flags, sinfo, NULL, stage_sha1);
+
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, stage_sha1, sizeof(stage_sha1));
+   hash_pipeline_layout(&ctx, pipeline->layout);
+   _mesa_sha1_final(&ctx, key);
+}
+
+/* Translates a stage to NIR and runs lvp_shader_lower() on it, or takes the
+ * result from the pipeline cache if possible.  llvmpipe caches the code it generates from
+ * this NIR on its own.  cache is NULL for shaders whose lowering has side
+ * effects on the pipeline (execution graph nodes).
+ */
 VkResult
-lvp_spirv_to_nir(struct lvp_pipeline *pipeline, const VkPipelineShaderStageCreateInfo *sinfo,
-                 nir_shader **out_nir)
+lvp_spirv_to_nir(struct lvp_pipeline *pipeline, struct vk_pipeline_cache *cache,
+                 const VkPipelineShaderStageCreateInfo *sinfo, nir_shader **out_nir)
 {
+   gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
+   unsigned char key[SHA1_DIGEST_LENGTH];
+
+   if (cache) {
+      lvp_shader_cache_key(pipeline, sinfo, key);
+      *out_nir = vk_pipeline_cache_lookup_nir(cache, key, sizeof(key),
+                                              pipeline->device->physical_device->drv_options[stage],
+                                              NULL, NULL);
+      if (*out_nir)
+         return VK_SUCCESS;
+   }
+
+   if (pipeline->flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR)
+      return VK_PIPELINE_COMPILE_REQUIRED;
+
    VkResult result = compile_spirv(pipeline->device, pipeline->flags, sinfo, out_nir);
-   if (result == VK_SUCCESS)
-      lvp_shader_lower(pipeline->device, pipeline, *out_nir, pipeline->layout);
+   if (result != VK_SUCCESS)
+      return result;
 
-   return result;
+   lvp_shader_lower(pipeline->device, pipeline, *out_nir, pipeline->layout);
+
+   if (cache)
+      vk_pipeline_cache_add_nir(cache, key, sizeof(key), *out_nir);
+
+   return VK_SUCCESS;
 }
 
 void
@@ -496,12 +569,13 @@ lvp_shader_init(struct lvp_shader *shader, nir_shader *nir)
 
 static VkResult
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct vk_pipeline_cache *cache,
                          const VkPipelineShaderStageCreateInfo *sinfo)
 {
    gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
    assert(stage <= LVP_SHADER_STAGES && stage != MESA_SHADER_NONE);
    nir_shader *nir;
-   VkResult result = lvp_spirv_to_nir(pipeline, sinfo, &nir);
+   VkResult result = lvp_spirv_to_nir(pipeline, cache, sinfo, &nir);
    if (result == VK_SUCCESS) {
       struct lvp_shader *shader = &pipeline->shaders[stage];
       lvp_shader_init(shader, nir);
@@ -767,7 +841,7 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
+                           struct vk_pipeline_cache *cache,
                            const VkGraphicsPipelineCreateInfo *pCreateInfo,
                            VkPipelineCreateFlagBits2KHR flags)
 {
@@ -851,6 +925,8 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->device = device;
 
+   /* stages copied from libraries don't hold a reference yet */
+   uint32_t compiled_stages = 0;
    for (uint32_t i = 0; i < pCreateInfo->stageCount; i++) {
       const VkPipelineShaderStageCreateInfo *sinfo = &pCreateInfo->pStages[i];
       gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
@@ -861,9 +937,10 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, sinfo);
+      result = lvp_shader_compile_to_ir(pipeline, cache, sinfo);
       if (result != VK_SUCCESS)
          goto fail;
+      compiled_stages |= BITFIELD_BIT(stage);
 
       switch (stage) {
       case MESA_SHADER_FRAGMENT:
@@ -921,9 +998,10 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
    return VK_SUCCESS;
 
 fail:
-   for (unsigned i = 0; i < ARRAY_SIZE(pipeline->shaders); i++) {
+   u_foreach_bit(i, compiled_stages)
       lvp_pipeline_nir_ref(&pipeline->shaders[i].pipeline_nir, NULL);
-   }
+   if (pipeline->layout)
+      vk_pipeline_layout_unref(&device->vk, &pipeline->layout->vk);
    vk_free(&device->vk.alloc, pipeline->state_data);
 
    return result;
@@ -955,14 +1033,13 @@ lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline, bool locked)
 static VkResult
 lvp_graphics_pipeline_create(
    VkDevice _device,
-   VkPipelineCache _cache,
+   struct vk_pipeline_cache *cache,
    const VkGraphicsPipelineCreateInfo *pCreateInfo,
    VkPipelineCreateFlagBits2KHR flags,
    VkPipeline *pPipeline,
    bool group)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -994,7 +1071,7 @@ lvp_graphics_pipeline_create(
          pci.pTessellationState = g->pTessellationState;
          pci.pStages = g->pStages;
          pci.stageCount = g->stageCount;
-         result = lvp_graphics_pipeline_create(_device, _cache, &pci, flags, &pipeline->groups[i], true);
+         result = lvp_graphics_pipeline_create(_device, cache, &pci, flags, &pipeline->groups[i], true);
          if (result != VK_SUCCESS) {
             lvp_pipeline_destroy(device, pipeline, false);
             return result;
@@ -1026,20 +1103,26 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, pipelineCache);
    VkResult result = VK_SUCCESS;
    unsigned i = 0;
 
+   if (!cache)
+      cache = device->vk.mem_cache;
+
    for (; i < count; i++) {
-      VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
       VkPipelineCreateFlagBits2KHR flags = vk_graphics_pipeline_create_flags(&pCreateInfos[i]);
 
-      if (!(flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR))
-         r = lvp_graphics_pipeline_create(_device,
-                                          pipelineCache,
-                                          &pCreateInfos[i],
-                                          flags,
-                                          &pPipelines[i],
-                                          false);
+      /* with FAIL_ON_PIPELINE_COMPILE_REQUIRED, shaders missing from the
+       * cache make this return VK_PIPELINE_COMPILE_REQUIRED
+       */
+      VkResult r = lvp_graphics_pipeline_create(_device,
+                                                cache,
+                                                &pCreateInfos[i],
+                                                flags,
+                                                &pPipelines[i],
+                                                false);
       if (r != VK_SUCCESS) {
          result = r;
          pPipelines[i] = VK_NULL_HANDLE;
@@ -1058,7 +1141,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
+                          struct vk_pipeline_cache *cache,
                           const VkComputePipelineCreateInfo *pCreateInfo,
                           VkPipelineCreateFlagBits2KHR flags)
 {
@@ -1070,7 +1153,7 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->type = LVP_PIPELINE_COMPUTE;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, &pCreateInfo->stage);
    if (result != VK_SUCCESS)
       return result;
 
@@ -1084,13 +1167,12 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 static VkResult
 lvp_compute_pipeline_create(
    VkDevice _device,
-   VkPipelineCache _cache,
+   struct vk_pipeline_cache *cache,
    const VkComputePipelineCreateInfo *pCreateInfo,
    VkPipelineCreateFlagBits2KHR flags,
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1106,6 +1188,8 @@ lvp_compute_pipeline_create(
    uint64_t t0 = os_time_get_nano();
    result = lvp_compute_pipeline_init(pipeline, device, cache, pCreateInfo, flags);
    if (result != VK_SUCCESS) {
+      if (pipeline->layout)
+         vk_pipeline_layout_unref(&device->vk, &pipeline->layout->vk);
       vk_free(&device->vk.alloc, pipeline);
       return result;
    }
@@ -1130,19 +1214,22 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, pipelineCache);
    VkResult result = VK_SUCCESS;
    unsigned i = 0;
 
+   if (!cache)
+      cache = device->vk.mem_cache;
+
    for (; i < count; i++) {
-      VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
       VkPipelineCreateFlagBits2KHR flags = vk_compute_pipeline_create_flags(&pCreateInfos[i]);
 
-      if (!(flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR))
-         r = lvp_compute_pipeline_create(_device,
-                                         pipelineCache,
-                                         &pCreateInfos[i],
-                                         flags,
-                                         &pPipelines[i]);
+      VkResult r = lvp_compute_pipeline_create(_device,
+                                               cache,
+                                               &pCreateInfos[i],
+                                               flags,
+                                               &pPipelines[i]);
       if (r != VK_SUCCESS) {
          result = r;
          pPipelines[i] = VK_NULL_HANDLE;
@@ -1382,7 +1469,10 @@ lvp_exec_graph_pipeline_create(VkDevice _device, VkPipelineCache _cache,
          .layout = create_info->layout,
       };
 
-      result = lvp_compute_pipeline_create(_device, _cache, &stage_create_info, flags, &pipeline->groups[i]);
+      /* node lowering records payload names on the pipeline, so node
+       * shaders cannot come from the cache
+       */
+      result = lvp_compute_pipeline_create(_device, NULL, &stage_create_info, flags, &pipeline->groups[i]);
       if (result != VK_SUCCESS)
          goto fail;
 
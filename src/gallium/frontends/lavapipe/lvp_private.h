@@ -82,6 +82,7 @@ typedef uint32_t xcb_window_t;
 #include "vk_command_pool.h"
 #include "vk_descriptor_set_layout.h"
 #include "vk_graphics_state.h"
+#include "vk_pipeline_cache.h"
 #include "vk_pipeline_layout.h"
 #include "vk_queue.h"
 #include "vk_sampler.h"
@@ -185,6 +186,16 @@ void lvp_finish_wsi(struct lvp_physical_device *physical_device);
 bool lvp_physical_device_extension_supported(struct lvp_physical_device *dev,
                                               const char *name);
 
+/* Family 0 can do everything and has a single queue, the one backing the
+ * device's own gallium context.  Family 1 is transfer-only; each of its
+ * queues gets a private gallium context and submit thread so copies can run
+ * in parallel with rendering.
+ */
+#define LVP_QUEUE_FAMILY_GENERAL 0
+#define LVP_QUEUE_FAMILY_TRANSFER 1
+#define LVP_QUEUE_FAMILY_COUNT 2
+#define LVP_MAX_TRANSFER_QUEUES 4
+
 struct lvp_queue {
    struct vk_queue vk;
    struct lvp_device *                         device;
@@ -197,16 +208,12 @@ struct lvp_queue {
    simple_mtx_t lock;
 };
 
-struct lvp_pipeline_cache {
-   struct vk_object_base                        base;
-   struct lvp_device *                          device;
-   VkAllocationCallbacks                        alloc;
-};
-
 struct lvp_device {
    struct vk_device vk;
 
    struct lvp_queue queue;
+   struct lvp_queue *transfer_queues;
+   uint32_t transfer_queue_count;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
@@ -705,8 +712,6 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image, vk.base, VkImage, VK_OBJECT_TYPE_IMAGE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image_view, vk.base, VkImageView,
                                VK_OBJECT_TYPE_IMAGE_VIEW);
-VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_cache, base, VkPipelineCache,
-                               VK_OBJECT_TYPE_PIPELINE_CACHE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline, base, VkPipeline,
                                VK_OBJECT_TYPE_PIPELINE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_shader, base, VkShaderEXT,
@@ -801,8 +806,8 @@ void
 queue_thread_noop(void *data, void *gdata, int thread_index);
 
 VkResult
-lvp_spirv_to_nir(struct lvp_pipeline *pipeline, const VkPipelineShaderStageCreateInfo *sinfo,
-                 nir_shader **out_nir);
+lvp_spirv_to_nir(struct lvp_pipeline *pipeline, struct vk_pipeline_cache *cache,
+                 const VkPipelineShaderStageCreateInfo *sinfo, nir_shader **out_nir);
 
 void
 lvp_shader_init(struct lvp_shader *shader, nir_shader *nir);
@@ -162,6 +162,7 @@ lvp_move_ray_tracing_intrinsic(nir_builder *b, nir_intrinsic_instr *instr, void
 
 static VkResult
 lvp_compile_ray_tracing_stages(struct lvp_pipeline *pipeline,
+                               struct vk_pipeline_cache *cache,
                                const VkRayTracingPipelineCreateInfoKHR *create_info)
 {
    VkResult result = VK_SUCCESS;
@@ -169,7 +170,7 @@ lvp_compile_ray_tracing_stages(struct lvp_pipeline *pipeline,
    uint32_t i = 0;
    for (; i < create_info->stageCount; i++) {
       nir_shader *nir;
-      result = lvp_spirv_to_nir(pipeline, create_info->pStages + i, &nir);
+      result = lvp_spirv_to_nir(pipeline, cache, create_info->pStages + i, &nir);
       if (result != VK_SUCCESS)
          return result;
 
@@ -1113,7 +1114,8 @@ lvp_compile_ray_tracing_pipeline(struct lvp_pipeline *pipeline,
 }
 
 static VkResult
-lvp_create_ray_tracing_pipeline(VkDevice _device, const VkAllocationCallbacks *allocator,
+lvp_create_ray_tracing_pipeline(VkDevice _device, struct vk_pipeline_cache *cache,
+                                const VkAllocationCallbacks *allocator,
                                 const VkRayTracingPipelineCreateInfoKHR *create_info,
                                 VkPipeline *out_pipeline)
 {
@@ -1154,7 +1156,7 @@ lvp_create_ray_tracing_pipeline(VkDevice _device, const VkAllocationCallbacks *a
       goto fail;
    }
 
-   result = lvp_compile_ray_tracing_stages(pipeline, create_info);
+   result = lvp_compile_ray_tracing_stages(pipeline, cache, create_info);
    if (result != VK_SUCCESS)
       goto fail;
 
@@ -1183,12 +1185,17 @@ lvp_CreateRayTracingPipelinesKHR(
    const VkAllocationCallbacks *pAllocator,
    VkPipeline *pPipelines)
 {
+   VK_FROM_HANDLE(lvp_device, pdevice, device);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, pipelineCache);
    VkResult result = VK_SUCCESS;
 
+   if (!cache)
+      cache = pdevice->vk.mem_cache;
+
    uint32_t i = 0;
    for (; i < createInfoCount; i++) {
       VkResult tmp_result = lvp_create_ray_tracing_pipeline(
-         device, pAllocator, pCreateInfos + i, pPipelines + i);
+         device, cache, pAllocator, pCreateInfos + i, pPipelines + i);
 
       if (tmp_result != VK_SUCCESS) {
          result = tmp_result;
@@ -22,7 +22,14 @@
  */
 
 #include "virgl_resource_cache.h"
+#include "util/hash_table.h"
 #include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/u_math.h"
+
+struct virgl_resource_cache_bucket {
+   struct list_head entries;
+};
 
 /* Checks whether the resource represented by a cache entry is able to hold
  * data of the specified size, bind and format.
@@ -46,11 +53,50 @@ virgl_resource_cache_entry_is_compatible(struct virgl_resource_cache_entry *entr
    }
 }
 
+static unsigned
+virgl_resource_cache_size_class(uint32_t size)
+{
+   return size ? util_logbase2(size) : 0;
+}
+
+/* Only resources with the same bind and target can ever be compatible, and
+ * the size limits above mean that a buffer is found either in its own size
+ * class or in the next one.
+ */
+static uint64_t
+virgl_resource_cache_bucket_key(const struct virgl_resource_params *params,
+                                unsigned size_class)
+{
+   return (uint64_t)params->bind << 32 | (uint64_t)params->target << 8 |
+          size_class;
+}
+
+static struct virgl_resource_cache_bucket *
+virgl_resource_cache_get_bucket(struct virgl_resource_cache *cache,
+                                const struct virgl_resource_params *params,
+                                unsigned size_class, bool create)
+{
+   const uint64_t key = virgl_resource_cache_bucket_key(params, size_class);
+   struct virgl_resource_cache_bucket *bucket =
+      _mesa_hash_table_u64_search(cache->buckets, key);
+
+   if (!bucket && create) {
+      bucket = ralloc(cache->buckets, struct virgl_resource_cache_bucket);
+      if (!bucket)
+         return NULL;
+      list_inithead(&bucket->entries);
+      _mesa_hash_table_u64_insert(cache->buckets, key, bucket);
+   }
+
+   return bucket;
+}
+
 static void
 virgl_resource_cache_entry_release(struct virgl_resource_cache *cache,
                                    struct virgl_resource_cache_entry *entry)
 {
       list_del(&entry->head);
+      list_del(&entry->bucket_head);
       cache->entry_release_func(entry, cache->user_data);
 }
 
@@ -68,18 +114,24 @@ virgl_resource_cache_destroy_expired(struct virgl_resource_cache *cache, int64_t
    }
 }
 
-void
+bool
 virgl_resource_cache_init(struct virgl_resource_cache *cache,
                           unsigned timeout_usecs,
                           virgl_resource_cache_entry_is_busy_func is_busy_func,
                           virgl_resource_cache_entry_release_func destroy_func,
                           void *user_data)
 {
+   cache->buckets = _mesa_hash_table_u64_create(NULL);
+   if (!cache->buckets)
+      return false;
+
    list_inithead(&cache->resources);
    cache->timeout_usecs = timeout_usecs;
    cache->entry_is_busy_func = is_busy_func;
    cache->entry_release_func = destroy_func;
    cache->user_data = user_data;
+
+   return true;
 }
 
 void
@@ -87,6 +139,7 @@ virgl_resource_cache_add(struct virgl_resource_cache *cache,
                          struct virgl_resource_cache_entry *entry)
 {
    const int64_t now = os_time_get();
+   struct virgl_resource_cache_bucket *bucket;
 
    /* Entry should not already be in the cache. */
    assert(entry->head.next == NULL);
@@ -94,9 +147,47 @@ virgl_resource_cache_add(struct virgl_resource_cache *cache,
 
    virgl_resource_cache_destroy_expired(cache, now);
 
+   bucket = virgl_resource_cache_get_bucket(cache, &entry->params,
+      virgl_resource_cache_size_class(entry->params.size), true);
+   if (!bucket) {
+      cache->entry_release_func(entry, cache->user_data);
+      return;
+   }
+
    entry->timeout_start = now;
    entry->timeout_end = entry->timeout_start + cache->timeout_usecs;
    list_addtail(&entry->head, &cache->resources);
+   list_addtail(&entry->bucket_head, &bucket->entries);
+}
+
+static struct virgl_resource_cache_entry *
+virgl_resource_cache_bucket_find(struct virgl_resource_cache *cache,
+                                 const struct virgl_resource_params *params,
+                                 unsigned size_class)
+{
+   struct virgl_resource_cache_bucket *bucket =
+      virgl_resource_cache_get_bucket(cache, params, size_class, false);
+
+   if (!bucket)
+      return NULL;
+
+   list_for_each_entry(struct virgl_resource_cache_entry,
+                       entry, &bucket->entries, bucket_head) {
+      if (!virgl_resource_cache_entry_is_compatible(entry, *params))
+         continue;
+
+      /* We either have found a compatible resource, in which case we are
+       * done, or the resource is busy, which means resources later in
+       * the bucket will also be busy, so there is no point in searching
+       * further.
+       */
+      if (cache->entry_is_busy_func(entry, cache->user_data))
+         return NULL;
+
+      return entry;
+   }
+
+   return NULL;
 }
 
 struct virgl_resource_cache_entry *
@@ -104,43 +195,20 @@ virgl_resource_cache_remove_compatible(struct virgl_resource_cache *cache,
                                        struct virgl_resource_params params)
 {
    const int64_t now = os_time_get();
-   struct virgl_resource_cache_entry *compat_entry = NULL;
-   bool check_expired = true;
+   const unsigned size_class = virgl_resource_cache_size_class(params.size);
+   struct virgl_resource_cache_entry *compat_entry;
 
-   /* Iterate through the cache to find a compatible resource, while also
-    * destroying any expired resources we come across.
-    */
-   list_for_each_entry_safe(struct virgl_resource_cache_entry,
-                            entry, &cache->resources, head) {
-      const bool compatible =
-         virgl_resource_cache_entry_is_compatible(entry, params);
-
-      if (compatible) {
-         if (!cache->entry_is_busy_func(entry, cache->user_data))
-            compat_entry = entry;
-
-         /* We either have found a compatible resource, in which case we are
-          * done, or the resource is busy, which means resources later in
-          * the cache list will also be busy, so there is no point in
-          * searching further.
-          */
-         break;
-      }
+   virgl_resource_cache_destroy_expired(cache, now);
 
-      /* If we aren't using this resource, check to see if it has expired.
-       * Once we have found the first non-expired resource, we can stop checking
-       * since the cache holds resources in non-decreasing timeout order.
-       */
-      if (check_expired) {
-         if (os_time_timeout(entry->timeout_start, entry->timeout_end, now))
-            virgl_resource_cache_entry_release(cache, entry);
-         else
-            check_expired = false;
-      }
-   }
+   compat_entry = virgl_resource_cache_bucket_find(cache, &params, size_class);
+   if (!compat_entry && params.target == PIPE_BUFFER)
+      compat_entry = virgl_resource_cache_bucket_find(cache, &params,
+                                                      size_class + 1);
 
-   if (compat_entry)
+   if (compat_entry) {
       list_del(&compat_entry->head);
+      list_del(&compat_entry->bucket_head);
+   }
 
    return compat_entry;
 }
@@ -153,3 +221,11 @@ virgl_resource_cache_flush(struct virgl_resource_cache *cache)
       virgl_resource_cache_entry_release(cache, entry);
    }
 }
+
+void
+virgl_resource_cache_fini(struct virgl_resource_cache *cache)
+{
+   virgl_resource_cache_flush(cache);
+   _mesa_hash_table_u64_destroy(cache->buckets);
+   cache->buckets = NULL;
+}
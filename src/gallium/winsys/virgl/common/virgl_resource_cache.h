@@ -29,6 +29,8 @@
 #include "util/list.h"
 #include "gallium/include/pipe/p_defines.h"
 
+struct hash_table_u64;
+
 struct virgl_resource_params {
    uint32_t size;
    uint32_t bind;
@@ -44,7 +46,10 @@ struct virgl_resource_params {
 };
 
 struct virgl_resource_cache_entry {
+   /* link in virgl_resource_cache::resources */
    struct list_head head;
+   /* link in the size class/bind bucket */
+   struct list_head bucket_head;
    int64_t timeout_start;
    int64_t timeout_end;
    struct virgl_resource_params params;
@@ -63,14 +68,22 @@ typedef void (*virgl_resource_cache_entry_release_func) (
    struct virgl_resource_cache_entry *entry, void *user_data);
 
 struct virgl_resource_cache {
+   /* all entries, in non-decreasing timeout order */
    struct list_head resources;
+   /* size class, bind and target -> struct virgl_resource_cache_bucket, each
+    * holding its entries in the same order as the list above */
+   struct hash_table_u64 *buckets;
    unsigned timeout_usecs;
    virgl_resource_cache_entry_is_busy_func entry_is_busy_func;
    virgl_resource_cache_entry_release_func entry_release_func;
    void *user_data;
 };
 
-void
+/** Initializes the cache.
+ *
+ *  Returns false if the cache could not be allocated.
+ */
+bool
 virgl_resource_cache_init(struct virgl_resource_cache *cache,
                           unsigned timeout_usecs,
                           virgl_resource_cache_entry_is_busy_func is_busy_func,
@@ -99,6 +112,10 @@ virgl_resource_cache_remove_compatible(struct virgl_resource_cache *cache,
 void
 virgl_resource_cache_flush(struct virgl_resource_cache *cache);
 
+/** Empties the resource cache and frees its internal storage. */
+void
+virgl_resource_cache_fini(struct virgl_resource_cache *cache);
+
 static inline void
 virgl_resource_cache_entry_init(struct virgl_resource_cache_entry *entry,
                                 struct virgl_resource_params params)
@@ -135,7 +135,7 @@ virgl_drm_winsys_destroy(struct virgl_winsys *qws)
 {
    struct virgl_drm_winsys *qdws = virgl_drm_winsys(qws);
 
-   virgl_resource_cache_flush(&qdws->cache);
+   virgl_resource_cache_fini(&qdws->cache);
 
    _mesa_hash_table_destroy(qdws->bo_handles, NULL);
    _mesa_hash_table_destroy(qdws->bo_names, NULL);
@@ -1260,10 +1260,13 @@ virgl_drm_winsys_create(int drmFD)
       return NULL;
 
    qdws->fd = drmFD;
-   virgl_resource_cache_init(&qdws->cache, CACHE_TIMEOUT_USEC,
-                             virgl_drm_resource_cache_entry_is_busy,
-                             virgl_drm_resource_cache_entry_release,
-                             qdws);
+   if (!virgl_resource_cache_init(&qdws->cache, CACHE_TIMEOUT_USEC,
+                                  virgl_drm_resource_cache_entry_is_busy,
+                                  virgl_drm_resource_cache_entry_release,
+                                  qdws)) {
+      FREE(qdws);
+      return NULL;
+   }
    (void) mtx_init(&qdws->mutex, mtx_plain);
    (void) mtx_init(&qdws->bo_handles_mutex, mtx_plain);
    p_atomic_set(&qdws->blob_id, 0);
@@ -23,12 +23,17 @@
 
 #include <sys/socket.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <netinet/in.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <util/anon_file.h>
 #include <util/format/u_format.h>
+#include <util/os_mman.h>
+#include <util/u_debug.h>
+#include <util/u_memory.h>
 #include <util/u_process.h>
 
 #include "virgl_vtest_winsys.h"
@@ -115,6 +120,176 @@ static int virgl_vtest_receive_fd(int socket_fd)
     return *((int *) CMSG_DATA(cmsgh));
 }
 
+static int virgl_vtest_send_fd(int socket_fd, int fd)
+{
+    struct cmsghdr *cmsgh;
+    struct msghdr msgh = { 0 };
+    char buf[CMSG_SPACE(sizeof(int))] = { 0 }, c = 0;
+    struct iovec iovec;
+
+    iovec.iov_base = &c;
+    iovec.iov_len = sizeof(char);
+
+    msgh.msg_iov = &iovec;
+    msgh.msg_iovlen = 1;
+    msgh.msg_control = buf;
+    msgh.msg_controllen = sizeof(buf);
+
+    cmsgh = CMSG_FIRSTHDR(&msgh);
+    cmsgh->cmsg_level = SOL_SOCKET;
+    cmsgh->cmsg_type = SCM_RIGHTS;
+    cmsgh->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsgh), &fd, sizeof(int));
+
+    if (sendmsg(socket_fd, &msgh, 0) < 0) {
+      fprintf(stderr, "Failed with %s\n", strerror(errno));
+      return -1;
+    }
+
+    return 0;
+}
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && sizeof(atomic_uint) == 4,
+              "the command ring requires lock-free 32-bit atomic_uint");
+
+#define VIRGL_VTEST_CMD_RING_BUFFER_SIZE (1 << 20)
+
+/* The producer side is serialized by virgl_vtest_winsys::sock_mutex, which
+ * also keeps the kicks from interleaving with other socket commands.
+ */
+struct virgl_vtest_cmd_ring {
+   void *map;
+   size_t map_size;
+
+   const volatile atomic_uint *head;
+   volatile atomic_uint *tail;
+   const volatile atomic_uint *status;
+
+   uint8_t *buffer;
+   uint32_t buffer_size;
+   uint32_t cur;
+
+   /* assigned by the server, see VCMD_PROTOCOL_FEATURE_CMD_RING */
+   uint32_t kick_cmd_id;
+};
+
+static void virgl_vtest_cmd_ring_create(struct virgl_vtest_winsys *vws,
+                                        uint32_t create_cmd_id)
+{
+   struct virgl_vtest_cmd_ring *ring;
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_CMD_RING_CREATE_SIZE];
+   int fd;
+
+   ring = CALLOC_STRUCT(virgl_vtest_cmd_ring);
+   if (!ring)
+      return;
+
+   ring->buffer_size = VIRGL_VTEST_CMD_RING_BUFFER_SIZE;
+   ring->map_size = VCMD_CMD_RING_BUFFER_OFFSET + ring->buffer_size;
+
+   fd = os_create_anonymous_file(ring->map_size, "virgl-vtest-cmd-ring");
+   if (fd < 0) {
+      FREE(ring);
+      return;
+   }
+
+   ring->map = os_mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+   if (ring->map == MAP_FAILED) {
+      close(fd);
+      FREE(ring);
+      return;
+   }
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_CMD_RING_CREATE_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = create_cmd_id;
+   cmd[VCMD_CMD_RING_CREATE_BUFFER_SIZE] = ring->buffer_size;
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+   if (virgl_vtest_send_fd(vws->sock_fd, fd)) {
+      /* The server is waiting for the byte the fd rides on.  Send it bare,
+       * which tells it that there is no ring, and stay on the socket.
+       */
+      char c = 0;
+
+      virgl_block_write(vws->sock_fd, &c, sizeof(c));
+      close(fd);
+      os_munmap(ring->map, ring->map_size);
+      FREE(ring);
+      return;
+   }
+   close(fd);
+
+   ring->head = ring->map + VCMD_CMD_RING_HEAD_OFFSET;
+   ring->tail = ring->map + VCMD_CMD_RING_TAIL_OFFSET;
+   ring->status = ring->map + VCMD_CMD_RING_STATUS_OFFSET;
+   ring->buffer = ring->map + VCMD_CMD_RING_BUFFER_OFFSET;
+   ring->kick_cmd_id = create_cmd_id + 1;
+
+   vws->cmd_ring = ring;
+}
+
+void virgl_vtest_cmd_ring_destroy(struct virgl_vtest_winsys *vws)
+{
+   struct virgl_vtest_cmd_ring *ring = vws->cmd_ring;
+
+   if (!ring)
+      return;
+
+   os_munmap(ring->map, ring->map_size);
+   FREE(ring);
+   vws->cmd_ring = NULL;
+}
+
+static void virgl_vtest_cmd_ring_write(struct virgl_vtest_cmd_ring *ring,
+                                       const void *data, uint32_t size)
+{
+   const uint32_t offset = ring->cur & (ring->buffer_size - 1);
+   const uint32_t first = MIN2(size, ring->buffer_size - offset);
+
+   memcpy(ring->buffer + offset, data, first);
+   memcpy(ring->buffer, (const uint8_t *)data + first, size - first);
+   ring->cur += size;
+}
+
+/* Returns false when the command does not fit.  Since the server drains the
+ * ring before looking at the socket, the caller can then fall back to the
+ * socket without breaking the ordering.
+ */
+static bool virgl_vtest_cmd_ring_submit(struct virgl_vtest_winsys *vws,
+                                        const uint32_t *vtest_hdr,
+                                        const void *data, uint32_t size)
+{
+   struct virgl_vtest_cmd_ring *ring = vws->cmd_ring;
+   const uint32_t hdr_size = VTEST_HDR_SIZE * 4;
+   uint32_t head;
+   bool kick;
+
+   head = atomic_load_explicit(ring->head, memory_order_acquire);
+   if (hdr_size + size > ring->buffer_size - (ring->cur - head))
+      return false;
+
+   virgl_vtest_cmd_ring_write(ring, vtest_hdr, hdr_size);
+   virgl_vtest_cmd_ring_write(ring, data, size);
+   atomic_store_explicit(ring->tail, ring->cur, memory_order_release);
+
+   /* pairs with the server setting the idle bit before checking the tail */
+   atomic_thread_fence(memory_order_seq_cst);
+   kick = atomic_load_explicit(ring->status, memory_order_relaxed) &
+          VCMD_CMD_RING_STATUS_IDLE;
+
+   if (kick) {
+      uint32_t kick_hdr[VTEST_HDR_SIZE];
+
+      kick_hdr[VTEST_CMD_LEN] = VCMD_CMD_RING_KICK_SIZE;
+      kick_hdr[VTEST_CMD_ID] = ring->kick_cmd_id;
+      virgl_block_write(vws->sock_fd, &kick_hdr, sizeof(kick_hdr));
+   }
+
+   return true;
+}
+
 static int virgl_vtest_send_init(struct virgl_vtest_winsys *vws)
 {
    uint32_t buf[VTEST_HDR_SIZE];
@@ -143,10 +318,13 @@ static int virgl_vtest_send_init(struct virgl_vtest_winsys *vws)
    return 0;
 }
 
-static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws)
+static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws,
+                                         uint32_t *features,
+                                         uint32_t *cmd_ring_create_id)
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
-   uint32_t version_buf[VCMD_PROTOCOL_VERSION_SIZE];
+   uint32_t version_buf[VCMD_PROTOCOL_VERSION_RING_SIZE];
+   uint32_t reply_size;
    uint32_t busy_wait_buf[VCMD_BUSY_WAIT_SIZE];
    uint32_t busy_wait_result[1];
    ASSERTED int ret;
@@ -174,15 +352,26 @@ static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws)
 
      vtest_hdr[VTEST_CMD_LEN] = VCMD_PROTOCOL_VERSION_SIZE;
      vtest_hdr[VTEST_CMD_ID] = VCMD_PROTOCOL_VERSION;
-     version_buf[VCMD_PROTOCOL_VERSION_VERSION] = VTEST_PROTOCOL_VERSION;
+     version_buf[VCMD_PROTOCOL_VERSION_VERSION] = VTEST_PROTOCOL_VERSION | *features;
      virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
      virgl_block_write(vws->sock_fd, &version_buf, sizeof(version_buf));
 
      ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
      assert(ret);
-     ret = virgl_block_read(vws->sock_fd, version_buf, sizeof(version_buf));
+     reply_size = vtest_hdr[VTEST_CMD_LEN];
+     assert(reply_size == VCMD_PROTOCOL_VERSION_SIZE ||
+            reply_size == VCMD_PROTOCOL_VERSION_RING_SIZE);
+     ret = virgl_block_read(vws->sock_fd, version_buf, reply_size * 4);
      assert(ret);
-     return version_buf[VCMD_PROTOCOL_VERSION_VERSION];
+     *features &= version_buf[VCMD_PROTOCOL_VERSION_VERSION];
+
+     /* the ring is only usable when the server assigned its command ids */
+     if (reply_size < VCMD_PROTOCOL_VERSION_RING_SIZE)
+        *features &= ~VCMD_PROTOCOL_FEATURE_CMD_RING;
+     else if (*features & VCMD_PROTOCOL_FEATURE_CMD_RING)
+        *cmd_ring_create_id = version_buf[VCMD_PROTOCOL_VERSION_RING_CREATE_ID];
+
+     return version_buf[VCMD_PROTOCOL_VERSION_VERSION] & VCMD_PROTOCOL_VERSION_MASK;
    }
 
    /* Read dummy busy_wait response */
@@ -191,6 +380,7 @@ static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws)
    assert(ret);
 
    /* Old server, return version 0 */
+   *features = 0;
    return 0;
 }
 
@@ -199,6 +389,11 @@ int virgl_vtest_connect(struct virgl_vtest_winsys *vws)
    struct sockaddr_un un;
    int sock, ret;
    const char* socket_name = os_get_option("VTEST_SOCKET_NAME");
+   uint32_t features = 0;
+   uint32_t cmd_ring_create_id = 0;
+
+   if (debug_get_bool_option("VTEST_CMD_RING", true))
+      features |= VCMD_PROTOCOL_FEATURE_CMD_RING;
 
    sock = socket(PF_UNIX, SOCK_STREAM, 0);
    if (sock < 0)
@@ -218,12 +413,16 @@ int virgl_vtest_connect(struct virgl_vtest_winsys *vws)
 
    vws->sock_fd = sock;
    virgl_vtest_send_init(vws);
-   vws->protocol_version = virgl_vtest_negotiate_version(vws);
+   vws->protocol_version = virgl_vtest_negotiate_version(vws, &features,
+                                                         &cmd_ring_create_id);
 
    /* Version 1 is deprecated. */
    if (vws->protocol_version == 1)
       vws->protocol_version = 0;
 
+   if (features & VCMD_PROTOCOL_FEATURE_CMD_RING)
+      virgl_vtest_cmd_ring_create(vws, cmd_ring_create_id);
+
    return 0;
 }
 
@@ -372,6 +571,11 @@ int virgl_vtest_submit_cmd(struct virgl_vtest_winsys *vws,
    vtest_hdr[VTEST_CMD_LEN] = cbuf->base.cdw;
    vtest_hdr[VTEST_CMD_ID] = VCMD_SUBMIT_CMD;
 
+   if (vws->cmd_ring &&
+       virgl_vtest_cmd_ring_submit(vws, vtest_hdr, cbuf->buf,
+                                   cbuf->base.cdw * 4))
+      return 0;
+
    virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
    virgl_block_write(vws->sock_fd, cbuf->buf, cbuf->base.cdw * 4);
    return 0;
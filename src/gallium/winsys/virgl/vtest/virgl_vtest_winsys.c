@@ -90,16 +90,17 @@ virgl_vtest_transfer_put(struct virgl_winsys *vws,
    size = vtest_get_transfer_size(res, box, stride, layer_stride, level,
                                   &valid_stride);
 
+   mtx_lock(&vtws->sock_mutex);
    virgl_vtest_send_transfer_put(vtws, res->res_handle,
                                  level, stride, layer_stride,
                                  box, size, buf_offset);
 
-   if (vtws->protocol_version >= 2)
-      return 0;
-
-   ptr = virgl_vtest_resource_map(vws, res);
-   virgl_vtest_send_transfer_put_data(vtws, ptr + buf_offset, size);
-   virgl_vtest_resource_unmap(vws, res);
+   if (vtws->protocol_version < 2) {
+      ptr = virgl_vtest_resource_map(vws, res);
+      virgl_vtest_send_transfer_put_data(vtws, ptr + buf_offset, size);
+      virgl_vtest_resource_unmap(vws, res);
+   }
+   mtx_unlock(&vtws->sock_mutex);
    return 0;
 }
 
@@ -118,6 +119,7 @@ virgl_vtest_transfer_get_internal(struct virgl_winsys *vws,
 
    size = vtest_get_transfer_size(res, box, stride, layer_stride, level,
                                   &valid_stride);
+   mtx_lock(&vtws->sock_mutex);
    virgl_vtest_send_transfer_get(vtws, res->res_handle,
                                  level, stride, layer_stride,
                                  box, size, buf_offset);
@@ -126,6 +128,8 @@ virgl_vtest_transfer_get_internal(struct virgl_winsys *vws,
       virgl_vtest_busy_wait(vtws, res->res_handle, VCMD_BUSY_WAIT_FLAG_WAIT);
 
    if (vtws->protocol_version >= 2) {
+      mtx_unlock(&vtws->sock_mutex);
+
       if (flush_front_buffer) {
          if (box->depth > 1 || box->z > 1) {
             fprintf(stderr, "Expected a 2D resource, received a 3D resource\n");
@@ -155,6 +159,7 @@ virgl_vtest_transfer_get_internal(struct virgl_winsys *vws,
       virgl_vtest_recv_transfer_get_data(vtws, ptr + buf_offset, size,
                                          valid_stride, box, res->format);
       virgl_vtest_resource_unmap(vws, res);
+      mtx_unlock(&vtws->sock_mutex);
    }
 
    return 0;
@@ -175,7 +180,9 @@ virgl_vtest_transfer_get(struct virgl_winsys *vws,
 static void virgl_hw_res_destroy(struct virgl_vtest_winsys *vtws,
                                  struct virgl_hw_res *res)
 {
+   mtx_lock(&vtws->sock_mutex);
    virgl_vtest_send_resource_unref(vtws, res->res_handle);
+   mtx_unlock(&vtws->sock_mutex);
    if (res->dt)
       vtws->sws->displaytarget_destroy(vtws->sws, res->dt);
    if (vtws->protocol_version >= 2) {
@@ -195,7 +202,9 @@ static bool virgl_vtest_resource_is_busy(struct virgl_winsys *vws,
 
    /* implement busy check */
    int ret;
+   mtx_lock(&vtws->sock_mutex);
    ret = virgl_vtest_busy_wait(vtws, res->res_handle, 0);
+   mtx_unlock(&vtws->sock_mutex);
 
    if (ret < 0)
       return false;
@@ -274,9 +283,11 @@ virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
    res->height = height;
    res->width = width;
    res->size = size;
+   mtx_lock(&vtws->sock_mutex);
    virgl_vtest_send_resource_create(vtws, handle, target, pipe_to_virgl_format(format), bind,
                                     width, height, depth, array_size,
                                     last_level, nr_samples, size, &fd);
+   mtx_unlock(&vtws->sock_mutex);
 
    if (vtws->protocol_version >= 2) {
       if (res->size == 0) {
@@ -359,7 +370,9 @@ static void virgl_vtest_resource_wait(struct virgl_winsys *vws,
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
 
+   mtx_lock(&vtws->sock_mutex);
    virgl_vtest_busy_wait(vtws, res->res_handle, VCMD_BUSY_WAIT_FLAG_WAIT);
+   mtx_unlock(&vtws->sock_mutex);
 }
 
 static struct virgl_hw_res *
@@ -544,7 +557,9 @@ static int virgl_vtest_winsys_submit_cmd(struct virgl_winsys *vws,
    if (cbuf->base.cdw == 0)
       return 0;
 
+   mtx_lock(&vtws->sock_mutex);
    ret = virgl_vtest_submit_cmd(vtws, cbuf);
+   mtx_unlock(&vtws->sock_mutex);
    if (fence && ret == 0)
       *fence = virgl_vtest_fence_create(vws);
 
@@ -669,8 +684,10 @@ virgl_vtest_winsys_destroy(struct virgl_winsys *vws)
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
 
-   virgl_resource_cache_flush(&vtws->cache);
+   virgl_resource_cache_fini(&vtws->cache);
+   virgl_vtest_cmd_ring_destroy(vtws);
 
+   mtx_destroy(&vtws->sock_mutex);
    mtx_destroy(&vtws->mutex);
    FREE(vtws);
 }
@@ -705,13 +722,18 @@ virgl_vtest_winsys_wrap(struct sw_winsys *sws)
    if (!vtws)
       return NULL;
 
+   if (!virgl_resource_cache_init(&vtws->cache, CACHE_TIMEOUT_USEC,
+                                  virgl_vtest_resource_cache_entry_is_busy,
+                                  virgl_vtest_resource_cache_entry_release,
+                                  vtws)) {
+      FREE(vtws);
+      return NULL;
+   }
+
+   (void) mtx_init(&vtws->sock_mutex, mtx_plain);
    virgl_vtest_connect(vtws);
    vtws->sws = sws;
 
-   virgl_resource_cache_init(&vtws->cache, CACHE_TIMEOUT_USEC,
-                             virgl_vtest_resource_cache_entry_is_busy,
-                             virgl_vtest_resource_cache_entry_release,
-                             vtws);
    (void) mtx_init(&vtws->mutex, mtx_plain);
 
    vtws->base.destroy = virgl_vtest_winsys_destroy;
@@ -36,6 +36,7 @@
 
 struct pipe_fence_handle;
 struct sw_winsys;
+struct virgl_vtest_cmd_ring;
 struct sw_displaytarget;
 
 struct virgl_vtest_winsys {
@@ -45,11 +46,16 @@ struct virgl_vtest_winsys {
 
    /* fd to remote renderer */
    int sock_fd;
+   /* serializes requests and their replies on sock_fd */
+   mtx_t sock_mutex;
 
    struct virgl_resource_cache cache;
    mtx_t mutex;
 
    unsigned protocol_version;
+
+   /* shared memory ring for VCMD_SUBMIT_CMD, if the server supports it */
+   struct virgl_vtest_cmd_ring *cmd_ring;
 };
 
 struct virgl_hw_res {
@@ -104,6 +110,7 @@ virgl_vtest_cmd_buf(struct virgl_cmd_buf *cbuf)
 
 
 int virgl_vtest_connect(struct virgl_vtest_winsys *vws);
+void virgl_vtest_cmd_ring_destroy(struct virgl_vtest_winsys *vws);
 int virgl_vtest_send_get_caps(struct virgl_vtest_winsys *vws,
                               struct virgl_drm_caps *caps);
 
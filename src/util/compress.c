@@ -44,6 +44,8 @@
 
 /* 3 is the recomended level, with 22 as the absolute maximum */
 #define ZSTD_COMPRESSION_LEVEL 3
+/* for data that is compressed once and sent right away */
+#define ZSTD_FAST_COMPRESSION_LEVEL 1
 
 size_t
 util_compress_max_compressed_len(size_t in_data_size)
@@ -70,15 +72,14 @@ util_compress_max_compressed_len(size_t in_data_size)
 #endif
 }
 
-/* Compress data and return the size of the compressed data */
-size_t
-util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
-                      uint8_t *out_data, size_t out_buff_size)
+static size_t
+compress_deflate(const uint8_t *in_data, size_t in_data_size,
+                 uint8_t *out_data, size_t out_buff_size, bool fast)
 {
-   MESA_TRACE_FUNC();
 #ifdef HAVE_ZSTD
    size_t ret = ZSTD_compress(out_data, out_buff_size, in_data, in_data_size,
-                              ZSTD_COMPRESSION_LEVEL);
+                              fast ? ZSTD_FAST_COMPRESSION_LEVEL :
+                                     ZSTD_COMPRESSION_LEVEL);
    if (ZSTD_isError(ret))
       return 0;
 
@@ -96,7 +97,7 @@ util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
    strm.avail_in = in_data_size;
    strm.avail_out = out_buff_size;
 
-   int ret = deflateInit(&strm, Z_BEST_COMPRESSION);
+   int ret = deflateInit(&strm, fast ? Z_BEST_SPEED : Z_BEST_COMPRESSION);
    if (ret != Z_OK) {
        (void) deflateEnd(&strm);
        return 0;
@@ -119,6 +120,26 @@ util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
 # endif
 }
 
+/* Compress data and return the size of the compressed data */
+size_t
+util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
+                      uint8_t *out_data, size_t out_buff_size)
+{
+   MESA_TRACE_FUNC();
+   return compress_deflate(in_data, in_data_size, out_data, out_buff_size,
+                           false);
+}
+
+/* Like util_compress_deflate(), but favors speed over compression ratio. */
+size_t
+util_compress_deflate_fast(const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_buff_size)
+{
+   MESA_TRACE_FUNC();
+   return compress_deflate(in_data, in_data_size, out_data, out_buff_size,
+                           true);
+}
+
 /**
  * Decompresses data, returns true if successful.
  */
@@ -37,4 +37,8 @@ size_t
 util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
                       uint8_t *out_data, size_t out_buff_size);
 
+size_t
+util_compress_deflate_fast(const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_buff_size);
+
 #endif
@@ -648,6 +648,14 @@
    DRI_CONF_OPT_B(venus_wsi_multi_plane_modifiers, def, \
                   "Enable support of multi-plane format modifiers for wsi images")
 
+#define DRI_CONF_VENUS_MEMORY_POOL(def) \
+   DRI_CONF_OPT_B(venus_memory_pool, def, \
+                  "Sub-allocate small host-visible memory allocations from pooled allocations")
+
+#define DRI_CONF_VENUS_PIPELINE_INDEX(def) \
+   DRI_CONF_OPT_B(venus_pipeline_index, def, \
+                  "Remember which pipelines persisted pipeline caches hold, to create them asynchronously")
+
 /**
  * \brief RADV specific configuration options
  */
@@ -254,6 +254,29 @@ _mesa_hash_table_destroy(struct hash_table *ht,
    ralloc_free(ht);
 }
 
+/**
+ * Frees the entries of a hash table set up with _mesa_hash_table_init(),
+ * leaving the struct itself to the caller.
+ *
+ * If delete_function is passed, it gets called on each entry present before
+ * freeing.
+ */
+void
+_mesa_hash_table_fini(struct hash_table *ht,
+                      void (*delete_function)(struct hash_entry *entry))
+{
+   if (!ht->table)
+      return;
+
+   if (delete_function) {
+      hash_table_foreach(ht, entry) {
+         delete_function(entry);
+      }
+   }
+   ralloc_free(ht->table);
+   ht->table = NULL;
+}
+
 static void
 hash_table_clear_fast(struct hash_table *ht)
 {
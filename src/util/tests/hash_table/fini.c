@@ -0,0 +1,64 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#undef NDEBUG
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "util/hash_table.h"
+
+static const char *str1 = "test1";
+static const char *str2 = "test2";
+static int delete_count = 0;
+
+static void
+delete_callback(struct hash_entry *entry)
+{
+   if (strcmp(entry->key, str1) != 0 && strcmp(entry->key, str2) != 0)
+      abort();
+
+   delete_count++;
+}
+
+int
+main(int argc, char **argv)
+{
+   struct hash_table ht;
+   bool ok;
+
+   (void) argc;
+   (void) argv;
+
+   ok = _mesa_hash_table_init(&ht, NULL, _mesa_hash_string,
+                              _mesa_key_string_equal);
+   assert(ok);
+
+   _mesa_hash_table_insert(&ht, str1, NULL);
+   _mesa_hash_table_insert(&ht, str2, NULL);
+
+   /* the callback runs once per entry and the storage is released */
+   _mesa_hash_table_fini(&ht, delete_callback);
+   assert(delete_count == 2);
+   assert(ht.table == NULL);
+
+   /* a second fini is a no-op */
+   _mesa_hash_table_fini(&ht, delete_callback);
+   assert(delete_count == 2);
+
+   /* the struct can be set up again, and torn down without a callback */
+   ok = _mesa_hash_table_init(&ht, NULL, _mesa_hash_string,
+                              _mesa_key_string_equal);
+   assert(ok);
+
+   _mesa_hash_table_insert(&ht, str1, NULL);
+   assert(_mesa_hash_table_search(&ht, str1));
+
+   _mesa_hash_table_fini(&ht, NULL);
+   assert(delete_count == 2);
+   assert(ht.table == NULL);
+
+   return 0;
+}
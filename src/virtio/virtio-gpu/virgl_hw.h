@@ -587,6 +587,10 @@ enum virgl_formats {
 #define VIRGL_CAP_V2_GROUP_VOTE           (1 << 15)
 #define VIRGL_CAP_V2_MIRROR_CLAMP_TO_EDGE (1 << 16)
 #define VIRGL_CAP_V2_MIRROR_CLAMP         (1 << 17)
+#define VIRGL_CAP_V2_NIR_SHADER           (1 << 18)
+#define VIRGL_CAP_V2_MULTI_DRAW           (1 << 19)
+#define VIRGL_CAP_V2_COMPRESS_ZLIB        (1 << 20)
+#define VIRGL_CAP_V2_COMPRESS_ZSTD        (1 << 21)
 
 /* virgl bind flags - these are compatible with mesa 10.5 gallium.
  * but are fixed, no other should be passed to virgl either.
@@ -770,6 +774,9 @@ struct virgl_caps_v2 {
         uint32_t max_uniform_block_size;
         uint32_t max_tcs_outputs;
         uint32_t max_tes_outputs;
+        /* Mesa version (PACKAGE_VERSION and git sha1) whose nir_serialize()
+         * format the host reads, see VIRGL_CAP_V2_NIR_SHADER. */
+        char nir_version[64];
 };
 
 union virgl_caps {
@@ -58,6 +58,7 @@ enum virgl_object_type {
    VIRGL_OBJECT_QUERY,
    VIRGL_OBJECT_STREAMOUT_TARGET,
    VIRGL_OBJECT_MSAA_SURFACE,
+   VIRGL_OBJECT_SHADER_NIR,
    VIRGL_MAX_OBJECTS,
 };
 
@@ -131,6 +132,9 @@ enum virgl_context_cmd {
 
    VIRGL_CCMD_CLEAR_SURFACE,
 
+   VIRGL_CCMD_DRAW_MULTI,
+   VIRGL_CCMD_COMPRESSED,
+
    VIRGL_MAX_COMMANDS
 };
 
@@ -285,6 +289,14 @@ enum virgl_shader_stage {
 #define VIRGL_OBJ_SHADER_SO_OUTPUT0_SO(x) (11 + (x * 2))
 #define VIRGL_OBJ_SHADER_SO_OUTPUT_STREAM(x) (((x) & 0x03) << 0)
 
+/* NIR shader object (VIRGL_CAP_V2_NIR_SHADER)
+ * Same layout as the shader object, but the payload is a nir_serialize()
+ * blob instead of TGSI text and NUM_TOKENS is unused.  The host tracks the
+ * result as a VIRGL_OBJECT_SHADER for binding and destruction.  The blob
+ * format is only stable within one Mesa version, so the guest only sends
+ * these when its version matches virgl_caps_v2::nir_version.
+ */
+
 /* viewport state */
 #define VIRGL_SET_VIEWPORT_STATE_SIZE(num_viewports) ((6 * num_viewports) + 1)
 #define VIRGL_SET_VIEWPORT_START_SLOT 1
@@ -360,6 +372,47 @@ enum virgl_shader_stage {
 #define VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_OFFSET 19
 #define VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_HANDLE 20
 
+/* draw multi: one header followed by a (start, count, index bias) record per
+ * draw.  For indexed draws, start is in indices from the offset of the bound
+ * index buffer.  When VIRGL_DRAW_MULTI_FLAG_INCREMENT_DRAWID is set, the
+ * draw id starts at VIRGL_DRAW_MULTI_DRAWID and increments per record.
+ */
+#define VIRGL_DRAW_MULTI_HEADER_SIZE 11
+#define VIRGL_DRAW_MULTI_RECORD_SIZE 3
+#define VIRGL_DRAW_MULTI_SIZE(num_draws) (VIRGL_DRAW_MULTI_HEADER_SIZE + VIRGL_DRAW_MULTI_RECORD_SIZE * (num_draws))
+#define VIRGL_DRAW_MULTI_MAX_DRAWS 1024
+#define VIRGL_DRAW_MULTI_MODE 1
+#define VIRGL_DRAW_MULTI_INDEXED 2
+#define VIRGL_DRAW_MULTI_INSTANCE_COUNT 3
+#define VIRGL_DRAW_MULTI_START_INSTANCE 4
+#define VIRGL_DRAW_MULTI_PRIMITIVE_RESTART 5
+#define VIRGL_DRAW_MULTI_RESTART_INDEX 6
+#define VIRGL_DRAW_MULTI_MIN_INDEX 7
+#define VIRGL_DRAW_MULTI_MAX_INDEX 8
+#define VIRGL_DRAW_MULTI_VERTICES_PER_PATCH 9
+#define VIRGL_DRAW_MULTI_DRAWID 10
+#define VIRGL_DRAW_MULTI_FLAGS 11
+#define VIRGL_DRAW_MULTI_FLAG_INCREMENT_DRAWID (1 << 0)
+#define VIRGL_DRAW_MULTI_START(i) (VIRGL_DRAW_MULTI_HEADER_SIZE + 1 + VIRGL_DRAW_MULTI_RECORD_SIZE * (i))
+#define VIRGL_DRAW_MULTI_COUNT(i) (VIRGL_DRAW_MULTI_START(i) + 1)
+#define VIRGL_DRAW_MULTI_INDEX_BIAS(i) (VIRGL_DRAW_MULTI_START(i) + 2)
+
+/* compressed: a single command, header included, compressed with the codec
+ * given in the object field of the header.  The host inflates it and
+ * decodes it in place of this one.
+ */
+enum virgl_compression {
+   VIRGL_COMPRESSION_NONE,
+   VIRGL_COMPRESSION_ZLIB,
+   VIRGL_COMPRESSION_ZSTD,
+};
+
+#define VIRGL_COMPRESSED_HEADER_SIZE 2
+#define VIRGL_COMPRESSED_SIZE(bytes) (VIRGL_COMPRESSED_HEADER_SIZE + ((bytes) + 3) / 4)
+#define VIRGL_COMPRESSED_DWORDS 1
+#define VIRGL_COMPRESSED_BYTES 2
+#define VIRGL_COMPRESSED_DATA 3
+
 /* create surface */
 #define VIRGL_OBJ_SURFACE_SIZE 5
 #define VIRGL_OBJ_SURFACE_HANDLE 1
@@ -150,6 +150,55 @@
 #define VCMD_PROTOCOL_VERSION_SIZE 1
 #define VCMD_PROTOCOL_VERSION_VERSION 0
 
+/* Optional features can be or'ed into VCMD_PROTOCOL_VERSION_VERSION by the
+ * client.  A server that supports a feature sets its bit in the reply as
+ * well.  Older servers clamp the value to their own version and thus never
+ * return any feature bit.
+ */
+#define VCMD_PROTOCOL_VERSION_MASK 0xffff
+#define VCMD_PROTOCOL_FEATURE_CMD_RING (1u << 31)
+
+/* Command ring (VCMD_PROTOCOL_FEATURE_CMD_RING)
+ *
+ * The upstream protocol assigns no command ids to the ring, and none are
+ * taken from its numbering here.  A server that supports the ring echoes
+ * the feature bit and replies with VCMD_PROTOCOL_VERSION_RING_SIZE dwords
+ * instead, the last one being the id it assigned to VCMD_CMD_RING_CREATE.
+ * VCMD_CMD_RING_KICK uses the id that follows.  The feature is only
+ * negotiated when both are present.
+ *
+ * VCMD_CMD_RING_CREATE is followed by a single byte carrying the fd of a
+ * shared memory file as SCM_RIGHTS.  When the byte arrives without an fd,
+ * no ring is created and the client keeps using the socket.  The file
+ * starts with the control words below and the ring buffer follows at
+ * VCMD_CMD_RING_BUFFER_OFFSET.  The buffer size is a power of two.
+ *
+ * Commands in the ring use the same header and payload as on the socket.
+ * They are dword aligned and wrap around at the end of the buffer.  They
+ * must not expect a reply or carry an fd.  HEAD and TAIL are free-running
+ * byte counters written by the server and the client respectively.
+ *
+ * The server consumes everything in the ring before handling the next
+ * command received on the socket, which keeps the two streams ordered.  It
+ * sets VCMD_CMD_RING_STATUS_IDLE before going to sleep on the socket, and
+ * the client sends VCMD_CMD_RING_KICK after updating TAIL when it sees that
+ * bit.
+ */
+#define VCMD_PROTOCOL_VERSION_RING_SIZE 2
+#define VCMD_PROTOCOL_VERSION_RING_CREATE_ID 1
+
+#define VCMD_CMD_RING_CREATE_SIZE 1
+#define VCMD_CMD_RING_CREATE_BUFFER_SIZE 0
+
+#define VCMD_CMD_RING_KICK_SIZE 0
+
+#define VCMD_CMD_RING_HEAD_OFFSET 0
+#define VCMD_CMD_RING_TAIL_OFFSET 4
+#define VCMD_CMD_RING_STATUS_OFFSET 8
+#define VCMD_CMD_RING_BUFFER_OFFSET 64
+
+#define VCMD_CMD_RING_STATUS_IDLE (1u << 0)
+
 #ifdef VIRGL_RENDERER_UNSTABLE_APIS
 
 enum vcmd_param  {
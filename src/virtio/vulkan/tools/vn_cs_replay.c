@@ -0,0 +1,317 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Replays a VN_CS_DUMP capture against a vtest server and reports how long
+ * the server takes to decode and execute the command streams.
+ *
+ *    vn_cs_replay [-s socket] [-r repeat] dump
+ *
+ * Every record is sent with VCMD_SUBMIT_CMD in capture order.  Replies are
+ * not wanted, so the reply flag of the leading command is cleared, and the
+ * ring control commands that only make sense to the capturing driver are
+ * skipped.  Memory contents and external resources are not captured, thus
+ * commands depending on them may fail on the server side.  The numbers are
+ * meant for comparing encodings of the same workload.
+ *
+ * The records are also broken down by the entry point of their leading
+ * command.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "util/os_time.h"
+#include "util/u_dynarray.h"
+#include "venus-protocol/vn_protocol_driver_defines.h"
+#define VIRGL_RENDERER_UNSTABLE_APIS
+#include "virtio-gpu/virglrenderer_hw.h"
+#include "vtest/vtest_protocol.h"
+
+#include "../vn_cs_dump.h"
+#include "vn_cs_command_names.h"
+
+/* large enough for all VkCommandTypeEXT, with the last one catching the
+ * unexpected
+ */
+#define REPLAY_COMMAND_TYPE_COUNT 512
+
+struct replay_record {
+   uint64_t ring_id;
+   uint32_t *data;
+   uint32_t dwords;
+};
+
+struct replay {
+   int sock_fd;
+
+   struct util_dynarray records;
+   uint64_t skipped_count;
+   uint64_t byte_count;
+
+   uint64_t record_count_by_type[REPLAY_COMMAND_TYPE_COUNT];
+   uint64_t byte_count_by_type[REPLAY_COMMAND_TYPE_COUNT];
+};
+
+static void
+replay_write(struct replay *replay, const void *buf, size_t size)
+{
+   while (size) {
+      const ssize_t ret = write(replay->sock_fd, buf, size);
+      if (ret < 0) {
+         fprintf(stderr, "lost connection to the server: %s\n",
+                 strerror(errno));
+         exit(1);
+      }
+      buf += ret;
+      size -= ret;
+   }
+}
+
+static void
+replay_read(struct replay *replay, void *buf, size_t size)
+{
+   while (size) {
+      const ssize_t ret = read(replay->sock_fd, buf, size);
+      if (ret <= 0) {
+         fprintf(stderr, "lost connection to the server\n");
+         exit(1);
+      }
+      buf += ret;
+      size -= ret;
+   }
+}
+
+static void
+replay_vcmd(struct replay *replay,
+            uint32_t id,
+            const void *data,
+            uint32_t dwords)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   vtest_hdr[VTEST_CMD_LEN] = dwords;
+   vtest_hdr[VTEST_CMD_ID] = id;
+   replay_write(replay, vtest_hdr, sizeof(vtest_hdr));
+   replay_write(replay, data, dwords * sizeof(uint32_t));
+}
+
+/* the server handles commands in order, so this also waits for all
+ * previously submitted command streams to be decoded
+ */
+static void
+replay_ping(struct replay *replay)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   replay_vcmd(replay, VCMD_PING_PROTOCOL_VERSION, NULL, 0);
+   replay_read(replay, vtest_hdr, sizeof(vtest_hdr));
+   if (vtest_hdr[VTEST_CMD_ID] != VCMD_PING_PROTOCOL_VERSION) {
+      fprintf(stderr, "unexpected reply %u\n", vtest_hdr[VTEST_CMD_ID]);
+      exit(1);
+   }
+}
+
+static bool
+replay_connect(struct replay *replay, const char *path)
+{
+   struct sockaddr_un un;
+
+   replay->sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (replay->sock_fd < 0)
+      return false;
+
+   memset(&un, 0, sizeof(un));
+   un.sun_family = AF_UNIX;
+   snprintf(un.sun_path, sizeof(un.sun_path), "%s", path);
+   if (connect(replay->sock_fd, (struct sockaddr *)&un, sizeof(un))) {
+      fprintf(stderr, "failed to connect to %s: %s\n", path, strerror(errno));
+      return false;
+   }
+
+   static const char name[] = "vn_cs_replay";
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   vtest_hdr[VTEST_CMD_LEN] = sizeof(name);
+   vtest_hdr[VTEST_CMD_ID] = VCMD_CREATE_RENDERER;
+   replay_write(replay, vtest_hdr, sizeof(vtest_hdr));
+   replay_write(replay, name, sizeof(name));
+
+   /* servers without ping support predate context init anyway */
+   replay_ping(replay);
+
+   uint32_t version = VTEST_PROTOCOL_VERSION;
+   replay_vcmd(replay, VCMD_PROTOCOL_VERSION, &version,
+               VCMD_PROTOCOL_VERSION_SIZE);
+   replay_read(replay, vtest_hdr, sizeof(vtest_hdr));
+   replay_read(replay, &version, sizeof(version));
+   if (version < 3) {
+      fprintf(stderr, "vtest protocol version %u is too old\n", version);
+      return false;
+   }
+
+   const uint32_t capset_id = VIRGL_RENDERER_CAPSET_VENUS;
+   replay_vcmd(replay, VCMD_CONTEXT_INIT, &capset_id,
+               VCMD_CONTEXT_INIT_SIZE);
+
+   return true;
+}
+
+static bool
+replay_skip_record(const struct replay_record *record)
+{
+   if (record->dwords < 2)
+      return true;
+
+   switch (record->data[0]) {
+   case VK_COMMAND_TYPE_vkSetReplyCommandStreamMESA_EXT:
+   case VK_COMMAND_TYPE_vkWaitVirtqueueSeqnoMESA_EXT:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool
+replay_load(struct replay *replay, const char *path)
+{
+   struct vn_cs_dump_header header;
+   struct vn_cs_dump_record dump_record;
+   bool ok = true;
+
+   FILE *fp = fopen(path, "rb");
+   if (!fp) {
+      fprintf(stderr, "failed to open %s\n", path);
+      return false;
+   }
+
+   if (fread(&header, sizeof(header), 1, fp) != 1 ||
+       header.magic != VN_CS_DUMP_MAGIC ||
+       header.version != VN_CS_DUMP_VERSION) {
+      fprintf(stderr, "%s is not a cs dump\n", path);
+      fclose(fp);
+      return false;
+   }
+
+   while (fread(&dump_record, sizeof(dump_record), 1, fp) == 1) {
+      struct replay_record record = {
+         .ring_id = dump_record.ring_id,
+         .data = malloc(dump_record.size),
+         .dwords = dump_record.size / sizeof(uint32_t),
+      };
+      if (!record.data ||
+          fread(record.data, dump_record.size, 1, fp) != 1) {
+         fprintf(stderr, "%s: truncated record\n", path);
+         free(record.data);
+         ok = false;
+         break;
+      }
+
+      if (replay_skip_record(&record)) {
+         replay->skipped_count++;
+         free(record.data);
+         continue;
+      }
+
+      record.data[1] &= ~VK_COMMAND_GENERATE_REPLY_BIT_EXT;
+
+      const uint32_t cmd_type =
+         MIN2(record.data[0], REPLAY_COMMAND_TYPE_COUNT - 1);
+      replay->record_count_by_type[cmd_type]++;
+      replay->byte_count_by_type[cmd_type] += dump_record.size;
+
+      replay->byte_count += dump_record.size;
+      util_dynarray_append(&replay->records, struct replay_record, record);
+   }
+
+   fclose(fp);
+   return ok;
+}
+
+static void
+replay_print_types(const struct replay *replay)
+{
+   for (uint32_t i = 0; i < REPLAY_COMMAND_TYPE_COUNT; i++) {
+      const uint64_t count = replay->record_count_by_type[i];
+      if (!count)
+         continue;
+
+      const uint64_t bytes = replay->byte_count_by_type[i];
+      const char *name = vn_cs_command_type_name(i);
+      if (name) {
+         printf("  %s: %" PRIu64 " records, %" PRIu64 " bytes\n", name,
+                count, bytes);
+      } else {
+         printf("  unknown command type %u: %" PRIu64 " records, %" PRIu64
+                " bytes\n", i, count, bytes);
+      }
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   const char *sock_path = VTEST_DEFAULT_SOCKET_NAME;
+   unsigned repeat = 1;
+   struct replay replay;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "s:r:")) != -1) {
+      switch (opt) {
+      case 's':
+         sock_path = optarg;
+         break;
+      case 'r':
+         repeat = MAX2(atoi(optarg), 1);
+         break;
+      default:
+         optind = argc;
+         break;
+      }
+   }
+
+   if (optind + 1 != argc) {
+      fprintf(stderr, "usage: %s [-s socket] [-r repeat] dump\n", argv[0]);
+      return 1;
+   }
+
+   memset(&replay, 0, sizeof(replay));
+   util_dynarray_init(&replay.records, NULL);
+
+   if (!replay_load(&replay, argv[optind]))
+      return 1;
+
+   printf("%zu records, %" PRIu64 " bytes, %" PRIu64 " skipped\n",
+          util_dynarray_num_elements(&replay.records, struct replay_record),
+          replay.byte_count, replay.skipped_count);
+   replay_print_types(&replay);
+
+   /* objects are created by the dump itself, so each run needs a fresh
+    * context
+    */
+   for (unsigned i = 0; i < repeat; i++) {
+      if (!replay_connect(&replay, sock_path))
+         return 1;
+
+      const int64_t start = os_time_get_nano();
+      util_dynarray_foreach(&replay.records, struct replay_record, record)
+         replay_vcmd(&replay, VCMD_SUBMIT_CMD, record->data, record->dwords);
+      replay_ping(&replay);
+      const int64_t elapsed = os_time_get_nano() - start;
+
+      printf("run %u: %.3f ms, %.1f MB/s\n", i, elapsed / 1e6,
+             elapsed ? replay.byte_count * 1e3 / elapsed : 0.0);
+
+      close(replay.sock_fd);
+   }
+
+   util_dynarray_foreach(&replay.records, struct replay_record, record)
+      free(record->data);
+   util_dynarray_fini(&replay.records);
+
+   return 0;
+}
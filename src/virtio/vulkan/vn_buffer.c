@@ -272,6 +272,8 @@ vn_buffer_init(struct vn_device *dev,
          .buffer = buf_handle,
       },
       &buf->requirements.memory);
+   vn_device_memory_pools_check_requirements(
+      dev, &buf->requirements.memory.memoryRequirements);
 
    /* If cacheable, store mem requirements from the synchronous call */
    if (entry) {
@@ -452,8 +454,24 @@ vn_BindBufferMemory2(VkDevice device,
                      const VkBindBufferMemoryInfo *pBindInfos)
 {
    struct vn_device *dev = vn_device_from_handle(device);
+
+   if (!dev->memory_pool_enabled) {
+      vn_async_vkBindBufferMemory2(dev->primary_ring, device, bindInfoCount,
+                                   pBindInfos);
+      return VK_SUCCESS;
+   }
+
+   STACK_ARRAY(VkBindBufferMemoryInfo, local_infos, bindInfoCount);
+   typed_memcpy(local_infos, pBindInfos, bindInfoCount);
+   for (uint32_t i = 0; i < bindInfoCount; i++) {
+      vn_device_memory_resolve(&local_infos[i].memory,
+                               &local_infos[i].memoryOffset);
+   }
+
    vn_async_vkBindBufferMemory2(dev->primary_ring, device, bindInfoCount,
-                                pBindInfos);
+                                local_infos);
+
+   STACK_ARRAY_FINISH(local_infos);
 
    return VK_SUCCESS;
 }
@@ -530,6 +548,8 @@ vn_GetDeviceBufferMemoryRequirements(
    /* Make the host call if not found in cache or not cacheable */
    vn_call_vkGetDeviceBufferMemoryRequirements(dev->primary_ring, device,
                                                pInfo, pMemoryRequirements);
+   vn_device_memory_pools_check_requirements(
+      dev, &pMemoryRequirements->memoryRequirements);
 
    /* If cacheable, store mem requirements from the host call */
    if (entry)
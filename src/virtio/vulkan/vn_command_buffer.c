@@ -36,6 +36,9 @@ vn_cmd_submit(struct vn_command_buffer *cmd);
       else                                                                   \
          _cmd->state = VN_COMMAND_BUFFER_STATE_INVALID;                      \
                                                                              \
+      if (VN_DEBUG(CS_STATS))                                                \
+         vn_cs_stats_add(VK_COMMAND_TYPE_##cmd_name##_EXT, _cmd_size);       \
+                                                                             \
       if (unlikely(VN_PERF(NO_CMD_BATCHING)))                                \
          vn_cmd_submit(_cmd);                                                \
    } while (0)
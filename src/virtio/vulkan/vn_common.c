@@ -32,6 +32,9 @@ static const struct debug_control vn_debug_options[] = {
    { "cache", VN_DEBUG_CACHE },
    { "no_sparse", VN_DEBUG_NO_SPARSE },
    { "no_gpl", VN_DEBUG_NO_GPL },
+   { "wait_stats", VN_DEBUG_WAIT_STATS },
+   { "mem_pool", VN_DEBUG_MEM_POOL },
+   { "cs_stats", VN_DEBUG_CS_STATS },
    { NULL, 0 },
    /* clang-format on */
 };
@@ -51,6 +54,7 @@ static const struct debug_control vn_perf_options[] = {
    { "no_multi_ring", VN_PERF_NO_MULTI_RING },
    { "no_async_image_create", VN_PERF_NO_ASYNC_IMAGE_CREATE },
    { "no_async_image_format", VN_PERF_NO_ASYNC_IMAGE_FORMAT },
+   { "no_descriptor_batching", VN_PERF_NO_DESCRIPTOR_BATCHING },
    { NULL, 0 },
    /* clang-format on */
 };
@@ -65,6 +69,7 @@ vn_env_init_once(void)
       parse_debug_string(os_get_option("VN_DEBUG"), vn_debug_options);
    vn_env.perf =
       parse_debug_string(os_get_option("VN_PERF"), vn_perf_options);
+   vn_env.cs_dump = os_get_option("VN_CS_DUMP");
 }
 
 void
@@ -153,10 +158,32 @@ vn_watchdog_acquire(struct vn_watchdog *watchdog, bool alive)
    return true;
 }
 
+static void
+vn_relax_stats_add(struct vn_relax_stats *stats, int64_t wait_ns)
+{
+   /* racy updates to the average are fine */
+   const int64_t avg_ns =
+      atomic_load_explicit(&stats->avg_wait_ns, memory_order_relaxed);
+   atomic_store_explicit(&stats->avg_wait_ns, avg_ns + (wait_ns - avg_ns) / 8,
+                         memory_order_relaxed);
+   atomic_fetch_add_explicit(&stats->total_wait_ns, wait_ns,
+                             memory_order_relaxed);
+
+   const uint32_t bucket = MIN2(util_last_bit64(wait_ns / 1000),
+                                VN_RELAX_HISTOGRAM_SIZE - 1);
+   atomic_fetch_add_explicit(&stats->histogram[bucket], 1,
+                             memory_order_relaxed);
+}
+
 void
 vn_relax_fini(struct vn_relax_state *state)
 {
-   vn_watchdog_release(&state->instance->ring.watchdog);
+   struct vn_instance *instance = state->instance;
+
+   vn_relax_stats_add(&instance->ring.relax_stats[state->reason],
+                      os_time_get_nano() - state->start_time);
+
+   vn_watchdog_release(&instance->ring.watchdog);
 }
 
 static inline const char *
@@ -237,11 +264,26 @@ vn_relax_init(struct vn_instance *instance, enum vn_relax_reason reason)
    if (vn_watchdog_acquire(watchdog, true))
       vn_ring_unset_status_bits(ring, VK_RING_STATUS_ALIVE_BIT_MESA);
 
+   const struct vn_relax_profile profile = vn_relax_get_profile(reason);
+
+   /* Busy waits only pay off when the waits usually end during them.
+    * Otherwise, they take CPU time away from the renderer, or from other VMs
+    * on an oversubscribed host, and we'd better sleep right away.
+    */
+   const uint64_t avg_wait_ns = atomic_load_explicit(
+      &instance->ring.relax_stats[reason].avg_wait_ns, memory_order_relaxed);
+   const uint32_t busy_wait_iters = avg_wait_ns > VN_RELAX_BUSY_WAIT_MAX_NS
+                                       ? 1
+                                       : 1 << profile.busy_wait_order;
+
    return (struct vn_relax_state){
       .instance = instance,
       .iter = 0,
-      .profile = vn_relax_get_profile(reason),
+      .profile = profile,
       .reason_str = vn_relax_reason_string(reason),
+      .reason = reason,
+      .busy_wait_iters = busy_wait_iters,
+      .start_time = os_time_get_nano(),
    };
 }
 
@@ -255,7 +297,7 @@ vn_relax(struct vn_relax_state *state)
 
    uint32_t *iter = &state->iter;
    (*iter)++;
-   if (*iter < (1 << busy_wait_order)) {
+   if (*iter < state->busy_wait_iters) {
       thrd_yield();
       return;
    }
@@ -289,10 +331,43 @@ vn_relax(struct vn_relax_state *state)
       }
    }
 
-   const uint32_t shift = util_last_bit(*iter) - busy_wait_order - 1;
+   /* iters skipped from the busy waits sleep for base_sleep_us */
+   const uint32_t order = util_last_bit(*iter);
+   const uint32_t shift =
+      order > busy_wait_order + 1 ? order - busy_wait_order - 1 : 0;
    os_time_sleep(base_sleep_us << shift);
 }
 
+void
+vn_relax_log_stats(struct vn_instance *instance)
+{
+   for (uint32_t i = 0; i < VN_RELAX_REASON_COUNT; i++) {
+      const struct vn_relax_stats *stats = &instance->ring.relax_stats[i];
+      uint64_t count = 0;
+      for (uint32_t j = 0; j < VN_RELAX_HISTOGRAM_SIZE; j++)
+         count += stats->histogram[j];
+      if (!count)
+         continue;
+
+      vn_log(instance, "%s waits: %" PRIu64 ", total %" PRIu64 " us",
+             vn_relax_reason_string(i), count, stats->total_wait_ns / 1000);
+      for (uint32_t j = 0; j < VN_RELAX_HISTOGRAM_SIZE; j++) {
+         if (!stats->histogram[j])
+            continue;
+
+         if (!j) {
+            vn_log(instance, "  < 1 us: %" PRIu64, stats->histogram[j]);
+         } else if (j == VN_RELAX_HISTOGRAM_SIZE - 1) {
+            vn_log(instance, "  >= %u us: %" PRIu64, 1u << (j - 1),
+                   stats->histogram[j]);
+         } else {
+            vn_log(instance, "  %u - %u us: %" PRIu64, 1u << (j - 1),
+                   (1u << j) - 1, stats->histogram[j]);
+         }
+      }
+   }
+}
+
 struct vn_ring *
 vn_tls_get_ring(struct vn_instance *instance)
 {
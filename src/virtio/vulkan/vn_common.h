@@ -112,6 +112,9 @@ enum vn_debug {
    VN_DEBUG_CACHE = 1ull << 6,
    VN_DEBUG_NO_SPARSE = 1ull << 7,
    VN_DEBUG_NO_GPL = 1ull << 8,
+   VN_DEBUG_WAIT_STATS = 1ull << 9,
+   VN_DEBUG_MEM_POOL = 1ull << 10,
+   VN_DEBUG_CS_STATS = 1ull << 11,
 };
 
 enum vn_perf {
@@ -128,6 +131,7 @@ enum vn_perf {
    VN_PERF_NO_MULTI_RING = 1ull << 11,
    VN_PERF_NO_ASYNC_IMAGE_CREATE = 1ull << 12,
    VN_PERF_NO_ASYNC_IMAGE_FORMAT = 1ull << 13,
+   VN_PERF_NO_DESCRIPTOR_BATCHING = 1ull << 14,
 };
 
 typedef uint64_t vn_object_id;
@@ -178,9 +182,21 @@ struct vn_refcount {
    atomic_int count;
 };
 
+/* The last ring submission an object depends on, so that commands using the
+ * object on another ring wait only for that submission rather than for the
+ * whole ring.  The ring must outlive the object, which holds for the primary
+ * ring.  The seqno is 64-bit and never wraps.
+ */
+struct vn_ring_dep {
+   struct vn_ring *ring;
+   atomic_uint_least64_t seqno;
+};
+
 struct vn_env {
    uint64_t debug;
    uint64_t perf;
+   /* path to dump the ring command streams to (see vn_cs_dump.h) */
+   const char *cs_dump;
 };
 extern struct vn_env vn_env;
 
@@ -239,11 +255,34 @@ struct vn_relax_profile {
    uint32_t abort_order;
 };
 
+#define VN_RELAX_REASON_COUNT (VN_RELAX_REASON_QUERY + 1)
+
+/* wait times above this make the initial busy waits pointless */
+#define VN_RELAX_BUSY_WAIT_MAX_NS (1000 * 1000)
+
+/* bucket 0 counts waits under 1us, bucket N waits in [2^(N-1), 2^N) us, and
+ * the last bucket everything longer
+ */
+#define VN_RELAX_HISTOGRAM_SIZE 16
+
+/* per vn_relax_reason wait statistics of an instance */
+struct vn_relax_stats {
+   /* moving average of the wait times, to decide whether to busy wait */
+   atomic_uint_least64_t avg_wait_ns;
+   atomic_uint_least64_t total_wait_ns;
+   atomic_uint_least64_t histogram[VN_RELAX_HISTOGRAM_SIZE];
+};
+
 struct vn_relax_state {
    struct vn_instance *instance;
    uint32_t iter;
    const struct vn_relax_profile profile;
    const char *reason_str;
+
+   enum vn_relax_reason reason;
+   /* busy waits before sleeping, adapted from the previous waits */
+   uint32_t busy_wait_iters;
+   int64_t start_time;
 };
 
 /* TLS ring
@@ -404,6 +443,9 @@ vn_relax(struct vn_relax_state *state);
 void
 vn_relax_fini(struct vn_relax_state *state);
 
+void
+vn_relax_log_stats(struct vn_instance *instance);
+
 static_assert(sizeof(vn_object_id) >= sizeof(uintptr_t), "");
 
 static inline VkResult
@@ -597,6 +639,12 @@ vn_cache_key_equal_function(const void *key1, const void *key2)
    return memcmp(key1, key2, SHA1_DIGEST_LENGTH) == 0;
 }
 
+/* hash the fields of a struct from first to last inclusive */
+#define VN_SHA1_UPDATE_FIELDS(ctx, s, first, last)                           \
+   _mesa_sha1_update(ctx, &(s)->first,                                       \
+                     offsetof(__typeof__(*(s)), last) + sizeof((s)->last) -  \
+                        offsetof(__typeof__(*(s)), first))
+
 static inline void
 vn_cached_storage_init(struct vn_cached_storage *storage,
                        const VkAllocationCallbacks *alloc)
@@ -5,6 +5,8 @@
 
 #include "vn_cs.h"
 
+#include "vn_cs_command_names.h"
+#include "vn_cs_dump.h"
 #include "vn_instance.h"
 #include "vn_renderer.h"
 
@@ -312,3 +314,99 @@ vn_cs_encoder_needs_roundtrip(struct vn_cs_encoder *enc)
 
    return false;
 }
+
+/* instrumentation */
+
+/* large enough for all VkCommandTypeEXT, with the last one catching the
+ * unexpected
+ */
+#define VN_CS_STATS_COMMAND_TYPE_COUNT 512
+
+static struct {
+   uint64_t command_count[VN_CS_STATS_COMMAND_TYPE_COUNT];
+   uint64_t byte_count[VN_CS_STATS_COMMAND_TYPE_COUNT];
+} vn_cs_stats;
+
+void
+vn_cs_stats_add(uint32_t cmd_type, size_t size)
+{
+   cmd_type = MIN2(cmd_type, VN_CS_STATS_COMMAND_TYPE_COUNT - 1);
+   p_atomic_inc(&vn_cs_stats.command_count[cmd_type]);
+   p_atomic_add(&vn_cs_stats.byte_count[cmd_type], size);
+}
+
+void
+vn_cs_stats_dump(void)
+{
+   vn_log(NULL, "dumping cs statistics per command");
+   for (uint32_t i = 0; i < VN_CS_STATS_COMMAND_TYPE_COUNT; i++) {
+      const uint64_t count = p_atomic_read(&vn_cs_stats.command_count[i]);
+      if (!count)
+         continue;
+
+      const uint64_t bytes = p_atomic_read(&vn_cs_stats.byte_count[i]);
+      const char *name = vn_cs_command_type_name(i);
+      if (name) {
+         vn_log(NULL, "  %s: %" PRIu64 " commands, %" PRIu64 " bytes", name,
+                count, bytes);
+      } else {
+         vn_log(NULL, "  unknown command type %u: %" PRIu64
+                " commands, %" PRIu64 " bytes", i, count, bytes);
+      }
+   }
+}
+
+static struct {
+   once_flag once;
+   simple_mtx_t mutex;
+   FILE *fp;
+} vn_cs_dump_file = {
+   .once = ONCE_FLAG_INIT,
+   .mutex = SIMPLE_MTX_INITIALIZER,
+};
+
+static void
+vn_cs_dump_open_once(void)
+{
+   FILE *fp = fopen(vn_env.cs_dump, "wb");
+   if (!fp) {
+      vn_log(NULL, "failed to open %s for cs dump", vn_env.cs_dump);
+      return;
+   }
+
+   const struct vn_cs_dump_header header = {
+      .magic = VN_CS_DUMP_MAGIC,
+      .version = VN_CS_DUMP_VERSION,
+   };
+   fwrite(&header, sizeof(header), 1, fp);
+
+   vn_cs_dump_file.fp = fp;
+}
+
+/**
+ * Append the committed commands of enc to the VN_CS_DUMP file, if any.
+ */
+void
+vn_cs_dump(uint64_t ring_id, const struct vn_cs_encoder *enc)
+{
+   if (likely(!vn_env.cs_dump))
+      return;
+
+   call_once(&vn_cs_dump_file.once, vn_cs_dump_open_once);
+   if (!vn_cs_dump_file.fp)
+      return;
+
+   const struct vn_cs_dump_record record = {
+      .ring_id = ring_id,
+      .size = vn_cs_encoder_get_len(enc),
+   };
+
+   simple_mtx_lock(&vn_cs_dump_file.mutex);
+   fwrite(&record, sizeof(record), 1, vn_cs_dump_file.fp);
+   for (uint32_t i = 0; i < enc->buffer_count; i++) {
+      const struct vn_cs_encoder_buffer *buf = &enc->buffers[i];
+      fwrite(buf->base, buf->committed_size, 1, vn_cs_dump_file.fp);
+   }
+   fflush(vn_cs_dump_file.fp);
+   simple_mtx_unlock(&vn_cs_dump_file.mutex);
+}
@@ -195,6 +195,27 @@ vn_cs_encoder_commit(struct vn_cs_encoder *enc);
 bool
 vn_cs_encoder_needs_roundtrip(struct vn_cs_encoder *enc);
 
+void
+vn_cs_stats_add(uint32_t cmd_type, size_t size);
+
+void
+vn_cs_stats_dump(void);
+
+/**
+ * Count an encoder holding a single command for VN_DEBUG(CS_STATS).
+ */
+static inline void
+vn_cs_stats_add_command(const struct vn_cs_encoder *enc)
+{
+   if (VN_DEBUG(CS_STATS) && enc->buffer_count) {
+      const uint32_t cmd_type = *(const uint32_t *)enc->buffers[0].base;
+      vn_cs_stats_add(cmd_type, vn_cs_encoder_get_len(enc));
+   }
+}
+
+void
+vn_cs_dump(uint64_t ring_id, const struct vn_cs_encoder *enc);
+
 static inline void
 vn_cs_decoder_init(struct vn_cs_decoder *dec, const void *data, size_t size)
 {
@@ -0,0 +1,62 @@
+# SPDX-License-Identifier: MIT
+"""Generate vn_cs_command_type_name() from the VkCommandTypeEXT enum of the
+venus protocol.
+
+Aliases share the value of the command they alias, so only the first name of
+each value is kept.
+"""
+
+import argparse
+import re
+
+COMMAND_TYPE_RE = re.compile(r'^\s*VK_COMMAND_TYPE_(\w+)_EXT\s*=\s*(\d+),')
+
+TEMPLATE_HEAD = """\
+/* This file is generated by vn_cs_command_names_gen.py.  Do not edit. */
+
+#ifndef VN_CS_COMMAND_NAMES_H
+#define VN_CS_COMMAND_NAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static inline const char *
+vn_cs_command_type_name(uint32_t cmd_type)
+{
+   switch (cmd_type) {
+"""
+
+TEMPLATE_TAIL = """\
+   default:
+      return NULL;
+   }
+}
+
+#endif /* VN_CS_COMMAND_NAMES_H */
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--defines', required=True,
+                        help='vn_protocol_driver_defines.h')
+    parser.add_argument('--out', required=True)
+    args = parser.parse_args()
+
+    names = {}
+    with open(args.defines, encoding='utf-8') as f:
+        for line in f:
+            m = COMMAND_TYPE_RE.match(line)
+            if m:
+                names.setdefault(int(m.group(2)), m.group(1))
+
+    with open(args.out, 'w', encoding='utf-8') as f:
+        f.write(TEMPLATE_HEAD)
+        for value in sorted(names):
+            f.write('   case {}:\n      return "{}";\n'.format(
+                value, names[value]))
+        f.write(TEMPLATE_TAIL)
+
+
+if __name__ == '__main__':
+    main()
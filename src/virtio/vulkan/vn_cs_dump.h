@@ -0,0 +1,31 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VN_CS_DUMP_H
+#define VN_CS_DUMP_H
+
+#include <stdint.h>
+
+/* The file format of VN_CS_DUMP, shared with tools/vn_cs_replay.c.
+ *
+ * A dump is a vn_cs_dump_header followed by records.  Each record is a
+ * vn_cs_dump_record followed by the size bytes of a command stream exactly
+ * as submitted to the ring, that is, before it is possibly uploaded to a
+ * shmem for indirect submission.
+ */
+
+#define VN_CS_DUMP_MAGIC 0x706d6476 /* "vdmp" */
+#define VN_CS_DUMP_VERSION 1
+
+struct vn_cs_dump_header {
+   uint32_t magic;
+   uint32_t version;
+};
+
+struct vn_cs_dump_record {
+   uint64_t ring_id;
+   uint64_t size;
+};
+
+#endif /* VN_CS_DUMP_H */
@@ -818,6 +818,35 @@ vn_descriptor_set_get_writes(uint32_t write_count,
    return local->writes;
 }
 
+static void
+vn_update_descriptor_sets(struct vn_device *dev,
+                          uint32_t write_count,
+                          const VkWriteDescriptorSet *writes,
+                          uint32_t copy_count,
+                          const VkCopyDescriptorSet *copies)
+{
+   VkDevice dev_handle = vn_device_to_handle(dev);
+
+   /* Descriptor updates are small and frequent.  Batch them with other
+    * async commands rather than submitting each of them to the ring.
+    */
+   if (!VN_PERF(NO_DESCRIPTOR_BATCHING)) {
+      const size_t cmd_size = vn_sizeof_vkUpdateDescriptorSets(
+         dev_handle, write_count, writes, copy_count, copies);
+      struct vn_cs_encoder *enc =
+         vn_ring_batch_begin(dev->primary_ring, cmd_size);
+      if (enc) {
+         vn_encode_vkUpdateDescriptorSets(enc, 0, dev_handle, write_count,
+                                          writes, copy_count, copies);
+         vn_ring_batch_end(dev->primary_ring, enc);
+         return;
+      }
+   }
+
+   vn_async_vkUpdateDescriptorSets(dev->primary_ring, dev_handle, write_count,
+                                   writes, copy_count, copies);
+}
+
 void
 vn_UpdateDescriptorSets(VkDevice device,
                         uint32_t descriptorWriteCount,
@@ -838,9 +867,8 @@ vn_UpdateDescriptorSets(VkDevice device,
    pDescriptorWrites = vn_descriptor_set_get_writes(
       descriptorWriteCount, pDescriptorWrites, VK_NULL_HANDLE, &local);
 
-   vn_async_vkUpdateDescriptorSets(dev->primary_ring, device,
-                                   descriptorWriteCount, pDescriptorWrites,
-                                   descriptorCopyCount, pDescriptorCopies);
+   vn_update_descriptor_sets(dev, descriptorWriteCount, pDescriptorWrites,
+                             descriptorCopyCount, pDescriptorCopies);
 
    STACK_ARRAY_FINISH(writes);
    STACK_ARRAY_FINISH(img_infos);
@@ -853,14 +881,30 @@ vn_descriptor_update_template_init(
    struct vn_descriptor_update_template *templ,
    const VkDescriptorUpdateTemplateCreateInfo *create_info)
 {
+   /* all sets updated with the template have layouts identical to this */
+   const struct vn_descriptor_set_layout *set_layout =
+      templ->push.set_layout
+         ? templ->push.set_layout
+         : vn_descriptor_set_layout_from_handle(
+              create_info->descriptorSetLayout);
+
    templ->entry_count = create_info->descriptorUpdateEntryCount;
    for (uint32_t i = 0; i < create_info->descriptorUpdateEntryCount; i++) {
       const VkDescriptorUpdateTemplateEntry *entry =
          &create_info->pDescriptorUpdateEntries[i];
-      templ->entries[i] = *entry;
+      struct vn_descriptor_update_template_entry *templ_entry =
+         &templ->entries[i];
+      templ_entry->base = *entry;
+      templ_entry->ignore_sampler = true;
+      templ_entry->ignore_iview = false;
       switch (entry->descriptorType) {
       case VK_DESCRIPTOR_TYPE_SAMPLER:
+         templ_entry->ignore_iview = true;
+         FALLTHROUGH;
       case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+         templ_entry->ignore_sampler =
+            set_layout->bindings[entry->dstBinding].has_immutable_samplers;
+         FALLTHROUGH;
       case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
       case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
       case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
@@ -956,10 +1000,6 @@ vn_descriptor_set_fill_update_with_template(
    const uint8_t *data,
    struct vn_descriptor_set_update *update)
 {
-   struct vn_descriptor_set *set = vn_descriptor_set_from_handle(set_handle);
-   const struct vn_descriptor_set_layout *set_layout =
-      templ->push.set_layout ? templ->push.set_layout : set->layout;
-
    update->write_count = templ->entry_count;
 
    uint32_t img_info_offset = 0;
@@ -967,22 +1007,17 @@ vn_descriptor_set_fill_update_with_template(
    uint32_t bview_offset = 0;
    uint32_t iub_offset = 0;
    for (uint32_t i = 0; i < templ->entry_count; i++) {
-      const VkDescriptorUpdateTemplateEntry *entry = &templ->entries[i];
+      const struct vn_descriptor_update_template_entry *templ_entry =
+         &templ->entries[i];
+      const VkDescriptorUpdateTemplateEntry *entry = &templ_entry->base;
       const uint8_t *ptr = data + entry->offset;
-      bool ignore_sampler = true;
-      bool ignore_iview = false;
       VkDescriptorImageInfo *img_infos = NULL;
       VkDescriptorBufferInfo *buf_infos = NULL;
       VkBufferView *bview_handles = NULL;
       VkWriteDescriptorSetInlineUniformBlock *iub = NULL;
       switch (entry->descriptorType) {
       case VK_DESCRIPTOR_TYPE_SAMPLER:
-         ignore_iview = true;
-         FALLTHROUGH;
       case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
-         ignore_sampler =
-            set_layout->bindings[entry->dstBinding].has_immutable_samplers;
-         FALLTHROUGH;
       case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
       case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
       case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
@@ -990,8 +1025,10 @@ vn_descriptor_set_fill_update_with_template(
          for (uint32_t j = 0; j < entry->descriptorCount; j++) {
             const VkDescriptorImageInfo *src = (const void *)ptr;
             img_infos[j] = (VkDescriptorImageInfo){
-               .sampler = ignore_sampler ? VK_NULL_HANDLE : src->sampler,
-               .imageView = ignore_iview ? VK_NULL_HANDLE : src->imageView,
+               .sampler =
+                  templ_entry->ignore_sampler ? VK_NULL_HANDLE : src->sampler,
+               .imageView =
+                  templ_entry->ignore_iview ? VK_NULL_HANDLE : src->imageView,
                .imageLayout = src->imageLayout,
             };
             ptr += entry->stride;
@@ -1076,8 +1113,7 @@ vn_UpdateDescriptorSetWithTemplate(
    vn_descriptor_set_fill_update_with_template(templ, descriptorSet, pData,
                                                &update);
 
-   vn_async_vkUpdateDescriptorSets(
-      dev->primary_ring, device, update.write_count, update.writes, 0, NULL);
+   vn_update_descriptor_sets(dev, update.write_count, update.writes, 0, NULL);
 
    STACK_ARRAY_FINISH(writes);
    STACK_ARRAY_FINISH(img_infos);
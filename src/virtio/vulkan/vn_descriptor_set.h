@@ -99,6 +99,14 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(vn_descriptor_set,
                                VkDescriptorSet,
                                VK_OBJECT_TYPE_DESCRIPTOR_SET)
 
+struct vn_descriptor_update_template_entry {
+   VkDescriptorUpdateTemplateEntry base;
+
+   /* resolved against the set layout upon template creation */
+   bool ignore_sampler;
+   bool ignore_iview;
+};
+
 struct vn_descriptor_update_template {
    struct vn_object_base base;
 
@@ -112,7 +120,7 @@ struct vn_descriptor_update_template {
    uint32_t buf_info_count;
    uint32_t bview_count;
    uint32_t iub_count;
-   VkDescriptorUpdateTemplateEntry entries[];
+   struct vn_descriptor_update_template_entry entries[];
 };
 VK_DEFINE_NONDISP_HANDLE_CASTS(vn_descriptor_update_template,
                                base.base,
@@ -432,6 +432,33 @@ vn_device_update_shader_cache_id(struct vn_device *dev)
 #endif
 }
 
+static void
+vn_device_pipeline_index_init(struct vn_device *dev)
+{
+#if !DETECT_OS_ANDROID && defined(ENABLE_SHADER_CACHE)
+   if (!dev->instance->enable_pipeline_index)
+      return;
+
+   const uint8_t *device_uuid =
+      dev->physical_device->base.base.properties.pipelineCacheUUID;
+
+   char uuid[VK_UUID_SIZE * 2 + 1];
+   mesa_bytes_to_hex(uuid, device_uuid, VK_UUID_SIZE);
+
+   /* keyed by pipelineCacheUUID such that the index is dropped whenever the
+    * host driver changes
+    */
+   dev->pipeline_index = disk_cache_create("venus_pipeline_index", uuid, 0);
+#endif
+}
+
+static void
+vn_device_pipeline_index_fini(struct vn_device *dev)
+{
+   if (dev->pipeline_index)
+      disk_cache_destroy(dev->pipeline_index);
+}
+
 static VkResult
 vn_device_init(struct vn_device *dev,
                struct vn_physical_device *physical_dev,
@@ -480,9 +507,14 @@ vn_device_init(struct vn_device *dev,
       goto out_memory_report_fini;
    }
 
+   /* feedback buffers grown at runtime can be sub-allocated from the memory
+    * pools, which must therefore outlive the feedback pools and the queues
+    */
+   vn_device_memory_pools_init(dev);
+
    result = vn_device_feedback_pool_init(dev);
    if (result != VK_SUCCESS)
-      goto out_queue_family_fini;
+      goto out_memory_pools_fini;
 
    result = vn_feedback_cmd_pools_init(dev);
    if (result != VK_SUCCESS)
@@ -500,6 +532,8 @@ vn_device_init(struct vn_device *dev,
     */
    vn_device_update_shader_cache_id(dev);
 
+   vn_device_pipeline_index_init(dev);
+
    return VK_SUCCESS;
 
 out_feedback_cmd_pools_fini:
@@ -508,7 +542,8 @@ out_feedback_cmd_pools_fini:
 out_feedback_pool_fini:
    vn_device_feedback_pool_fini(dev);
 
-out_queue_family_fini:
+out_memory_pools_fini:
+   vn_device_memory_pools_fini(dev);
    vn_device_queue_family_fini(dev);
 
 out_memory_report_fini:
@@ -582,6 +617,8 @@ vn_DestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator)
    if (!dev)
       return;
 
+   vn_device_pipeline_index_fini(dev);
+
    vn_image_reqs_cache_fini(dev);
    vn_buffer_reqs_cache_fini(dev);
 
@@ -592,6 +629,8 @@ vn_DestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator)
 
    vn_device_feedback_pool_fini(dev);
 
+   vn_device_memory_pools_fini(dev);
+
    vn_device_queue_family_fini(dev);
 
    vn_device_memory_report_fini(dev);
@@ -52,6 +52,15 @@ struct vn_device {
 
    struct vn_buffer_reqs_cache buffer_reqs_cache;
    struct vn_image_reqs_cache image_reqs_cache;
+
+   /* per memory type sub-allocators, only used when memory_pool_enabled */
+   bool memory_pool_enabled;
+   struct vn_device_memory_pool memory_pools[VK_MAX_MEMORY_TYPES];
+
+   /* which pipelines persisted pipeline caches hold, opt-in with the
+    * venus_pipeline_index option (see vn_pipeline.c)
+    */
+   struct disk_cache *pipeline_index;
 };
 VK_DEFINE_HANDLE_CASTS(vn_device,
                        base.base.base,
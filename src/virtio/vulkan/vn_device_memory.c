@@ -17,10 +17,13 @@
 #include "vn_buffer.h"
 #include "vn_device.h"
 #include "vn_image.h"
+#include "vn_instance.h"
 #include "vn_physical_device.h"
 #include "vn_renderer.h"
 #include "vn_renderer_util.h"
 
+#include "util/vma.h"
+
 /* device memory commands */
 
 static inline VkResult
@@ -317,6 +320,300 @@ vn_device_memory_alloc(struct vn_device *dev,
    }
 }
 
+static void
+vn_device_memory_free(struct vn_device *dev,
+                      struct vn_device_memory *mem,
+                      const VkAllocationCallbacks *alloc)
+{
+   /* ensure renderer side import still sees the resource */
+   vn_device_memory_bo_fini(dev, mem);
+
+   if (mem->bo_roundtrip_seqno_valid)
+      vn_ring_wait_roundtrip(dev->primary_ring, mem->bo_roundtrip_seqno);
+
+   vn_device_memory_free_simple(dev, mem);
+   vk_device_memory_destroy(&dev->base.base, alloc, &mem->base.base);
+}
+
+/* device memory pools
+ *
+ * Offsets are aligned to VN_MEMORY_POOL_ALIGNMENT because the resources to
+ * be bound are unknown at allocation time.  To keep the waste bounded, only
+ * allocations of at most VN_MEMORY_POOL_MAX_ALLOC_SIZE are pooled, each
+ * wasting less than VN_MEMORY_POOL_ALIGNMENT, and empty blocks are released
+ * except for the last one of a pool.
+ */
+
+#define VN_MEMORY_POOL_BLOCK_SIZE (16ull * 1024 * 1024)
+#define VN_MEMORY_POOL_MAX_ALLOC_SIZE (1ull * 1024 * 1024)
+#define VN_MEMORY_POOL_ALIGNMENT (64ull * 1024)
+
+/* util_vma_heap_alloc returns 0 on failures */
+#define VN_MEMORY_POOL_HEAP_START VN_MEMORY_POOL_ALIGNMENT
+
+struct vn_device_memory_pool_block {
+   struct list_head head;
+
+   struct vn_device_memory *memory;
+   struct util_vma_heap heap;
+   uint32_t alloc_count;
+};
+
+static struct vn_device_memory_pool_block *
+vn_device_memory_pool_block_create(struct vn_device *dev,
+                                   uint32_t mem_type_index)
+{
+   const VkAllocationCallbacks *alloc = &dev->base.base.alloc;
+   struct vn_device_memory_pool_block *block =
+      vk_zalloc(alloc, sizeof(*block), VN_DEFAULT_ALIGN,
+                VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+   if (!block)
+      return NULL;
+
+   const VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = VN_MEMORY_POOL_BLOCK_SIZE,
+      .memoryTypeIndex = mem_type_index,
+   };
+   struct vn_device_memory *mem = vk_device_memory_create(
+      &dev->base.base, &alloc_info, NULL, sizeof(*mem));
+   if (!mem) {
+      vk_free(alloc, block);
+      return NULL;
+   }
+
+   vn_object_set_id(mem, vn_get_next_obj_id(), VK_OBJECT_TYPE_DEVICE_MEMORY);
+
+   if (vn_device_memory_alloc(dev, mem, &alloc_info) != VK_SUCCESS) {
+      vk_device_memory_destroy(&dev->base.base, NULL, &mem->base.base);
+      vk_free(alloc, block);
+      return NULL;
+   }
+
+   block->memory = mem;
+   util_vma_heap_init(&block->heap, VN_MEMORY_POOL_HEAP_START,
+                      VN_MEMORY_POOL_BLOCK_SIZE);
+   block->heap.alloc_high = false;
+
+   return block;
+}
+
+static void
+vn_device_memory_pool_block_destroy(struct vn_device *dev,
+                                    struct vn_device_memory_pool_block *block)
+{
+   assert(!block->alloc_count);
+
+   util_vma_heap_finish(&block->heap);
+   vn_device_memory_free(dev, block->memory, NULL);
+   vk_free(&dev->base.base.alloc, block);
+}
+
+static bool
+vn_device_memory_should_pool(struct vn_device *dev,
+                             const VkMemoryAllocateInfo *alloc_info)
+{
+   if (!dev->memory_pool_enabled)
+      return false;
+
+   /* anything chained (dedicated, export, device mask, priority, etc.)
+    * requires a memory of its own
+    */
+   if (alloc_info->pNext ||
+       alloc_info->allocationSize > VN_MEMORY_POOL_MAX_ALLOC_SIZE)
+      return false;
+
+   const struct vn_device_memory_pool *pool =
+      &dev->memory_pools[alloc_info->memoryTypeIndex];
+   if (p_atomic_read(&pool->disabled))
+      return false;
+
+   const VkMemoryType *mem_type =
+      &dev->physical_device->memory_properties
+          .memoryTypes[alloc_info->memoryTypeIndex];
+   return (mem_type->propertyFlags &
+           (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT |
+            VK_MEMORY_PROPERTY_PROTECTED_BIT)) ==
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+static VkResult
+vn_device_memory_pool_alloc(struct vn_device *dev,
+                            struct vn_device_memory *mem)
+{
+   const struct vk_device_memory *mem_vk = &mem->base.base;
+   struct vn_device_memory_pool *pool =
+      &dev->memory_pools[mem_vk->memory_type_index];
+   const VkDeviceSize size = align64(mem_vk->size, VN_MEMORY_POOL_ALIGNMENT);
+
+   simple_mtx_lock(&pool->mutex);
+
+   struct vn_device_memory_pool_block *block = NULL;
+   uint64_t addr = 0;
+   list_for_each_entry(struct vn_device_memory_pool_block, iter,
+                       &pool->blocks, head) {
+      addr = util_vma_heap_alloc(&iter->heap, size, VN_MEMORY_POOL_ALIGNMENT);
+      if (addr) {
+         block = iter;
+         break;
+      }
+   }
+
+   if (!block) {
+      block = vn_device_memory_pool_block_create(dev,
+                                                 mem_vk->memory_type_index);
+      if (!block) {
+         simple_mtx_unlock(&pool->mutex);
+         return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+      }
+
+      list_add(&block->head, &pool->blocks);
+      pool->stats.block_count++;
+      pool->stats.max_block_count =
+         MAX2(pool->stats.max_block_count, pool->stats.block_count);
+
+      addr = util_vma_heap_alloc(&block->heap, size, VN_MEMORY_POOL_ALIGNMENT);
+      assert(addr);
+   }
+
+   block->alloc_count++;
+
+   pool->stats.alloc_count++;
+   pool->stats.max_alloc_count =
+      MAX2(pool->stats.max_alloc_count, pool->stats.alloc_count);
+   pool->stats.used_size += mem_vk->size;
+   pool->stats.occupied_size += size;
+   pool->stats.max_occupied_size =
+      MAX2(pool->stats.max_occupied_size, pool->stats.occupied_size);
+
+   simple_mtx_unlock(&pool->mutex);
+
+   mem->pool_block = block;
+   mem->pool_memory = block->memory;
+   mem->pool_offset = addr - VN_MEMORY_POOL_HEAP_START;
+
+   return VK_SUCCESS;
+}
+
+static void
+vn_device_memory_pool_free(struct vn_device *dev,
+                           struct vn_device_memory *mem)
+{
+   const struct vk_device_memory *mem_vk = &mem->base.base;
+   struct vn_device_memory_pool *pool =
+      &dev->memory_pools[mem_vk->memory_type_index];
+   struct vn_device_memory_pool_block *block = mem->pool_block;
+   const VkDeviceSize size = align64(mem_vk->size, VN_MEMORY_POOL_ALIGNMENT);
+
+   simple_mtx_lock(&pool->mutex);
+
+   util_vma_heap_free(&block->heap,
+                      mem->pool_offset + VN_MEMORY_POOL_HEAP_START, size);
+   block->alloc_count--;
+
+   pool->stats.alloc_count--;
+   pool->stats.used_size -= mem_vk->size;
+   pool->stats.occupied_size -= size;
+
+   /* keep the last block around to avoid thrashing */
+   if (!block->alloc_count && pool->stats.block_count > 1) {
+      list_del(&block->head);
+      pool->stats.block_count--;
+      vn_device_memory_pool_block_destroy(dev, block);
+   }
+
+   simple_mtx_unlock(&pool->mutex);
+}
+
+static void
+vn_device_memory_pool_debug_dump(struct vn_device *dev,
+                                 uint32_t mem_type_index)
+{
+   struct vn_device_memory_pool *pool = &dev->memory_pools[mem_type_index];
+   if (!pool->stats.max_block_count)
+      return;
+
+   VkDeviceSize free_size = 0;
+   VkDeviceSize max_hole_size = 0;
+   list_for_each_entry(struct vn_device_memory_pool_block, block,
+                       &pool->blocks, head) {
+      free_size += block->heap.free_size;
+      max_hole_size =
+         MAX2(max_hole_size,
+              util_vma_heap_get_max_free_continuous_size(&block->heap));
+   }
+
+   vn_log(dev->instance, "dumping memory type %u pool statistics",
+          mem_type_index);
+   vn_log(dev->instance, "  blocks: %u (max %u)", pool->stats.block_count,
+          pool->stats.max_block_count);
+   vn_log(dev->instance, "  allocations: %u (max %u)",
+          pool->stats.alloc_count, pool->stats.max_alloc_count);
+   vn_log(dev->instance,
+          "  occupied: %" PRIu64 " (max %" PRIu64 "), padding %" PRIu64,
+          pool->stats.occupied_size, pool->stats.max_occupied_size,
+          pool->stats.occupied_size - pool->stats.used_size);
+   vn_log(dev->instance,
+          "  free: %" PRIu64 ", largest hole %" PRIu64 ", fragmentation %u%%",
+          free_size, max_hole_size,
+          free_size ? (unsigned)(100 - max_hole_size * 100 / free_size) : 0);
+}
+
+void
+vn_device_memory_pools_init(struct vn_device *dev)
+{
+   /* sparse binds are not translated */
+   dev->memory_pool_enabled = dev->instance->enable_memory_pool &&
+                              !dev->base.base.enabled_features.sparseBinding;
+   if (!dev->memory_pool_enabled)
+      return;
+
+   for (uint32_t i = 0; i < ARRAY_SIZE(dev->memory_pools); i++) {
+      struct vn_device_memory_pool *pool = &dev->memory_pools[i];
+      simple_mtx_init(&pool->mutex, mtx_plain);
+      list_inithead(&pool->blocks);
+   }
+}
+
+void
+vn_device_memory_pools_fini(struct vn_device *dev)
+{
+   if (!dev->memory_pool_enabled)
+      return;
+
+   for (uint32_t i = 0; i < ARRAY_SIZE(dev->memory_pools); i++) {
+      struct vn_device_memory_pool *pool = &dev->memory_pools[i];
+
+      if (VN_DEBUG(MEM_POOL))
+         vn_device_memory_pool_debug_dump(dev, i);
+
+      /* leaked allocations keep their blocks alive until here */
+      list_for_each_entry_safe(struct vn_device_memory_pool_block, block,
+                               &pool->blocks, head) {
+         block->alloc_count = 0;
+         vn_device_memory_pool_block_destroy(dev, block);
+      }
+      simple_mtx_destroy(&pool->mutex);
+   }
+}
+
+/* Called with the requirements of every resource queried from the renderer.
+ * Apps query them before allocating the memory to bind, so a memory type is
+ * no longer pooled before it could be sub-allocated for such a resource.
+ */
+void
+vn_device_memory_pools_check_requirements(struct vn_device *dev,
+                                          const VkMemoryRequirements *reqs)
+{
+   if (!dev->memory_pool_enabled ||
+       reqs->alignment <= VN_MEMORY_POOL_ALIGNMENT)
+      return;
+
+   u_foreach_bit(i, reqs->memoryTypeBits)
+      p_atomic_set(&dev->memory_pools[i].disabled, true);
+}
+
 static void
 vn_device_memory_emit_report(struct vn_device *dev,
                              struct vn_device_memory *mem,
@@ -386,6 +683,8 @@ vn_AllocateMemory(VkDevice device,
    } else if (import_fd_info) {
       result = vn_device_memory_import_dma_buf(dev, mem, pAllocateInfo, false,
                                                import_fd_info->fd);
+   } else if (vn_device_memory_should_pool(dev, pAllocateInfo)) {
+      result = vn_device_memory_pool_alloc(dev, mem);
    } else {
       result = vn_device_memory_alloc(dev, mem, pAllocateInfo);
    }
@@ -414,14 +713,13 @@ vn_FreeMemory(VkDevice device,
 
    vn_device_memory_emit_report(dev, mem, /* is_alloc */ false, VK_SUCCESS);
 
-   /* ensure renderer side import still sees the resource */
-   vn_device_memory_bo_fini(dev, mem);
-
-   if (mem->bo_roundtrip_seqno_valid)
-      vn_ring_wait_roundtrip(dev->primary_ring, mem->bo_roundtrip_seqno);
+   if (mem->pool_block) {
+      vn_device_memory_pool_free(dev, mem);
+      vk_device_memory_destroy(&dev->base.base, pAllocator, &mem->base.base);
+      return;
+   }
 
-   vn_device_memory_free_simple(dev, mem);
-   vk_device_memory_destroy(&dev->base.base, pAllocator, &mem->base.base);
+   vn_device_memory_free(dev, mem, pAllocator);
 }
 
 uint64_t
@@ -433,20 +731,12 @@ vn_GetDeviceMemoryOpaqueCaptureAddress(
                                                         device, pInfo);
 }
 
-VkResult
-vn_MapMemory(VkDevice device,
-             VkDeviceMemory memory,
-             VkDeviceSize offset,
-             VkDeviceSize size,
-             VkMemoryMapFlags flags,
-             void **ppData)
+static VkResult
+vn_device_memory_map(struct vn_device *dev,
+                     struct vn_device_memory *mem,
+                     void **out_ptr)
 {
-   VN_TRACE_FUNC();
-   struct vn_device *dev = vn_device_from_handle(device);
-   struct vn_device_memory *mem = vn_device_memory_from_handle(memory);
-   const struct vk_device_memory *mem_vk = &mem->base.base;
    const bool need_bo = !mem->base_bo;
-   void *ptr = NULL;
    VkResult result;
 
    /* We don't want to blindly create a bo for each HOST_VISIBLE memory as
@@ -464,27 +754,58 @@ vn_MapMemory(VkDevice device,
    if (need_bo) {
       result = vn_device_memory_bo_init(dev, mem);
       if (result != VK_SUCCESS)
-         return vn_error(dev->instance, result);
+         return result;
    }
 
-   ptr = vn_renderer_bo_map(dev->renderer, mem->base_bo);
-   if (!ptr) {
+   *out_ptr = vn_renderer_bo_map(dev->renderer, mem->base_bo);
+   if (!*out_ptr) {
       /* vn_renderer_bo_map implies a roundtrip on success, but not here. */
       if (need_bo) {
          result = vn_ring_submit_roundtrip(dev->primary_ring,
                                            &mem->bo_roundtrip_seqno);
          if (result != VK_SUCCESS)
-            return vn_error(dev->instance, result);
+            return result;
 
          mem->bo_roundtrip_seqno_valid = true;
       }
 
-      return vn_error(dev->instance, VK_ERROR_MEMORY_MAP_FAILED);
+      return VK_ERROR_MEMORY_MAP_FAILED;
+   }
+
+   return VK_SUCCESS;
+}
+
+VkResult
+vn_MapMemory(VkDevice device,
+             VkDeviceMemory memory,
+             VkDeviceSize offset,
+             VkDeviceSize size,
+             VkMemoryMapFlags flags,
+             void **ppData)
+{
+   VN_TRACE_FUNC();
+   struct vn_device *dev = vn_device_from_handle(device);
+   struct vn_device_memory *mem = vn_device_memory_from_handle(memory);
+   const struct vk_device_memory *mem_vk = &mem->base.base;
+   void *ptr = NULL;
+   VkResult result;
+
+   if (mem->pool_memory) {
+      /* the pool memory is shared and mapped once */
+      struct vn_device_memory_pool *pool =
+         &dev->memory_pools[mem_vk->memory_type_index];
+      simple_mtx_lock(&pool->mutex);
+      result = vn_device_memory_map(dev, mem->pool_memory, &ptr);
+      simple_mtx_unlock(&pool->mutex);
+   } else {
+      result = vn_device_memory_map(dev, mem, &ptr);
    }
+   if (result != VK_SUCCESS)
+      return vn_error(dev->instance, result);
 
    mem->map_end = size == VK_WHOLE_SIZE ? mem_vk->size : offset + size;
 
-   *ppData = ptr + offset;
+   *ppData = ptr + mem->pool_offset + offset;
 
    return VK_SUCCESS;
 }
@@ -506,10 +827,14 @@ vn_FlushMappedMemoryRanges(VkDevice device,
       struct vn_device_memory *mem =
          vn_device_memory_from_handle(range->memory);
 
+      const struct vn_device_memory *bo_mem =
+         mem->pool_memory ? mem->pool_memory : mem;
+
       const VkDeviceSize size = range->size == VK_WHOLE_SIZE
                                    ? mem->map_end - range->offset
                                    : range->size;
-      vn_renderer_bo_flush(dev->renderer, mem->base_bo, range->offset, size);
+      vn_renderer_bo_flush(dev->renderer, bo_mem->base_bo,
+                           mem->pool_offset + range->offset, size);
    }
 
    return VK_SUCCESS;
@@ -527,11 +852,14 @@ vn_InvalidateMappedMemoryRanges(VkDevice device,
       struct vn_device_memory *mem =
          vn_device_memory_from_handle(range->memory);
 
+      const struct vn_device_memory *bo_mem =
+         mem->pool_memory ? mem->pool_memory : mem;
+
       const VkDeviceSize size = range->size == VK_WHOLE_SIZE
                                    ? mem->map_end - range->offset
                                    : range->size;
-      vn_renderer_bo_invalidate(dev->renderer, mem->base_bo, range->offset,
-                                size);
+      vn_renderer_bo_invalidate(dev->renderer, bo_mem->base_bo,
+                                mem->pool_offset + range->offset, size);
    }
 
    return VK_SUCCESS;
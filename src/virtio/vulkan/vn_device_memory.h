@@ -13,6 +13,35 @@
 
 #include "vn_common.h"
 
+struct vn_device_memory_pool_block;
+
+/* Small host-visible allocations of a memory type are sub-allocated from
+ * large pooled allocations, the blocks, when the venus_memory_pool option is
+ * set.
+ */
+struct vn_device_memory_pool {
+   /* protect blocks and stats */
+   simple_mtx_t mutex;
+   struct list_head blocks;
+
+   /* set once a resource that can be bound to this memory type requires a
+    * stricter alignment than the pooled offsets provide
+    */
+   bool disabled;
+
+   struct {
+      uint32_t block_count;
+      uint32_t max_block_count;
+      uint32_t alloc_count;
+      uint32_t max_alloc_count;
+      /* sum of the requested sizes of the live allocations */
+      VkDeviceSize used_size;
+      /* sum of the aligned sizes of the live allocations */
+      VkDeviceSize occupied_size;
+      VkDeviceSize max_occupied_size;
+   } stats;
+};
+
 struct vn_device_memory {
    struct vn_device_memory_base base;
 
@@ -48,12 +77,45 @@ struct vn_device_memory {
    uint64_t bo_roundtrip_seqno;
 
    VkDeviceSize map_end;
+
+   /* non-NULL when sub-allocated from a memory pool, in which case the
+    * renderer only knows about pool_memory and this memory lives at
+    * pool_offset inside of it
+    */
+   struct vn_device_memory_pool_block *pool_block;
+   struct vn_device_memory *pool_memory;
+   VkDeviceSize pool_offset;
 };
 VK_DEFINE_NONDISP_HANDLE_CASTS(vn_device_memory,
                                base.base.base,
                                VkDeviceMemory,
                                VK_OBJECT_TYPE_DEVICE_MEMORY)
 
+/* Replace a sub-allocated memory by the memory backing it, adjusting offset
+ * accordingly.  This must be done for every memory handle sent to the
+ * renderer with an offset.
+ */
+static inline void
+vn_device_memory_resolve(VkDeviceMemory *mem_handle, VkDeviceSize *offset)
+{
+   const struct vn_device_memory *mem =
+      vn_device_memory_from_handle(*mem_handle);
+   if (mem && mem->pool_memory) {
+      *mem_handle = vn_device_memory_to_handle(mem->pool_memory);
+      *offset += mem->pool_offset;
+   }
+}
+
+void
+vn_device_memory_pools_init(struct vn_device *dev);
+
+void
+vn_device_memory_pools_fini(struct vn_device *dev);
+
+void
+vn_device_memory_pools_check_requirements(struct vn_device *dev,
+                                          const VkMemoryRequirements *reqs);
+
 VkResult
 vn_device_memory_import_dma_buf(struct vn_device *dev,
                                 struct vn_device_memory *mem,
@@ -370,6 +370,11 @@ vn_image_init_memory_requirements(struct vn_image *img,
             &img->requirements[i].memory);
       }
    }
+
+   for (uint32_t i = 0; i < plane_count; i++) {
+      vn_device_memory_pools_check_requirements(
+         dev, &img->requirements[i].memory.memoryRequirements);
+   }
 }
 
 static VkResult
@@ -814,6 +819,8 @@ vn_image_bind_wsi_memory(struct vn_device *dev,
       assert(!img->wsi.memory);
       img->wsi.memory = mem;
 #endif
+
+      vn_device_memory_resolve(&info->memory, &info->memoryOffset);
    }
 
    vn_async_vkBindImageMemory2(dev->primary_ring, vn_device_to_handle(dev),
@@ -837,8 +844,24 @@ vn_BindImageMemory2(VkDevice device,
          return vn_image_bind_wsi_memory(dev, bindInfoCount, pBindInfos);
    }
 
+   if (!dev->memory_pool_enabled) {
+      vn_async_vkBindImageMemory2(dev->primary_ring, device, bindInfoCount,
+                                  pBindInfos);
+      return VK_SUCCESS;
+   }
+
+   STACK_ARRAY(VkBindImageMemoryInfo, local_infos, bindInfoCount);
+   typed_memcpy(local_infos, pBindInfos, bindInfoCount);
+   for (uint32_t i = 0; i < bindInfoCount; i++) {
+      vn_device_memory_resolve(&local_infos[i].memory,
+                               &local_infos[i].memoryOffset);
+   }
+
    vn_async_vkBindImageMemory2(dev->primary_ring, device, bindInfoCount,
-                               pBindInfos);
+                               local_infos);
+
+   STACK_ARRAY_FINISH(local_infos);
+
    return VK_SUCCESS;
 }
 
@@ -1125,6 +1148,8 @@ vn_GetDeviceImageMemoryRequirements(
 
          vn_call_vkGetDeviceImageMemoryRequirements(
             dev->primary_ring, device, &req_info[i], &reqs[i].memory);
+         vn_device_memory_pools_check_requirements(
+            dev, &reqs[i].memory.memoryRequirements);
       }
       vn_image_fill_reqs(&reqs[plane], pMemoryRequirements);
       vn_image_store_reqs_in_cache(dev, key, plane_count, reqs);
@@ -1134,6 +1159,8 @@ vn_GetDeviceImageMemoryRequirements(
    } else {
       vn_call_vkGetDeviceImageMemoryRequirements(dev->primary_ring, device,
                                                  pInfo, pMemoryRequirements);
+      vn_device_memory_pools_check_requirements(
+         dev, &pMemoryRequirements->memoryRequirements);
    }
 }
 
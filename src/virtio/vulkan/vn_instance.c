@@ -62,6 +62,8 @@ static const driOptionDescription vn_dri_options[] = {
       DRI_CONF_VK_XWAYLAND_WAIT_READY(true)
       DRI_CONF_VENUS_IMPLICIT_FENCING(false)
       DRI_CONF_VENUS_WSI_MULTI_PLANE_MODIFIERS(false)
+      DRI_CONF_VENUS_MEMORY_POOL(false)
+      DRI_CONF_VENUS_PIPELINE_INDEX(false)
    DRI_CONF_SECTION_END
    DRI_CONF_SECTION_DEBUG
       DRI_CONF_VK_WSI_FORCE_BGRA8_UNORM_FIRST(false)
@@ -115,6 +117,9 @@ vn_instance_init_renderer_versions(struct vn_instance *instance)
 static inline void
 vn_instance_fini_ring(struct vn_instance *instance)
 {
+   if (VN_DEBUG(WAIT_STATS))
+      vn_relax_log_stats(instance);
+
    vn_watchdog_fini(&instance->ring.watchdog);
 
    list_for_each_entry_safe(struct vn_tls_ring, tls_ring,
@@ -122,6 +127,9 @@ vn_instance_fini_ring(struct vn_instance *instance)
       vn_tls_destroy_ring(tls_ring);
 
    vn_ring_destroy(instance->ring.ring);
+
+   if (VN_DEBUG(CS_STATS))
+      vn_cs_stats_dump();
 }
 
 static VkResult
@@ -352,10 +360,18 @@ vn_CreateInstance(const VkInstanceCreateInfo *pCreateInfo,
       driQueryOptionb(&instance->dri_options, "venus_implicit_fencing");
    instance->enable_wsi_multi_plane_modifiers = driQueryOptionb(
       &instance->dri_options, "venus_wsi_multi_plane_modifiers");
+   instance->enable_memory_pool =
+      driQueryOptionb(&instance->dri_options, "venus_memory_pool");
+   instance->enable_pipeline_index =
+      driQueryOptionb(&instance->dri_options, "venus_pipeline_index");
 
    if (VN_DEBUG(INIT)) {
       vn_log(instance, "supports multi-plane wsi format modifiers: %s",
              instance->enable_wsi_multi_plane_modifiers ? "yes" : "no");
+      vn_log(instance, "sub-allocates small memory allocations: %s",
+             instance->enable_memory_pool ? "yes" : "no");
+      vn_log(instance, "indexes persisted pipeline caches: %s",
+             instance->enable_pipeline_index ? "yes" : "no");
    }
 
    const char *engine_name = instance->base.base.app_info.engine_name;
@@ -32,6 +32,8 @@ struct vn_instance {
    struct driOptionCache dri_options;
    struct driOptionCache available_dri_options;
    bool enable_wsi_multi_plane_modifiers;
+   bool enable_memory_pool;
+   bool enable_pipeline_index;
 
    struct vn_renderer *renderer;
 
@@ -48,6 +50,7 @@ struct vn_instance {
       struct list_head tls_rings;
 
       struct vn_watchdog watchdog;
+      struct vn_relax_stats relax_stats[VN_RELAX_REASON_COUNT];
    } ring;
 
    /* Between the driver and the app, VN_MAX_API_VERSION is what we advertise
@@ -10,6 +10,7 @@
 
 #include "vn_pipeline.h"
 
+#include "util/disk_cache.h"
 #include "venus-protocol/vn_protocol_driver_pipeline.h"
 #include "venus-protocol/vn_protocol_driver_pipeline_cache.h"
 #include "venus-protocol/vn_protocol_driver_pipeline_layout.h"
@@ -251,9 +252,15 @@ vn_CreateShaderModule(VkDevice device,
 
    vn_object_base_init(&mod->base, VK_OBJECT_TYPE_SHADER_MODULE, &dev->base);
 
+   if (dev->pipeline_index)
+      _mesa_sha1_compute(pCreateInfo->pCode, pCreateInfo->codeSize, mod->sha1);
+
    VkShaderModule mod_handle = vn_shader_module_to_handle(mod);
-   vn_async_vkCreateShaderModule(dev->primary_ring, device, pCreateInfo, NULL,
-                                 &mod_handle);
+   struct vn_ring_submit_command submit;
+   vn_ring_dep_init(&mod->ring_dep, dev->primary_ring);
+   vn_submit_vkCreateShaderModule(dev->primary_ring, 0, device, pCreateInfo,
+                                  NULL, &mod_handle, &submit);
+   vn_ring_dep_add(&mod->ring_dep, &submit);
 
    *pShaderModule = mod_handle;
 
@@ -315,6 +322,38 @@ vn_pipeline_layout_unref(struct vn_device *dev,
       vn_pipeline_layout_destroy(dev, pipeline_layout);
 }
 
+static void
+vn_pipeline_layout_hash(struct vn_pipeline_layout *layout,
+                        const VkPipelineLayoutCreateInfo *create_info)
+{
+   struct mesa_sha1 sha1_ctx;
+   _mesa_sha1_init(&sha1_ctx);
+
+   for (uint32_t i = 0; i < create_info->setLayoutCount; i++) {
+      const struct vn_descriptor_set_layout *set_layout =
+         vn_descriptor_set_layout_from_handle(create_info->pSetLayouts[i]);
+      const uint32_t binding_count =
+         set_layout ? set_layout->last_binding + 1 : 0;
+
+      _mesa_sha1_update(&sha1_ctx, &binding_count, sizeof(binding_count));
+      for (uint32_t j = 0; j < binding_count; j++) {
+         const struct vn_descriptor_set_layout_binding *binding =
+            &set_layout->bindings[j];
+         _mesa_sha1_update(&sha1_ctx, &binding->type, sizeof(binding->type));
+         _mesa_sha1_update(&sha1_ctx, &binding->count,
+                           sizeof(binding->count));
+         _mesa_sha1_update(&sha1_ctx, &binding->has_immutable_samplers,
+                           sizeof(binding->has_immutable_samplers));
+      }
+   }
+
+   _mesa_sha1_update(&sha1_ctx, create_info->pPushConstantRanges,
+                     sizeof(*create_info->pPushConstantRanges) *
+                        create_info->pushConstantRangeCount);
+
+   _mesa_sha1_final(&sha1_ctx, layout->sha1);
+}
+
 VkResult
 vn_CreatePipelineLayout(VkDevice device,
                         const VkPipelineLayoutCreateInfo *pCreateInfo,
@@ -358,9 +397,18 @@ vn_CreatePipelineLayout(VkDevice device,
 
    layout->has_push_constant_ranges = pCreateInfo->pushConstantRangeCount > 0;
 
+   if (dev->pipeline_index)
+      vn_pipeline_layout_hash(layout, pCreateInfo);
+
+   /* This also covers the set layouts, which are created on the primary
+    * ring as well and hence before the pipeline layout.
+    */
    VkPipelineLayout layout_handle = vn_pipeline_layout_to_handle(layout);
-   vn_async_vkCreatePipelineLayout(dev->primary_ring, device, pCreateInfo,
-                                   NULL, &layout_handle);
+   struct vn_ring_submit_command submit;
+   vn_ring_dep_init(&layout->ring_dep, dev->primary_ring);
+   vn_submit_vkCreatePipelineLayout(dev->primary_ring, 0, device, pCreateInfo,
+                                    NULL, &layout_handle, &submit);
+   vn_ring_dep_add(&layout->ring_dep, &submit);
 
    *pPipelineLayout = layout_handle;
 
@@ -414,9 +462,24 @@ vn_CreatePipelineCache(VkDevice device,
       pCreateInfo = &local_create_info;
    }
 
+   if (dev->pipeline_index) {
+      if (pCreateInfo->initialDataSize) {
+         _mesa_sha1_compute(pCreateInfo->pInitialData,
+                            pCreateInfo->initialDataSize,
+                            cache->index.data_sha1);
+         cache->index.has_data = true;
+      }
+      simple_mtx_init(&cache->index.mutex, mtx_plain);
+      cache->index.pipeline_hashes = _mesa_set_create(
+         NULL, vn_cache_key_hash_function, vn_cache_key_equal_function);
+   }
+
    VkPipelineCache cache_handle = vn_pipeline_cache_to_handle(cache);
-   vn_async_vkCreatePipelineCache(dev->primary_ring, device, pCreateInfo,
-                                  NULL, &cache_handle);
+   struct vn_ring_submit_command submit;
+   vn_ring_dep_init(&cache->ring_dep, dev->primary_ring);
+   vn_submit_vkCreatePipelineCache(dev->primary_ring, 0, device, pCreateInfo,
+                                   NULL, &cache_handle, &submit);
+   vn_ring_dep_add(&cache->ring_dep, &submit);
 
    *pPipelineCache = cache_handle;
 
@@ -440,6 +503,12 @@ vn_DestroyPipelineCache(VkDevice device,
    vn_async_vkDestroyPipelineCache(dev->primary_ring, device, pipelineCache,
                                    NULL);
 
+   if (dev->pipeline_index) {
+      simple_mtx_destroy(&cache->index.mutex);
+      /* the hashes are ralloc'ed off the set */
+      _mesa_set_destroy(cache->index.pipeline_hashes, NULL);
+   }
+
    vn_object_base_fini(&cache->base);
    vk_free(alloc, cache);
 }
@@ -454,21 +523,117 @@ vn_get_target_ring(struct vn_device *dev)
    if (!ring)
       return NULL;
 
-   if (ring != dev->primary_ring) {
-      /* Ensure pipeline create and pipeline cache retrieval dependencies are
-       * ready on the renderer side.
-       *
-       * TODO:
-       * - For pipeline create, track ring seqnos of layout and renderpass
-       *   objects it depends on, and only wait for those seqnos once.
-       * - For pipeline cache retrieval, track ring seqno of pipeline cache
-       *   object it depends on. Treat different sync mode separately.
-       */
-      vn_ring_wait_all(dev->primary_ring);
-   }
+   /* Objects are created asynchronously on the primary ring.  Callers must
+    * wait for the ring deps of the objects they use when a different ring
+    * is returned.
+    */
    return ring;
 }
 
+static void
+vn_pipelines_add_dep(VkPipelineCache cache_handle,
+                     uint32_t pipeline_count,
+                     const VkPipeline *pipeline_handles,
+                     const struct vn_ring_submit_command *submit)
+{
+   struct vn_pipeline_cache *cache =
+      vn_pipeline_cache_from_handle(cache_handle);
+   if (cache)
+      vn_ring_dep_add(&cache->ring_dep, submit);
+
+   for (uint32_t i = 0; i < pipeline_count; i++) {
+      struct vn_pipeline *pipeline =
+         vn_pipeline_from_handle(pipeline_handles[i]);
+      vn_ring_dep_add(&pipeline->ring_dep, submit);
+   }
+}
+
+static void
+vn_pipeline_cache_wait_dep(VkPipelineCache cache_handle,
+                           const struct vn_ring *ring)
+{
+   struct vn_pipeline_cache *cache =
+      vn_pipeline_cache_from_handle(cache_handle);
+   if (cache)
+      vn_ring_dep_wait(&cache->ring_dep, ring);
+}
+
+static void
+vn_pipeline_layout_wait_dep(VkPipelineLayout layout_handle,
+                            const struct vn_ring *ring)
+{
+   struct vn_pipeline_layout *layout =
+      vn_pipeline_layout_from_handle(layout_handle);
+   if (layout)
+      vn_ring_dep_wait(&layout->ring_dep, ring);
+}
+
+static void
+vn_pipeline_wait_dep(VkPipeline pipeline_handle, const struct vn_ring *ring)
+{
+   struct vn_pipeline *pipeline = vn_pipeline_from_handle(pipeline_handle);
+   if (pipeline)
+      vn_ring_dep_wait(&pipeline->ring_dep, ring);
+}
+
+static void
+vn_shader_stage_wait_dep(const VkPipelineShaderStageCreateInfo *stage,
+                         const struct vn_ring *ring)
+{
+   /* module can be VK_NULL_HANDLE with VkShaderModuleCreateInfo chained */
+   struct vn_shader_module *mod = vn_shader_module_from_handle(stage->module);
+   if (mod)
+      vn_ring_dep_wait(&mod->ring_dep, ring);
+}
+
+static void
+vn_pipeline_libraries_wait_dep(const void *pnext, const struct vn_ring *ring)
+{
+   const VkPipelineLibraryCreateInfoKHR *library_info =
+      vk_find_struct_const(pnext, PIPELINE_LIBRARY_CREATE_INFO_KHR);
+   if (!library_info)
+      return;
+
+   for (uint32_t i = 0; i < library_info->libraryCount; i++)
+      vn_pipeline_wait_dep(library_info->pLibraries[i], ring);
+}
+
+/* see the pipeline index below */
+static void
+vn_pipeline_index_key(struct vn_device *dev,
+                      const uint8_t *data_sha1,
+                      const uint8_t *pipeline_hash,
+                      cache_key key)
+{
+   uint8_t sha1[SHA1_DIGEST_LENGTH * 2];
+   memcpy(sha1, data_sha1, SHA1_DIGEST_LENGTH);
+   memcpy(sha1 + SHA1_DIGEST_LENGTH, pipeline_hash, SHA1_DIGEST_LENGTH);
+
+   /* mix in the driver identity as disk_cache_put_key does not */
+   disk_cache_compute_key(dev->pipeline_index, sha1, sizeof(sha1), key);
+}
+
+static void
+vn_pipeline_cache_index_commit(struct vn_device *dev,
+                               struct vn_pipeline_cache *cache,
+                               const void *data,
+                               size_t data_size)
+{
+   if (!cache->index.pipeline_hashes)
+      return;
+
+   uint8_t data_sha1[SHA1_DIGEST_LENGTH];
+   _mesa_sha1_compute(data, data_size, data_sha1);
+
+   simple_mtx_lock(&cache->index.mutex);
+   set_foreach(cache->index.pipeline_hashes, entry) {
+      cache_key key;
+      vn_pipeline_index_key(dev, data_sha1, entry->key, key);
+      disk_cache_put_key(dev->pipeline_index, key);
+   }
+   simple_mtx_unlock(&cache->index.mutex);
+}
+
 VkResult
 vn_GetPipelineCacheData(VkDevice device,
                         VkPipelineCache pipelineCache,
@@ -478,6 +643,10 @@ vn_GetPipelineCacheData(VkDevice device,
    struct vn_device *dev = vn_device_from_handle(device);
    struct vn_physical_device *physical_dev = dev->physical_device;
    struct vn_ring *target_ring = vn_get_target_ring(dev);
+   if (!target_ring)
+      return vn_error(dev->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+   vn_pipeline_cache_wait_dep(pipelineCache, target_ring);
 
    struct vk_pipeline_cache_header *header = pData;
    VkResult result;
@@ -510,6 +679,15 @@ vn_GetPipelineCacheData(VkDevice device,
    if (result < VK_SUCCESS)
       return vn_error(dev->instance, result);
 
+   /* the app is persisting the cache, which is when the index learns what
+    * the data holds
+    */
+   if (dev->pipeline_index && result == VK_SUCCESS) {
+      vn_pipeline_cache_index_commit(
+         dev, vn_pipeline_cache_from_handle(pipelineCache),
+         pData + header->header_size, *pDataSize);
+   }
+
    *pDataSize += header->header_size;
 
    return result;
@@ -522,9 +700,12 @@ vn_MergePipelineCaches(VkDevice device,
                        const VkPipelineCache *pSrcCaches)
 {
    struct vn_device *dev = vn_device_from_handle(device);
+   struct vn_pipeline_cache *dst = vn_pipeline_cache_from_handle(dstCache);
 
-   vn_async_vkMergePipelineCaches(dev->primary_ring, device, dstCache,
-                                  srcCacheCount, pSrcCaches);
+   struct vn_ring_submit_command submit;
+   vn_submit_vkMergePipelineCaches(dev->primary_ring, 0, device, dstCache,
+                                   srcCacheCount, pSrcCaches, &submit);
+   vn_ring_dep_add(&dst->ring_dep, &submit);
 
    return VK_SUCCESS;
 }
@@ -577,6 +758,7 @@ vn_create_pipeline_handles(struct vn_device *dev,
       vn_object_base_init(&pipeline->base, VK_OBJECT_TYPE_PIPELINE,
                           &dev->base);
       pipeline->type = type;
+      vn_ring_dep_init(&pipeline->ring_dep, dev->primary_ring);
       pipeline_handles[i] = vn_pipeline_to_handle(pipeline);
    }
 
@@ -1528,6 +1710,288 @@ vn_invalidate_pipeline_creation_feedback(const VkBaseInStructure *chain)
       feedback_info->pPipelineStageCreationFeedbacks[i].flags = 0;
 }
 
+/* pipeline index
+ *
+ * The renderer does not tell whether a pipeline hits the host pipeline
+ * caches. Instead, when the app retrieves the data of a VkPipelineCache,
+ * dev->pipeline_index records the pipelines created with the cache under the
+ * hash of the data. When a later run creates a cache from the same data, a
+ * pipeline created with it is likely to be in the host cache already.
+ *
+ * That is only a hint for how to submit the pipeline. Creation feedback and
+ * VK_PIPELINE_COMPILE_REQUIRED are never derived from it, and the hashes
+ * cover what commonly affects compilation but need not be exact.
+ */
+
+/* flags that do not affect compilation */
+#define VN_PIPELINE_INDEX_IGNORED_FLAGS                                      \
+   (VN_PIPELINE_CREATE_SYNC_MASK | VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT | \
+    VK_PIPELINE_CREATE_DERIVATIVE_BIT)
+
+static void
+vn_pipeline_index_hash_flags(struct mesa_sha1 *ctx,
+                             VkPipelineCreateFlags flags)
+{
+   flags &= ~VN_PIPELINE_INDEX_IGNORED_FLAGS;
+   _mesa_sha1_update(ctx, &flags, sizeof(flags));
+}
+
+static void
+vn_pipeline_index_hash_shader_stage(
+   struct mesa_sha1 *ctx, const VkPipelineShaderStageCreateInfo *stage_info)
+{
+   VN_SHA1_UPDATE_FIELDS(ctx, stage_info, flags, stage);
+   _mesa_sha1_update(ctx, stage_info->pName, strlen(stage_info->pName));
+
+   const struct vn_shader_module *mod =
+      vn_shader_module_from_handle(stage_info->module);
+   if (mod) {
+      _mesa_sha1_update(ctx, mod->sha1, sizeof(mod->sha1));
+   } else {
+      const VkShaderModuleCreateInfo *mod_info =
+         vk_find_struct_const(stage_info->pNext, SHADER_MODULE_CREATE_INFO);
+      const VkPipelineShaderStageModuleIdentifierCreateInfoEXT *id_info =
+         vk_find_struct_const(
+            stage_info->pNext,
+            PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT);
+      if (mod_info)
+         _mesa_sha1_update(ctx, mod_info->pCode, mod_info->codeSize);
+      else if (id_info)
+         _mesa_sha1_update(ctx, id_info->pIdentifier,
+                           id_info->identifierSize);
+   }
+
+   const VkSpecializationInfo *spec_info = stage_info->pSpecializationInfo;
+   if (spec_info) {
+      _mesa_sha1_update(ctx, spec_info->pMapEntries,
+                        sizeof(*spec_info->pMapEntries) *
+                           spec_info->mapEntryCount);
+      _mesa_sha1_update(ctx, spec_info->pData, spec_info->dataSize);
+   }
+}
+
+static void
+vn_pipeline_index_hash_layout(struct mesa_sha1 *ctx,
+                              VkPipelineLayout layout_handle)
+{
+   const struct vn_pipeline_layout *layout =
+      vn_pipeline_layout_from_handle(layout_handle);
+   if (layout)
+      _mesa_sha1_update(ctx, layout->sha1, sizeof(layout->sha1));
+}
+
+static void
+vn_graphics_pipeline_index_hash(
+   const VkGraphicsPipelineCreateInfo *info,
+   const struct vn_graphics_pipeline_fix_desc *fix_desc,
+   struct vn_pipeline *pipeline)
+{
+   struct mesa_sha1 sha1_ctx;
+   struct mesa_sha1 *ctx = &sha1_ctx;
+   _mesa_sha1_init(ctx);
+
+   /* info has been fixed, and ignored pointers have been erased */
+   vn_pipeline_index_hash_flags(ctx, info->flags);
+
+   for (uint32_t i = 0; i < info->stageCount && info->pStages; i++)
+      vn_pipeline_index_hash_shader_stage(ctx, &info->pStages[i]);
+
+   const VkPipelineVertexInputStateCreateInfo *vi = info->pVertexInputState;
+   if (vi) {
+      _mesa_sha1_update(ctx, vi->pVertexBindingDescriptions,
+                        sizeof(*vi->pVertexBindingDescriptions) *
+                           vi->vertexBindingDescriptionCount);
+      _mesa_sha1_update(ctx, vi->pVertexAttributeDescriptions,
+                        sizeof(*vi->pVertexAttributeDescriptions) *
+                           vi->vertexAttributeDescriptionCount);
+   }
+
+   if (info->pInputAssemblyState) {
+      VN_SHA1_UPDATE_FIELDS(ctx, info->pInputAssemblyState, flags,
+                            primitiveRestartEnable);
+   }
+   if (info->pTessellationState) {
+      VN_SHA1_UPDATE_FIELDS(ctx, info->pTessellationState, flags,
+                            patchControlPoints);
+   }
+   if (info->pViewportState) {
+      VN_SHA1_UPDATE_FIELDS(ctx, info->pViewportState, flags, viewportCount);
+      _mesa_sha1_update(ctx, &info->pViewportState->scissorCount,
+                        sizeof(info->pViewportState->scissorCount));
+   }
+   if (info->pRasterizationState) {
+      VN_SHA1_UPDATE_FIELDS(ctx, info->pRasterizationState, flags,
+                            lineWidth);
+   }
+
+   const VkPipelineMultisampleStateCreateInfo *ms = info->pMultisampleState;
+   if (ms) {
+      VN_SHA1_UPDATE_FIELDS(ctx, ms, flags, minSampleShading);
+      if (ms->pSampleMask) {
+         _mesa_sha1_update(ctx, ms->pSampleMask,
+                           sizeof(*ms->pSampleMask) *
+                              DIV_ROUND_UP(ms->rasterizationSamples, 32));
+      }
+      VN_SHA1_UPDATE_FIELDS(ctx, ms, alphaToCoverageEnable,
+                            alphaToOneEnable);
+   }
+
+   if (info->pDepthStencilState) {
+      VN_SHA1_UPDATE_FIELDS(ctx, info->pDepthStencilState, flags,
+                            maxDepthBounds);
+   }
+
+   const VkPipelineColorBlendStateCreateInfo *cb = info->pColorBlendState;
+   if (cb) {
+      VN_SHA1_UPDATE_FIELDS(ctx, cb, flags, logicOp);
+      if (cb->pAttachments) {
+         _mesa_sha1_update(ctx, cb->pAttachments,
+                           sizeof(*cb->pAttachments) * cb->attachmentCount);
+      }
+      _mesa_sha1_update(ctx, cb->blendConstants, sizeof(cb->blendConstants));
+   }
+
+   if (info->pDynamicState) {
+      _mesa_sha1_update(ctx, info->pDynamicState->pDynamicStates,
+                        sizeof(*info->pDynamicState->pDynamicStates) *
+                           info->pDynamicState->dynamicStateCount);
+   }
+
+   vn_pipeline_index_hash_layout(ctx, info->layout);
+
+   if (!fix_desc->self.render_pass && info->renderPass) {
+      const struct vn_render_pass *pass =
+         vn_render_pass_from_handle(info->renderPass);
+      _mesa_sha1_update(ctx, pass->sha1, sizeof(pass->sha1));
+      _mesa_sha1_update(ctx, &info->subpass, sizeof(info->subpass));
+   }
+
+   const VkPipelineRenderingCreateInfo *rendering_info =
+      vk_find_struct_const(info->pNext, PIPELINE_RENDERING_CREATE_INFO);
+   if (rendering_info) {
+      _mesa_sha1_update(ctx, &rendering_info->viewMask,
+                        sizeof(rendering_info->viewMask));
+      if (rendering_info->pColorAttachmentFormats) {
+         _mesa_sha1_update(ctx, rendering_info->pColorAttachmentFormats,
+                           sizeof(*rendering_info->pColorAttachmentFormats) *
+                              rendering_info->colorAttachmentCount);
+      }
+      VN_SHA1_UPDATE_FIELDS(ctx, rendering_info, depthAttachmentFormat,
+                            stencilAttachmentFormat);
+   }
+
+   const VkGraphicsPipelineLibraryCreateInfoEXT *gpl_info =
+      vk_find_struct_const(info->pNext,
+                           GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT);
+   if (gpl_info)
+      _mesa_sha1_update(ctx, &gpl_info->flags, sizeof(gpl_info->flags));
+
+   const VkPipelineLibraryCreateInfoKHR *library_info =
+      vk_find_struct_const(info->pNext, PIPELINE_LIBRARY_CREATE_INFO_KHR);
+   for (uint32_t i = 0; library_info && i < library_info->libraryCount;
+        i++) {
+      const struct vn_pipeline *library =
+         vn_pipeline_from_handle(library_info->pLibraries[i]);
+      _mesa_sha1_update(ctx, library->index_hash,
+                        sizeof(library->index_hash));
+   }
+
+   _mesa_sha1_final(ctx, pipeline->index_hash);
+}
+
+static void
+vn_compute_pipeline_index_hash(const VkComputePipelineCreateInfo *info,
+                               struct vn_pipeline *pipeline)
+{
+   struct mesa_sha1 sha1_ctx;
+   _mesa_sha1_init(&sha1_ctx);
+
+   vn_pipeline_index_hash_flags(&sha1_ctx, info->flags);
+   vn_pipeline_index_hash_shader_stage(&sha1_ctx, &info->stage);
+   vn_pipeline_index_hash_layout(&sha1_ctx, info->layout);
+
+   _mesa_sha1_final(&sha1_ctx, pipeline->index_hash);
+}
+
+static bool
+vn_pipeline_index_predict_warm(struct vn_device *dev,
+                               const struct vn_pipeline_cache *cache,
+                               const struct vn_pipeline *pipeline)
+{
+   if (!cache || !cache->index.has_data)
+      return false;
+
+   cache_key key;
+   vn_pipeline_index_key(dev, cache->index.data_sha1, pipeline->index_hash,
+                         key);
+   return disk_cache_has_key(dev->pipeline_index, key);
+}
+
+static void
+vn_pipeline_cache_index_add(struct vn_pipeline_cache *cache,
+                            uint32_t pipeline_count,
+                            const VkPipeline *pipeline_handles)
+{
+   struct set *hashes = cache->index.pipeline_hashes;
+   if (!hashes)
+      return;
+
+   simple_mtx_lock(&cache->index.mutex);
+   /* failed pipelines have been destroyed */
+   for (uint32_t i = 0; i < pipeline_count; i++) {
+      const struct vn_pipeline *pipeline =
+         vn_pipeline_from_handle(pipeline_handles[i]);
+      if (!pipeline)
+         continue;
+
+      /* apps recreating the same pipelines must not grow the set */
+      if (_mesa_set_search(hashes, pipeline->index_hash))
+         continue;
+
+      /* the index is only a prediction, so just stop recording when full */
+      if (hashes->entries >= VN_PIPELINE_CACHE_INDEX_MAX_HASHES)
+         break;
+
+      void *hash = ralloc_memdup(hashes, pipeline->index_hash,
+                                 sizeof(pipeline->index_hash));
+      if (hash)
+         _mesa_set_add(hashes, hash);
+   }
+   simple_mtx_unlock(&cache->index.mutex);
+}
+
+static void
+vn_graphics_pipelines_wait_deps(
+   VkPipelineCache cache,
+   uint32_t info_count,
+   const VkGraphicsPipelineCreateInfo *infos,
+   const struct vn_graphics_pipeline_fix_desc *fix_descs,
+   const struct vn_ring *ring)
+{
+   vn_pipeline_cache_wait_dep(cache, ring);
+
+   /* infos have been fixed, and ignored handles other than renderPass have
+    * been erased
+    */
+   for (uint32_t i = 0; i < info_count; i++) {
+      const VkGraphicsPipelineCreateInfo *info = &infos[i];
+
+      for (uint32_t j = 0; j < info->stageCount; j++)
+         vn_shader_stage_wait_dep(&info->pStages[j], ring);
+
+      vn_pipeline_layout_wait_dep(info->layout, ring);
+
+      if (!fix_descs[i].self.render_pass && info->renderPass) {
+         struct vn_render_pass *pass =
+            vn_render_pass_from_handle(info->renderPass);
+         vn_ring_dep_wait(&pass->ring_dep, ring);
+      }
+
+      vn_pipeline_wait_dep(info->basePipelineHandle, ring);
+      vn_pipeline_libraries_wait_dep(info->pNext, ring);
+   }
+}
+
 VkResult
 vn_CreateGraphicsPipelines(VkDevice device,
                            VkPipelineCache pipelineCache,
@@ -1539,7 +2003,11 @@ vn_CreateGraphicsPipelines(VkDevice device,
    struct vn_device *dev = vn_device_from_handle(device);
    const VkAllocationCallbacks *alloc =
       pAllocator ? pAllocator : &dev->base.base.alloc;
+   struct vn_pipeline_cache *cache =
+      dev->pipeline_index ? vn_pipeline_cache_from_handle(pipelineCache)
+                          : NULL;
    bool want_sync = false;
+   bool all_warm = cache != NULL;
    VkResult result;
 
    /* silence -Wmaybe-uninitialized false alarm on release build with gcc */
@@ -1583,6 +2051,13 @@ vn_CreateGraphicsPipelines(VkDevice device,
       if ((pCreateInfos[i].flags & VN_PIPELINE_CREATE_SYNC_MASK))
          want_sync = true;
 
+      if (dev->pipeline_index) {
+         vn_graphics_pipeline_index_hash(&pCreateInfos[i], &fix_descs[i],
+                                         pipeline);
+         if (!vn_pipeline_index_predict_warm(dev, cache, pipeline))
+            all_warm = false;
+      }
+
       vn_invalidate_pipeline_creation_feedback(
          (const VkBaseInStructure *)pCreateInfos[i].pNext);
    }
@@ -1595,9 +2070,20 @@ vn_CreateGraphicsPipelines(VkDevice device,
       return vn_error(dev->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
    }
 
+   /* Pipelines likely in the host cache are cheap to create. Submit them
+    * without waiting for the renderer, as a wrong guess only costs a compile
+    * on the primary ring.
+    */
+   if (all_warm && !want_sync)
+      target_ring = dev->primary_ring;
+
    if (want_sync || target_ring != dev->primary_ring) {
       if (target_ring == dev->primary_ring) {
          VN_TRACE_SCOPE("want sync");
+      } else {
+         vn_graphics_pipelines_wait_deps(pipelineCache, createInfoCount,
+                                         pCreateInfos, fix_descs,
+                                         target_ring);
       }
 
       result = vn_call_vkCreateGraphicsPipelines(
@@ -1607,17 +2093,44 @@ vn_CreateGraphicsPipelines(VkDevice device,
          vn_destroy_failed_pipeline_handles(dev, createInfoCount, pPipelines,
                                             alloc);
    } else {
-      vn_async_vkCreateGraphicsPipelines(target_ring, device, pipelineCache,
-                                         createInfoCount, pCreateInfos, NULL,
-                                         pPipelines);
+      struct vn_ring_submit_command submit;
+      vn_submit_vkCreateGraphicsPipelines(target_ring, 0, device,
+                                          pipelineCache, createInfoCount,
+                                          pCreateInfos, NULL, pPipelines,
+                                          &submit);
+      vn_pipelines_add_dep(pipelineCache, createInfoCount, pPipelines,
+                           &submit);
       result = VK_SUCCESS;
    }
 
+   if (cache)
+      vn_pipeline_cache_index_add(cache, createInfoCount, pPipelines);
+
    vk_free(alloc, fix_tmp);
    STACK_ARRAY_FINISH(fix_descs);
    return vn_result(dev->instance, result);
 }
 
+static void
+vn_compute_pipelines_wait_deps(VkPipelineCache cache,
+                               uint32_t info_count,
+                               const VkComputePipelineCreateInfo *infos,
+                               const struct vn_ring *ring)
+{
+   vn_pipeline_cache_wait_dep(cache, ring);
+
+   for (uint32_t i = 0; i < info_count; i++) {
+      const VkComputePipelineCreateInfo *info = &infos[i];
+
+      vn_shader_stage_wait_dep(&info->stage, ring);
+      vn_pipeline_layout_wait_dep(info->layout, ring);
+
+      if ((info->flags & VK_PIPELINE_CREATE_DERIVATIVE_BIT) &&
+          info->basePipelineIndex == -1)
+         vn_pipeline_wait_dep(info->basePipelineHandle, ring);
+   }
+}
+
 VkResult
 vn_CreateComputePipelines(VkDevice device,
                           VkPipelineCache pipelineCache,
@@ -1629,7 +2142,11 @@ vn_CreateComputePipelines(VkDevice device,
    struct vn_device *dev = vn_device_from_handle(device);
    const VkAllocationCallbacks *alloc =
       pAllocator ? pAllocator : &dev->base.base.alloc;
+   struct vn_pipeline_cache *cache =
+      dev->pipeline_index ? vn_pipeline_cache_from_handle(pipelineCache)
+                          : NULL;
    bool want_sync = false;
+   bool all_warm = cache != NULL;
    VkResult result;
 
    memset(pPipelines, 0, sizeof(*pPipelines) * createInfoCount);
@@ -1649,6 +2166,12 @@ vn_CreateComputePipelines(VkDevice device,
       if ((pCreateInfos[i].flags & VN_PIPELINE_CREATE_SYNC_MASK))
          want_sync = true;
 
+      if (dev->pipeline_index) {
+         vn_compute_pipeline_index_hash(&pCreateInfos[i], pipeline);
+         if (!vn_pipeline_index_predict_warm(dev, cache, pipeline))
+            all_warm = false;
+      }
+
       vn_invalidate_pipeline_creation_feedback(
          (const VkBaseInStructure *)pCreateInfos[i].pNext);
    }
@@ -1659,7 +2182,16 @@ vn_CreateComputePipelines(VkDevice device,
       return vn_error(dev->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
    }
 
+   /* see vn_CreateGraphicsPipelines */
+   if (all_warm && !want_sync)
+      target_ring = dev->primary_ring;
+
    if (want_sync || target_ring != dev->primary_ring) {
+      if (target_ring != dev->primary_ring) {
+         vn_compute_pipelines_wait_deps(pipelineCache, createInfoCount,
+                                        pCreateInfos, target_ring);
+      }
+
       result = vn_call_vkCreateComputePipelines(
          target_ring, device, pipelineCache, createInfoCount, pCreateInfos,
          NULL, pPipelines);
@@ -1667,12 +2199,19 @@ vn_CreateComputePipelines(VkDevice device,
          vn_destroy_failed_pipeline_handles(dev, createInfoCount, pPipelines,
                                             alloc);
    } else {
-      vn_async_vkCreateComputePipelines(target_ring, device, pipelineCache,
-                                        createInfoCount, pCreateInfos, NULL,
-                                        pPipelines);
+      struct vn_ring_submit_command submit;
+      vn_submit_vkCreateComputePipelines(target_ring, 0, device,
+                                         pipelineCache, createInfoCount,
+                                         pCreateInfos, NULL, pPipelines,
+                                         &submit);
+      vn_pipelines_add_dep(pipelineCache, createInfoCount, pPipelines,
+                           &submit);
       result = VK_SUCCESS;
    }
 
+   if (cache)
+      vn_pipeline_cache_index_add(cache, createInfoCount, pPipelines);
+
    return vn_result(dev->instance, result);
 }
 
@@ -13,8 +13,18 @@
 
 #include "vn_common.h"
 
+#include "util/mesa-sha1.h"
+#include "util/set.h"
+
+/* bounds the pipeline hashes a vn_pipeline_cache records for the index */
+#define VN_PIPELINE_CACHE_INDEX_MAX_HASHES 4096
+
 struct vn_shader_module {
    struct vn_object_base base;
+   struct vn_ring_dep ring_dep;
+
+   /* SPIR-V hash, valid only with dev->pipeline_index */
+   uint8_t sha1[SHA1_DIGEST_LENGTH];
 };
 VK_DEFINE_NONDISP_HANDLE_CASTS(vn_shader_module,
                                base.base,
@@ -27,6 +37,10 @@ struct vn_pipeline_layout {
    struct vn_descriptor_set_layout *push_descriptor_set_layout;
    bool has_push_constant_ranges;
    struct vn_refcount refcount;
+   struct vn_ring_dep ring_dep;
+
+   /* valid only with dev->pipeline_index */
+   uint8_t sha1[SHA1_DIGEST_LENGTH];
 };
 VK_DEFINE_NONDISP_HANDLE_CASTS(vn_pipeline_layout,
                                base.base,
@@ -35,6 +49,25 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(vn_pipeline_layout,
 
 struct vn_pipeline_cache {
    struct vn_object_base base;
+
+   /* covers the creation as well as async merges and pipeline creations
+    * that may update the cache
+    */
+   struct vn_ring_dep ring_dep;
+
+   /* valid only with dev->pipeline_index */
+   struct {
+      /* hash of the initial data, if any */
+      bool has_data;
+      uint8_t data_sha1[SHA1_DIGEST_LENGTH];
+
+      /* distinct hashes of the pipelines created with the cache, at most
+       * VN_PIPELINE_CACHE_INDEX_MAX_HASHES of them, recorded in the index
+       * when the app retrieves the cache data
+       */
+      simple_mtx_t mutex;
+      struct set *pipeline_hashes;
+   } index;
 };
 VK_DEFINE_NONDISP_HANDLE_CASTS(vn_pipeline_cache,
                                base.base,
@@ -49,6 +82,10 @@ enum vn_pipeline_type {
 struct vn_pipeline {
    struct vn_object_base base;
    enum vn_pipeline_type type;
+   struct vn_ring_dep ring_dep;
+
+   /* create info hash, valid only with dev->pipeline_index */
+   uint8_t index_hash[SHA1_DIGEST_LENGTH];
 
    /**
     * The VkPipelineLayout provided directly (without linking) at pipeline
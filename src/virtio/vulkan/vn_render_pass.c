@@ -76,6 +76,60 @@
       }                                                                      \
    } while (false)
 
+#define HASH_ATTACHMENT_REFS(ctx, refs, ref_count)                           \
+   do {                                                                      \
+      for (uint32_t k = 0; refs && k < ref_count; k++)                       \
+         VN_SHA1_UPDATE_FIELDS(ctx, &refs[k], attachment, layout);           \
+   } while (false)
+
+/* Hash what pipelines compiled against the render pass may depend on, for
+ * the pipeline index. This covers the whole pass other than the pNext
+ * chains, as the view masks are taken from the subpasses.
+ */
+#define HASH_RENDER_PASS(_pass, _pCreateInfo)                                \
+   do {                                                                      \
+      struct mesa_sha1 sha1_ctx;                                             \
+      _mesa_sha1_init(&sha1_ctx);                                            \
+      _mesa_sha1_update(&sha1_ctx, &_pCreateInfo->attachmentCount,           \
+                        sizeof(_pCreateInfo->attachmentCount));              \
+      for (uint32_t i = 0; i < _pCreateInfo->attachmentCount; i++) {         \
+         VN_SHA1_UPDATE_FIELDS(&sha1_ctx, &_pCreateInfo->pAttachments[i],    \
+                               flags, finalLayout);                          \
+      }                                                                      \
+                                                                             \
+      _mesa_sha1_update(&sha1_ctx, &_pCreateInfo->subpassCount,              \
+                        sizeof(_pCreateInfo->subpassCount));                 \
+      for (uint32_t i = 0; i < _pCreateInfo->subpassCount; i++) {            \
+         __auto_type subpass_desc = &_pCreateInfo->pSubpasses[i];            \
+         _mesa_sha1_update(&sha1_ctx, &subpass_desc->flags,                  \
+                           sizeof(subpass_desc->flags));                     \
+         _mesa_sha1_update(&sha1_ctx, &subpass_desc->pipelineBindPoint,      \
+                           sizeof(subpass_desc->pipelineBindPoint));         \
+         _mesa_sha1_update(&sha1_ctx, &_pass->subpasses[i].view_mask,        \
+                           sizeof(_pass->subpasses[i].view_mask));           \
+         _mesa_sha1_update(&sha1_ctx, &subpass_desc->inputAttachmentCount,   \
+                           sizeof(subpass_desc->inputAttachmentCount));      \
+         HASH_ATTACHMENT_REFS(&sha1_ctx, subpass_desc->pInputAttachments,    \
+                              subpass_desc->inputAttachmentCount);           \
+         _mesa_sha1_update(&sha1_ctx, &subpass_desc->colorAttachmentCount,   \
+                           sizeof(subpass_desc->colorAttachmentCount));      \
+         HASH_ATTACHMENT_REFS(&sha1_ctx, subpass_desc->pColorAttachments,    \
+                              subpass_desc->colorAttachmentCount);           \
+         HASH_ATTACHMENT_REFS(&sha1_ctx, subpass_desc->pResolveAttachments,  \
+                              subpass_desc->colorAttachmentCount);           \
+         HASH_ATTACHMENT_REFS(&sha1_ctx,                                     \
+                              subpass_desc->pDepthStencilAttachment, 1);     \
+      }                                                                      \
+                                                                             \
+      _mesa_sha1_update(&sha1_ctx, &_pCreateInfo->dependencyCount,           \
+                        sizeof(_pCreateInfo->dependencyCount));              \
+      for (uint32_t i = 0; i < _pCreateInfo->dependencyCount; i++) {         \
+         VN_SHA1_UPDATE_FIELDS(&sha1_ctx, &_pCreateInfo->pDependencies[i],   \
+                               srcSubpass, dependencyFlags);                 \
+      }                                                                      \
+      _mesa_sha1_final(&sha1_ctx, _pass->sha1);                              \
+   } while (false)
+
 static inline void
 vn_render_pass_count_present_src(const VkRenderPassCreateInfo *create_info,
                                  uint32_t *initial_count,
@@ -238,9 +292,15 @@ vn_CreateRenderPass(VkDevice device,
          pass->subpasses[i].view_mask = multiview_info->pViewMasks[i];
    }
 
+   if (dev->pipeline_index)
+      HASH_RENDER_PASS(pass, pCreateInfo);
+
    VkRenderPass pass_handle = vn_render_pass_to_handle(pass);
-   vn_async_vkCreateRenderPass(dev->primary_ring, device, pCreateInfo, NULL,
-                               &pass_handle);
+   struct vn_ring_submit_command submit;
+   vn_ring_dep_init(&pass->ring_dep, dev->primary_ring);
+   vn_submit_vkCreateRenderPass(dev->primary_ring, 0, device, pCreateInfo,
+                                NULL, &pass_handle, &submit);
+   vn_ring_dep_add(&pass->ring_dep, &submit);
 
    STACK_ARRAY_FINISH(attachments);
 
@@ -288,9 +348,15 @@ vn_CreateRenderPass2(VkDevice device,
    for (uint32_t i = 0; i < pCreateInfo->subpassCount; i++)
       pass->subpasses[i].view_mask = pCreateInfo->pSubpasses[i].viewMask;
 
+   if (dev->pipeline_index)
+      HASH_RENDER_PASS(pass, pCreateInfo);
+
    VkRenderPass pass_handle = vn_render_pass_to_handle(pass);
-   vn_async_vkCreateRenderPass2(dev->primary_ring, device, pCreateInfo, NULL,
-                                &pass_handle);
+   struct vn_ring_submit_command submit;
+   vn_ring_dep_init(&pass->ring_dep, dev->primary_ring);
+   vn_submit_vkCreateRenderPass2(dev->primary_ring, 0, device, pCreateInfo,
+                                 NULL, &pass_handle, &submit);
+   vn_ring_dep_add(&pass->ring_dep, &submit);
 
    STACK_ARRAY_FINISH(attachments);
 
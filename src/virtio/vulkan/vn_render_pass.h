@@ -13,6 +13,8 @@
 
 #include "vn_common.h"
 
+#include "util/mesa-sha1.h"
+
 struct vn_present_src_attachment {
    uint32_t index;
 
@@ -30,6 +32,7 @@ struct vn_subpass {
 
 struct vn_render_pass {
    struct vn_object_base base;
+   struct vn_ring_dep ring_dep;
 
    VkExtent2D granularity;
 
@@ -38,6 +41,9 @@ struct vn_render_pass {
    uint32_t present_release_count;
    uint32_t subpass_count;
 
+   /* valid only with dev->pipeline_index */
+   uint8_t sha1[SHA1_DIGEST_LENGTH];
+
    /* Attachments where initialLayout or finalLayout was
     * VK_IMAGE_LAYOUT_PRESENT_SRC_KHR.
     */
@@ -54,6 +54,20 @@ struct vtest {
    mtx_t sock_mutex;
    int sock_fd;
 
+   /* The server replies in request order.  After init, a request expecting
+    * a reply takes a ticket under sock_mutex and releases sock_mutex before
+    * waiting for its turn to read the reply.  Other threads can send their
+    * requests meanwhile, and a ticket serves as an implicit request id.
+    */
+   struct {
+      /* protected by sock_mutex */
+      uint64_t next_ticket;
+
+      mtx_t mutex;
+      cnd_t cond;
+      uint64_t serving;
+   } reply;
+
    uint32_t protocol_version;
    uint32_t max_timeline_count;
 
@@ -161,6 +175,28 @@ vtest_write(struct vtest *vtest, const void *buf, size_t size)
    } while (size);
 }
 
+static uint64_t
+vtest_reply_ticket_locked(struct vtest *vtest)
+{
+   return vtest->reply.next_ticket++;
+}
+
+static void
+vtest_reply_begin(struct vtest *vtest, uint64_t ticket)
+{
+   mtx_lock(&vtest->reply.mutex);
+   while (vtest->reply.serving != ticket)
+      cnd_wait(&vtest->reply.cond, &vtest->reply.mutex);
+}
+
+static void
+vtest_reply_end(struct vtest *vtest)
+{
+   vtest->reply.serving++;
+   cnd_broadcast(&vtest->reply.cond);
+   mtx_unlock(&vtest->reply.mutex);
+}
+
 static void
 vtest_vcmd_create_renderer(struct vtest *vtest, const char *name)
 {
@@ -312,13 +348,12 @@ vtest_vcmd_context_init(struct vtest *vtest,
    vtest_write(vtest, vcmd_context_init, sizeof(vcmd_context_init));
 }
 
-static uint32_t
+static uint64_t
 vtest_vcmd_resource_create_blob(struct vtest *vtest,
                                 enum vcmd_blob_type type,
                                 uint32_t flags,
                                 VkDeviceSize size,
-                                vn_object_id blob_id,
-                                int *res_fd)
+                                vn_object_id blob_id)
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
    uint32_t vcmd_res_create_blob[VCMD_RES_CREATE_BLOB_SIZE];
@@ -338,6 +373,18 @@ vtest_vcmd_resource_create_blob(struct vtest *vtest,
    vtest_write(vtest, vtest_hdr, sizeof(vtest_hdr));
    vtest_write(vtest, vcmd_res_create_blob, sizeof(vcmd_res_create_blob));
 
+   return vtest_reply_ticket_locked(vtest);
+}
+
+static uint32_t
+vtest_vcmd_resource_create_blob_reply(struct vtest *vtest,
+                                      uint64_t ticket,
+                                      int *res_fd)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+
+   vtest_reply_begin(vtest, ticket);
+
    vtest_read(vtest, vtest_hdr, sizeof(vtest_hdr));
    assert(vtest_hdr[VTEST_CMD_LEN] == 1);
    assert(vtest_hdr[VTEST_CMD_ID] == VCMD_RESOURCE_CREATE_BLOB);
@@ -347,6 +394,8 @@ vtest_vcmd_resource_create_blob(struct vtest *vtest,
 
    *res_fd = vtest_receive_fd(vtest);
 
+   vtest_reply_end(vtest);
+
    return res_id;
 }
 
@@ -364,7 +413,7 @@ vtest_vcmd_resource_unref(struct vtest *vtest, uint32_t res_id)
    vtest_write(vtest, vcmd_res_unref, sizeof(vcmd_res_unref));
 }
 
-static uint32_t
+static uint64_t
 vtest_vcmd_sync_create(struct vtest *vtest, uint64_t initial_val)
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
@@ -380,6 +429,16 @@ vtest_vcmd_sync_create(struct vtest *vtest, uint64_t initial_val)
    vtest_write(vtest, vtest_hdr, sizeof(vtest_hdr));
    vtest_write(vtest, vcmd_sync_create, sizeof(vcmd_sync_create));
 
+   return vtest_reply_ticket_locked(vtest);
+}
+
+static uint32_t
+vtest_vcmd_sync_create_reply(struct vtest *vtest, uint64_t ticket)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+
+   vtest_reply_begin(vtest, ticket);
+
    vtest_read(vtest, vtest_hdr, sizeof(vtest_hdr));
    assert(vtest_hdr[VTEST_CMD_LEN] == 1);
    assert(vtest_hdr[VTEST_CMD_ID] == VCMD_SYNC_CREATE);
@@ -387,6 +446,8 @@ vtest_vcmd_sync_create(struct vtest *vtest, uint64_t initial_val)
    uint32_t sync_id;
    vtest_read(vtest, &sync_id, sizeof(sync_id));
 
+   vtest_reply_end(vtest);
+
    return sync_id;
 }
 
@@ -418,6 +479,16 @@ vtest_vcmd_sync_read(struct vtest *vtest, uint32_t sync_id)
    vtest_write(vtest, vtest_hdr, sizeof(vtest_hdr));
    vtest_write(vtest, vcmd_sync_read, sizeof(vcmd_sync_read));
 
+   return vtest_reply_ticket_locked(vtest);
+}
+
+static uint64_t
+vtest_vcmd_sync_read_reply(struct vtest *vtest, uint64_t ticket)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+
+   vtest_reply_begin(vtest, ticket);
+
    vtest_read(vtest, vtest_hdr, sizeof(vtest_hdr));
    assert(vtest_hdr[VTEST_CMD_LEN] == 2);
    assert(vtest_hdr[VTEST_CMD_ID] == VCMD_SYNC_READ);
@@ -425,6 +496,8 @@ vtest_vcmd_sync_read(struct vtest *vtest, uint32_t sync_id)
    uint64_t val;
    vtest_read(vtest, &val, sizeof(val));
 
+   vtest_reply_end(vtest);
+
    return val;
 }
 
@@ -445,7 +518,7 @@ vtest_vcmd_sync_write(struct vtest *vtest, uint32_t sync_id, uint64_t val)
    vtest_write(vtest, vcmd_sync_write, sizeof(vcmd_sync_write));
 }
 
-static int
+static uint64_t
 vtest_vcmd_sync_wait(struct vtest *vtest,
                      uint32_t flags,
                      int poll_timeout,
@@ -474,11 +547,25 @@ vtest_vcmd_sync_wait(struct vtest *vtest,
       vtest_write(vtest, sync, sizeof(sync));
    }
 
+   return vtest_reply_ticket_locked(vtest);
+}
+
+static int
+vtest_vcmd_sync_wait_reply(struct vtest *vtest, uint64_t ticket)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+
+   vtest_reply_begin(vtest, ticket);
+
    vtest_read(vtest, vtest_hdr, sizeof(vtest_hdr));
    assert(vtest_hdr[VTEST_CMD_LEN] == 0);
    assert(vtest_hdr[VTEST_CMD_ID] == VCMD_SYNC_WAIT);
 
-   return vtest_receive_fd(vtest);
+   const int fd = vtest_receive_fd(vtest);
+
+   vtest_reply_end(vtest);
+
+   return fd;
 }
 
 static void
@@ -599,9 +686,11 @@ vtest_sync_read(struct vn_renderer *renderer,
    struct vtest_sync *sync = (struct vtest_sync *)_sync;
 
    mtx_lock(&vtest->sock_mutex);
-   *val = vtest_vcmd_sync_read(vtest, sync->base.sync_id);
+   const uint64_t ticket = vtest_vcmd_sync_read(vtest, sync->base.sync_id);
    mtx_unlock(&vtest->sock_mutex);
 
+   *val = vtest_vcmd_sync_read_reply(vtest, ticket);
+
    return VK_SUCCESS;
 }
 
@@ -641,9 +730,11 @@ vtest_sync_create(struct vn_renderer *renderer,
       return VK_ERROR_OUT_OF_HOST_MEMORY;
 
    mtx_lock(&vtest->sock_mutex);
-   sync->base.sync_id = vtest_vcmd_sync_create(vtest, initial_val);
+   const uint64_t ticket = vtest_vcmd_sync_create(vtest, initial_val);
    mtx_unlock(&vtest->sock_mutex);
 
+   sync->base.sync_id = vtest_vcmd_sync_create_reply(vtest, ticket);
+
    *out_sync = &sync->base;
    return VK_SUCCESS;
 }
@@ -754,11 +845,14 @@ vtest_bo_create_from_device_memory(
    const uint32_t blob_flags = vtest_bo_blob_flags(flags, external_handles);
 
    mtx_lock(&vtest->sock_mutex);
+   const uint64_t ticket = vtest_vcmd_resource_create_blob(
+      vtest, VCMD_BLOB_TYPE_HOST3D, blob_flags, size, mem_id);
+   mtx_unlock(&vtest->sock_mutex);
+
    int res_fd;
-   uint32_t res_id = vtest_vcmd_resource_create_blob(
-      vtest, VCMD_BLOB_TYPE_HOST3D, blob_flags, size, mem_id, &res_fd);
+   uint32_t res_id =
+      vtest_vcmd_resource_create_blob_reply(vtest, ticket, &res_fd);
    assert(res_id > 0 && res_fd >= 0);
-   mtx_unlock(&vtest->sock_mutex);
 
    struct vtest_bo *bo = util_sparse_array_get(&vtest->bo_array, res_id);
    *bo = (struct vtest_bo){
@@ -815,12 +909,14 @@ vtest_shmem_create(struct vn_renderer *renderer, size_t size)
    }
 
    mtx_lock(&vtest->sock_mutex);
+   const uint64_t ticket = vtest_vcmd_resource_create_blob(
+      vtest, vtest->shmem_blob_mem, VCMD_BLOB_FLAG_MAPPABLE, size, 0);
+   mtx_unlock(&vtest->sock_mutex);
+
    int res_fd;
-   uint32_t res_id = vtest_vcmd_resource_create_blob(
-      vtest, vtest->shmem_blob_mem, VCMD_BLOB_FLAG_MAPPABLE, size, 0,
-      &res_fd);
+   uint32_t res_id =
+      vtest_vcmd_resource_create_blob_reply(vtest, ticket, &res_fd);
    assert(res_id > 0 && res_fd >= 0);
-   mtx_unlock(&vtest->sock_mutex);
 
    void *ptr =
       mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, res_fd, 0);
@@ -896,11 +992,13 @@ vtest_wait(struct vn_renderer *renderer, const struct vn_renderer_wait *wait)
     * to do a quick check (or spin a bit) before waiting.
     */
    mtx_lock(&vtest->sock_mutex);
-   const int fd =
+   const uint64_t ticket =
       vtest_vcmd_sync_wait(vtest, flags, poll_timeout, wait->syncs,
                            wait->sync_values, wait->sync_count);
    mtx_unlock(&vtest->sock_mutex);
 
+   const int fd = vtest_vcmd_sync_wait_reply(vtest, ticket);
+
    VkResult result = sync_wait_poll(fd, poll_timeout);
    close(fd);
 
@@ -966,6 +1064,8 @@ vtest_destroy(struct vn_renderer *renderer,
       close(vtest->sock_fd);
    }
 
+   cnd_destroy(&vtest->reply.cond);
+   mtx_destroy(&vtest->reply.mutex);
    mtx_destroy(&vtest->sock_mutex);
    util_sparse_array_finish(&vtest->shmem_array);
    util_sparse_array_finish(&vtest->bo_array);
@@ -1030,6 +1130,8 @@ vtest_init(struct vtest *vtest)
    util_sparse_array_init(&vtest->bo_array, sizeof(struct vtest_bo), 1024);
 
    mtx_init(&vtest->sock_mutex, mtx_plain);
+   mtx_init(&vtest->reply.mutex, mtx_plain);
+   cnd_init(&vtest->reply.cond);
    vtest->sock_fd = vtest_connect_socket(
       vtest->instance, socket_name ? socket_name : VTEST_DEFAULT_SOCKET_NAME);
    if (vtest->sock_fd < 0)
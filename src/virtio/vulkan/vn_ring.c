@@ -7,6 +7,7 @@
 
 #include <sys/resource.h>
 
+#include "util/perf/u_perfetto.h"
 #include "venus-protocol/vn_protocol_driver_transport.h"
 
 #include "vn_cs.h"
@@ -15,6 +16,15 @@
 
 #define VN_RING_IDLE_TIMEOUT_NS (1ull * 1000 * 1000)
 
+/* max size of a shmem-backed cs to be copied into the ring */
+#define VN_RING_SHMEM_DIRECT_MAX_SIZE (4 * 1024)
+
+/* floor of the adaptive direct_size */
+#define VN_RING_DIRECT_MIN_SIZE (256)
+
+/* number of space waits without stalling to double direct_size */
+#define VN_RING_DIRECT_GROW_INTERVAL (256)
+
 static_assert(ATOMIC_INT_LOCK_FREE == 2 && sizeof(atomic_uint) == 4,
               "vn_ring_shared requires lock-free 32-bit atomic_uint");
 
@@ -38,6 +48,9 @@ struct vn_ring {
    struct vn_ring_shared shared;
    uint32_t cur;
 
+   /* ring->cur extended to 64 bits, updated before the tail is stored */
+   atomic_uint_least64_t submitted;
+
    /* This mutex ensures below:
     * - atomic of ring submission
     * - reply shmem resource set and ring submission are paired
@@ -47,11 +60,30 @@ struct vn_ring {
    /* size limit for cmd submission via ring shmem, derived from
     * (buffer_size >> direct_order) upon vn_ring_create
     */
+   uint32_t direct_max_size;
+
+   /* The effective limit, protected by mutex.  It shrinks when the ring runs
+    * out of space such that bursts of large cmds go through shmems instead
+    * and take little ring space, and grows back after a while without
+    * running out of space.
+    */
    uint32_t direct_size;
+   uint32_t direct_grow_count;
 
    /* used for indirect submission of large command (non-VkCommandBuffer) */
    struct vn_cs_encoder upload;
 
+   /* Small async commands are accumulated here by vn_ring_batch_begin and
+    * written to the ring ahead of the next submission.  The capacity is
+    * direct_max_size.
+    */
+   struct {
+      void *data;
+      size_t len;
+      struct vn_cs_encoder_buffer buffer;
+      struct vn_cs_encoder enc;
+   } batch;
+
    struct list_head submits;
    struct list_head free_submits;
 
@@ -61,6 +93,14 @@ struct vn_ring {
 
    int64_t last_notify;
    int64_t next_notify;
+
+   /* protected by mutex */
+   struct {
+      uint64_t submit_count;
+      uint64_t direct_count;
+      uint64_t byte_count;
+      char counter_name[32];
+   } stats;
 };
 
 struct vn_ring_submit {
@@ -171,16 +211,33 @@ vn_ring_get_seqno_status(struct vn_ring *ring, uint32_t seqno)
    return vn_ring_ge_seqno(ring, vn_ring_load_head(ring), seqno);
 }
 
+static uint64_t
+vn_ring_extend_seqno(const struct vn_ring *ring, uint32_t seqno)
+{
+   /* seqno must not be ahead of ring->submitted, and must be loaded before
+    * it.  Both hold for the head, which never passes the tail, and for the
+    * seqno of a completed submission.
+    */
+   const uint64_t submitted =
+      atomic_load_explicit(&ring->submitted, memory_order_acquire);
+   return submitted - (uint32_t)((uint32_t)submitted - seqno);
+}
+
+static enum vn_relax_reason
+vn_ring_seqno_relax_reason(const struct vn_ring *ring)
+{
+   return ring == ring->instance->ring.ring ? VN_RELAX_REASON_RING_SEQNO
+                                            : VN_RELAX_REASON_TLS_RING_SEQNO;
+}
+
 static void
 vn_ring_wait_seqno(struct vn_ring *ring, uint32_t seqno)
 {
    /* A renderer wait incurs several hops and the renderer might poll
     * repeatedly anyway.  Let's just poll here.
     */
-   const enum vn_relax_reason reason = ring == ring->instance->ring.ring
-                                          ? VN_RELAX_REASON_RING_SEQNO
-                                          : VN_RELAX_REASON_TLS_RING_SEQNO;
-   struct vn_relax_state relax_state = vn_relax_init(ring->instance, reason);
+   struct vn_relax_state relax_state =
+      vn_relax_init(ring->instance, vn_ring_seqno_relax_reason(ring));
    do {
       if (vn_ring_get_seqno_status(ring, seqno)) {
          vn_relax_fini(&relax_state);
@@ -190,15 +247,78 @@ vn_ring_wait_seqno(struct vn_ring *ring, uint32_t seqno)
    } while (true);
 }
 
+static VkResult
+vn_ring_submit_locked(struct vn_ring *ring,
+                      const struct vn_cs_encoder *cs,
+                      struct vn_renderer_shmem *extra_shmem,
+                      uint32_t *ring_seqno);
+
+static void
+vn_ring_flush_batch_locked(struct vn_ring *ring)
+{
+   if (!ring->batch.len)
+      return;
+
+   struct vn_cs_encoder_buffer buf =
+      VN_CS_ENCODER_BUFFER_INITIALIZER(ring->batch.data);
+   struct vn_cs_encoder enc = VN_CS_ENCODER_INITIALIZER(&buf, ring->batch.len);
+   enc.cur += ring->batch.len;
+   vn_cs_encoder_commit(&enc);
+
+   ring->batch.len = 0;
+   vn_ring_submit_locked(ring, &enc, NULL, NULL);
+}
+
 void
 vn_ring_wait_all(struct vn_ring *ring)
 {
+   mtx_lock(&ring->mutex);
+   vn_ring_flush_batch_locked(ring);
+   mtx_unlock(&ring->mutex);
+
    /* load from tail rather than ring->cur for atomicity */
    const uint32_t pending_seqno =
       atomic_load_explicit(ring->shared.tail, memory_order_relaxed);
    vn_ring_wait_seqno(ring, pending_seqno);
 }
 
+void
+vn_ring_dep_add(struct vn_ring_dep *dep,
+                const struct vn_ring_submit_command *submit)
+{
+   if (!submit->ring_seqno_valid)
+      return;
+
+   const uint64_t seqno = vn_ring_extend_seqno(dep->ring, submit->ring_seqno);
+   uint64_t old = atomic_load_explicit(&dep->seqno, memory_order_relaxed);
+   while (old < seqno &&
+          !atomic_compare_exchange_weak_explicit(&dep->seqno, &old, seqno,
+                                                 memory_order_relaxed,
+                                                 memory_order_relaxed))
+      ;
+}
+
+void
+vn_ring_dep_wait(const struct vn_ring_dep *dep, const struct vn_ring *ring)
+{
+   /* commands on the same ring are consumed in order */
+   if (!dep->ring || dep->ring == ring)
+      return;
+
+   const uint64_t seqno =
+      atomic_load_explicit(&dep->seqno, memory_order_relaxed);
+   if (vn_ring_extend_seqno(dep->ring, vn_ring_load_head(dep->ring)) >= seqno)
+      return;
+
+   struct vn_relax_state relax_state = vn_relax_init(
+      dep->ring->instance, vn_ring_seqno_relax_reason(dep->ring));
+   do {
+      vn_relax(&relax_state);
+   } while (vn_ring_extend_seqno(dep->ring, vn_ring_load_head(dep->ring)) <
+            seqno);
+   vn_relax_fini(&relax_state);
+}
+
 static bool
 vn_ring_has_space(const struct vn_ring *ring,
                   uint32_t size,
@@ -213,14 +333,40 @@ vn_ring_has_space(const struct vn_ring *ring,
    return false;
 }
 
+static void
+vn_ring_grow_direct_size(struct vn_ring *ring)
+{
+   if (likely(ring->direct_size >= ring->direct_max_size))
+      return;
+
+   if (++ring->direct_grow_count >= VN_RING_DIRECT_GROW_INTERVAL) {
+      ring->direct_size =
+         MIN2(ring->direct_size * 2, ring->direct_max_size);
+      ring->direct_grow_count = 0;
+   }
+}
+
+static void
+vn_ring_shrink_direct_size(struct vn_ring *ring)
+{
+   ring->direct_size = MAX2(ring->direct_size / 2,
+                            MIN2(VN_RING_DIRECT_MIN_SIZE,
+                                 ring->direct_max_size));
+   ring->direct_grow_count = 0;
+}
+
 static uint32_t
 vn_ring_wait_space(struct vn_ring *ring, uint32_t size)
 {
    assert(size <= ring->buffer_size);
 
    uint32_t head;
-   if (likely(vn_ring_has_space(ring, size, &head)))
+   if (likely(vn_ring_has_space(ring, size, &head))) {
+      vn_ring_grow_direct_size(ring);
       return head;
+   }
+
+   vn_ring_shrink_direct_size(ring);
 
    {
       VN_TRACE_FUNC();
@@ -309,8 +455,12 @@ vn_ring_create(struct vn_instance *instance,
 
    mtx_init(&ring->mutex, mtx_plain);
 
-   ring->direct_size = layout->buffer_size >> direct_order;
-   assert(ring->direct_size);
+   ring->direct_max_size = layout->buffer_size >> direct_order;
+   assert(ring->direct_max_size);
+   ring->direct_size = ring->direct_max_size;
+
+   /* batching is skipped when this fails */
+   ring->batch.data = malloc(ring->direct_max_size);
 
    vn_cs_encoder_init(&ring->upload, instance,
                       VN_CS_ENCODER_STORAGE_SHMEM_ARRAY, 1 * 1024 * 1024);
@@ -321,6 +471,9 @@ vn_ring_create(struct vn_instance *instance,
    mtx_init(&ring->roundtrip_mutex, mtx_plain);
    ring->roundtrip_next = 1;
 
+   snprintf(ring->stats.counter_name, sizeof(ring->stats.counter_name),
+            "venus ring 0x%" PRIx64 " bytes", ring->id);
+
    /* VkRingPriorityInfoMESA support requires
     * VK_MESA_VENUS_PROTOCOL_SPEC_VERSION >= 2  */
    int prio = 0;
@@ -380,6 +533,14 @@ vn_ring_destroy(struct vn_ring *ring)
 
    mtx_destroy(&ring->roundtrip_mutex);
 
+   if (VN_DEBUG(CS_STATS)) {
+      vn_log(ring->instance,
+             "ring 0x%" PRIx64 ": %" PRIu64 " submits (%" PRIu64
+             " direct), %" PRIu64 " bytes",
+             ring->id, ring->stats.submit_count, ring->stats.direct_count,
+             ring->stats.byte_count);
+   }
+
    vn_ring_retire_submits(ring, ring->cur);
    assert(list_is_empty(&ring->submits));
 
@@ -387,6 +548,8 @@ vn_ring_destroy(struct vn_ring *ring)
                             &ring->free_submits, head)
       free(submit);
 
+   free(ring->batch.data);
+
    vn_cs_encoder_fini(&ring->upload);
    vn_renderer_shmem_unref(ring->instance->renderer, ring->shmem);
 
@@ -440,6 +603,13 @@ vn_ring_submit_internal(struct vn_ring *ring,
       vn_ring_write_buffer(ring, buf->base, buf->committed_size);
    }
 
+   /* extend before storing the tail so that the head never gets ahead */
+   const uint64_t submitted =
+      atomic_load_explicit(&ring->submitted, memory_order_relaxed);
+   atomic_store_explicit(
+      &ring->submitted, submitted + (uint32_t)(ring->cur - (uint32_t)submitted),
+      memory_order_release);
+
    vn_ring_store_tail(ring);
    const VkRingStatusFlagsMESA status = vn_ring_load_status(ring);
    if (status & VK_RING_STATUS_FATAL_BIT_MESA) {
@@ -575,7 +745,17 @@ static inline bool
 vn_ring_submission_can_direct(const struct vn_ring *ring,
                               const struct vn_cs_encoder *cs)
 {
-   return vn_cs_encoder_get_len(cs) <= ring->direct_size;
+   const size_t len = vn_cs_encoder_get_len(cs);
+
+   /* Shmem-backed streams, such as VkCommandBuffer recordings, can be
+    * consumed by the renderer in place. Only copy them into the ring when
+    * they are small enough that the copy is cheaper than the indirection.
+    */
+   if (cs->storage_type != VN_CS_ENCODER_STORAGE_POINTER &&
+       len > VN_RING_SHMEM_DIRECT_MAX_SIZE)
+      return false;
+
+   return len <= ring->direct_size;
 }
 
 static struct vn_cs_encoder *
@@ -609,6 +789,11 @@ vn_ring_submit_locked(struct vn_ring *ring,
                       struct vn_renderer_shmem *extra_shmem,
                       uint32_t *ring_seqno)
 {
+   /* batched commands must be consumed before anything that follows */
+   vn_ring_flush_batch_locked(ring);
+
+   vn_cs_dump(ring->id, cs);
+
    const bool direct = vn_ring_submission_can_direct(ring, cs);
    if (!direct && cs->storage_type == VN_CS_ENCODER_STORAGE_POINTER) {
       cs = vn_ring_cs_upload_locked(ring, cs);
@@ -637,6 +822,14 @@ vn_ring_submit_locked(struct vn_ring *ring,
 
    vn_ring_submission_cleanup(&submit);
 
+   ring->stats.submit_count++;
+   ring->stats.direct_count += direct;
+   ring->stats.byte_count += vn_cs_encoder_get_len(cs);
+   if (util_perfetto_is_tracing_enabled()) {
+      util_perfetto_counter_set(ring->stats.counter_name,
+                                ring->stats.byte_count);
+   }
+
    if (ring_seqno)
       *ring_seqno = seqno;
 
@@ -681,6 +874,7 @@ vn_ring_submit_command(struct vn_ring *ring,
    assert(!vn_cs_encoder_is_empty(&submit->command));
 
    vn_cs_encoder_commit(&submit->command);
+   vn_cs_stats_add_command(&submit->command);
 
    size_t reply_offset = 0;
    if (submit->reply_size) {
@@ -719,6 +913,41 @@ vn_ring_submit_command(struct vn_ring *ring,
    }
 }
 
+/**
+ * Reserves size bytes for an async command that can be batched with other
+ * async commands.  The ring is locked until vn_ring_batch_end.  NULL is
+ * returned, and the ring is not locked, when the command should be submitted
+ * normally instead.
+ */
+struct vn_cs_encoder *
+vn_ring_batch_begin(struct vn_ring *ring, size_t size)
+{
+   if (!ring->batch.data || size > ring->direct_max_size)
+      return NULL;
+
+   mtx_lock(&ring->mutex);
+
+   if (ring->batch.len + size > ring->direct_max_size)
+      vn_ring_flush_batch_locked(ring);
+
+   ring->batch.buffer =
+      VN_CS_ENCODER_BUFFER_INITIALIZER(ring->batch.data + ring->batch.len);
+   ring->batch.enc = VN_CS_ENCODER_INITIALIZER(&ring->batch.buffer, size);
+
+   return &ring->batch.enc;
+}
+
+void
+vn_ring_batch_end(struct vn_ring *ring, struct vn_cs_encoder *enc)
+{
+   assert(enc == &ring->batch.enc);
+   vn_cs_stats_add_command(enc);
+   ring->batch.len += vn_cs_encoder_get_len(enc);
+   assert(ring->batch.len <= ring->direct_max_size);
+
+   mtx_unlock(&ring->mutex);
+}
+
 void
 vn_ring_free_command_reply(struct vn_ring *ring,
                            struct vn_ring_submit_command *submit)
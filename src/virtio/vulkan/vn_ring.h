@@ -84,6 +84,20 @@ struct vn_ring_submit_command {
    uint32_t ring_seqno;
 };
 
+static inline void
+vn_ring_dep_init(struct vn_ring_dep *dep, struct vn_ring *ring)
+{
+   dep->ring = ring;
+   atomic_init(&dep->seqno, 0);
+}
+
+void
+vn_ring_dep_add(struct vn_ring_dep *dep,
+                const struct vn_ring_submit_command *submit);
+
+void
+vn_ring_dep_wait(const struct vn_ring_dep *dep, const struct vn_ring *ring);
+
 static inline struct vn_cs_encoder *
 vn_ring_submit_command_init(struct vn_ring *ring,
                             struct vn_ring_submit_command *submit,
@@ -121,6 +135,12 @@ VkResult
 vn_ring_submit_command_simple(struct vn_ring *ring,
                               const struct vn_cs_encoder *cs);
 
+struct vn_cs_encoder *
+vn_ring_batch_begin(struct vn_ring *ring, size_t size);
+
+void
+vn_ring_batch_end(struct vn_ring *ring, struct vn_cs_encoder *enc);
+
 VkResult
 vn_ring_submit_roundtrip(struct vn_ring *ring, uint64_t *roundtrip_seqno);
 